@@ -29,6 +29,10 @@
 #! a shared library using Qt. Additionally, it generates
 #! plugin meta-data by creating a MANIFEST.MF text file
 #! which is embedded in the share library as a Qt resource.
+#! The manifest and the other plug-in resources are also written
+#! into a binary resource file next to the library (with the
+#! additional suffix ".rcc"), which allows installing the plug-in
+#! without loading the library.
 #!
 #! The following variables can be set in a file named
 #! manifest_headers.cmake, which will then be read by
@@ -371,12 +375,44 @@ macro(ctkMacroBuildPlugin)
     PREFIX "lib"
     )
 
+  # Write the manifest and the resources into a binary resource file next to the
+  # plug-in library. The plug-in framework reads this file when installing the
+  # plug-in, instead of loading the library.
+  string(REPLACE "." "_" _plugin_symbolicname ${Plugin-SymbolicName})
+  set(_plugin_qrc_files "${CMAKE_CURRENT_BINARY_DIR}/${_plugin_symbolicname}_manifest.qrc")
+  if(_plugin_cached_resources_in_source_tree OR _plugin_cached_resources_in_binary_tree)
+    list(APPEND _plugin_qrc_files "${CMAKE_CURRENT_BINARY_DIR}/${_plugin_symbolicname}_cached.qrc")
+  endif()
+  foreach(_resource ${MY_RESOURCES})
+    if(IS_ABSOLUTE "${_resource}")
+      list(APPEND _plugin_qrc_files "${_resource}")
+    else()
+      list(APPEND _plugin_qrc_files "${CMAKE_CURRENT_SOURCE_DIR}/${_resource}")
+    endif()
+  endforeach()
+  if(CTK_QT_VERSION VERSION_GREATER "4")
+    set(_plugin_rcc_executable Qt5::rcc)
+  else()
+    set(_plugin_rcc_executable ${QT_RCC_EXECUTABLE})
+  endif()
+  add_custom_command(TARGET ${lib_name} POST_BUILD
+    COMMAND ${_plugin_rcc_executable} -binary -o "$<TARGET_FILE:${lib_name}>.rcc" ${_plugin_qrc_files}
+    WORKING_DIRECTORY ${CMAKE_CURRENT_BINARY_DIR}
+    VERBATIM
+    )
+
   if(NOT MY_TEST_PLUGIN AND NOT MY_NO_INSTALL)
     # Install rules
     install(TARGETS ${lib_name} EXPORT CTKExports
       RUNTIME DESTINATION ${CTK_INSTALL_PLUGIN_DIR} COMPONENT RuntimePlugins
       LIBRARY DESTINATION ${CTK_INSTALL_PLUGIN_DIR} COMPONENT RuntimePlugins
       ARCHIVE DESTINATION ${CTK_INSTALL_PLUGIN_DIR} COMPONENT Development)
+    if(NOT CMAKE_VERSION VERSION_LESS 3.5)
+      # Generator expressions in install(FILES) require CMake 3.5. Without the
+      # resource file, the plug-in library is loaded during installation.
+      install(FILES "$<TARGET_FILE:${lib_name}>.rcc"
+        DESTINATION ${CTK_INSTALL_PLUGIN_DIR} COMPONENT RuntimePlugins)
+    endif()
   endif()
 
   set(my_libs
@@ -577,5 +577,43 @@ int ctkDependencyGraphTest2(int argc, char * argv [] )
 
   }
 
+  // check that topological ordering works on graphs
+  // with more than 100 vertices
+  {
+  const int numberOfVertices = 150;
+
+  ctkDependencyGraph graph(numberOfVertices);
+
+  /*
+   * 150 -> 149 -> ... -> 2 -> 1
+   */
+  for (int i = numberOfVertices; i > 1; --i)
+    {
+    graph.insertEdge(i, i - 1);
+    }
+
+  std::list<int> globalSort;
+  if (!graph.topologicalSort(globalSort))
+    {
+    std::cerr << "Problem with topologicalSort(globalSort): unexpected cycle" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  std::list<int> expectedGlobalSort;
+  for (int i = numberOfVertices; i > 0; --i)
+    {
+    expectedGlobalSort.push_back(i);
+    }
+
+  if (globalSort != expectedGlobalSort)
+  {
+    std::cerr << "Problem with topologicalSort(globalSort)" << std::endl;
+    printIntegerList("globalSort:", globalSort);
+    printIntegerList("expectedGlobalSort:", expectedGlobalSort);
+    return EXIT_FAILURE;
+  }
+
+  }
+
   return EXIT_SUCCESS;
 }
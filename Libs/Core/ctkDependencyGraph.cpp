@@ -699,12 +699,6 @@ bool ctkDependencyGraph::topologicalSort(std::list<int>& sorted, int rootId)
 	int x, y;			        // current and next vertex
   
   outdegree.resize(d_ptr->NVertices + 1);
-	
-	// resize if needed
-	if (d_ptr->NVertices > MAXV)
-	  {
-    outdegree.resize(d_ptr->NVertices);
-	  }
 
 	d_ptr->computeOutdegrees(outdegree);
 	
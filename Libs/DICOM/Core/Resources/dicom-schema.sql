@@ -22,7 +22,7 @@ DROP INDEX IF EXISTS 'SeriesStudyIndex' ;
 DROP INDEX IF EXISTS 'StudiesPatientIndex' ;
 
 CREATE TABLE 'SchemaInfo' ( 'Version' VARCHAR(1024) NOT NULL );
-INSERT INTO 'SchemaInfo' VALUES('0.6.2');
+INSERT INTO 'SchemaInfo' VALUES('0.6.3');
 
 CREATE TABLE 'Images' (
   'SOPInstanceUID' VARCHAR(64) NOT NULL,
@@ -89,6 +89,8 @@ CREATE INDEX IF NOT EXISTS 'StudiesPatientIndex' ON 'Studies' ('PatientsUID');
 
 CREATE TABLE 'Directories' (
   'Dirname' VARCHAR(1024) ,
+  'ModifiedTime' INTEGER ,
+  'EntryCount' INT ,
   PRIMARY KEY ('Dirname') );
 
 CREATE TABLE 'ColumnDisplayProperties' (
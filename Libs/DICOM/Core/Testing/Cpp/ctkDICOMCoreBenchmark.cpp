@@ -0,0 +1,310 @@
+/*=========================================================================
+
+  Library:   CTK
+
+  Copyright (c) Kitware Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0.txt
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+=========================================================================*/
+
+// Qt includes
+#include <QCoreApplication>
+#include <QDir>
+#include <QProcessEnvironment>
+#include <QSharedPointer>
+#include <QSqlQuery>
+#include <QTemporaryDir>
+#include <QTest>
+
+// CTK includes
+#include "ctkDICOMDatabase.h"
+#include "ctkDICOMHeaderRecord.h"
+#include "ctkDICOMIndexer.h"
+#include "ctkDICOMItem.h"
+#include "ctkDICOMModel.h"
+#include "ctkDICOMSyntheticDataGenerator.h"
+#include "ctkTest.h"
+
+// DCMTK includes
+#include <dcmtk/dcmdata/dcdatset.h>
+#include <dcmtk/dcmdata/dcdeftag.h>
+
+/// Benchmarks of DICOM database operations on a synthetic dataset.
+///
+/// Size of the generated dataset can be set using environment variables:
+/// CTK_DICOM_BENCHMARK_PATIENTS, CTK_DICOM_BENCHMARK_STUDIES (per patient),
+/// CTK_DICOM_BENCHMARK_SERIES (per study), CTK_DICOM_BENCHMARK_INSTANCES (per series),
+/// CTK_DICOM_BENCHMARK_IMAGE_SIZE (0 = no pixel data), CTK_DICOM_BENCHMARK_SEED.
+///
+/// Results can be saved in machine-readable format using the standard QTest options,
+/// for example: "-o results.xml,xml" or "-o results.csv,csv".
+// ----------------------------------------------------------------------------
+class ctkDICOMCoreBenchmarker: public QObject
+{
+  Q_OBJECT
+private slots:
+  void initTestCase();
+  void cleanupTestCase();
+
+  void benchmarkIndexDirectory();
+  void benchmarkRescanDirectory();
+  void benchmarkParseHeaders_data();
+  void benchmarkParseHeaders();
+  void benchmarkInsert();
+  void benchmarkUpdateDisplayedFields();
+  void benchmarkTagCacheLookup();
+  void benchmarkModelScroll();
+
+private:
+  int environmentValue(const QString& name, int defaultValue);
+  bool openDatabase(ctkDICOMDatabase& database, const QString& name);
+  int rowCount(ctkDICOMDatabase& database, const QString& table);
+
+  ctkDICOMSyntheticDataGenerator Generator;
+  QSharedPointer<QTemporaryDir> TemporaryDir;
+  QString InputDirectory;
+  QStringList InputFiles;
+  QStringList InstanceUIDs;
+  /// Database that is populated by the indexer, used by benchmarks of read operations
+  ctkDICOMDatabase IndexedDatabase;
+};
+
+// ----------------------------------------------------------------------------
+int ctkDICOMCoreBenchmarker::environmentValue(const QString& name, int defaultValue)
+{
+  bool ok = false;
+  int value = QProcessEnvironment::systemEnvironment().value(name).toInt(&ok);
+  return ok ? value : defaultValue;
+}
+
+// ----------------------------------------------------------------------------
+bool ctkDICOMCoreBenchmarker::openDatabase(ctkDICOMDatabase& database, const QString& name)
+{
+  QDir databaseDir(this->TemporaryDir->path());
+  databaseDir.mkpath(name);
+  databaseDir.cd(name);
+  databaseDir.remove("ctkDICOM.sql");
+  databaseDir.remove("ctkDICOMTagCache.sql");
+  database.openDatabase(databaseDir.filePath("ctkDICOM.sql"));
+  return database.isOpen() && database.lastError().isEmpty();
+}
+
+// ----------------------------------------------------------------------------
+int ctkDICOMCoreBenchmarker::rowCount(ctkDICOMDatabase& database, const QString& table)
+{
+  QSqlQuery query(database.database());
+  if (!query.exec(QString("SELECT COUNT(*) FROM %1").arg(table)) || !query.next())
+  {
+    return -1;
+  }
+  return query.value(0).toInt();
+}
+
+// ----------------------------------------------------------------------------
+void ctkDICOMCoreBenchmarker::initTestCase()
+{
+  this->Generator = ctkDICOMSyntheticDataGenerator(this->environmentValue("CTK_DICOM_BENCHMARK_SEED", 0));
+  this->Generator.setPatientCount(this->environmentValue("CTK_DICOM_BENCHMARK_PATIENTS", 4));
+  this->Generator.setStudiesPerPatient(this->environmentValue("CTK_DICOM_BENCHMARK_STUDIES", 2));
+  this->Generator.setSeriesPerStudy(this->environmentValue("CTK_DICOM_BENCHMARK_SERIES", 3));
+  this->Generator.setInstancesPerSeries(this->environmentValue("CTK_DICOM_BENCHMARK_INSTANCES", 10));
+  this->Generator.setImageSize(this->environmentValue("CTK_DICOM_BENCHMARK_IMAGE_SIZE", 0));
+  qDebug() << "Synthetic dataset:" << this->Generator.patientCount() << "patients,"
+    << this->Generator.studiesPerPatient() << "studies/patient,"
+    << this->Generator.seriesPerStudy() << "series/study,"
+    << this->Generator.instancesPerSeries() << "instances/series, image size"
+    << this->Generator.imageSize();
+
+  this->TemporaryDir = QSharedPointer<QTemporaryDir>(new QTemporaryDir);
+  QVERIFY(this->TemporaryDir->isValid());
+  this->InputDirectory = QDir(this->TemporaryDir->path()).filePath("Input");
+  this->InputFiles = this->Generator.writeFiles(this->InputDirectory);
+  QCOMPARE(this->InputFiles.size(), this->Generator.instanceCount());
+
+  for (int patient = 0; patient < this->Generator.patientCount(); ++patient)
+  {
+    for (int study = 0; study < this->Generator.studiesPerPatient(); ++study)
+    {
+      for (int series = 0; series < this->Generator.seriesPerStudy(); ++series)
+      {
+        for (int instance = 0; instance < this->Generator.instancesPerSeries(); ++instance)
+        {
+          this->InstanceUIDs << this->Generator.sopInstanceUID(patient, study, series, instance);
+        }
+      }
+    }
+  }
+}
+
+// ----------------------------------------------------------------------------
+void ctkDICOMCoreBenchmarker::cleanupTestCase()
+{
+  this->IndexedDatabase.closeDatabase();
+  this->TemporaryDir.clear();
+}
+
+// ----------------------------------------------------------------------------
+void ctkDICOMCoreBenchmarker::benchmarkIndexDirectory()
+{
+  QVERIFY(this->openDatabase(this->IndexedDatabase, "Indexed"));
+  ctkDICOMIndexer indexer;
+  indexer.setDatabase(&this->IndexedDatabase);
+  QBENCHMARK_ONCE
+  {
+    indexer.addDirectory(this->InputDirectory);
+    indexer.waitForImportFinished();
+  }
+  QCOMPARE(this->rowCount(this->IndexedDatabase, "Images"), this->Generator.instanceCount());
+}
+
+// ----------------------------------------------------------------------------
+void ctkDICOMCoreBenchmarker::benchmarkRescanDirectory()
+{
+  // All files are already indexed, only the modification check is performed
+  ctkDICOMIndexer indexer;
+  indexer.setDatabase(&this->IndexedDatabase);
+  QBENCHMARK
+  {
+    indexer.addDirectory(this->InputDirectory);
+    indexer.waitForImportFinished();
+  }
+  QCOMPARE(this->rowCount(this->IndexedDatabase, "Images"), this->Generator.instanceCount());
+}
+
+// ----------------------------------------------------------------------------
+void ctkDICOMCoreBenchmarker::benchmarkParseHeaders_data()
+{
+  QTest::addColumn<bool>("memoryMapped");
+  QTest::newRow("stdio") << false;
+  QTest::newRow("memory mapped") << true;
+}
+
+// ----------------------------------------------------------------------------
+void ctkDICOMCoreBenchmarker::benchmarkParseHeaders()
+{
+  QFETCH(bool, memoryMapped);
+  QStringList instanceUIDs;
+  QBENCHMARK
+  {
+    instanceUIDs.clear();
+    foreach(const QString& filePath, this->InputFiles)
+    {
+      ctkDICOMItem dataset;
+      dataset.SetMemoryMappedFileReadEnabled(memoryMapped);
+      dataset.InitializeFromFileHeader(filePath);
+      instanceUIDs << dataset.GetElementAsString(DCM_SOPInstanceUID);
+    }
+  }
+  // Both read modes must give the same result
+  QCOMPARE(instanceUIDs, this->InstanceUIDs);
+}
+
+// ----------------------------------------------------------------------------
+void ctkDICOMCoreBenchmarker::benchmarkInsert()
+{
+  // Parse files before the measurement, only the database insertion is measured
+  QList<ctkDICOMDatabase::IndexingResult> indexingResults;
+  foreach(const QString& filePath, this->InputFiles)
+  {
+    ctkDICOMItem dataset;
+    dataset.InitializeFromFileHeader(filePath);
+    ctkDICOMDatabase::IndexingResult indexingResult;
+    indexingResult.filePath = filePath;
+    indexingResult.header = ctkDICOMHeaderRecord(dataset);
+    indexingResult.copyFile = false;
+    indexingResult.overwriteExistingDataset = false;
+    indexingResults << indexingResult;
+  }
+
+  ctkDICOMDatabase database;
+  QVERIFY(this->openDatabase(database, "Inserted"));
+  QBENCHMARK_ONCE
+  {
+    database.insert(indexingResults);
+  }
+  QCOMPARE(this->rowCount(database, "Images"), this->Generator.instanceCount());
+  database.closeDatabase();
+}
+
+// ----------------------------------------------------------------------------
+void ctkDICOMCoreBenchmarker::benchmarkUpdateDisplayedFields()
+{
+  // Mark all displayed fields as outdated
+  QSqlQuery query(this->IndexedDatabase.database());
+  QVERIFY(query.exec("UPDATE Images SET DisplayedFieldsUpdatedTimestamp = NULL"));
+  query.finish();
+  QBENCHMARK_ONCE
+  {
+    this->IndexedDatabase.updateDisplayedFields();
+  }
+  QCOMPARE(this->rowCount(this->IndexedDatabase, "Images WHERE DisplayedFieldsUpdatedTimestamp IS NULL"), 0);
+}
+
+// ----------------------------------------------------------------------------
+void ctkDICOMCoreBenchmarker::benchmarkTagCacheLookup()
+{
+  QStringList tags;
+  tags << "0008,0060" << "0008,103e" << "0020,0013" << "0020,0032" << "0018,0050";
+  // First lookup reads the values from the files and stores them in the tag cache
+  QList<QStringList> values = this->IndexedDatabase.instanceValues(this->InstanceUIDs, tags);
+  QCOMPARE(values.size(), this->InstanceUIDs.size());
+  QBENCHMARK
+  {
+    values = this->IndexedDatabase.instanceValues(this->InstanceUIDs, tags);
+  }
+  QCOMPARE(values.size(), this->InstanceUIDs.size());
+}
+
+// ----------------------------------------------------------------------------
+void ctkDICOMCoreBenchmarker::benchmarkModelScroll()
+{
+  int visitedRows = 0;
+  QBENCHMARK
+  {
+    ctkDICOMModel model;
+    model.setEndLevel(ctkDICOMModel::ImageType);
+    model.setDatabase(this->IndexedDatabase.database());
+    // Traverse the whole tree, as when all items are expanded and scrolled through in a view
+    visitedRows = 0;
+    QList<QModelIndex> parents;
+    parents << QModelIndex();
+    while (!parents.isEmpty())
+    {
+      QModelIndex parent = parents.takeFirst();
+      while (model.canFetchMore(parent))
+      {
+        model.fetchMore(parent);
+      }
+      int rows = model.rowCount(parent);
+      for (int row = 0; row < rows; ++row)
+      {
+        QModelIndex index = model.index(row, 0, parent);
+        for (int column = 0; column < model.columnCount(parent); ++column)
+        {
+          model.data(model.index(row, column, parent));
+        }
+        if (model.hasChildren(index))
+        {
+          parents << index;
+        }
+      }
+      visitedRows += rows;
+    }
+  }
+  QVERIFY(visitedRows >= this->Generator.instanceCount());
+}
+
+// ----------------------------------------------------------------------------
+CTK_TEST_MAIN(ctkDICOMCoreBenchmark)
+#include "moc_ctkDICOMCoreBenchmark.cpp"
@@ -21,6 +21,7 @@
 // Qt includes
 #include <QCoreApplication>
 #include <QDir>
+#include <QSqlQuery>
 #include <QTimer>
 
 // ctkDICOMCore includes
@@ -89,6 +90,53 @@ int ctkDICOMDatabaseTest1( int argc, char * argv [] )
   database.insert(0, false, true);
   database.insert(0, false, false);
 
+  // Directory fingerprints
+  QHash<QString, ctkDICOMDatabase::DirectoryFingerprint> fingerprints;
+  fingerprints["/dicom/a"] = ctkDICOMDatabase::DirectoryFingerprint(1000, 3);
+  fingerprints["/dicom/b"] = ctkDICOMDatabase::DirectoryFingerprint(2000, 5);
+  if (!database.setDirectoryFingerprints(fingerprints))
+    {
+    std::cerr << "ctkDICOMDatabase::setDirectoryFingerprints() failed." << std::endl;
+    return EXIT_FAILURE;
+    }
+  database.removeDirectoryFingerprints(QStringList() << "/dicom/a");
+  QHash<QString, ctkDICOMDatabase::DirectoryFingerprint> storedFingerprints;
+  database.allDirectoryFingerprints(storedFingerprints);
+  if (storedFingerprints.size() != 1
+    || storedFingerprints.value("/dicom/b") != ctkDICOMDatabase::DirectoryFingerprint(2000, 5))
+    {
+    std::cerr << "ctkDICOMDatabase::allDirectoryFingerprints() failed: "
+              << storedFingerprints.size() << " fingerprints found" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // WAL mode and read snapshots
+  database.setWALModeEnabled(true);
+  QSqlQuery journalModeQuery(database.database());
+  if (!journalModeQuery.exec("PRAGMA journal_mode") || !journalModeQuery.next()
+    || journalModeQuery.value(0).toString().toLower() != "wal")
+    {
+    std::cerr << "ctkDICOMDatabase::setWALModeEnabled() failed." << std::endl;
+    return EXIT_FAILURE;
+    }
+  journalModeQuery.finish();
+  if (!database.beginReadSnapshot() || !database.beginReadSnapshot()
+    || !database.isReadSnapshotActive())
+    {
+    std::cerr << "ctkDICOMDatabase::beginReadSnapshot() failed." << std::endl;
+    return EXIT_FAILURE;
+    }
+  database.patientsCount();
+  database.endReadSnapshot();
+  database.endReadSnapshot();
+  if (database.isReadSnapshotActive())
+    {
+    std::cerr << "ctkDICOMDatabase::endReadSnapshot() failed." << std::endl;
+    return EXIT_FAILURE;
+    }
+  database.checkpoint(true);
+  database.setWALModeEnabled(false);
+
   database.closeDatabase();
   database.initializeDatabase();
 
@@ -21,10 +21,15 @@
 // Qt includes
 #include <QCoreApplication>
 #include <QDir>
+#include <QSqlQuery>
 #include <QTimer>
 
 // ctkDICOMCore includes
 #include "ctkDICOMDatabase.h"
+#include "ctkDICOMHeaderRecord.h"
+
+// DCMTK includes
+#include <dcmtk/dcmdata/dcdeftag.h>
 
 // STD includes
 #include <iostream>
@@ -131,6 +136,31 @@ int ctkDICOMDatabaseTest2( int argc, char * argv [] )
     return EXIT_FAILURE;
     }
 
+  // Only the header is parsed during insert, but presence of pixel data must still be reported
+  if (!database.instanceValueExists(instanceUID, "7fe0,0010"))
+    {
+    std::cerr << "ctkDICOMDatabase: pixel data element is not found" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  //
+  // Test that the compact header record returns the same values as the dataset
+  //
+  ctkDICOMItem dataset;
+  dataset.InitializeFromFileHeader(dicomFilePath);
+  ctkDICOMHeaderRecord header(dataset, QStringList() << tag, QStringList() << "7fe0,0010");
+  if (header.GetElementAsString(DCM_SOPInstanceUID) != instanceUID
+    || header.GetElementAsString(DCM_PatientName) != dataset.GetElementAsString(DCM_PatientName)
+    || header.GetAllElementValuesAsString(DcmTagKey(0x0008, 0x103e)) != dataset.GetAllElementValuesAsString(DcmTagKey(0x0008, 0x103e))
+    || header.GetElementAsInteger(DCM_SeriesNumber) != dataset.GetElementAsInteger(DCM_SeriesNumber)
+    || header.IsTagParsed(DCM_StationName)
+    || header.IsTagParsed(DcmTagKey(0x7fe0, 0x0010)) != dataset.IsTagParsed(DcmTagKey(0x7fe0, 0x0010))
+    || !header.GetAllElementValuesAsString(DcmTagKey(0x7fe0, 0x0010)).isNull())
+    {
+    std::cerr << "ctkDICOMHeaderRecord: values do not match the dataset" << std::endl;
+    return EXIT_FAILURE;
+    }
+
 
   //
   // Test the tag cache
@@ -184,6 +214,25 @@ int ctkDICOMDatabaseTest2( int argc, char * argv [] )
     return EXIT_FAILURE;
     }
 
+  // Batched lookup: the SOP instance UID value is not cached yet, therefore it is read from the file
+  QString sopInstanceUIDTag("0008,0018");
+  QList<QStringList> foundValues = database.instanceValues(
+    QStringList() << instanceUID << "1.2.3.4", QStringList() << tag << sopInstanceUIDTag);
+  if (foundValues.size() != 2
+    || foundValues[0] != (QStringList() << knownSeriesDescription << instanceUID)
+    || foundValues[1] != (QStringList() << "" << ""))
+    {
+    std::cerr << "ctkDICOMDatabase: invalid element values returned by instanceValues" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  if (database.cachedTags(QStringList() << instanceUID, QStringList() << sopInstanceUIDTag).value(0)
+    != (QStringList() << instanceUID))
+    {
+    std::cerr << "ctkDICOMDatabase: values read by instanceValues were not cached" << std::endl;
+    return EXIT_FAILURE;
+    }
+
   // now update the database
   database.updateSchema();
 
@@ -204,6 +253,75 @@ int ctkDICOMDatabaseTest2( int argc, char * argv [] )
     return EXIT_FAILURE;
     }
 
+  // Displayed fields are updated by the schema update
+  QSqlQuery displayedFieldsQuery(database.database());
+  if (!displayedFieldsQuery.exec("SELECT Series.DisplayedCount, Studies.DisplayedNumberOfSeries, Patients.DisplayedNumberOfStudies "
+      "FROM Series JOIN Studies ON Series.StudyInstanceUID = Studies.StudyInstanceUID "
+      "JOIN Patients ON Studies.PatientsUID = Patients.UID")
+    || !displayedFieldsQuery.next()
+    || displayedFieldsQuery.value(0).toInt() != 1
+    || displayedFieldsQuery.value(1).toInt() != 1
+    || displayedFieldsQuery.value(2).toInt() != 1)
+    {
+    std::cerr << "ctkDICOMDatabase: invalid displayed fields after updateDisplayedFields" << std::endl;
+    return EXIT_FAILURE;
+    }
+  displayedFieldsQuery.finish();
+
+  // Fields that are not set by the displayed field rules are kept when the displayed fields are updated
+  QSqlQuery resetQuery(database.database());
+  if (!resetQuery.exec("UPDATE Studies SET StudyID = NULL")
+    || !resetQuery.exec("UPDATE Series SET AcquisitionNumber = NULL, TemporalPosition = NULL")
+    || !resetQuery.exec("UPDATE Images SET DisplayedFieldsUpdatedTimestamp = NULL"))
+    {
+    std::cerr << "ctkDICOMDatabase: could not reset fields" << std::endl;
+    return EXIT_FAILURE;
+    }
+  resetQuery.finish();
+  database.updateDisplayedFields();
+  if (!displayedFieldsQuery.exec("SELECT Studies.StudyID, Series.AcquisitionNumber, Series.TemporalPosition, Series.DisplayedCount "
+      "FROM Series JOIN Studies ON Series.StudyInstanceUID = Studies.StudyInstanceUID")
+    || !displayedFieldsQuery.next()
+    || !displayedFieldsQuery.isNull(0)
+    || !displayedFieldsQuery.isNull(1)
+    || !displayedFieldsQuery.isNull(2)
+    || displayedFieldsQuery.value(3).toInt() != 1)
+    {
+    std::cerr << "ctkDICOMDatabase: fields not set by the rules were changed by updateDisplayedFields" << std::endl;
+    return EXIT_FAILURE;
+    }
+  displayedFieldsQuery.finish();
+
+  // Search index is kept up-to-date when the database content changes
+  if (!database.isSearchIndexAvailable("Series"))
+    {
+    std::cerr << "ctkDICOMDatabase: search index is not available" << std::endl;
+    return EXIT_FAILURE;
+    }
+  QSqlQuery searchQuery(database.database());
+  searchQuery.prepare("SELECT SeriesInstanceUID FROM Series WHERE " + database.searchIndexCondition("Series"));
+  searchQuery.addBindValue(ctkDICOMDatabase::searchPattern("cor*fast"));
+  if (!searchQuery.exec() || !searchQuery.next())
+    {
+    std::cerr << "ctkDICOMDatabase: series is not found using the search index" << std::endl;
+    return EXIT_FAILURE;
+    }
+  searchQuery.finish();
+  // LIKE wildcards in the filter text are matched literally
+  if (ctkDICOMDatabase::searchPattern("50%_x*") != "%50\\%\\_x%%")
+    {
+    std::cerr << "ctkDICOMDatabase::searchPattern() failed: "
+              << qPrintable(ctkDICOMDatabase::searchPattern("50%_x*")) << std::endl;
+    return EXIT_FAILURE;
+    }
+  searchQuery.addBindValue(ctkDICOMDatabase::searchPattern("cor%fast"));
+  if (!searchQuery.exec() || searchQuery.next())
+    {
+    std::cerr << "ctkDICOMDatabase: '%' of the search text is used as a wildcard" << std::endl;
+    return EXIT_FAILURE;
+    }
+  searchQuery.finish();
+
   database.closeDatabase();
   database.initializeDatabase();
 
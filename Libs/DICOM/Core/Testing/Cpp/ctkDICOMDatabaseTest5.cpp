@@ -100,6 +100,30 @@ int ctkDICOMDatabaseTest5( int argc, char * argv [] )
     return EXIT_FAILURE;
     }
 
+  //
+  // Store the file in the database folder using a hard link (the file is
+  // copied if links are not supported), then replace it by moving a file
+  //
+  QFile::copy(dicomFilePath, firstDestination);
+  database.setFileStorageMode(ctkDICOMDatabase::HardLinkFileStorage);
+  database.insert(firstDestination, true, false);
+  filePathInDatabase = database.fileForInstance(instanceUID);
+  if (filePathInDatabase == firstDestination
+    || !QFileInfo(filePathInDatabase).exists() || !QFileInfo(firstDestination).exists())
+    {
+    std::cerr << "ctkDICOMDatabase: file was not stored in " << filePathInDatabase.toStdString() << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  database.setFileStorageMode(ctkDICOMDatabase::MoveFileStorage);
+  database.insert(secondDestination, true, false);
+  if (database.fileForInstance(instanceUID) != filePathInDatabase
+    || !QFileInfo(filePathInDatabase).exists() || QFileInfo(secondDestination).exists())
+    {
+    std::cerr << "ctkDICOMDatabase: file was not moved to " << filePathInDatabase.toStdString() << std::endl;
+    return EXIT_FAILURE;
+    }
+
   //
   // Close and clean up
   //
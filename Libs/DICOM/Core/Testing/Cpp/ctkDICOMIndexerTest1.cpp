@@ -21,10 +21,16 @@
 // Qt includes
 #include <QCoreApplication>
 #include <QDir>
+#include <QTemporaryDir>
 
 // ctkDICOMCore includes
 #include "ctkDICOMDatabase.h"
 #include "ctkDICOMIndexer.h"
+#include "ctkDICOMSyntheticDataGenerator.h"
+
+// DCMTK includes
+#include <dcmtk/dcmdata/dcddirif.h>
+#include <dcmtk/dcmdata/dcfilefo.h>
 
 // STD includes
 #include <iostream>
@@ -36,6 +42,20 @@ int ctkDICOMIndexerTest1( int argc, char * argv [] )
   ctkDICOMDatabase database;
   ctkDICOMIndexer indexer;
 
+  // Test ctkDICOMIndexer::setParsingThreadCount()
+  if (indexer.parsingThreadCount() < 1)
+  {
+    std::cerr << "ctkDICOMIndexer::parsingThreadCount() failed: invalid default value "
+              << indexer.parsingThreadCount() << std::endl;
+    return EXIT_FAILURE;
+  }
+  indexer.setParsingThreadCount(2);
+  if (indexer.parsingThreadCount() != 2)
+  {
+    std::cerr << "ctkDICOMIndexer::setParsingThreadCount() failed" << std::endl;
+    return EXIT_FAILURE;
+  }
+
   // Test ctkDICOMIndexer::addDirectory()
   // just check if it doesn't crash
   // Create block to test batch indexing using indexingBatch helper class.
@@ -50,5 +70,98 @@ int ctkDICOMIndexerTest1( int argc, char * argv [] )
   // ensure all concurrent inserts are complete
   indexer.waitForImportFinished();
 
+  // Metrics of the last indexing are available after indexing is completed
+  ctkDICOMDatabase::IndexingMetrics metrics = indexer.indexingMetrics();
+  if (metrics.elapsedNanoseconds <= 0
+    || metrics.counts[ctkDICOMDatabase::IndexingMetrics::StatPhase] < metrics.counts[ctkDICOMDatabase::IndexingMetrics::ParsePhase])
+  {
+    std::cerr << "ctkDICOMIndexer::indexingMetrics() failed" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Test fast DICOMDIR indexing: instances are added from the DICOMDIR records,
+  // then completed from the referenced files.
+  {
+    QTemporaryDir mediaDir;
+    ctkDICOMSyntheticDataGenerator generator;
+    generator.setPatientCount(1);
+    generator.setStudiesPerPatient(1);
+    generator.setSeriesPerStudy(2);
+    generator.setInstancesPerSeries(3);
+    generator.setImageSize(16);
+    QDir(mediaDir.path()).mkpath("DATA");
+    DicomDirInterface dicomDirInterface;
+    dicomDirInterface.enableInventMode(OFTrue);
+    if (dicomDirInterface.createNewDicomDir(DicomDirInterface::AP_GeneralPurpose,
+      QDir(mediaDir.path()).filePath("DICOMDIR").toLocal8Bit().constData()).bad())
+    {
+      std::cerr << "Failed to create DICOMDIR" << std::endl;
+      return EXIT_FAILURE;
+    }
+    for (int series = 0; series < generator.seriesPerStudy(); ++series)
+    {
+      for (int instance = 0; instance < generator.instancesPerSeries(); ++instance)
+      {
+        // file IDs of DICOMDIR records are limited to 8 uppercase characters per component
+        QString fileID = QString("DATA/S%1I%2").arg(series).arg(instance);
+        DcmFileFormat fileFormat;
+        generator.createDataset(0, 0, series, instance, fileFormat.getDataset());
+        if (fileFormat.saveFile(QDir(mediaDir.path()).filePath(fileID).toLocal8Bit().constData(), EXS_LittleEndianExplicit).bad()
+          || dicomDirInterface.addDicomFile(fileID.toLatin1().constData(), mediaDir.path().toLocal8Bit().constData()).bad())
+        {
+          std::cerr << "Failed to add " << qPrintable(fileID) << " to DICOMDIR" << std::endl;
+          return EXIT_FAILURE;
+        }
+      }
+    }
+    if (dicomDirInterface.writeDicomDir().bad())
+    {
+      std::cerr << "Failed to write DICOMDIR" << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    ctkDICOMDatabase dicomdirDatabase;
+    dicomdirDatabase.openDatabase(QDir(mediaDir.path()).filePath("ctkDICOM.sql"));
+    ctkDICOMIndexer dicomdirIndexer;
+    dicomdirIndexer.setFastDicomdirIndexingEnabled(true);
+    if (!dicomdirIndexer.addDicomdir(&dicomdirDatabase, mediaDir.path()))
+    {
+      std::cerr << "ctkDICOMIndexer::addDicomdir() failed" << std::endl;
+      return EXIT_FAILURE;
+    }
+    dicomdirIndexer.waitForImportFinished();
+    if (dicomdirDatabase.imagesCount() != generator.instanceCount())
+    {
+      std::cerr << "ctkDICOMIndexer::addDicomdir() failed: " << dicomdirDatabase.imagesCount()
+                << " instances indexed instead of " << generator.instanceCount() << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    // Tags that are not in the DICOMDIR records are read from the files
+    DcmDataset expectedDataset;
+    generator.createDataset(0, 0, 0, 0, &expectedDataset);
+    OFString expectedSeriesDescription;
+    OFString expectedPatientBirthDate;
+    expectedDataset.findAndGetOFString(DCM_SeriesDescription, expectedSeriesDescription);
+    expectedDataset.findAndGetOFString(DCM_PatientBirthDate, expectedPatientBirthDate);
+    if (dicomdirDatabase.descriptionForSeries(generator.seriesInstanceUID(0, 0, 0)) != expectedSeriesDescription.c_str()
+      || dicomdirDatabase.cachedTag(generator.sopInstanceUID(0, 0, 0, 0), "0010,0030") != expectedPatientBirthDate.c_str())
+    {
+      std::cerr << "ctkDICOMIndexer::addDicomdir() failed: partial instances are not completed" << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    // Indexing the DICOMDIR again skips the completed instances, their files are not parsed again
+    dicomdirIndexer.addDicomdir(&dicomdirDatabase, mediaDir.path());
+    dicomdirIndexer.waitForImportFinished();
+    if (dicomdirIndexer.indexingMetrics().counts[ctkDICOMDatabase::IndexingMetrics::ParsePhase] != 0
+      || dicomdirDatabase.descriptionForSeries(generator.seriesInstanceUID(0, 0, 0)) != expectedSeriesDescription.c_str())
+    {
+      std::cerr << "ctkDICOMIndexer::addDicomdir() failed: completed instances are indexed again" << std::endl;
+      return EXIT_FAILURE;
+    }
+    dicomdirDatabase.closeDatabase();
+  }
+
   return EXIT_SUCCESS;
 }
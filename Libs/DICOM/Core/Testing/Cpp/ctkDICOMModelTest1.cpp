@@ -23,6 +23,8 @@
 #include <QDebug>
 #include <QFileInfo>
 #include <QSqlQuery>
+#include <QTime>
+#include <QVariant>
 
 // ctkDICOMCore includes
 #include "ctkDICOMDatabase.h"
@@ -88,6 +90,99 @@ int ctkDICOMModelTest1( int argc, char * argv [] )
     qDebug() << model.rowCount() << model.columnCount();
     qDebug() << model.index(0,0);
 
+    // Rows fetched by the database thread must match the rows fetched synchronously
+    int patientCount = model.rowCount();
+    QString firstPatientUID = model.data(model.index(0,0), ctkDICOMModel::UIDRole).toString();
+    model.setAsynchronousFetchEnabled(true);
+    QTime timer;
+    timer.start();
+    while (model.rowCount() < patientCount && timer.elapsed() < 10000)
+      {
+      QCoreApplication::processEvents(QEventLoop::AllEvents, 100);
+      }
+    if (model.rowCount() != patientCount
+      || model.data(model.index(0,0), ctkDICOMModel::UIDRole).toString() != firstPatientUID)
+      {
+      std::cerr << "Asynchronous fetch failed: " << model.rowCount() << " rows fetched, expected "
+                << patientCount << std::endl;
+      return EXIT_FAILURE;
+      }
+
+    // Expand a placeholder row (a row that is not fetched yet), as a view does when the user
+    // expands a "Loading..." row. Its children must be fetched when the row arrives.
+    // Rows after the first blocks are placeholders, add enough patients (each with a study).
+    const int addedPatientCount = 1000;
+    QSqlDatabase database = myCTK.database();
+    database.transaction();
+    QSqlQuery insertPatientQuery(database);
+    insertPatientQuery.prepare("INSERT INTO Patients (PatientsName, PatientID, InsertTimestamp) VALUES (?, ?, ?)");
+    QSqlQuery insertStudyQuery(database);
+    insertStudyQuery.prepare("INSERT INTO Studies (StudyInstanceUID, PatientsUID, InsertTimestamp) VALUES (?, ?, ?)");
+    for (int i = 0; i < addedPatientCount; ++i)
+      {
+      insertPatientQuery.addBindValue(QString("Placeholder^Patient%1").arg(i));
+      insertPatientQuery.addBindValue(QString("PlaceholderPatient%1").arg(i));
+      insertPatientQuery.addBindValue(QString("20200101"));
+      insertStudyQuery.addBindValue(QString("1.2.3.4.%1").arg(i));
+      if (!insertPatientQuery.exec())
+        {
+        std::cerr << "Failed to add patients" << std::endl;
+        return EXIT_FAILURE;
+        }
+      insertStudyQuery.addBindValue(insertPatientQuery.lastInsertId());
+      insertStudyQuery.addBindValue(QString("20200101"));
+      if (!insertStudyQuery.exec())
+        {
+        std::cerr << "Failed to add studies" << std::endl;
+        return EXIT_FAILURE;
+        }
+      }
+    database.commit();
+    patientCount += addedPatientCount;
+
+    model.reset();
+    timer.start();
+    while (model.rowCount() < patientCount && timer.elapsed() < 10000)
+      {
+      QCoreApplication::processEvents(QEventLoop::AllEvents, 100);
+      }
+    if (model.rowCount() != patientCount)
+      {
+      std::cerr << "Asynchronous fetch failed: " << model.rowCount() << " rows fetched, expected "
+                << patientCount << std::endl;
+      return EXIT_FAILURE;
+      }
+    QModelIndex placeholderIndex = model.index(patientCount - 1, 0);
+    if (!model.data(placeholderIndex, ctkDICOMModel::UIDRole).toString().isEmpty()
+      || !model.hasChildren(placeholderIndex) || !model.canFetchMore(placeholderIndex))
+      {
+      std::cerr << "Last row is expected to be a placeholder" << std::endl;
+      return EXIT_FAILURE;
+      }
+    model.fetchMore(placeholderIndex);
+    timer.start();
+    while (model.rowCount(placeholderIndex) < 1 && timer.elapsed() < 10000)
+      {
+      QCoreApplication::processEvents(QEventLoop::AllEvents, 100);
+      }
+    if (model.data(placeholderIndex, ctkDICOMModel::UIDRole).toString().isEmpty()
+      || model.rowCount(placeholderIndex) < 1)
+      {
+      std::cerr << "Children of a placeholder row are not fetched" << std::endl;
+      return EXIT_FAILURE;
+      }
+
+    model.setAsynchronousFetchEnabled(false);
+
+    // Sorted rows are paged by sort value, all the rows must be found
+    model.sort(0, Qt::DescendingOrder);
+    if (model.rowCount() != patientCount)
+      {
+      std::cerr << "Sorted fetch failed: " << model.rowCount() << " rows fetched, expected "
+                << patientCount << std::endl;
+      return EXIT_FAILURE;
+      }
+
     return EXIT_SUCCESS;
   }
   catch (std::exception e)
@@ -75,5 +75,15 @@ int ctkDICOMQueryTest2( int argc, char * argv [] )
               << "No study instance retrieved" << std::endl;
     return EXIT_FAILURE;
     }
+
+  // Query series using parallel associations
+  int studyCount = query.studyInstanceUIDQueried().count();
+  query.setMaximumAssociationCount(2);
+  res = query.query(database);
+  if (!res || query.studyInstanceUIDQueried().count() != studyCount)
+    {
+    std::cout << "ctkDICOMQuery::query() failed using parallel associations" << std::endl;
+    return EXIT_FAILURE;
+    }
   return EXIT_SUCCESS;
 }
@@ -87,6 +87,20 @@ int ctkDICOMRetrieveTest1( int argc, char * argv [] )
     return EXIT_FAILURE;
     }
 
+  if (retrieve.ingestQueueSize() != 100)
+    {
+    std::cerr << "ctkDICOMRetrieve::ingestQueueSize() failed: "
+              << retrieve.ingestQueueSize() << std::endl;
+    return EXIT_FAILURE;
+    }
+  retrieve.setIngestQueueSize(10);
+  if (retrieve.ingestQueueSize() != 10)
+    {
+    std::cerr << "ctkDICOMRetrieve::setIngestQueueSize() failed: "
+              << retrieve.ingestQueueSize() << std::endl;
+    return EXIT_FAILURE;
+    }
+
   std::cerr << "Set Database\n";
   QSharedPointer<ctkDICOMDatabase> dicomDatabase(new ctkDICOMDatabase);
   retrieve.setDatabase(dicomDatabase);
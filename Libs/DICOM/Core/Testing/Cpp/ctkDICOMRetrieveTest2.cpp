@@ -108,6 +108,21 @@ int ctkDICOMRetrieveTest2( int argc, char * argv [] )
       }
     }
 
+  // Retrieve the studies again, using multiple associations
+  retrieve.setMaximumAssociationCount(2);
+  foreach(const QString& study, query.studyInstanceUIDQueried())
+    {
+    std::cerr << "ctkDICOMRetrieveTest2: Retrieving in parallel " << study.toStdString() << "\n";
+    bool res = retrieve.moveStudy(study);
+    if (!res)
+      {
+      std::cout << "ctkDICOMRetrieve::moveStudy() failed using multiple associations. "
+                << "Study " << qPrintable(study) << " can't be retrieved"
+                << std::endl;
+      return EXIT_FAILURE;
+      }
+    }
+
   std::cerr << "ctkDICOMRetrieveTest2: Exit success\n";
 
   return EXIT_SUCCESS;
@@ -0,0 +1,294 @@
+/*=========================================================================
+
+  Library:   CTK
+
+  Copyright (c) Kitware Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0.txt
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+=========================================================================*/
+
+// Qt includes
+#include <QDate>
+#include <QDir>
+#include <QVector>
+
+// CTK includes
+#include "ctkDICOMSyntheticDataGenerator.h"
+
+// DCMTK includes
+#include <dcmtk/dcmdata/dcdeftag.h>
+#include <dcmtk/dcmdata/dcfilefo.h>
+#include <dcmtk/dcmdata/dcuid.h>
+
+// STD includes
+#include <iostream>
+
+namespace
+{
+const char* const Modalities[] = { "CT", "MR", "PT", "US" };
+const char* const SOPClassUIDs[] = { UID_CTImageStorage, UID_MRImageStorage,
+  UID_PositronEmissionTomographyImageStorage, UID_UltrasoundImageStorage };
+const char* const BodyParts[] = { "HEAD", "CHEST", "ABDOMEN", "PELVIS", "KNEE" };
+const char* const LastNames[] = { "Smith", "Jones", "Garcia", "Miller", "Davis", "Lopez", "Wilson", "Moore" };
+const char* const FirstNames[] = { "Anna", "Ben", "Chloe", "David", "Emma", "Felix", "Grace", "Henry" };
+const int ModalityCount = sizeof(Modalities) / sizeof(Modalities[0]);
+const int BodyPartCount = sizeof(BodyParts) / sizeof(BodyParts[0]);
+const int LastNameCount = sizeof(LastNames) / sizeof(LastNames[0]);
+const int FirstNameCount = sizeof(FirstNames) / sizeof(FirstNames[0]);
+}
+
+//------------------------------------------------------------------------------
+ctkDICOMSyntheticDataGenerator::ctkDICOMSyntheticDataGenerator(int seed)
+  : Seed(seed)
+  , PatientCount(10)
+  , StudiesPerPatient(2)
+  , SeriesPerStudy(3)
+  , InstancesPerSeries(10)
+  , ImageSize(0)
+{
+}
+
+//------------------------------------------------------------------------------
+int ctkDICOMSyntheticDataGenerator::seed() const
+{
+  return this->Seed;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMSyntheticDataGenerator::setPatientCount(int count)
+{
+  this->PatientCount = count;
+}
+
+//------------------------------------------------------------------------------
+int ctkDICOMSyntheticDataGenerator::patientCount() const
+{
+  return this->PatientCount;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMSyntheticDataGenerator::setStudiesPerPatient(int count)
+{
+  this->StudiesPerPatient = count;
+}
+
+//------------------------------------------------------------------------------
+int ctkDICOMSyntheticDataGenerator::studiesPerPatient() const
+{
+  return this->StudiesPerPatient;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMSyntheticDataGenerator::setSeriesPerStudy(int count)
+{
+  this->SeriesPerStudy = count;
+}
+
+//------------------------------------------------------------------------------
+int ctkDICOMSyntheticDataGenerator::seriesPerStudy() const
+{
+  return this->SeriesPerStudy;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMSyntheticDataGenerator::setInstancesPerSeries(int count)
+{
+  this->InstancesPerSeries = count;
+}
+
+//------------------------------------------------------------------------------
+int ctkDICOMSyntheticDataGenerator::instancesPerSeries() const
+{
+  return this->InstancesPerSeries;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMSyntheticDataGenerator::setImageSize(int size)
+{
+  this->ImageSize = size;
+}
+
+//------------------------------------------------------------------------------
+int ctkDICOMSyntheticDataGenerator::imageSize() const
+{
+  return this->ImageSize;
+}
+
+//------------------------------------------------------------------------------
+int ctkDICOMSyntheticDataGenerator::instanceCount() const
+{
+  return this->PatientCount * this->StudiesPerPatient * this->SeriesPerStudy * this->InstancesPerSeries;
+}
+
+//------------------------------------------------------------------------------
+unsigned int ctkDICOMSyntheticDataGenerator::value(unsigned int a, unsigned int b, unsigned int c, unsigned int d) const
+{
+  // FNV-1a hash of the seed and the arguments
+  unsigned int hash = 2166136261u;
+  unsigned int values[] = { static_cast<unsigned int>(this->Seed), a, b, c, d };
+  for (int valueIndex = 0; valueIndex < 5; ++valueIndex)
+  {
+    for (int byteIndex = 0; byteIndex < 4; ++byteIndex)
+    {
+      hash ^= (values[valueIndex] >> (8 * byteIndex)) & 0xff;
+      hash *= 16777619u;
+    }
+  }
+  return hash;
+}
+
+//------------------------------------------------------------------------------
+QString ctkDICOMSyntheticDataGenerator::patientID(int patient) const
+{
+  return QString("SYN%1-%2").arg(this->Seed).arg(patient, 6, 10, QChar('0'));
+}
+
+//------------------------------------------------------------------------------
+QString ctkDICOMSyntheticDataGenerator::studyInstanceUID(int patient, int study) const
+{
+  return QString("%1.%2.%3.%4").arg(SITE_STUDY_UID_ROOT).arg(this->Seed).arg(patient + 1).arg(study + 1);
+}
+
+//------------------------------------------------------------------------------
+QString ctkDICOMSyntheticDataGenerator::seriesInstanceUID(int patient, int study, int series) const
+{
+  return QString("%1.%2.%3.%4.%5").arg(SITE_SERIES_UID_ROOT).arg(this->Seed)
+    .arg(patient + 1).arg(study + 1).arg(series + 1);
+}
+
+//------------------------------------------------------------------------------
+QString ctkDICOMSyntheticDataGenerator::sopInstanceUID(int patient, int study, int series, int instance) const
+{
+  return QString("%1.%2.%3.%4.%5.%6").arg(SITE_INSTANCE_UID_ROOT).arg(this->Seed)
+    .arg(patient + 1).arg(study + 1).arg(series + 1).arg(instance + 1);
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMSyntheticDataGenerator::createDataset(int patient, int study, int series, int instance, DcmDataset* dataset) const
+{
+  if (!dataset)
+  {
+    return;
+  }
+  // Patient
+  QString patientName = QString("%1^%2")
+    .arg(LastNames[this->value(1, patient) % LastNameCount])
+    .arg(FirstNames[this->value(2, patient) % FirstNameCount]);
+  QDate birthDate = QDate(1940, 1, 1).addDays(this->value(3, patient) % (365 * 60));
+  dataset->putAndInsertString(DCM_SpecificCharacterSet, "ISO_IR 100");
+  dataset->putAndInsertString(DCM_PatientName, patientName.toLatin1().constData());
+  dataset->putAndInsertString(DCM_PatientID, this->patientID(patient).toLatin1().constData());
+  dataset->putAndInsertString(DCM_PatientBirthDate, birthDate.toString("yyyyMMdd").toLatin1().constData());
+  dataset->putAndInsertString(DCM_PatientSex, (this->value(4, patient) % 2) ? "F" : "M");
+
+  // Study
+  QDate studyDate = QDate(2000, 1, 1).addDays(this->value(5, patient, study) % (365 * 20));
+  QString studyTime = QString("%1%2%3")
+    .arg(8 + this->value(6, patient, study) % 10, 2, 10, QChar('0'))
+    .arg(this->value(7, patient, study) % 60, 2, 10, QChar('0'))
+    .arg(this->value(8, patient, study) % 60, 2, 10, QChar('0'));
+  const char* bodyPart = BodyParts[this->value(9, patient, study) % BodyPartCount];
+  dataset->putAndInsertString(DCM_StudyInstanceUID, this->studyInstanceUID(patient, study).toLatin1().constData());
+  dataset->putAndInsertString(DCM_StudyID, QString::number(study + 1).toLatin1().constData());
+  dataset->putAndInsertString(DCM_StudyDate, studyDate.toString("yyyyMMdd").toLatin1().constData());
+  dataset->putAndInsertString(DCM_StudyTime, studyTime.toLatin1().constData());
+  dataset->putAndInsertString(DCM_StudyDescription, QString("Synthetic %1 study").arg(bodyPart).toLatin1().constData());
+  dataset->putAndInsertString(DCM_AccessionNumber,
+    QString("ACC%1").arg(this->value(10, patient, study) % 100000000, 8, 10, QChar('0')).toLatin1().constData());
+  dataset->putAndInsertString(DCM_ReferringPhysicianName, "Synthetic^Referrer");
+  dataset->putAndInsertString(DCM_InstitutionName, "Synthetic Hospital");
+
+  // Series
+  int modalityIndex = this->value(11, patient, study, series) % ModalityCount;
+  QString seriesDescription = QString("%1 %2 series %3").arg(Modalities[modalityIndex]).arg(bodyPart).arg(series + 1);
+  dataset->putAndInsertString(DCM_SeriesInstanceUID,
+    this->seriesInstanceUID(patient, study, series).toLatin1().constData());
+  dataset->putAndInsertString(DCM_SeriesNumber, QString::number(series + 1).toLatin1().constData());
+  dataset->putAndInsertString(DCM_SeriesDate, studyDate.toString("yyyyMMdd").toLatin1().constData());
+  dataset->putAndInsertString(DCM_SeriesTime, studyTime.toLatin1().constData());
+  dataset->putAndInsertString(DCM_SeriesDescription, seriesDescription.toLatin1().constData());
+  dataset->putAndInsertString(DCM_Modality, Modalities[modalityIndex]);
+  dataset->putAndInsertString(DCM_BodyPartExamined, bodyPart);
+  dataset->putAndInsertString(DCM_FrameOfReferenceUID,
+    (this->seriesInstanceUID(patient, study, series) + ".1").toLatin1().constData());
+
+  // Instance
+  dataset->putAndInsertString(DCM_SOPClassUID, SOPClassUIDs[modalityIndex]);
+  dataset->putAndInsertString(DCM_SOPInstanceUID,
+    this->sopInstanceUID(patient, study, series, instance).toLatin1().constData());
+  dataset->putAndInsertString(DCM_InstanceNumber, QString::number(instance + 1).toLatin1().constData());
+  dataset->putAndInsertString(DCM_ImagePositionPatient,
+    QString("0\\0\\%1").arg(instance * 2.5).toLatin1().constData());
+  dataset->putAndInsertString(DCM_ImageOrientationPatient, "1\\0\\0\\0\\1\\0");
+  dataset->putAndInsertString(DCM_SliceThickness, "2.5");
+
+  if (this->ImageSize <= 0)
+  {
+    return;
+  }
+  dataset->putAndInsertUint16(DCM_SamplesPerPixel, 1);
+  dataset->putAndInsertString(DCM_PhotometricInterpretation, "MONOCHROME2");
+  dataset->putAndInsertUint16(DCM_Rows, this->ImageSize);
+  dataset->putAndInsertUint16(DCM_Columns, this->ImageSize);
+  dataset->putAndInsertString(DCM_PixelSpacing, "0.5\\0.5");
+  dataset->putAndInsertUint16(DCM_BitsAllocated, 16);
+  dataset->putAndInsertUint16(DCM_BitsStored, 12);
+  dataset->putAndInsertUint16(DCM_HighBit, 11);
+  dataset->putAndInsertUint16(DCM_PixelRepresentation, 0);
+  QVector<Uint16> pixels(this->ImageSize * this->ImageSize);
+  unsigned int pixelSeed = this->value(12, patient, study, series * this->InstancesPerSeries + instance);
+  for (int pixelIndex = 0; pixelIndex < pixels.size(); ++pixelIndex)
+  {
+    // Linear congruential generator, it is much faster than hashing each pixel
+    pixelSeed = pixelSeed * 1664525u + 1013904223u;
+    pixels[pixelIndex] = static_cast<Uint16>((pixelSeed >> 16) & 0x0fff);
+  }
+  dataset->putAndInsertUint16Array(DCM_PixelData, pixels.constData(), pixels.size());
+}
+
+//------------------------------------------------------------------------------
+QStringList ctkDICOMSyntheticDataGenerator::writeFiles(const QString& directory) const
+{
+  QStringList filePaths;
+  QDir outputDir(directory);
+  for (int patient = 0; patient < this->PatientCount; ++patient)
+  {
+    for (int study = 0; study < this->StudiesPerPatient; ++study)
+    {
+      for (int series = 0; series < this->SeriesPerStudy; ++series)
+      {
+        QString seriesDirName = QString("P%1/ST%2/SE%3").arg(patient).arg(study).arg(series);
+        if (!outputDir.mkpath(seriesDirName))
+        {
+          std::cerr << "Failed to create directory " << qPrintable(outputDir.filePath(seriesDirName)) << std::endl;
+          return QStringList();
+        }
+        for (int instance = 0; instance < this->InstancesPerSeries; ++instance)
+        {
+          QString filePath = outputDir.filePath(QString("%1/IM%2.dcm").arg(seriesDirName).arg(instance));
+          DcmFileFormat fileFormat;
+          this->createDataset(patient, study, series, instance, fileFormat.getDataset());
+          OFCondition status = fileFormat.saveFile(filePath.toLocal8Bit().constData(), EXS_LittleEndianExplicit);
+          if (!status.good())
+          {
+            std::cerr << "Failed to write " << qPrintable(filePath) << ": " << status.text() << std::endl;
+            return QStringList();
+          }
+          filePaths << filePath;
+        }
+      }
+    }
+  }
+  return filePaths;
+}
@@ -0,0 +1,86 @@
+/*=========================================================================
+
+  Library:   CTK
+
+  Copyright (c) Kitware Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0.txt
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+=========================================================================*/
+
+#ifndef __ctkDICOMSyntheticDataGenerator_h
+#define __ctkDICOMSyntheticDataGenerator_h
+
+// Qt includes
+#include <QString>
+#include <QStringList>
+
+class DcmDataset;
+
+/// \ingroup DICOM_Core
+///
+/// Generates DICOM instances with a configurable patient/study/series/instance fan-out,
+/// for testing and benchmarking.
+///
+/// Generated content only depends on the seed and the fan-out settings: UIDs, names,
+/// dates, and pixel values are the same in each run, therefore results of different runs
+/// (and of different versions of the code) can be compared.
+class ctkDICOMSyntheticDataGenerator
+{
+public:
+  ctkDICOMSyntheticDataGenerator(int seed = 0);
+
+  int seed() const;
+
+  void setPatientCount(int count);
+  int patientCount() const;
+  void setStudiesPerPatient(int count);
+  int studiesPerPatient() const;
+  void setSeriesPerStudy(int count);
+  int seriesPerStudy() const;
+  void setInstancesPerSeries(int count);
+  int instancesPerSeries() const;
+
+  /// Number of rows and columns of the generated images.
+  /// If 0 then instances are generated without pixel data (header only).
+  void setImageSize(int size);
+  int imageSize() const;
+
+  /// Total number of instances
+  int instanceCount() const;
+
+  QString patientID(int patient) const;
+  QString studyInstanceUID(int patient, int study) const;
+  QString seriesInstanceUID(int patient, int study, int series) const;
+  QString sopInstanceUID(int patient, int study, int series, int instance) const;
+
+  /// Fill the dataset with the content of the specified instance.
+  void createDataset(int patient, int study, int series, int instance, DcmDataset* dataset) const;
+
+  /// Write all instances into the directory, one subdirectory per series.
+  /// Returns the list of written file paths (empty list in case of error).
+  QStringList writeFiles(const QString& directory) const;
+
+protected:
+  /// Deterministic pseudo-random number for the given instance and purpose
+  unsigned int value(unsigned int a, unsigned int b = 0, unsigned int c = 0, unsigned int d = 0) const;
+
+  int Seed;
+  int PatientCount;
+  int StudiesPerPatient;
+  int SeriesPerStudy;
+  int InstancesPerSeries;
+  int ImageSize;
+};
+
+#endif
@@ -21,16 +21,23 @@
 #include <stdexcept>
 
 // Qt includes
+#include <QDataStream>
 #include <QDate>
+#include <QDir>
 #include <QDebug>
+#include <QElapsedTimer>
 #include <QFile>
 #include <QFileInfo>
 #include <QFileSystemWatcher>
+#include <QMutex>
+#include <QRunnable>
 #include <QSet>
 #include <QSqlError>
 #include <QSqlQuery>
 #include <QSqlRecord>
 #include <QStringList>
+#include <QThread>
+#include <QThreadPool>
 #include <QUuid>
 #include <QVariant>
 
@@ -38,6 +45,7 @@
 #include "ctkDICOMDatabase.h"
 #include "ctkDICOMAbstractThumbnailGenerator.h"
 #include "ctkDICOMItem.h"
+#include "ctkDICOMMappedInputStream_p.h"
 
 #include "ctkLogger.h"
 
@@ -59,6 +67,18 @@
 #include <dcmtk/dcmdata/dcrledrg.h>  /* for DcmRLEDecoderRegistration */
 #include <dcmtk/dcmdata/dcrleerg.h>  /* for DcmRLEEncoderRegistration */
 
+// System includes (for creating hard links and file clones)
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <linux/fs.h> /* for FICLONE */
+#endif
+
 //------------------------------------------------------------------------------
 static ctkLogger logger("org.commontk.dicom.DICOMDatabase" );
 //------------------------------------------------------------------------------
@@ -72,6 +92,83 @@ static QString ValueIsNotStored("__VALUE_IS_NOT_STORED__");
 /// Separator character for table and field names to be used in display rules manager
 static QString TableFieldSeparator(":");
 
+/// Maximum number of host parameters in a single SQL statement (SQLITE_MAX_VARIABLE_NUMBER
+/// is 999 by default in SQLite versions before 3.32)
+static const int MAXIMUM_SQL_VARIABLE_COUNT = 999;
+/// Number of items above which the inserted patient, study, series caches are cleared
+/// to limit memory usage
+static const int INSERTED_UIDS_CACHE_MAXIMUM_SIZE = 10000;
+/// Version of the packed per-instance record format that is stored in the TagCacheInstances table
+static const quint8 TAG_CACHE_RECORD_FORMAT_VERSION = 1;
+/// Maximum number of instances whose cached tags are kept in memory at the same time
+/// when the displayed fields are updated (instances of a series are always processed together)
+static const int DISPLAYED_FIELDS_BATCH_SIZE = 10000;
+
+//------------------------------------------------------------------------------
+/// Instance whose displayed fields are being updated
+struct ctkDICOMDisplayedFieldsInstance
+{
+  QString SOPInstanceUID;
+  QString SeriesInstanceUID;
+  QString StudyInstanceUID;
+  QString PatientCompositeID;
+  QMap<QString, QString> CachedTags;
+};
+
+//------------------------------------------------------------------------------
+/// Instances and the displayed fields of their series, studies, and patients.
+/// Instances of different partitions do not share any series, study, or patient,
+/// therefore the partitions can be processed in parallel.
+struct ctkDICOMDisplayedFieldsPartition
+{
+  QList<ctkDICOMDisplayedFieldsInstance> Instances;
+  QMap<QString, QMap<QString, QString> > Series;
+  QMap<QString, QMap<QString, QString> > Studies;
+  QMap<QString, QMap<QString, QString> > Patients;
+};
+
+//------------------------------------------------------------------------------
+/// Find the partition that a partition has been merged into (with path halving)
+static int ctkDICOMDisplayedFieldsRootPartition(QVector<int>& parentPartitions, int partition)
+{
+  while (parentPartitions[partition] != partition)
+  {
+    parentPartitions[partition] = parentPartitions[parentPartitions[partition]];
+    partition = parentPartitions[partition];
+  }
+  return partition;
+}
+
+//------------------------------------------------------------------------------
+/// Evaluates the displayed field generator rules for the instances of a partition.
+/// Only the maps of the partition are accessed, the database is not used.
+class ctkDICOMDisplayedFieldsWorker : public QRunnable
+{
+public:
+  ctkDICOMDisplayedFieldsWorker(ctkDICOMDisplayedFieldGenerator& generator, ctkDICOMDisplayedFieldsPartition& partition)
+    : Generator(generator)
+    , Partition(partition)
+  {
+  }
+
+  virtual void run()
+  {
+    foreach (const ctkDICOMDisplayedFieldsInstance& instance, this->Partition.Instances)
+    {
+      QMap<QString, QString>& displayedFieldsForCurrentStudy = this->Partition.Studies[instance.StudyInstanceUID];
+      displayedFieldsForCurrentStudy["PatientCompositeID"] = instance.PatientCompositeID;
+      this->Generator.updateDisplayedFieldsForInstance(instance.SOPInstanceUID, instance.CachedTags,
+        this->Partition.Series[instance.SeriesInstanceUID],
+        displayedFieldsForCurrentStudy,
+        this->Partition.Patients[instance.PatientCompositeID]);
+    }
+  }
+
+protected:
+  ctkDICOMDisplayedFieldGenerator& Generator;
+  ctkDICOMDisplayedFieldsPartition& Partition;
+};
+
 //------------------------------------------------------------------------------
 class ctkDICOMDatabasePrivate
 {
@@ -92,12 +189,49 @@ public:
   bool loggedExecBatch(QSqlQuery& query);
   bool LoggedExecVerbose;
 
+  /// Get a prepared query for the statement. The statement is only prepared when it is first
+  /// requested, subsequent calls return the same query (with all bound values reset).
+  /// Call finish() on the returned query after the results are read, so that
+  /// the query does not keep the database locked.
+  QSqlQuery cachedQuery(const QSqlDatabase& database, const QString& statement);
+  /// Must be called before the database connections are closed or tables are dropped.
+  void clearCachedQueries();
+  /// Prepared queries, the key is the connection name and statement
+  QHash<QString, QSqlQuery> CachedQueries;
+
+  /// Insert rows into a table using multi-row INSERT statements.
+  /// \param insertStatement Statement without the values, such as "INSERT INTO Directories VALUES "
+  /// \param values Values of all the inserted rows, one after the other.
+  /// If a multi-row insert fails (e.g., due to a constraint violation) then rows are
+  /// inserted one by one so that only the offending rows are skipped.
+  bool insertRows(const QSqlDatabase& database, const QString& insertStatement, int columnCount, const QVariantList& values);
+
   bool removeImage(const QString& sopInstanceUID);
 
   /// Store copy of the dataset in database folder.
   /// If the original file is available then that will be inserted. If not then a file is created from the dataset object.
-  bool storeDatasetFile(const ctkDICOMItem& dataset, const QString& originalFilePath,
-    const QString& studyInstanceUID, const QString& seriesInstanceUID, const QString& sopInstanceUID, QString& storedFilePath);
+  /// If storeInBackground is true then the original file is stored by the file storage thread pool
+  /// (the caller must call waitForStoredFiles before the instance is added to the database).
+  /// If dataset is null then the original file must be available.
+  bool storeDatasetFile(const ctkDICOMItem* dataset, const QString& originalFilePath,
+    const QString& studyInstanceUID, const QString& seriesInstanceUID, const QString& sopInstanceUID, QString& storedFilePath,
+    bool storeInBackground = false);
+  /// Store an existing file at storedFilePath using the specified storage mode.
+  /// Falls back to copying if the storage mode is not supported for the file. Can be called from any thread.
+  static bool storeFile(const QString& originalFilePath, const QString& storedFilePath, ctkDICOMDatabase::FileStorageMode mode);
+  /// Wait for files that are stored in the background and remove instances whose file
+  /// could not be stored from the pending rows.
+  void waitForStoredFiles();
+  ctkDICOMDatabase::FileStorageMode StorageMode;
+  int StorageThreadCount;
+  QThreadPool StorageThreadPool;
+
+  bool MemoryMappedFileRead;
+  /// Instances whose file could not be stored in the background
+  QSet<QString> FailedStoredSOPInstanceUIDs;
+  QMutex FailedStoredSOPInstanceUIDsMutex;
+  /// Instances of the current insert batch that were dropped by waitForStoredFiles
+  QSet<QString> DroppedSOPInstanceUIDs;
 
   /// Returns false in case of an error
   bool indexingStatusForFile(const QString& filePath, const QString& sopInstanceUID, bool& datasetInDatabase, bool& datasetUpToDate, QString& databaseFilename);
@@ -107,38 +241,58 @@ public:
     const QString& studyInstanceUID, const QString& seriesInstanceUID, const QString& sopInstanceUID);
 
   /// Get basic UIDs for a data set, return true if the data set has all the required tags
-  bool uidsForDataSet(const ctkDICOMItem& dataset, QString& patientsName, QString& patientID, QString& studyInstanceUID, QString& seriesInstanceUID);
+  bool uidsForDataSet(const ctkDICOMHeaderRecord& header, QString& patientsName, QString& patientID, QString& studyInstanceUID, QString& seriesInstanceUID);
   bool uidsForDataSet(QString& patientsName, QString& patientID, QString& studyInstanceUID);
 
   /// Dataset must be set always
   /// \param filePath It has to be set if this is an import of an actual file
   void insert ( const ctkDICOMItem& dataset, const QString& filePath, bool storeFile = true, bool generateThumbnail = true);
 
+  /// Create a compact record of the values of the dataset that are inserted into the database
+  /// (values of hierarchy tags and tags to precache).
+  ctkDICOMHeaderRecord headerRecordForDataset(const ctkDICOMItem& dataset);
+
   /// Copy the complete list of files to an extra table
   QStringList allFilesInDatabase();
 
-  /// Update database tables from the displayed fields determined by the plugin roles
+  /// Update database tables from the displayed fields determined by the plugin roles.
+  /// Each patient, study, and series row is updated by a single statement, which also sets its
+  /// DisplayedFieldsUpdatedTimestamp. A transaction should be started by the caller.
   /// \return Success flag
   bool applyDisplayedFieldsChanges( QMap<QString, QMap<QString, QString> > &displayedFieldsMapSeries,
                                     QMap<QString, QMap<QString, QString> > &displayedFieldsMapStudy,
                                     QMap<QString, QMap<QString, QString> > &displayedFieldsMapPatient );
-
-  /// Find patient by composite patient ID and return its index and insert it in the given fields map
-  /// \param displayedFieldsMapPatient Map of patient field maps (name, value pairs) to which the found patient
-  ///   is inserted on success. Also contains the generated patient index
-  /// \return The composite patient ID if successfully gound, empty string otherwise
-  QString getDisplayPatientFieldsKey(const QString& patientID, const QString& patientsName, const QString& patientsBirthDate,
+  /// Update the row of a table where keyField equals the value of keyField in fields.
+  /// \param updateQueries Prepared statements, reused for rows that update the same fields
+  /// \param skippedFields Fields that are not written to the table
+  bool updateDisplayedFieldsRow(QHash<QString, QSqlQuery>& updateQueries, const QString& table, const QString& keyField,
+    const QMap<QString, QString>& fields, const QStringList& skippedFields = QStringList());
+
+  /// Compute the displayed fields of a batch of instances:
+  /// cached tags of all instances and the current displayed fields of their patients, studies, and series
+  /// are read in bulk, then the rules are evaluated in parallel for groups of instances that do not share
+  /// any patient, study, or series.
+  /// \param instances Instances to process, only SOPInstanceUID and SeriesInstanceUID need to be set.
+  /// \param displayedFieldsMapSeries Map of series field maps (name, value pairs), updated in place
+  /// \param displayedFieldsMapStudy Map of study field maps (name, value pairs), updated in place
+  /// \param displayedFieldsMapPatient Map of patient field maps by composite patient ID, updated in place
+  void updateDisplayedFieldsForInstances(QList<ctkDICOMDisplayedFieldsInstance> instances,
+    QMap<QString, QMap<QString, QString> >& displayedFieldsMapSeries,
+    QMap<QString, QMap<QString, QString> >& displayedFieldsMapStudy,
     QMap<QString, QMap<QString, QString> >& displayedFieldsMapPatient);
 
-  /// Find study by instance UID and insert it in the given fields map
-  /// \param displayedFieldsMapStudy Map of study field maps (name, value pairs) to which the found study has been inserted on success
-  /// \return The study instance UID if successfully found, empty string otherwise
-  QString getDisplayStudyFieldsKey(QString studyInstanceUID, QMap<QString, QMap<QString, QString> > &displayedFieldsMapStudy);
+  /// Read all rows of a table where keyField is one of the specified values.
+  /// Each row is returned as a map of field name and value. NULL values are not added to the map.
+  /// \param fields Fields to read, all fields are read if empty
+  bool readRowsForKeys(const QString& table, const QString& keyField, const QStringList& keys,
+    QList<QMap<QString, QString> >& rows, const QStringList& fields = QStringList());
+  /// Count rows of a table for each of the specified values of keyField (using GROUP BY queries).
+  /// Values that are not found in the table are not added to rowCounts.
+  bool rowCountsForKeys(const QString& table, const QString& keyField, const QStringList& keys,
+    QHash<QString, int>& rowCounts);
 
-  /// Find series by instance UID and insert it in the given fields map
-  /// \param displayedFieldsMapSeries Map of series field maps (name, value pairs) to which the found series has been inserted on success
-  /// \return The series instance UID if successfully found, empty string otherwise
-  QString getDisplaySeriesFieldsKey(QString seriesInstanceUID, QMap<QString, QMap<QString, QString> > &displayedFieldsMapSeries);
+  /// Convert a tag cache record to a map of tag and value (placeholder values are converted to empty string)
+  void cachedTagsFromRecord(const QHash<int, QString>& valuesForTagID, QMap<QString, QString>& cachedTags);
 
   /// Get all Filename values from table
   QStringList filenames(QString table);
@@ -156,6 +310,33 @@ public:
 
   int rowCount(const QString& tableName);
 
+  /// Set journal mode and checkpoint policy of the database connection according to WALModeEnabled
+  void applyJournalMode(QSqlDatabase& database);
+
+  /// Add the database file and, in WAL mode, the write-ahead log file and the database directory
+  /// to the file system watcher. SQLite deletes the log file on checkpoints and when the last
+  /// connection is closed, therefore the watched files have to be updated when the directory changes.
+  /// Returns true if watching of the write-ahead log file is started.
+  bool updateWatchedFiles();
+  QFileSystemWatcher* DatabaseFileWatcher;
+
+  /// Create the search index of patients, studies, and series and the triggers that keep
+  /// the index up-to-date when rows are inserted, updated (for example by updateDisplayedFields),
+  /// or deleted. Existing index is reused, unless rebuild is true.
+  void initializeSearchIndex(bool rebuild = false);
+  /// Fields of the table whose values are included in the search index
+  QStringList searchIndexFields(const QString& table);
+  /// Tables whose search index is available
+  QStringList SearchIndexTables;
+
+  /// Performance counters of database update phases
+  ctkDICOMDatabase::IndexingMetrics Metrics;
+
+  bool WALModeEnabled;
+  int WALAutoCheckpoint;
+  /// Number of nested beginReadSnapshot calls
+  int ReadSnapshotDepth;
+
   /// Name of the database file (i.e. for SQLITE the sqlite file)
   QString DatabaseFileName;
   QString LastError;
@@ -172,10 +353,18 @@ public:
   /// It would be very expensive to check in the database
   /// presence of all these records on each slice insertion,
   /// therefore we cache recently added entries in memory.
-  QMap<QString, int> InsertedPatientsCompositeIDCache; // map from composite patient ID to database ID
+  QHash<QString, int> InsertedPatientsCompositeIDCache; // map from composite patient ID to database ID
   QSet<QString> InsertedStudyUIDsCache;
   QSet<QString> InsertedSeriesUIDsCache;
 
+  /// Images rows and tag cache values that are collected during a batch insert
+  /// and are inserted into the database by flushPendingRows.
+  QVariantList PendingImagesValues;
+  QSet<QString> PendingImagesSOPInstanceUIDs;
+  QSet<QString> PendingImagesFilenames;
+  QHash<QString, QHash<QString, QString> > PendingTagCacheValues; // SOPInstanceUID -> (tag -> value)
+  void flushPendingRows();
+
   /// There is no unique patient ID. We use this composite ID in InsertedPatientsCompositeIDCache.
   /// It is not a problem that is somewhat more strict than the criteria that is used to decide if a study should be insert
   /// under the same patient.
@@ -194,13 +383,112 @@ public:
   QStringList TagsToPrecache;
   QStringList TagsToExcludeFromStorage;
   bool openTagCacheDatabase();
-  void precacheTags(const ctkDICOMItem& dataset, const QString sopInstanceUID);
+
+  /// The tag cache stores a single packed record for each instance, which contains
+  /// all the cached values of the instance. In packed records tags are referred to by
+  /// integer identifiers, which are stored in the TagCacheTags table.
+  QHash<QString, int> TagCacheTagIDs;
+  QHash<int, QString> TagCacheTagNames;
+  /// Read tag identifiers from the tag cache database (they may have been added by other connections)
+  bool loadTagCacheTagIDs();
+  /// Get identifier of a tag in the tag cache. If addIfMissing is true then a new identifier is
+  /// added if the tag is not found. Returns -1 if the tag is not found.
+  int tagCacheTagID(const QString& tag, bool addIfMissing);
+  /// Read identifier of a single tag from the tag cache database. Returns -1 if the tag is not found.
+  int readTagCacheTagID(const QString& tag);
+  static QByteArray packTagValues(const QHash<int, QString>& valuesForTagID);
+  static QHash<int, QString> unpackTagValues(const QByteArray& packedValues);
+  /// Read packed records of instances from the tag cache, in as few queries as possible.
+  /// Instances that are not found in the cache are not added to the output.
+  bool readTagCacheRecords(const QStringList& sopInstanceUIDs, QHash<QString, QHash<int, QString> >& valuesForTagIDForInstance);
+  /// Add values to the packed records of instances in the tag cache. Existing values of other tags are kept.
+  /// Empty values are stored as TagNotInInstance. A transaction should be started by the caller.
+  bool writeTagCacheValues(const QHash<QString, QHash<QString, QString> >& valuesForTagForInstance);
+  /// Get the value that is stored in the tag cache for a tag of a dataset
+  QString tagCacheValueFromDataset(const ctkDICOMItem& dataset, const QString& tag);
+  void precacheTags(const ctkDICOMHeaderRecord& header, const QString sopInstanceUID);
 
   // Return true if a new item is inserted
-  bool insertPatientStudySeries(const ctkDICOMItem& dataset, const QString& patientID, const QString& patientsName);
-  bool insertPatient(const ctkDICOMItem& dataset, int& databasePatientID);
-  bool insertStudy(const ctkDICOMItem& dataset, int dbPatientID);
-  bool insertSeries( const ctkDICOMItem& dataset, QString studyInstanceUID);
+  bool insertPatientStudySeries(const ctkDICOMHeaderRecord& header, const QString& patientID, const QString& patientsName);
+  bool insertPatient(const ctkDICOMHeaderRecord& header, int& databasePatientID);
+  bool insertStudy(const ctkDICOMHeaderRecord& header, int dbPatientID);
+  bool insertSeries( const ctkDICOMHeaderRecord& header, QString studyInstanceUID);
+};
+
+//------------------------------------------------------------------------------
+static bool ctkDICOMDatabaseCreateHardLink(const QString& originalFilePath, const QString& linkFilePath)
+{
+#ifdef _WIN32
+  return CreateHardLinkW(reinterpret_cast<const wchar_t*>(QDir::toNativeSeparators(linkFilePath).utf16()),
+    reinterpret_cast<const wchar_t*>(QDir::toNativeSeparators(originalFilePath).utf16()), NULL) != 0;
+#else
+  return link(QFile::encodeName(originalFilePath).constData(), QFile::encodeName(linkFilePath).constData()) == 0;
+#endif
+}
+
+//------------------------------------------------------------------------------
+static bool ctkDICOMDatabaseCloneFile(const QString& originalFilePath, const QString& clonedFilePath)
+{
+#if defined(__linux__) && defined(FICLONE)
+  int originalFile = open(QFile::encodeName(originalFilePath).constData(), O_RDONLY);
+  if (originalFile < 0)
+  {
+    return false;
+  }
+  int clonedFile = open(QFile::encodeName(clonedFilePath).constData(), O_WRONLY | O_CREAT | O_EXCL, 0666);
+  if (clonedFile < 0)
+  {
+    close(originalFile);
+    return false;
+  }
+  bool success = (ioctl(clonedFile, FICLONE, originalFile) == 0);
+  close(clonedFile);
+  close(originalFile);
+  if (!success)
+  {
+    // file system does not support cloning or the files are on different volumes
+    QFile::remove(clonedFilePath);
+  }
+  return success;
+#else
+  Q_UNUSED(originalFilePath);
+  Q_UNUSED(clonedFilePath);
+  return false;
+#endif
+}
+
+//------------------------------------------------------------------------------
+/// Stores an existing file in the database folder in the storage thread pool of the database
+class ctkDICOMDatabaseStoreFileWorker : public QRunnable
+{
+public:
+  ctkDICOMDatabaseStoreFileWorker(ctkDICOMDatabasePrivate* databasePrivate, const QString& originalFilePath,
+    const QString& storedFilePath, const QString& sopInstanceUID, ctkDICOMDatabase::FileStorageMode mode)
+    : DatabasePrivate(databasePrivate)
+    , OriginalFilePath(originalFilePath)
+    , StoredFilePath(storedFilePath)
+    , SOPInstanceUID(sopInstanceUID)
+    , Mode(mode)
+  {
+  }
+
+  virtual void run()
+  {
+    if (ctkDICOMDatabasePrivate::storeFile(this->OriginalFilePath, this->StoredFilePath, this->Mode))
+    {
+      return;
+    }
+    logger.error("Error storing file: " + this->OriginalFilePath + " to: " + this->StoredFilePath);
+    QMutexLocker locker(&this->DatabasePrivate->FailedStoredSOPInstanceUIDsMutex);
+    this->DatabasePrivate->FailedStoredSOPInstanceUIDs.insert(this->SOPInstanceUID);
+  }
+
+protected:
+  ctkDICOMDatabasePrivate* DatabasePrivate;
+  QString OriginalFilePath;
+  QString StoredFilePath;
+  QString SOPInstanceUID;
+  ctkDICOMDatabase::FileStorageMode Mode;
 };
 
 //------------------------------------------------------------------------------
@@ -213,6 +501,13 @@ ctkDICOMDatabasePrivate::ctkDICOMDatabasePrivate(ctkDICOMDatabase& o): q_ptr(&o)
   this->LoggedExecVerbose = false;
   this->TagCacheVerified = false;
   this->DisplayedFieldsTableAvailable = false;
+  this->WALModeEnabled = false;
+  this->WALAutoCheckpoint = 1000;
+  this->ReadSnapshotDepth = 0;
+  this->DatabaseFileWatcher = NULL;
+  this->StorageMode = ctkDICOMDatabase::CopyFileStorage;
+  this->StorageThreadCount = 1;
+  this->MemoryMappedFileRead = false;
   this->resetLastInsertedValues();
 }
 
@@ -251,6 +546,499 @@ ctkDICOMDatabasePrivate::~ctkDICOMDatabasePrivate()
 {
 }
 
+//------------------------------------------------------------------------------
+QSqlQuery ctkDICOMDatabasePrivate::cachedQuery(const QSqlDatabase& database, const QString& statement)
+{
+  QString key = database.connectionName() + TableFieldSeparator + statement;
+  QHash<QString, QSqlQuery>::iterator it = this->CachedQueries.find(key);
+  if (it != this->CachedQueries.end())
+  {
+    // Copies of a query share the same prepared statement
+    return it.value();
+  }
+  QSqlQuery query(database);
+  if (!query.prepare(statement))
+  {
+    logger.error("SQLITE ERROR: failed to prepare statement " + statement + " Error: " + query.lastError().text());
+    return query;
+  }
+  this->CachedQueries.insert(key, query);
+  return query;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMDatabasePrivate::clearCachedQueries()
+{
+  this->CachedQueries.clear();
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMDatabasePrivate::insertRows(const QSqlDatabase& database, const QString& insertStatement,
+  int columnCount, const QVariantList& values)
+{
+  const int rowCount = values.size() / columnCount;
+  const int maximumStatementRowCount = MAXIMUM_SQL_VARIABLE_COUNT / columnCount;
+  const QString rowPlaceholders = QString("(?") + QString(",?").repeated(columnCount - 1) + QString(")");
+  bool success = true;
+  int firstRowIndex = 0;
+  while (firstRowIndex < rowCount)
+  {
+    int statementRowCount = qMin(maximumStatementRowCount, rowCount - firstRowIndex);
+    QString statement = insertStatement + rowPlaceholders
+      + (QString(",") + rowPlaceholders).repeated(statementRowCount - 1);
+    // Only full-size statements are cached to keep the number of cached statements low
+    QSqlQuery insertQuery = (statementRowCount == maximumStatementRowCount)
+      ? this->cachedQuery(database, statement) : QSqlQuery(database);
+    if (statementRowCount != maximumStatementRowCount)
+    {
+      insertQuery.prepare(statement);
+    }
+    const int firstValueIndex = firstRowIndex * columnCount;
+    for (int valueIndex = 0; valueIndex < statementRowCount * columnCount; ++valueIndex)
+    {
+      insertQuery.bindValue(valueIndex, values[firstValueIndex + valueIndex]);
+    }
+    if (!insertQuery.exec())
+    {
+      // Retry inserting rows one by one so that only the offending rows are skipped
+      if (this->LoggedExecVerbose)
+      {
+        logger.debug("Multi-row insert failed, inserting rows one by one. Error: " + insertQuery.lastError().text());
+      }
+      QSqlQuery insertRowQuery = this->cachedQuery(database, insertStatement + rowPlaceholders);
+      for (int rowIndex = firstRowIndex; rowIndex < firstRowIndex + statementRowCount; ++rowIndex)
+      {
+        for (int columnIndex = 0; columnIndex < columnCount; ++columnIndex)
+        {
+          insertRowQuery.bindValue(columnIndex, values[rowIndex * columnCount + columnIndex]);
+        }
+        if (!this->loggedExec(insertRowQuery))
+        {
+          success = false;
+        }
+        insertRowQuery.finish();
+      }
+    }
+    insertQuery.finish();
+    firstRowIndex += statementRowCount;
+  }
+  return success;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMDatabasePrivate::flushPendingRows()
+{
+  this->waitForStoredFiles();
+  if (!this->PendingImagesValues.isEmpty())
+  {
+    this->insertRows(this->Database, "INSERT INTO Images ( 'SOPInstanceUID', 'Filename', 'SeriesInstanceUID', 'InsertTimestamp' ) VALUES ",
+      4, this->PendingImagesValues);
+    this->PendingImagesValues.clear();
+    this->PendingImagesSOPInstanceUIDs.clear();
+    this->PendingImagesFilenames.clear();
+  }
+  if (!this->PendingTagCacheValues.isEmpty())
+  {
+    QElapsedTimer precacheTimer;
+    precacheTimer.start();
+    this->writeTagCacheValues(this->PendingTagCacheValues);
+    this->Metrics.addPhase(ctkDICOMDatabase::IndexingMetrics::PrecachePhase,
+      this->PendingTagCacheValues.size(), precacheTimer.nsecsElapsed());
+    this->PendingTagCacheValues.clear();
+  }
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMDatabasePrivate::loadTagCacheTagIDs()
+{
+  this->TagCacheTagIDs.clear();
+  this->TagCacheTagNames.clear();
+  QSqlQuery tagsQuery(this->TagCacheDatabase);
+  if (!this->loggedExec(tagsQuery, "SELECT TagID, Tag FROM TagCacheTags"))
+  {
+    return false;
+  }
+  while (tagsQuery.next())
+  {
+    int tagID = tagsQuery.value(0).toInt();
+    QString tag = tagsQuery.value(1).toString();
+    this->TagCacheTagIDs.insert(tag, tagID);
+    this->TagCacheTagNames.insert(tagID, tag);
+  }
+  tagsQuery.finish();
+  return true;
+}
+
+//------------------------------------------------------------------------------
+int ctkDICOMDatabasePrivate::tagCacheTagID(const QString& tag, bool addIfMissing)
+{
+  QHash<QString, int>::const_iterator it = this->TagCacheTagIDs.constFind(tag);
+  if (it != this->TagCacheTagIDs.constEnd())
+  {
+    return it.value();
+  }
+  // The tag may have been added by another database connection
+  int tagID = this->readTagCacheTagID(tag);
+  if (tagID >= 0 || !addIfMissing)
+  {
+    return tagID;
+  }
+  QSqlQuery insertTagQuery = this->cachedQuery(this->TagCacheDatabase, "INSERT OR IGNORE INTO TagCacheTags (Tag) VALUES (?)");
+  insertTagQuery.bindValue(0, tag);
+  if (!this->loggedExec(insertTagQuery))
+  {
+    return -1;
+  }
+  insertTagQuery.finish();
+  return this->readTagCacheTagID(tag);
+}
+
+//------------------------------------------------------------------------------
+int ctkDICOMDatabasePrivate::readTagCacheTagID(const QString& tag)
+{
+  QSqlQuery tagQuery = this->cachedQuery(this->TagCacheDatabase, "SELECT TagID FROM TagCacheTags WHERE Tag = ?");
+  tagQuery.bindValue(0, tag);
+  if (!this->loggedExec(tagQuery))
+  {
+    return -1;
+  }
+  if (!tagQuery.next())
+  {
+    tagQuery.finish();
+    return -1;
+  }
+  int tagID = tagQuery.value(0).toInt();
+  tagQuery.finish();
+  this->TagCacheTagIDs.insert(tag, tagID);
+  this->TagCacheTagNames.insert(tagID, tag);
+  return tagID;
+}
+
+//------------------------------------------------------------------------------
+QByteArray ctkDICOMDatabasePrivate::packTagValues(const QHash<int, QString>& valuesForTagID)
+{
+  QByteArray packedValues;
+  QDataStream stream(&packedValues, QIODevice::WriteOnly);
+  stream.setVersion(QDataStream::Qt_5_0);
+  stream << quint8(TAG_CACHE_RECORD_FORMAT_VERSION) << quint32(valuesForTagID.size());
+  for (QHash<int, QString>::const_iterator it = valuesForTagID.constBegin(); it != valuesForTagID.constEnd(); ++it)
+  {
+    stream << qint32(it.key()) << it.value().toUtf8();
+  }
+  return packedValues;
+}
+
+//------------------------------------------------------------------------------
+QHash<int, QString> ctkDICOMDatabasePrivate::unpackTagValues(const QByteArray& packedValues)
+{
+  QHash<int, QString> valuesForTagID;
+  QDataStream stream(packedValues);
+  stream.setVersion(QDataStream::Qt_5_0);
+  quint8 formatVersion = 0;
+  quint32 count = 0;
+  stream >> formatVersion >> count;
+  if (formatVersion != TAG_CACHE_RECORD_FORMAT_VERSION)
+  {
+    logger.warn("Unsupported record format found in tag cache");
+    return valuesForTagID;
+  }
+  valuesForTagID.reserve(count);
+  for (quint32 i = 0; i < count && stream.status() == QDataStream::Ok; ++i)
+  {
+    qint32 tagID = -1;
+    QByteArray value;
+    stream >> tagID >> value;
+    valuesForTagID.insert(tagID, QString::fromUtf8(value));
+  }
+  if (stream.status() != QDataStream::Ok)
+  {
+    logger.warn("Invalid record found in tag cache");
+  }
+  return valuesForTagID;
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMDatabasePrivate::readTagCacheRecords(const QStringList& sopInstanceUIDs,
+  QHash<QString, QHash<int, QString> >& valuesForTagIDForInstance)
+{
+  const QString selectStatement("SELECT SOPInstanceUID, TagValues FROM TagCacheInstances WHERE SOPInstanceUID IN ");
+  bool success = true;
+  int firstIndex = 0;
+  while (firstIndex < sopInstanceUIDs.size())
+  {
+    int statementUIDCount = qMin(MAXIMUM_SQL_VARIABLE_COUNT, sopInstanceUIDs.size() - firstIndex);
+    QString statement = selectStatement + QString("(?") + QString(",?").repeated(statementUIDCount - 1) + QString(")");
+    // Only single-instance and full-size statements are cached to keep the number of cached statements low
+    QSqlQuery selectQuery(this->TagCacheDatabase);
+    if (statementUIDCount == 1 || statementUIDCount == MAXIMUM_SQL_VARIABLE_COUNT)
+    {
+      selectQuery = this->cachedQuery(this->TagCacheDatabase, statement);
+    }
+    else
+    {
+      selectQuery.prepare(statement);
+    }
+    for (int i = 0; i < statementUIDCount; ++i)
+    {
+      selectQuery.bindValue(i, sopInstanceUIDs[firstIndex + i]);
+    }
+    if (this->loggedExec(selectQuery))
+    {
+      while (selectQuery.next())
+      {
+        valuesForTagIDForInstance.insert(selectQuery.value(0).toString(), unpackTagValues(selectQuery.value(1).toByteArray()));
+      }
+    }
+    else
+    {
+      success = false;
+    }
+    selectQuery.finish();
+    firstIndex += statementUIDCount;
+  }
+  return success;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMDatabasePrivate::cachedTagsFromRecord(const QHash<int, QString>& valuesForTagID, QMap<QString, QString>& cachedTags)
+{
+  cachedTags.clear();
+  for (QHash<int, QString>::const_iterator it = valuesForTagID.constBegin(); it != valuesForTagID.constEnd(); ++it)
+  {
+    if (!this->TagCacheTagNames.contains(it.key()))
+    {
+      // tag has been added by another database connection
+      this->loadTagCacheTagIDs();
+    }
+    QString tag = this->TagCacheTagNames.value(it.key());
+    if (tag.isEmpty())
+    {
+      continue;
+    }
+    QString value = it.value();
+    if (value == TagNotInInstance || value == ValueIsEmptyString || value == ValueIsNotStored)
+    {
+      value = QString("");
+    }
+    cachedTags.insert(tag, value);
+  }
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMDatabasePrivate::writeTagCacheValues(const QHash<QString, QHash<QString, QString> >& valuesForTagForInstance)
+{
+  if (valuesForTagForInstance.isEmpty())
+  {
+    return true;
+  }
+
+  // Merge new values into existing records
+  QHash<QString, QHash<int, QString> > valuesForTagIDForInstance;
+  bool success = this->readTagCacheRecords(valuesForTagForInstance.keys(), valuesForTagIDForInstance);
+  for (QHash<QString, QHash<QString, QString> >::const_iterator instanceIt = valuesForTagForInstance.constBegin();
+    instanceIt != valuesForTagForInstance.constEnd(); ++instanceIt)
+  {
+    QHash<int, QString>& valuesForTagID = valuesForTagIDForInstance[instanceIt.key()];
+    for (QHash<QString, QString>::const_iterator tagIt = instanceIt.value().constBegin(); tagIt != instanceIt.value().constEnd(); ++tagIt)
+    {
+      int tagID = this->tagCacheTagID(tagIt.key(), true);
+      if (tagID < 0)
+      {
+        logger.error("Failed to add tag " + tagIt.key() + " to tag cache");
+        success = false;
+        continue;
+      }
+      // replace empty strings with special flag string
+      valuesForTagID.insert(tagID, tagIt.value().isEmpty() ? TagNotInInstance : tagIt.value());
+    }
+  }
+
+  QVariantList values;
+  for (QHash<QString, QHash<int, QString> >::const_iterator it = valuesForTagIDForInstance.constBegin();
+    it != valuesForTagIDForInstance.constEnd(); ++it)
+  {
+    values << it.key() << packTagValues(it.value());
+  }
+  if (!this->insertRows(this->TagCacheDatabase, "INSERT OR REPLACE INTO TagCacheInstances VALUES ", 2, values))
+  {
+    success = false;
+  }
+  return success;
+}
+
+//------------------------------------------------------------------------------
+QString ctkDICOMDatabasePrivate::tagCacheValueFromDataset(const ctkDICOMItem& dataset, const QString& tag)
+{
+  Q_Q(ctkDICOMDatabase);
+  unsigned short group, element;
+  q->tagToGroupElement(tag, group, element);
+  DcmTagKey tagKey(group, element);
+  if (this->TagsToExcludeFromStorage.contains(tag))
+  {
+    return dataset.TagExists(tagKey) ? ValueIsNotStored : TagNotInInstance;
+  }
+  QString value = dataset.GetAllElementValuesAsString(tagKey);
+  return value.isEmpty() ? TagNotInInstance : value;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMDatabasePrivate::applyJournalMode(QSqlDatabase& database)
+{
+  if (!database.isOpen() || this->DatabaseFileName == ":memory:")
+  {
+    // in-memory databases do not support WAL mode
+    return;
+  }
+  QSqlQuery journalModeQuery(database);
+  if (this->WALModeEnabled)
+  {
+    this->loggedExec(journalModeQuery, "PRAGMA journal_mode = WAL");
+    journalModeQuery.finish();
+    this->loggedExec(journalModeQuery, QString("PRAGMA wal_autocheckpoint = %1").arg(this->WALAutoCheckpoint));
+  }
+  else
+  {
+    // Journal mode is stored in the database file, so it has to be reset if WAL mode was enabled earlier
+    if (this->loggedExec(journalModeQuery, "PRAGMA journal_mode")
+      && journalModeQuery.next()
+      && journalModeQuery.value(0).toString().toLower() == "wal")
+    {
+      journalModeQuery.finish();
+      this->loggedExec(journalModeQuery, "PRAGMA journal_mode = DELETE");
+    }
+  }
+  journalModeQuery.finish();
+}
+
+//------------------------------------------------------------------------------
+QStringList ctkDICOMDatabasePrivate::searchIndexFields(const QString& table)
+{
+  QStringList candidateFields;
+  if (table == "Patients")
+  {
+    candidateFields << "PatientsName" << "PatientID" << "PatientsBirthDate" << "PatientsSex"
+      << "PatientsAge" << "PatientsComments" << "DisplayedPatientsName";
+  }
+  else if (table == "Studies")
+  {
+    candidateFields << "StudyInstanceUID" << "StudyID" << "StudyDate" << "StudyTime" << "StudyDescription"
+      << "AccessionNumber" << "ModalitiesInStudy" << "InstitutionName" << "ReferringPhysician"
+      << "PerformingPhysiciansName";
+  }
+  else if (table == "Series")
+  {
+    candidateFields << "SeriesInstanceUID" << "SeriesNumber" << "SeriesDate" << "SeriesTime"
+      << "SeriesDescription" << "Modality" << "BodyPartExamined" << "ContrastAgent" << "ScanningSequence";
+  }
+  // Older schemas may not contain all the fields
+  QSqlRecord tableRecord = this->Database.record(table);
+  QStringList fields;
+  foreach(const QString& field, candidateFields)
+  {
+    if (tableRecord.indexOf(field) >= 0)
+    {
+      fields << field;
+    }
+  }
+  return fields;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMDatabasePrivate::initializeSearchIndex(bool rebuild)
+{
+  this->SearchIndexTables.clear();
+  if (!this->Database.isOpen())
+  {
+    return;
+  }
+  QStringList tables = this->Database.tables();
+  foreach(const QString& table, QStringList() << "Patients" << "Studies" << "Series")
+  {
+    QStringList fields = this->searchIndexFields(table);
+    if (!tables.contains(table) || fields.isEmpty())
+    {
+      continue;
+    }
+    QString indexTable = table + "SearchIndex";
+    QString insertTrigger = indexTable + "Insert";
+    QString updateTrigger = indexTable + "Update";
+    QString deleteTrigger = indexTable + "Delete";
+
+    // Triggers are removed when the table is dropped (for example, when the schema is updated),
+    // therefore the index is only valid if all the triggers exist.
+    QSqlQuery query(this->Database);
+    query.prepare("SELECT COUNT(*) FROM sqlite_master WHERE type = 'trigger' AND name IN (?, ?, ?)");
+    query.addBindValue(insertTrigger);
+    query.addBindValue(updateTrigger);
+    query.addBindValue(deleteTrigger);
+    bool indexValid = tables.contains(indexTable) && this->loggedExec(query) && query.next() && query.value(0).toInt() == 3;
+    query.finish();
+    if (indexValid && !rebuild)
+    {
+      this->SearchIndexTables << table;
+      continue;
+    }
+
+    if (!tables.contains(indexTable))
+    {
+      // Use full-text search table with trigram tokenizer (SQLite 3.34 or later), which speeds up
+      // substring search with LIKE operator. If not supported by the SQLite library
+      // then use a regular table (LIKE performs a full table scan, without loading rows into the application).
+      if (!query.exec(QString("CREATE VIRTUAL TABLE %1 USING fts5(SearchText, tokenize = 'trigram')").arg(indexTable)))
+      {
+        logger.debug("Full-text search with trigram tokenizer is not available, using regular table for search index");
+        if (!this->loggedExec(query, QString("CREATE TABLE %1 (SearchText TEXT)").arg(indexTable)))
+        {
+          continue;
+        }
+      }
+      query.finish();
+    }
+
+    QStringList newValues;
+    QStringList currentValues;
+    foreach(const QString& field, fields)
+    {
+      newValues << QString("coalesce(new.%1, '')").arg(field);
+      currentValues << QString("coalesce(%1, '')").arg(field);
+    }
+    // Rows of the index have the same rowid as the indexed rows
+    QString newSearchText = newValues.join(" || char(10) || ");
+    QString currentSearchText = currentValues.join(" || char(10) || ");
+    bool success = true;
+    foreach(const QString& trigger, QStringList() << insertTrigger << updateTrigger << deleteTrigger)
+    {
+      success = success && this->loggedExec(query, QString("DROP TRIGGER IF EXISTS %1").arg(trigger));
+    }
+    success = success && this->loggedExec(query, QString(
+      "CREATE TRIGGER %1 AFTER INSERT ON %2 BEGIN "
+      "INSERT INTO %3 (rowid, SearchText) VALUES (new.rowid, %4); END")
+      .arg(insertTrigger).arg(table).arg(indexTable).arg(newSearchText));
+    success = success && this->loggedExec(query, QString(
+      "CREATE TRIGGER %1 AFTER UPDATE OF %2 ON %3 BEGIN "
+      "DELETE FROM %4 WHERE rowid = old.rowid; "
+      "INSERT INTO %4 (rowid, SearchText) VALUES (new.rowid, %5); END")
+      .arg(updateTrigger).arg(fields.join(", ")).arg(table).arg(indexTable).arg(newSearchText));
+    success = success && this->loggedExec(query, QString(
+      "CREATE TRIGGER %1 AFTER DELETE ON %2 BEGIN "
+      "DELETE FROM %3 WHERE rowid = old.rowid; END")
+      .arg(deleteTrigger).arg(table).arg(indexTable));
+    success = success && this->loggedExec(query, QString("DELETE FROM %1").arg(indexTable));
+    success = success && this->loggedExec(query, QString(
+      "INSERT INTO %1 (rowid, SearchText) SELECT rowid, %2 FROM %3")
+      .arg(indexTable).arg(currentSearchText).arg(table));
+    query.finish();
+    if (success)
+    {
+      this->SearchIndexTables << table;
+    }
+    else
+    {
+      logger.error("Failed to create search index for table " + table);
+    }
+  }
+}
+
 //------------------------------------------------------------------------------
 int ctkDICOMDatabasePrivate::rowCount(const QString& tableName)
 {
@@ -402,31 +1190,35 @@ QString ctkDICOMDatabasePrivate::compositePatientID(const QString& patientID, co
 }
 
 //------------------------------------------------------------------------------
-bool ctkDICOMDatabasePrivate::insertPatient(const ctkDICOMItem& dataset, int& dbPatientID)
+bool ctkDICOMDatabasePrivate::insertPatient(const ctkDICOMHeaderRecord& header, int& dbPatientID)
 {
   dbPatientID = -1;
 
   // Check if patient is already present in the db
 
   QString patientsName, patientID, studyInstanceUID, seriesInstanceUID;
-  if (!this->uidsForDataSet(dataset, patientsName, patientID, studyInstanceUID, seriesInstanceUID))
+  if (!this->uidsForDataSet(header, patientsName, patientID, studyInstanceUID, seriesInstanceUID))
   {
     // error occurred, message is already logged
     return false;
   }
-  QString patientsBirthDate(dataset.GetElementAsString(DCM_PatientBirthDate));
+  QString patientsBirthDate(header.GetElementAsString(DCM_PatientBirthDate));
 
-  QSqlQuery checkPatientExistsQuery(this->Database);
-  checkPatientExistsQuery.prepare("SELECT * FROM Patients WHERE PatientID = ? AND PatientsName = ?");
+  QSqlQuery checkPatientExistsQuery = this->cachedQuery(this->Database, "SELECT UID FROM Patients WHERE PatientID = ? AND PatientsName = ?");
   checkPatientExistsQuery.bindValue(0, patientID);
   checkPatientExistsQuery.bindValue(1, patientsName);
   loggedExec(checkPatientExistsQuery);
 
   QString compositeID = this->compositePatientID(patientID, patientsName, patientsBirthDate);
+  if (this->InsertedPatientsCompositeIDCache.size() >= INSERTED_UIDS_CACHE_MAXIMUM_SIZE)
+  {
+    this->InsertedPatientsCompositeIDCache.clear();
+  }
   if (checkPatientExistsQuery.next())
   {
     // we found him
-    dbPatientID = checkPatientExistsQuery.value(checkPatientExistsQuery.record().indexOf("UID")).toInt();
+    dbPatientID = checkPatientExistsQuery.value(0).toInt();
+    checkPatientExistsQuery.finish();
     if (this->LoggedExecVerbose)
     {
       qDebug() << "Found patient in the database as UId: " << dbPatientID;
@@ -441,14 +1233,14 @@ bool ctkDICOMDatabasePrivate::insertPatient(const ctkDICOMItem& dataset, int& db
   }
   else
   {
+    checkPatientExistsQuery.finish();
     // Insert it
-    QString patientsBirthTime(dataset.GetElementAsString(DCM_PatientBirthTime));
-    QString patientsSex(dataset.GetElementAsString(DCM_PatientSex));
-    QString patientsAge(dataset.GetElementAsString(DCM_PatientAge));
-    QString patientComments(dataset.GetElementAsString(DCM_PatientComments));
+    QString patientsBirthTime(header.GetElementAsString(DCM_PatientBirthTime));
+    QString patientsSex(header.GetElementAsString(DCM_PatientSex));
+    QString patientsAge(header.GetElementAsString(DCM_PatientAge));
+    QString patientComments(header.GetElementAsString(DCM_PatientComments));
 
-    QSqlQuery insertPatientStatement(this->Database);
-    insertPatientStatement.prepare("INSERT INTO Patients "
+    QSqlQuery insertPatientStatement = this->cachedQuery(this->Database, "INSERT INTO Patients "
       "( 'UID', 'PatientsName', 'PatientID', 'PatientsBirthDate', 'PatientsBirthTime', 'PatientsSex', 'PatientsAge', 'PatientsComments', "
       "'InsertTimestamp', 'DisplayedPatientsName', 'DisplayedNumberOfStudies', 'DisplayedFieldsUpdatedTimestamp' ) "
       "VALUES ( NULL, ?, ?, ?, ?, ?, ?, ?, ?, NULL, NULL, NULL )");
@@ -460,10 +1252,12 @@ bool ctkDICOMDatabasePrivate::insertPatient(const ctkDICOMItem& dataset, int& db
     // TODO: shift patient's age to study,
     // since this is not a patient level attribute in images
     // insertPatientStatement.bindValue( 5, patientsAge );
+    insertPatientStatement.bindValue(5, QVariant(QVariant::String));
     insertPatientStatement.bindValue(6, patientComments);
     insertPatientStatement.bindValue(7, QDateTime::currentDateTime());
     loggedExec(insertPatientStatement);
     dbPatientID = insertPatientStatement.lastInsertId().toInt();
+    insertPatientStatement.finish();
     this->InsertedPatientsCompositeIDCache[compositeID] = dbPatientID;
     if (this->LoggedExecVerbose)
     {
@@ -474,47 +1268,51 @@ bool ctkDICOMDatabasePrivate::insertPatient(const ctkDICOMItem& dataset, int& db
 }
 
 //------------------------------------------------------------------------------
-bool ctkDICOMDatabasePrivate::insertStudy(const ctkDICOMItem& dataset, int dbPatientID)
+bool ctkDICOMDatabasePrivate::insertStudy(const ctkDICOMHeaderRecord& header, int dbPatientID)
 {
-  QString studyInstanceUID(dataset.GetElementAsString(DCM_StudyInstanceUID) );
-  QSqlQuery checkStudyExistsQuery(this->Database);
-  checkStudyExistsQuery.prepare( "SELECT * FROM Studies WHERE StudyInstanceUID = ?" );
+  QString studyInstanceUID(header.GetElementAsString(DCM_StudyInstanceUID) );
+  QSqlQuery checkStudyExistsQuery = this->cachedQuery(this->Database, "SELECT 1 FROM Studies WHERE StudyInstanceUID = ?");
   checkStudyExistsQuery.bindValue( 0, studyInstanceUID );
   checkStudyExistsQuery.exec();
-  if (!checkStudyExistsQuery.next())
+  bool studyExists = checkStudyExistsQuery.next();
+  checkStudyExistsQuery.finish();
+  if (this->InsertedStudyUIDsCache.size() >= INSERTED_UIDS_CACHE_MAXIMUM_SIZE)
+  {
+    this->InsertedStudyUIDsCache.clear();
+  }
+  if (!studyExists)
   {
     if (this->LoggedExecVerbose)
     {
       qDebug() << "Need to insert new study: " << studyInstanceUID;
     }
 
-    QString studyID(dataset.GetElementAsString(DCM_StudyID) );
-    QString studyDate(dataset.GetElementAsString(DCM_StudyDate) );
-    QString studyTime(dataset.GetElementAsString(DCM_StudyTime) );
-    QString accessionNumber(dataset.GetElementAsString(DCM_AccessionNumber) );
-    QString modalitiesInStudy(dataset.GetElementAsString(DCM_ModalitiesInStudy) );
-    QString institutionName(dataset.GetElementAsString(DCM_InstitutionName) );
-    QString performingPhysiciansName(dataset.GetElementAsString(DCM_PerformingPhysicianName) );
-    QString referringPhysician(dataset.GetElementAsString(DCM_ReferringPhysicianName) );
-    QString studyDescription(dataset.GetElementAsString(DCM_StudyDescription) );
-
-    QSqlQuery insertStudyStatement(this->Database);
-    insertStudyStatement.prepare( "INSERT INTO Studies "
+    QString studyID(header.GetElementAsString(DCM_StudyID) );
+    QString studyDate(header.GetElementAsString(DCM_StudyDate) );
+    QString studyTime(header.GetElementAsString(DCM_StudyTime) );
+    QString accessionNumber(header.GetElementAsString(DCM_AccessionNumber) );
+    QString modalitiesInStudy(header.GetElementAsString(DCM_ModalitiesInStudy) );
+    QString institutionName(header.GetElementAsString(DCM_InstitutionName) );
+    QString performingPhysiciansName(header.GetElementAsString(DCM_PerformingPhysicianName) );
+    QString referringPhysician(header.GetElementAsString(DCM_ReferringPhysicianName) );
+    QString studyDescription(header.GetElementAsString(DCM_StudyDescription) );
+
+    QSqlQuery insertStudyStatement = this->cachedQuery(this->Database, "INSERT INTO Studies "
       "( 'StudyInstanceUID', 'PatientsUID', 'StudyID', 'StudyDate', 'StudyTime', 'AccessionNumber', 'ModalitiesInStudy', 'InstitutionName', 'ReferringPhysician', 'PerformingPhysiciansName', "
         "'StudyDescription', 'InsertTimestamp', 'DisplayedNumberOfSeries', 'DisplayedFieldsUpdatedTimestamp' ) "
       "VALUES ( ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, NULL, NULL )" );
-    insertStudyStatement.addBindValue( studyInstanceUID );
-    insertStudyStatement.addBindValue( dbPatientID );
-    insertStudyStatement.addBindValue( studyID );
-    insertStudyStatement.addBindValue( QDate::fromString ( studyDate, "yyyyMMdd" ) );
-    insertStudyStatement.addBindValue( studyTime );
-    insertStudyStatement.addBindValue( accessionNumber );
-    insertStudyStatement.addBindValue( modalitiesInStudy );
-    insertStudyStatement.addBindValue( institutionName );
-    insertStudyStatement.addBindValue( referringPhysician );
-    insertStudyStatement.addBindValue( performingPhysiciansName );
-    insertStudyStatement.addBindValue( studyDescription );
-    insertStudyStatement.addBindValue( QDateTime::currentDateTime() );
+    insertStudyStatement.bindValue( 0, studyInstanceUID );
+    insertStudyStatement.bindValue( 1, dbPatientID );
+    insertStudyStatement.bindValue( 2, studyID );
+    insertStudyStatement.bindValue( 3, QDate::fromString ( studyDate, "yyyyMMdd" ) );
+    insertStudyStatement.bindValue( 4, studyTime );
+    insertStudyStatement.bindValue( 5, accessionNumber );
+    insertStudyStatement.bindValue( 6, modalitiesInStudy );
+    insertStudyStatement.bindValue( 7, institutionName );
+    insertStudyStatement.bindValue( 8, referringPhysician );
+    insertStudyStatement.bindValue( 9, performingPhysiciansName );
+    insertStudyStatement.bindValue( 10, studyDescription );
+    insertStudyStatement.bindValue( 11, QDateTime::currentDateTime() );
     if (!insertStudyStatement.exec())
     {
       logger.error( "Error executing statement: " + insertStudyStatement.lastQuery() + " Error: " + insertStudyStatement.lastError().text() );
@@ -523,6 +1321,7 @@ bool ctkDICOMDatabasePrivate::insertStudy(const ctkDICOMItem& dataset, int dbPat
     {
       this->InsertedStudyUIDsCache.insert(studyInstanceUID);
     }
+    insertStudyStatement.finish();
 
     return true;
   }
@@ -538,57 +1337,61 @@ bool ctkDICOMDatabasePrivate::insertStudy(const ctkDICOMItem& dataset, int dbPat
 }
 
 //------------------------------------------------------------------------------
-bool ctkDICOMDatabasePrivate::insertSeries(const ctkDICOMItem& dataset, QString studyInstanceUID)
+bool ctkDICOMDatabasePrivate::insertSeries(const ctkDICOMHeaderRecord& header, QString studyInstanceUID)
 {
-  QString seriesInstanceUID(dataset.GetElementAsString(DCM_SeriesInstanceUID) );
-  QSqlQuery checkSeriesExistsQuery(this->Database);
-  checkSeriesExistsQuery.prepare( "SELECT * FROM Series WHERE SeriesInstanceUID = ?" );
+  QString seriesInstanceUID(header.GetElementAsString(DCM_SeriesInstanceUID) );
+  QSqlQuery checkSeriesExistsQuery = this->cachedQuery(this->Database, "SELECT 1 FROM Series WHERE SeriesInstanceUID = ?");
   checkSeriesExistsQuery.bindValue( 0, seriesInstanceUID );
   if (this->LoggedExecVerbose)
   {
     logger.warn( "Statement: " + checkSeriesExistsQuery.lastQuery() );
   }
   checkSeriesExistsQuery.exec();
-  if (!checkSeriesExistsQuery.next())
+  bool seriesExists = checkSeriesExistsQuery.next();
+  checkSeriesExistsQuery.finish();
+  if (this->InsertedSeriesUIDsCache.size() >= INSERTED_UIDS_CACHE_MAXIMUM_SIZE)
+  {
+    this->InsertedSeriesUIDsCache.clear();
+  }
+  if (!seriesExists)
   {
     if (this->LoggedExecVerbose)
     {
       qDebug() << "Need to insert new series: " << seriesInstanceUID;
     }
 
-    QString seriesDate(dataset.GetElementAsString(DCM_SeriesDate) );
-    QString seriesTime(dataset.GetElementAsString(DCM_SeriesTime) );
-    QString seriesDescription(dataset.GetElementAsString(DCM_SeriesDescription) );
-    QString modality(dataset.GetElementAsString(DCM_Modality) );
-    QString bodyPartExamined(dataset.GetElementAsString(DCM_BodyPartExamined) );
-    QString frameOfReferenceUID(dataset.GetElementAsString(DCM_FrameOfReferenceUID) );
-    QString contrastAgent(dataset.GetElementAsString(DCM_ContrastBolusAgent) );
-    QString scanningSequence(dataset.GetElementAsString(DCM_ScanningSequence) );
-    long seriesNumber(dataset.GetElementAsInteger(DCM_SeriesNumber) );
-    long acquisitionNumber(dataset.GetElementAsInteger(DCM_AcquisitionNumber) );
-    long echoNumber(dataset.GetElementAsInteger(DCM_EchoNumbers) );
-    long temporalPosition(dataset.GetElementAsInteger(DCM_TemporalPositionIdentifier) );
-
-    QSqlQuery insertSeriesStatement(this->Database);
-    insertSeriesStatement.prepare( "INSERT INTO Series "
+    QString seriesDate(header.GetElementAsString(DCM_SeriesDate) );
+    QString seriesTime(header.GetElementAsString(DCM_SeriesTime) );
+    QString seriesDescription(header.GetElementAsString(DCM_SeriesDescription) );
+    QString modality(header.GetElementAsString(DCM_Modality) );
+    QString bodyPartExamined(header.GetElementAsString(DCM_BodyPartExamined) );
+    QString frameOfReferenceUID(header.GetElementAsString(DCM_FrameOfReferenceUID) );
+    QString contrastAgent(header.GetElementAsString(DCM_ContrastBolusAgent) );
+    QString scanningSequence(header.GetElementAsString(DCM_ScanningSequence) );
+    long seriesNumber(header.GetElementAsInteger(DCM_SeriesNumber) );
+    long acquisitionNumber(header.GetElementAsInteger(DCM_AcquisitionNumber) );
+    long echoNumber(header.GetElementAsInteger(DCM_EchoNumbers) );
+    long temporalPosition(header.GetElementAsInteger(DCM_TemporalPositionIdentifier) );
+
+    QSqlQuery insertSeriesStatement = this->cachedQuery(this->Database, "INSERT INTO Series "
       "( 'SeriesInstanceUID', 'StudyInstanceUID', 'SeriesNumber', 'SeriesDate', 'SeriesTime', 'SeriesDescription', 'Modality', 'BodyPartExamined', "
         "'FrameOfReferenceUID', 'AcquisitionNumber', 'ContrastAgent', 'ScanningSequence', 'EchoNumber', 'TemporalPosition', 'InsertTimestamp' ) "
       "VALUES ( ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ? )" );
-    insertSeriesStatement.addBindValue( seriesInstanceUID );
-    insertSeriesStatement.addBindValue( studyInstanceUID );
-    insertSeriesStatement.addBindValue( static_cast<int>(seriesNumber) );
-    insertSeriesStatement.addBindValue( QDate::fromString ( seriesDate, "yyyyMMdd" ) );
-    insertSeriesStatement.addBindValue( seriesTime );
-    insertSeriesStatement.addBindValue( seriesDescription );
-    insertSeriesStatement.addBindValue( modality );
-    insertSeriesStatement.addBindValue( bodyPartExamined );
-    insertSeriesStatement.addBindValue( frameOfReferenceUID );
-    insertSeriesStatement.addBindValue( static_cast<int>(acquisitionNumber) );
-    insertSeriesStatement.addBindValue( contrastAgent );
-    insertSeriesStatement.addBindValue( scanningSequence );
-    insertSeriesStatement.addBindValue( static_cast<int>(echoNumber) );
-    insertSeriesStatement.addBindValue( static_cast<int>(temporalPosition) );
-    insertSeriesStatement.addBindValue( QDateTime::currentDateTime() );
+    insertSeriesStatement.bindValue( 0, seriesInstanceUID );
+    insertSeriesStatement.bindValue( 1, studyInstanceUID );
+    insertSeriesStatement.bindValue( 2, static_cast<int>(seriesNumber) );
+    insertSeriesStatement.bindValue( 3, QDate::fromString ( seriesDate, "yyyyMMdd" ) );
+    insertSeriesStatement.bindValue( 4, seriesTime );
+    insertSeriesStatement.bindValue( 5, seriesDescription );
+    insertSeriesStatement.bindValue( 6, modality );
+    insertSeriesStatement.bindValue( 7, bodyPartExamined );
+    insertSeriesStatement.bindValue( 8, frameOfReferenceUID );
+    insertSeriesStatement.bindValue( 9, static_cast<int>(acquisitionNumber) );
+    insertSeriesStatement.bindValue( 10, contrastAgent );
+    insertSeriesStatement.bindValue( 11, scanningSequence );
+    insertSeriesStatement.bindValue( 12, static_cast<int>(echoNumber) );
+    insertSeriesStatement.bindValue( 13, static_cast<int>(temporalPosition) );
+    insertSeriesStatement.bindValue( 14, QDateTime::currentDateTime() );
     if ( !insertSeriesStatement.exec() )
     {
       logger.error( "Error executing statement: "
@@ -599,6 +1402,7 @@ bool ctkDICOMDatabasePrivate::insertSeries(const ctkDICOMItem& dataset, QString
     {
       this->InsertedSeriesUIDsCache.insert(seriesInstanceUID);
     }
+    insertSeriesStatement.finish();
 
     return true;
   }
@@ -621,6 +1425,9 @@ bool ctkDICOMDatabasePrivate::openTagCacheDatabase()
   {
     return true;
   }
+  this->clearCachedQueries();
+  this->TagCacheTagIDs.clear();
+  this->TagCacheTagNames.clear();
   this->TagCacheDatabase = QSqlDatabase::addDatabase(
         "QSQLITE", this->Database.connectionName() + "TagCache");
   this->TagCacheDatabase.setDatabaseName(this->TagCacheDatabaseFilename);
@@ -636,11 +1443,13 @@ bool ctkDICOMDatabasePrivate::openTagCacheDatabase()
   pragmaSyncQuery.exec("PRAGMA synchronous = OFF");
   pragmaSyncQuery.finish();
 
+  this->applyJournalMode(this->TagCacheDatabase);
+
   return true;
 }
 
 //------------------------------------------------------------------------------
-void ctkDICOMDatabasePrivate::precacheTags(const ctkDICOMItem& dataset, const QString sopInstanceUID)
+void ctkDICOMDatabasePrivate::precacheTags(const ctkDICOMHeaderRecord& header, const QString sopInstanceUID)
 {
   Q_Q(ctkDICOMDatabase);
 
@@ -650,10 +1459,15 @@ void ctkDICOMDatabasePrivate::precacheTags(const ctkDICOMItem& dataset, const QS
     unsigned short group, element;
     q->tagToGroupElement(tag, group, element);
     DcmTagKey tagKey(group, element);
+    if (!header.IsTagParsed(tagKey))
+    {
+      // Element was not read (header-only parsing), its value is cached when first requested
+      continue;
+    }
     QString value;
     if (this->TagsToExcludeFromStorage.contains(tag))
     {
-      if (dataset.TagExists(tagKey))
+      if (header.TagExists(tagKey))
       {
         value = ValueIsNotStored;
       }
@@ -664,7 +1478,7 @@ void ctkDICOMDatabasePrivate::precacheTags(const ctkDICOMItem& dataset, const QS
     }
     else
     {
-      value = dataset.GetAllElementValuesAsString(tagKey);
+      value = header.GetAllElementValuesAsString(tagKey);
     }
     sopInstanceUIDs << sopInstanceUID;
     tags << tag;
@@ -680,21 +1494,42 @@ void ctkDICOMDatabasePrivate::precacheTags(const ctkDICOMItem& dataset, const QS
 bool ctkDICOMDatabasePrivate::removeImage(const QString& sopInstanceUID)
 {
   Q_Q(ctkDICOMDatabase);
-  QSqlQuery deleteFile(Database);
-  deleteFile.prepare("DELETE FROM Images WHERE SOPInstanceUID == :sopInstanceUID");
-  deleteFile.bindValue(":sopInstanceUID", sopInstanceUID);
+  // The directory of the removed file is no longer up-to-date in the database
+  QStringList modifiedDirectories;
+  QSqlQuery fileQuery = this->cachedQuery(this->Database, "SELECT Filename FROM Images WHERE SOPInstanceUID == ?");
+  fileQuery.bindValue(0, sopInstanceUID);
+  if (this->loggedExec(fileQuery))
+  {
+    while (fileQuery.next())
+    {
+      QString directory = QFileInfo(fileQuery.value(0).toString()).path();
+      if (!modifiedDirectories.contains(directory))
+      {
+        modifiedDirectories << directory;
+      }
+    }
+  }
+  fileQuery.finish();
+
+  QSqlQuery deleteFile = this->cachedQuery(this->Database, "DELETE FROM Images WHERE SOPInstanceUID == ?");
+  deleteFile.bindValue(0, sopInstanceUID);
   bool success = deleteFile.exec();
   if (!success)
   {
     logger.error("SQLITE ERROR deleting old image row: " + deleteFile.lastError().driverText());
   }
+  deleteFile.finish();
+  if (success)
+  {
+    q->removeDirectoryFingerprints(modifiedDirectories);
+  }
   return success;
 }
 
 //------------------------------------------------------------------------------
-bool ctkDICOMDatabasePrivate::storeDatasetFile(const ctkDICOMItem& dataset, const QString& originalFilePath,
+bool ctkDICOMDatabasePrivate::storeDatasetFile(const ctkDICOMItem* dataset, const QString& originalFilePath,
   const QString& studyInstanceUID, const QString& seriesInstanceUID, const QString& sopInstanceUID,
-  QString& storedFilePath)
+  QString& storedFilePath, bool storeInBackground)
 {
   Q_Q(ctkDICOMDatabase);
 
@@ -719,7 +1554,7 @@ bool ctkDICOMDatabasePrivate::storeDatasetFile(const ctkDICOMItem& dataset, cons
     {
       logger.debug("Saving file: " + storedFilePath);
     }
-    if (!dataset.SaveToFile(storedFilePath))
+    if (!dataset || !dataset->SaveToFile(storedFilePath))
     {
       logger.error("Error saving file: " + storedFilePath);
       return false;
@@ -728,17 +1563,93 @@ bool ctkDICOMDatabasePrivate::storeDatasetFile(const ctkDICOMItem& dataset, cons
   else
   {
     // we're inserting an existing file
-    QFile currentFile(originalFilePath);
-    currentFile.copy(storedFilePath);
     if (this->LoggedExecVerbose)
     {
-      logger.debug("Copy file from: " + originalFilePath + " to: " + storedFilePath);
+      logger.debug("Store file from: " + originalFilePath + " to: " + storedFilePath);
+    }
+    if (storeInBackground)
+    {
+      this->StorageThreadPool.start(new ctkDICOMDatabaseStoreFileWorker(
+        this, originalFilePath, storedFilePath, sopInstanceUID, this->StorageMode));
+    }
+    else if (!storeFile(originalFilePath, storedFilePath, this->StorageMode))
+    {
+      logger.error("Error storing file: " + originalFilePath + " to: " + storedFilePath);
+      return false;
     }
   }
 
   return true;
 }
 
+//------------------------------------------------------------------------------
+bool ctkDICOMDatabasePrivate::storeFile(const QString& originalFilePath, const QString& storedFilePath,
+  ctkDICOMDatabase::FileStorageMode mode)
+{
+  if (QFileInfo(originalFilePath).absoluteFilePath() == QFileInfo(storedFilePath).absoluteFilePath())
+  {
+    // the file is already in the database folder
+    return true;
+  }
+  if (QFile::exists(storedFilePath))
+  {
+    // Replace the previously stored file of the instance
+    QFile::remove(storedFilePath);
+  }
+  switch (mode)
+  {
+    case ctkDICOMDatabase::HardLinkFileStorage:
+      if (ctkDICOMDatabaseCreateHardLink(originalFilePath, storedFilePath))
+      {
+        return true;
+      }
+      break;
+    case ctkDICOMDatabase::ReflinkFileStorage:
+      if (ctkDICOMDatabaseCloneFile(originalFilePath, storedFilePath))
+      {
+        return true;
+      }
+      break;
+    case ctkDICOMDatabase::MoveFileStorage:
+      // If the files are on different volumes then the file is copied and the original is removed
+      return QFile::rename(originalFilePath, storedFilePath);
+    default:
+      break;
+  }
+  return QFile::copy(originalFilePath, storedFilePath);
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMDatabasePrivate::waitForStoredFiles()
+{
+  this->StorageThreadPool.waitForDone();
+  QSet<QString> failedSOPInstanceUIDs;
+  {
+    QMutexLocker locker(&this->FailedStoredSOPInstanceUIDsMutex);
+    failedSOPInstanceUIDs.swap(this->FailedStoredSOPInstanceUIDs);
+  }
+  if (failedSOPInstanceUIDs.isEmpty())
+  {
+    return;
+  }
+  this->DroppedSOPInstanceUIDs.unite(failedSOPInstanceUIDs);
+  // Instances are only added to the database if their file has been stored
+  QVariantList imagesValues;
+  for (int valueIndex = 0; valueIndex + 3 < this->PendingImagesValues.size(); valueIndex += 4)
+  {
+    QString sopInstanceUID = this->PendingImagesValues[valueIndex].toString();
+    if (failedSOPInstanceUIDs.contains(sopInstanceUID))
+    {
+      this->PendingImagesSOPInstanceUIDs.remove(sopInstanceUID);
+      this->PendingImagesFilenames.remove(this->PendingImagesValues[valueIndex + 1].toString());
+      this->PendingTagCacheValues.remove(sopInstanceUID);
+      continue;
+    }
+    imagesValues << this->PendingImagesValues.mid(valueIndex, 4);
+  }
+  this->PendingImagesValues = imagesValues;
+}
+
 //------------------------------------------------------------------------------
 bool ctkDICOMDatabasePrivate::indexingStatusForFile(const QString& filePath, const QString& sopInstanceUID,
   bool& datasetInDatabase, bool& datasetUpToDate, QString& databaseFilename)
@@ -747,9 +1658,8 @@ bool ctkDICOMDatabasePrivate::indexingStatusForFile(const QString& filePath, con
   datasetInDatabase = false;
   datasetUpToDate = false;
 
-  QSqlQuery fileExistsQuery(Database);
-  fileExistsQuery.prepare("SELECT InsertTimestamp,Filename FROM Images WHERE SOPInstanceUID == :sopInstanceUID");
-  fileExistsQuery.bindValue(":sopInstanceUID", sopInstanceUID);
+  QSqlQuery fileExistsQuery = this->cachedQuery(this->Database, "SELECT InsertTimestamp,Filename FROM Images WHERE SOPInstanceUID == ?");
+  fileExistsQuery.bindValue(0, sopInstanceUID);
   bool success = fileExistsQuery.exec();
   if (!success)
   {
@@ -760,6 +1670,7 @@ bool ctkDICOMDatabasePrivate::indexingStatusForFile(const QString& filePath, con
   if (!foundSOPInstanceUID)
   {
     // this data set is not in the database yet
+    fileExistsQuery.finish();
     return true;
   }
 
@@ -768,8 +1679,9 @@ bool ctkDICOMDatabasePrivate::indexingStatusForFile(const QString& filePath, con
   // The SOP instance UID exists in the database. In theory, new SOP instance UID must be generated if
   // a file is modified, but some software may not respect this, so check if the file was modified.
   databaseFilename = fileExistsQuery.value(1).toString();
-  QDateTime fileLastModified(QFileInfo(databaseFilename).lastModified());
   QDateTime databaseInsertTimestamp(QDateTime::fromString(fileExistsQuery.value(0).toString(), Qt::ISODate));
+  fileExistsQuery.finish();
+  QDateTime fileLastModified(QFileInfo(databaseFilename).lastModified());
   // Compare QFileInfo objects instead of path strings to ensure equivalent file names
   // (such as same file name in uppercase/lowercase on Windows) are considered as equal.
   if (QFileInfo(databaseFilename) == QFileInfo(filePath) && fileLastModified < databaseInsertTimestamp)
@@ -782,7 +1694,7 @@ bool ctkDICOMDatabasePrivate::indexingStatusForFile(const QString& filePath, con
 }
 
 //------------------------------------------------------------------------------
-bool ctkDICOMDatabasePrivate::insertPatientStudySeries(const ctkDICOMItem& dataset,
+bool ctkDICOMDatabasePrivate::insertPatientStudySeries(const ctkDICOMHeaderRecord& header,
   const QString& patientID, const QString& patientsName)
 {
   Q_Q(ctkDICOMDatabase);
@@ -790,11 +1702,11 @@ bool ctkDICOMDatabasePrivate::insertPatientStudySeries(const ctkDICOMItem& datas
 
   // Insert new patient if needed
   // Generate composite patient ID
-  QString patientsBirthDate(dataset.GetElementAsString(DCM_PatientBirthDate));
+  QString patientsBirthDate(header.GetElementAsString(DCM_PatientBirthDate));
   QString compositePatientId = this->compositePatientID(patientID, patientsName, patientsBirthDate);
   // The dbPatientID  is a unique number within the database, generated by the sqlite autoincrement.
   // The patientID  is the (non-unique) DICOM patient id.
-  QMap<QString, int>::iterator dbPatientIDit = this->InsertedPatientsCompositeIDCache.find(compositePatientId);
+  QHash<QString, int>::iterator dbPatientIDit = this->InsertedPatientsCompositeIDCache.find(compositePatientId);
   int dbPatientID = -1;
   if (dbPatientIDit != this->InsertedPatientsCompositeIDCache.end())
   {
@@ -807,7 +1719,7 @@ bool ctkDICOMDatabasePrivate::insertPatientStudySeries(const ctkDICOMItem& datas
     {
       qDebug() << "Insert new patient if not already in database: " << patientID << " " << patientsName;
     }
-    if (this->insertPatient(dataset, dbPatientID))
+    if (this->insertPatient(header, dbPatientID))
     {
       databaseWasChanged = true;
       emit q->patientAdded(dbPatientID, patientID, patientsName, patientsBirthDate);
@@ -819,10 +1731,10 @@ bool ctkDICOMDatabasePrivate::insertPatientStudySeries(const ctkDICOMItem& datas
   }
 
   // Insert new study if needed
-  QString studyInstanceUID(dataset.GetElementAsString(DCM_StudyInstanceUID));
+  QString studyInstanceUID(header.GetElementAsString(DCM_StudyInstanceUID));
   if (!this->InsertedStudyUIDsCache.contains(studyInstanceUID))
   {
-    if (this->insertStudy(dataset, dbPatientID))
+    if (this->insertStudy(header, dbPatientID))
     {
       if (this->LoggedExecVerbose)
       {
@@ -834,10 +1746,10 @@ bool ctkDICOMDatabasePrivate::insertPatientStudySeries(const ctkDICOMItem& datas
     }
   }
 
-  QString seriesInstanceUID(dataset.GetElementAsString(DCM_SeriesInstanceUID));
+  QString seriesInstanceUID(header.GetElementAsString(DCM_SeriesInstanceUID));
   if (!seriesInstanceUID.isEmpty() && !this->InsertedSeriesUIDsCache.contains(seriesInstanceUID))
   {
-    if (this->insertSeries(dataset, studyInstanceUID))
+    if (this->insertSeries(header, studyInstanceUID))
     {
       if (this->LoggedExecVerbose)
       {
@@ -871,22 +1783,27 @@ bool ctkDICOMDatabasePrivate::storeThumbnailFile(const QString& originalFilePath
     // thumbnail already exists and up-to-date
     return true;
   }
+  QElapsedTimer thumbnailTimer;
+  thumbnailTimer.start();
   QDir(q->databaseDirectory() + "/thumbs/").mkpath(studySeriesDirectory);
-  DicomImage dcmImage(QDir::toNativeSeparators(originalFilePath).toUtf8());
-  return this->ThumbnailGenerator->generateThumbnail(&dcmImage, thumbnailPath);
+  // Only the first frame is rendered, partial access avoids loading all frames of multi-frame images
+  DicomImage dcmImage(QDir::toNativeSeparators(originalFilePath).toUtf8(), CIF_UsePartialAccessToPixelData, 0, 1);
+  bool success = this->ThumbnailGenerator->generateThumbnail(&dcmImage, thumbnailPath);
+  this->Metrics.addPhase(ctkDICOMDatabase::IndexingMetrics::ThumbnailPhase, 1, thumbnailTimer.nsecsElapsed());
+  return success;
 }
 
 
 //------------------------------------------------------------------------------
-bool ctkDICOMDatabasePrivate::uidsForDataSet(const ctkDICOMItem& dataset,
+bool ctkDICOMDatabasePrivate::uidsForDataSet(const ctkDICOMHeaderRecord& header,
   QString& patientsName, QString& patientID, QString& studyInstanceUID, QString& seriesInstanceUID)
 {
   Q_Q(ctkDICOMDatabase);
   // If the following fields can not be evaluated, cancel evaluation of the DICOM file
-  patientsName = dataset.GetElementAsString(DCM_PatientName);
-  patientID = dataset.GetElementAsString(DCM_PatientID);
-  studyInstanceUID = dataset.GetElementAsString(DCM_StudyInstanceUID);
-  seriesInstanceUID = dataset.GetElementAsString(DCM_SeriesInstanceUID);
+  patientsName = header.GetElementAsString(DCM_PatientName);
+  patientID = header.GetElementAsString(DCM_PatientID);
+  studyInstanceUID = header.GetElementAsString(DCM_StudyInstanceUID);
+  seriesInstanceUID = header.GetElementAsString(DCM_SeriesInstanceUID);
   return this->uidsForDataSet(patientsName, patientID, studyInstanceUID);
 }
 
@@ -917,6 +1834,12 @@ bool ctkDICOMDatabasePrivate::uidsForDataSet(QString& patientsName, QString& pat
   return true;
 }
 
+//------------------------------------------------------------------------------
+ctkDICOMHeaderRecord ctkDICOMDatabasePrivate::headerRecordForDataset(const ctkDICOMItem& dataset)
+{
+  return ctkDICOMHeaderRecord(dataset, this->TagsToPrecache, this->TagsToExcludeFromStorage);
+}
+
 //------------------------------------------------------------------------------
 void ctkDICOMDatabasePrivate::insert(const ctkDICOMItem& dataset, const QString& filePath, bool storeFile, bool generateThumbnail)
 {
@@ -925,7 +1848,8 @@ void ctkDICOMDatabasePrivate::insert(const ctkDICOMItem& dataset, const QString&
   // this is the method that all other insert signatures end up calling
   // after they have pre-parsed their arguments
 
-  QString sopInstanceUID(dataset.GetElementAsString(DCM_SOPInstanceUID));
+  ctkDICOMHeaderRecord header = this->headerRecordForDataset(dataset);
+  QString sopInstanceUID(header.GetElementAsString(DCM_SOPInstanceUID));
 
   // Check to see if the file has already been loaded
   if (this->LoggedExecVerbose)
@@ -959,7 +1883,7 @@ void ctkDICOMDatabasePrivate::insert(const ctkDICOMItem& dataset, const QString&
 
   // Verify that minimum required fields are present
   QString patientsName, patientID, studyInstanceUID, seriesInstanceUID;
-  if (!this->uidsForDataSet(dataset, patientsName, patientID, studyInstanceUID, seriesInstanceUID))
+  if (!this->uidsForDataSet(header, patientsName, patientID, studyInstanceUID, seriesInstanceUID))
   {
     // error occurred, message is already logged
     return;
@@ -969,37 +1893,39 @@ void ctkDICOMDatabasePrivate::insert(const ctkDICOMItem& dataset, const QString&
   QString storedFilePath = filePath;
   if (storeFile && !seriesInstanceUID.isEmpty() && !q->isInMemory())
   {
-    if (!this->storeDatasetFile(dataset, filePath, studyInstanceUID, seriesInstanceUID, sopInstanceUID, storedFilePath))
+    if (!this->storeDatasetFile(&dataset, filePath, studyInstanceUID, seriesInstanceUID, sopInstanceUID, storedFilePath))
     {
       logger.error("Error saving file: " + filePath);
       return;
     }
   }
 
-  bool databaseWasChanged = this->insertPatientStudySeries(dataset, patientID, patientsName);
+  bool databaseWasChanged = this->insertPatientStudySeries(header, patientID, patientsName);
 
   if (!storedFilePath.isEmpty() && !seriesInstanceUID.isEmpty())
   {
-    QSqlQuery checkImageExistsQuery(Database);
-    checkImageExistsQuery.prepare("SELECT * FROM Images WHERE Filename = ?");
-    checkImageExistsQuery.addBindValue(storedFilePath);
+    QSqlQuery checkImageExistsQuery = this->cachedQuery(this->Database, "SELECT 1 FROM Images WHERE Filename = ?");
+    checkImageExistsQuery.bindValue(0, storedFilePath);
     checkImageExistsQuery.exec();
     if (this->LoggedExecVerbose)
     {
       qDebug() << "Maybe add Instance";
     }
-    if (!checkImageExistsQuery.next())
+    bool imageExists = checkImageExistsQuery.next();
+    checkImageExistsQuery.finish();
+    if (!imageExists)
     {
-      QSqlQuery insertImageStatement(Database);
-      insertImageStatement.prepare("INSERT INTO Images ( 'SOPInstanceUID', 'Filename', 'SeriesInstanceUID', 'InsertTimestamp' ) VALUES ( ?, ?, ?, ? )");
-      insertImageStatement.addBindValue(sopInstanceUID);
-      insertImageStatement.addBindValue(storedFilePath);
-      insertImageStatement.addBindValue(seriesInstanceUID);
-      insertImageStatement.addBindValue(QDateTime::currentDateTime());
+      QSqlQuery insertImageStatement = this->cachedQuery(this->Database,
+        "INSERT INTO Images ( 'SOPInstanceUID', 'Filename', 'SeriesInstanceUID', 'InsertTimestamp' ) VALUES ( ?, ?, ?, ? )");
+      insertImageStatement.bindValue(0, sopInstanceUID);
+      insertImageStatement.bindValue(1, storedFilePath);
+      insertImageStatement.bindValue(2, seriesInstanceUID);
+      insertImageStatement.bindValue(3, QDateTime::currentDateTime());
       insertImageStatement.exec();
+      insertImageStatement.finish();
 
       // insert was needed, so cache any application-requested tags
-      this->precacheTags(dataset, sopInstanceUID);
+      this->precacheTags(header, sopInstanceUID);
 
       // let users of this class track when things happen
       emit q->instanceAdded(sopInstanceUID);
@@ -1025,19 +1951,51 @@ void ctkDICOMDatabase::insert(const QList<ctkDICOMDatabase::IndexingResult>& ind
 {
   Q_D(ctkDICOMDatabase);
   bool databaseWasChanged = false;
+  // instanceAdded is emitted after the rows are inserted and committed,
+  // so that slots can look up the added instances in the database
+  QStringList addedInstanceUIDs;
+  // Thumbnails are generated after the rows are inserted, when files stored in the background are available
+  // (stored file path, study, series, and instance UID of each thumbnail)
+  QList<QStringList> thumbnailRequests;
+
+  // Precache and thumbnail phases are measured separately, they are excluded from the insert time
+  QElapsedTimer insertTimer;
+  insertTimer.start();
+  qint64 nestedPhasesNanosecondsBefore = d->Metrics.nanoseconds[IndexingMetrics::PrecachePhase]
+    + d->Metrics.nanoseconds[IndexingMetrics::ThumbnailPhase];
+
+  // Patients, studies, and series may have been modified by other database connections
+  // since the last batch, therefore cached items are only used within a batch.
+  d->resetLastInsertedValues();
+  d->DroppedSOPInstanceUIDs.clear();
 
   d->TagCacheDatabase.transaction();
   d->Database.transaction();
 
   foreach(const ctkDICOMDatabase::IndexingResult & indexingResult, indexingResults)
   {
-    const ctkDICOMItem& dataset = *indexingResult.dataset.data();
+    ctkDICOMHeaderRecord header = indexingResult.header;
+    if (!header.IsInitialized() && indexingResult.dataset)
+    {
+      header = d->headerRecordForDataset(*indexingResult.dataset);
+    }
     QString filePath = indexingResult.filePath;
-    bool generateThumbnail = false; // thumbnail will be generated when needed, don't slow down import with that
+    if (!header.IsInitialized())
+    {
+      logger.error("Failed to insert file into database (no dataset): " + filePath);
+      continue;
+    }
+    bool generateThumbnail = indexingResult.generateThumbnail;
     bool storeFile = indexingResult.copyFile;
 
     // Check to see if the file has already been loaded
-    QString sopInstanceUID(dataset.GetElementAsString(DCM_SOPInstanceUID));
+    QString sopInstanceUID(header.GetElementAsString(DCM_SOPInstanceUID));
+    if (d->PendingImagesSOPInstanceUIDs.contains(sopInstanceUID))
+    {
+      // The same instance is already in this batch, insert pending rows
+      // so that the instance is found in the database.
+      d->flushPendingRows();
+    }
     bool datasetInDatabase = false;
     bool datasetUpToDate = false;
     if (indexingResult.overwriteExistingDataset)
@@ -1074,7 +2032,7 @@ void ctkDICOMDatabase::insert(const QList<ctkDICOMDatabase::IndexingResult>& ind
 
     // Verify that minimum required fields are present
     QString patientsName, patientID, studyInstanceUID, seriesInstanceUID;
-    if (!d->uidsForDataSet(dataset, patientsName, patientID, studyInstanceUID, seriesInstanceUID))
+    if (!d->uidsForDataSet(header, patientsName, patientID, studyInstanceUID, seriesInstanceUID))
     {
       logger.error("Failed to insert file into database (required fields missing): " + filePath);
       continue;
@@ -1084,32 +2042,42 @@ void ctkDICOMDatabase::insert(const QList<ctkDICOMDatabase::IndexingResult>& ind
     QString storedFilePath = filePath;
     if (storeFile && !seriesInstanceUID.isEmpty() && !this->isInMemory())
     {
-      if (!d->storeDatasetFile(dataset, filePath, studyInstanceUID, seriesInstanceUID, sopInstanceUID, storedFilePath))
+      // Existing files can be stored in parallel, they are waited for before the rows are inserted
+      bool storeInBackground = (d->StorageThreadCount > 1 && !filePath.isEmpty());
+      if (!d->storeDatasetFile(indexingResult.dataset.data(), filePath, studyInstanceUID, seriesInstanceUID, sopInstanceUID, storedFilePath,
+        storeInBackground))
       {
         continue;
       }
     }
 
-    if (d->insertPatientStudySeries(dataset, patientID, patientsName))
+    if (d->insertPatientStudySeries(header, patientID, patientsName))
     {
       databaseWasChanged = true;
     }
 
     if (!storedFilePath.isEmpty() && !seriesInstanceUID.isEmpty())
     {
+      if (d->PendingImagesFilenames.contains(storedFilePath))
+      {
+        d->flushPendingRows();
+      }
+
       // Insert all pre-cached fields into tag cache
-      QSqlQuery insertTags(d->TagCacheDatabase);
-      insertTags.prepare("INSERT OR REPLACE INTO TagCache VALUES(?,?,?)");
-      insertTags.bindValue(0, sopInstanceUID);
       foreach(const QString & tag, d->TagsToPrecache)
       {
         unsigned short group, element;
         this->tagToGroupElement(tag, group, element);
         DcmTagKey tagKey(group, element);
+        if (!header.IsTagParsed(tagKey))
+        {
+          // Element was not read (header-only parsing), its value is cached when first requested
+          continue;
+        }
         QString value;
         if (d->TagsToExcludeFromStorage.contains(tag))
         {
-          if (dataset.TagExists(tagKey))
+          if (header.TagExists(tagKey))
           {
             value = ValueIsNotStored;
           }
@@ -1120,29 +2088,17 @@ void ctkDICOMDatabase::insert(const QList<ctkDICOMDatabase::IndexingResult>& ind
         }
         else
         {
-          value = dataset.GetAllElementValuesAsString(tagKey);
+          value = header.GetAllElementValuesAsString(tagKey);
         }
-        insertTags.bindValue(1, tag);
-        if (value.isEmpty())
-        {
-          insertTags.bindValue(2, TagNotInInstance);
-        }
-        else
-        {
-          insertTags.bindValue(2, value);
-        }
-        insertTags.exec();
+        d->PendingTagCacheValues[sopInstanceUID].insert(tag, value);
       }
 
-      // Insert image files
-      QSqlQuery insertImageStatement(d->Database);
-      insertImageStatement.prepare("INSERT INTO Images ( 'SOPInstanceUID', 'Filename', 'SeriesInstanceUID', 'InsertTimestamp' ) VALUES ( ?, ?, ?, ? )");
-      insertImageStatement.addBindValue(sopInstanceUID);
-      insertImageStatement.addBindValue(storedFilePath);
-      insertImageStatement.addBindValue(seriesInstanceUID);
-      insertImageStatement.addBindValue(QDateTime::currentDateTime());
-      insertImageStatement.exec();
-      emit instanceAdded(sopInstanceUID);
+      // Insert image files (rows are inserted into the database in bulk, by flushPendingRows)
+      d->PendingImagesValues << sopInstanceUID << storedFilePath << seriesInstanceUID << QDateTime::currentDateTime();
+      d->PendingImagesSOPInstanceUIDs.insert(sopInstanceUID);
+      d->PendingImagesFilenames.insert(storedFilePath);
+      d->DroppedSOPInstanceUIDs.remove(sopInstanceUID);
+      addedInstanceUIDs << sopInstanceUID;
       if (d->LoggedExecVerbose)
       {
         qDebug() << "Instance Added";
@@ -1151,14 +2107,40 @@ void ctkDICOMDatabase::insert(const QList<ctkDICOMDatabase::IndexingResult>& ind
 
       if (generateThumbnail)
       {
-        d->storeThumbnailFile(storedFilePath, studyInstanceUID, seriesInstanceUID, sopInstanceUID);
+        thumbnailRequests << (QStringList() << storedFilePath << studyInstanceUID << seriesInstanceUID << sopInstanceUID);
       }
     }
   }
 
+  d->flushPendingRows();
+
   d->Database.commit();
   d->TagCacheDatabase.commit();
 
+  foreach(const QStringList& thumbnailRequest, thumbnailRequests)
+  {
+    if (!d->DroppedSOPInstanceUIDs.contains(thumbnailRequest[3]))
+    {
+      d->storeThumbnailFile(thumbnailRequest[0], thumbnailRequest[1], thumbnailRequest[2], thumbnailRequest[3]);
+    }
+  }
+
+  foreach(const QString& sopInstanceUID, addedInstanceUIDs)
+  {
+    // Files stored in the background are only known to be stored after flushPendingRows
+    if (d->DroppedSOPInstanceUIDs.contains(sopInstanceUID))
+    {
+      continue;
+    }
+    emit instanceAdded(sopInstanceUID);
+  }
+  d->DroppedSOPInstanceUIDs.clear();
+
+  qint64 nestedPhasesNanoseconds = d->Metrics.nanoseconds[IndexingMetrics::PrecachePhase]
+    + d->Metrics.nanoseconds[IndexingMetrics::ThumbnailPhase] - nestedPhasesNanosecondsBefore;
+  d->Metrics.addPhase(IndexingMetrics::InsertPhase, indexingResults.size(),
+    insertTimer.nsecsElapsed() - nestedPhasesNanoseconds);
+
   if (databaseWasChanged && this->isInMemory())
   {
     emit this->databaseChanged();
@@ -1167,368 +2149,451 @@ void ctkDICOMDatabase::insert(const QList<ctkDICOMDatabase::IndexingResult>& ind
 
 
 //------------------------------------------------------------------------------
-QString ctkDICOMDatabasePrivate::getDisplayPatientFieldsKey(const QString& patientID,
-  const QString& patientsName, const QString& patientsBirthDate,
-  QMap<QString, QMap<QString, QString> >& displayedFieldsMapPatient)
+bool ctkDICOMDatabasePrivate::readRowsForKeys(const QString& table, const QString& keyField, const QStringList& keys,
+  QList<QMap<QString, QString> >& rows, const QStringList& fields)
 {
-  QString compositeID = this->compositePatientID(patientID, patientsName, patientsBirthDate);
-
-  // Look for the patient in the displayed fields cache first
-  if (displayedFieldsMapPatient.find(compositeID) != displayedFieldsMapPatient.end())
-  {
-    return compositeID;
-  }
-
-  // Look for the patient in the display database
-  QSqlQuery displayPatientsQuery(this->Database);
-  displayPatientsQuery.prepare( "SELECT * FROM Patients WHERE PatientID = :patientID AND PatientsName = :patientsName ;" );
-  displayPatientsQuery.bindValue(":patientID", patientID);
-  displayPatientsQuery.bindValue(":patientsName", patientsName);
-  if (!displayPatientsQuery.exec())
-  {
-    logger.error("SQLITE ERROR: " + displayPatientsQuery.lastError().driverText());
-    return QString();
-  }
-  if (displayPatientsQuery.size() > 1)
-  {
-    logger.warn("Multiple patients found with PatientsName=" + patientsName + " and PatientID=" + patientID);
-  }
-  if (displayPatientsQuery.next())
-  {
-    QSqlRecord patientRecord = displayPatientsQuery.record();
-    QMap<QString, QString> patientFieldsMap;
-    for (int fieldIndex=0; fieldIndex<patientRecord.count(); ++fieldIndex)
+  QString selectedFields = fields.isEmpty() ? QString("*") : fields.join(", ");
+  bool success = true;
+  int firstIndex = 0;
+  while (firstIndex < keys.size())
+  {
+    int statementKeyCount = qMin(MAXIMUM_SQL_VARIABLE_COUNT, keys.size() - firstIndex);
+    QSqlQuery selectQuery(this->Database);
+    selectQuery.prepare(QString("SELECT %1 FROM %2 WHERE %3 IN (?%4) ;")
+      .arg(selectedFields).arg(table).arg(keyField).arg(QString(",?").repeated(statementKeyCount - 1)));
+    for (int i = 0; i < statementKeyCount; ++i)
+    {
+      selectQuery.bindValue(i, keys[firstIndex + i]);
+    }
+    if (this->loggedExec(selectQuery))
+    {
+      while (selectQuery.next())
+      {
+        QSqlRecord record = selectQuery.record();
+        QMap<QString, QString> row;
+        for (int fieldIndex = 0; fieldIndex < record.count(); ++fieldIndex)
+        {
+          if (record.isNull(fieldIndex))
+          {
+            // the value would be written back as an empty string
+            continue;
+          }
+          row.insert(record.fieldName(fieldIndex), record.value(fieldIndex).toString());
+        }
+        rows << row;
+      }
+    }
+    else
     {
-      patientFieldsMap.insert(patientRecord.fieldName(fieldIndex), patientRecord.value(fieldIndex).toString());
+      success = false;
     }
-    displayedFieldsMapPatient[compositeID] = patientFieldsMap;
-    return compositeID;
+    firstIndex += statementKeyCount;
   }
-
-  logger.error("Failed to find patient with PatientsName=" + patientsName + " and PatientID=" + patientID);
-  return QString();
+  return success;
 }
 
 //------------------------------------------------------------------------------
-QString ctkDICOMDatabasePrivate::getDisplayStudyFieldsKey(QString studyInstanceUID, QMap<QString, QMap<QString, QString> > &displayedFieldsMapStudy)
+bool ctkDICOMDatabasePrivate::rowCountsForKeys(const QString& table, const QString& keyField, const QStringList& keys,
+  QHash<QString, int>& rowCounts)
 {
-  // Look for the study in the displayed fields cache first
-  foreach (QString currentStudyInstanceUid, displayedFieldsMapStudy.keys())
+  bool success = true;
+  int firstIndex = 0;
+  while (firstIndex < keys.size())
   {
-    if ( !displayedFieldsMapStudy[currentStudyInstanceUid]["StudyInstanceUID"].compare(studyInstanceUID) )
+    int statementKeyCount = qMin(MAXIMUM_SQL_VARIABLE_COUNT, keys.size() - firstIndex);
+    QSqlQuery countQuery(this->Database);
+    countQuery.prepare(QString("SELECT %2, COUNT(*) FROM %1 WHERE %2 IN (?%3) GROUP BY %2 ;")
+      .arg(table).arg(keyField).arg(QString(",?").repeated(statementKeyCount - 1)));
+    for (int i = 0; i < statementKeyCount; ++i)
     {
-      return studyInstanceUID;
+      countQuery.bindValue(i, keys[firstIndex + i]);
+    }
+    if (this->loggedExec(countQuery))
+    {
+      while (countQuery.next())
+      {
+        rowCounts.insert(countQuery.value(0).toString(), countQuery.value(1).toInt());
+      }
+    }
+    else
+    {
+      success = false;
     }
+    firstIndex += statementKeyCount;
   }
+  return success;
+}
 
-  // Look for the study in the display database
-  QSqlQuery displayStudiesQuery(this->Database);
-  displayStudiesQuery.prepare( QString("SELECT StudyInstanceUID FROM Studies WHERE StudyInstanceUID = :studyInstanceUID ;") );
-  displayStudiesQuery.bindValue(":studyInstanceUID", studyInstanceUID);
-  if (!displayStudiesQuery.exec())
-  {
-    logger.error("SQLITE ERROR: " + displayStudiesQuery.lastError().driverText());
-    return QString();
-  }
-  if (displayStudiesQuery.size() > 1)
+//------------------------------------------------------------------------------
+void ctkDICOMDatabasePrivate::updateDisplayedFieldsForInstances(QList<ctkDICOMDisplayedFieldsInstance> instances,
+  QMap<QString, QMap<QString, QString> >& displayedFieldsMapSeries,
+  QMap<QString, QMap<QString, QString> >& displayedFieldsMapStudy,
+  QMap<QString, QMap<QString, QString> >& displayedFieldsMapPatient)
+{
+  // Read cached tags of all the instances
+
+  QStringList sopInstanceUIDs;
+  foreach (const ctkDICOMDisplayedFieldsInstance& instance, instances)
   {
-    logger.warn("Multiple studies found with StudyInstanceUID=" + studyInstanceUID);
+    sopInstanceUIDs << instance.SOPInstanceUID;
   }
-  if (displayStudiesQuery.next())
+  QHash<QString, QHash<int, QString> > valuesForTagIDForInstance;
+  this->readTagCacheRecords(sopInstanceUIDs, valuesForTagIDForInstance);
+
+  QSet<QString> missingSeriesInstanceUIDs;
+  QSet<QString> missingStudyInstanceUIDs;
+  QSet<QString> missingPatientIDs;
+  QHash<QString, QString> patientRowKeyForCompositeID; // composite ID -> PatientID and PatientsName
+  for (QList<ctkDICOMDisplayedFieldsInstance>::iterator instanceIt = instances.begin(); instanceIt != instances.end(); )
   {
-    QSqlRecord studyRecord = displayStudiesQuery.record();
-    QMap<QString, QString> studyFieldsMap;
-    for (int fieldIndex=0; fieldIndex<studyRecord.count(); ++fieldIndex)
+    ctkDICOMDisplayedFieldsInstance& instance = *instanceIt;
+    this->cachedTagsFromRecord(valuesForTagIDForInstance.value(instance.SOPInstanceUID), instance.CachedTags);
+
+    QString patientsName = instance.CachedTags[ctkDICOMItem::TagKeyStripped(DCM_PatientName)];
+    QString patientID = instance.CachedTags[ctkDICOMItem::TagKeyStripped(DCM_PatientID)];
+    instance.StudyInstanceUID = instance.CachedTags[ctkDICOMItem::TagKeyStripped(DCM_StudyInstanceUID)];
+    if (!this->uidsForDataSet(patientsName, patientID, instance.StudyInstanceUID))
+    {
+      // error occurred, message is already logged
+      instanceIt = instances.erase(instanceIt);
+      continue;
+    }
+    QString patientsBirthDate = instance.CachedTags[ctkDICOMItem::TagKeyStripped(DCM_PatientBirthDate)];
+    instance.PatientCompositeID = this->compositePatientID(patientID, patientsName, patientsBirthDate);
+
+    if (!displayedFieldsMapPatient.contains(instance.PatientCompositeID))
     {
-      studyFieldsMap.insert(studyRecord.fieldName(fieldIndex), studyRecord.value(fieldIndex).toString());
+      missingPatientIDs.insert(patientID);
+      patientRowKeyForCompositeID.insert(instance.PatientCompositeID, patientID + TableFieldSeparator + patientsName);
     }
-    displayedFieldsMapStudy.insert(studyInstanceUID, studyFieldsMap);
-    return studyInstanceUID;
+    if (!displayedFieldsMapStudy.contains(instance.StudyInstanceUID))
+    {
+      missingStudyInstanceUIDs.insert(instance.StudyInstanceUID);
+    }
+    if (!displayedFieldsMapSeries.contains(instance.SeriesInstanceUID))
+    {
+      missingSeriesInstanceUIDs.insert(instance.SeriesInstanceUID);
+    }
+    ++instanceIt;
   }
 
-  logger.error("Failed to find study with StudyInstanceUID=" + studyInstanceUID);
-  return QString();
-}
+  // Read current displayed fields of the patients, studies, and series that are not in the maps yet
 
-//------------------------------------------------------------------------------
-QString ctkDICOMDatabasePrivate::getDisplaySeriesFieldsKey(QString seriesInstanceUID, QMap<QString, QMap<QString, QString> > &displayedFieldsMapSeries)
-{
-  // Look for the series in the displayed fields cache first
-  foreach (QString currentSeriesInstanceUid, displayedFieldsMapSeries.keys())
+  QList<QMap<QString, QString> > rows;
+  this->readRowsForKeys("Patients", "PatientID", missingPatientIDs.toList(), rows);
+  QHash<QString, QMap<QString, QString> > patientRows;
+  foreach (const QMap<QString, QString>& row, rows)
   {
-    if ( !displayedFieldsMapSeries[currentSeriesInstanceUid]["SeriesInstanceUID"].compare(seriesInstanceUID) )
+    QString rowKey = row.value("PatientID") + TableFieldSeparator + row.value("PatientsName");
+    if (patientRows.contains(rowKey))
     {
-      return seriesInstanceUID;
+      logger.warn("Multiple patients found with PatientsName=" + row.value("PatientsName") + " and PatientID=" + row.value("PatientID"));
+      continue;
     }
+    patientRows.insert(rowKey, row);
   }
-
-  // Look for the series in the display database
-  QSqlQuery displaySeriesQuery(this->Database);
-  displaySeriesQuery.prepare( QString("SELECT SeriesInstanceUID FROM Series WHERE SeriesInstanceUID = :seriesInstanceUID ;") );
-  displaySeriesQuery.bindValue(":seriesInstanceUID", seriesInstanceUID);
-  if (!displaySeriesQuery.exec())
+  for (QHash<QString, QString>::const_iterator it = patientRowKeyForCompositeID.constBegin(); it != patientRowKeyForCompositeID.constEnd(); ++it)
   {
-    logger.error("SQLITE ERROR: " + displaySeriesQuery.lastError().driverText());
-    return QString();
+    if (patientRows.contains(it.value()))
+    {
+      displayedFieldsMapPatient.insert(it.key(), patientRows.value(it.value()));
+    }
   }
-  if (displaySeriesQuery.size() > 1)
+  rows.clear();
+  // Only the UID of studies and series is read, so that only the fields set by the rules are written back
+  // (other fields keep their current value, including NULL) and the rules start from empty fields.
+  this->readRowsForKeys("Studies", "StudyInstanceUID", missingStudyInstanceUIDs.toList(), rows,
+    QStringList() << "StudyInstanceUID");
+  foreach (const QMap<QString, QString>& row, rows)
   {
-    logger.warn("Multiple series found with SeriesInstanceUID=" + seriesInstanceUID);
+    displayedFieldsMapStudy.insert(row.value("StudyInstanceUID"), row);
   }
-  if (displaySeriesQuery.next())
+  rows.clear();
+  this->readRowsForKeys("Series", "SeriesInstanceUID", missingSeriesInstanceUIDs.toList(), rows,
+    QStringList() << "SeriesInstanceUID");
+  foreach (const QMap<QString, QString>& row, rows)
   {
-    QSqlRecord seriesRecord = displaySeriesQuery.record();
-    QMap<QString, QString> seriesFieldsMap;
-    for (int fieldIndex=0; fieldIndex<seriesRecord.count(); ++fieldIndex)
-    {
-      seriesFieldsMap.insert(seriesRecord.fieldName(fieldIndex), seriesRecord.value(fieldIndex).toString());
-    }
-    displayedFieldsMapSeries.insert(seriesInstanceUID, seriesFieldsMap);
-    return seriesInstanceUID;
+    displayedFieldsMapSeries.insert(row.value("SeriesInstanceUID"), row);
   }
+  rows.clear();
 
-  logger.error("Failed to find series with SeriesInstanceUID=" + seriesInstanceUID);
-  return QString();
-}
-
-//------------------------------------------------------------------------------
-bool ctkDICOMDatabasePrivate::applyDisplayedFieldsChanges( QMap<QString, QMap<QString, QString> > &displayedFieldsMapSeries,
-                                                           QMap<QString, QMap<QString, QString> > &displayedFieldsMapStudy,
-                                                           QMap<QString, QMap<QString, QString> > &displayedFieldsMapPatient)
-{
-  QMap<QString, int> patientCompositeIdToPatientUidMap;
-
-  // Update patient fields
+  // Partition the instances: instances that share a patient, study, or series are put in the same
+  // partition (using a union-find structure where each instance starts in its own partition),
+  // so that the rules see the same sequence of instances for each patient, study, and series
+  // as if all the instances were processed one by one.
 
-  foreach(QString compositeID, displayedFieldsMapPatient.keys())
+  QList<ctkDICOMDisplayedFieldsInstance> validInstances;
+  QVector<int> parentPartitions;
+  QHash<QString, int> partitionForKey;
+  foreach (const ctkDICOMDisplayedFieldsInstance& instance, instances)
   {
-    QMap<QString, QString> currentPatient = displayedFieldsMapPatient[compositeID];
-    QSqlQuery displayPatientsQuery(this->Database);
-    displayPatientsQuery.prepare( "SELECT * FROM Patients WHERE PatientID=:patientID AND PatientsName=:patientsName ;" );
-    displayPatientsQuery.bindValue(":patientID", currentPatient["PatientID"]);
-    displayPatientsQuery.bindValue(":patientsName", currentPatient["PatientsName"]);
-    if (!displayPatientsQuery.exec())
+    if (!displayedFieldsMapPatient.contains(instance.PatientCompositeID))
     {
-      logger.error("SQLITE ERROR: " + displayPatientsQuery.lastError().driverText());
-      return false;
+      logger.error("Failed to find patient for SOP Instance UID = " + instance.SOPInstanceUID);
+      continue;
+    }
+    if (!displayedFieldsMapStudy.contains(instance.StudyInstanceUID))
+    {
+      logger.error("Failed to find study for SOP Instance UID = " + instance.SOPInstanceUID);
+      continue;
     }
-    if (displayPatientsQuery.next())
+    if (!displayedFieldsMapSeries.contains(instance.SeriesInstanceUID))
     {
-      QString displayPatientsFieldUpdateString;
-      QList<QString> boundValues;
-      foreach (QString tagName, currentPatient.keys())
+      logger.error("Failed to find series for SOP Instance UID = " + instance.SOPInstanceUID);
+      continue;
+    }
+    int partition = parentPartitions.size();
+    parentPartitions.append(partition);
+    QStringList keys;
+    keys << "Patient" + TableFieldSeparator + instance.PatientCompositeID
+      << "Study" + TableFieldSeparator + instance.StudyInstanceUID
+      << "Series" + TableFieldSeparator + instance.SeriesInstanceUID;
+    foreach (const QString& key, keys)
+    {
+      QHash<QString, int>::iterator partitionIt = partitionForKey.find(key);
+      if (partitionIt == partitionForKey.end())
       {
-        if (tagName == "PatientCompositeID")
-        {
-          continue; // Do not write patient index that is only used internally and temporarily
-        }
-        displayPatientsFieldUpdateString.append( tagName + " = ? , " );
-        boundValues << currentPatient[tagName];
+        partitionForKey.insert(key, partition);
+        continue;
       }
+      int rootPartition = ctkDICOMDisplayedFieldsRootPartition(parentPartitions, partitionIt.value());
+      // Merge the partition of the key into the partition of this instance
+      parentPartitions[rootPartition] = partition;
+      partitionIt.value() = partition;
+    }
+    validInstances << instance;
+  }
 
-      // Trim the separators from the end
-      displayPatientsFieldUpdateString = displayPatientsFieldUpdateString.left(displayPatientsFieldUpdateString.size() - 3);
-
-      QSqlRecord patientRecord = displayPatientsQuery.record();
-      int patientUID = patientRecord.value("UID").toInt();
-
-      QSqlQuery updateDisplayPatientStatement(this->Database);
-      updateDisplayPatientStatement.prepare( QString("UPDATE Patients SET %1 WHERE UID = ? ;").arg(displayPatientsFieldUpdateString) );
-      foreach (QString boundValue, boundValues)
-        {
-        updateDisplayPatientStatement.addBindValue(boundValue);
-        }
-      updateDisplayPatientStatement.addBindValue(patientUID);
-      this->loggedExec(updateDisplayPatientStatement);
-
-      QSqlQuery updateDisplayedFieldsUpdatedTimestampStatement(this->Database);
-      updateDisplayedFieldsUpdatedTimestampStatement.prepare("UPDATE Patients SET DisplayedFieldsUpdatedTimestamp=CURRENT_TIMESTAMP WHERE UID = ? ;");
-      updateDisplayedFieldsUpdatedTimestampStatement.addBindValue(patientUID);
-      this->loggedExec(updateDisplayedFieldsUpdatedTimestampStatement);
-
-      patientCompositeIdToPatientUidMap[compositeID] = patientUID;
+  QVector<ctkDICOMDisplayedFieldsPartition> partitions;
+  QHash<int, int> partitionIndexForRootPartition;
+  for (int instanceIndex = 0; instanceIndex < validInstances.size(); ++instanceIndex)
+  {
+    const ctkDICOMDisplayedFieldsInstance& instance = validInstances[instanceIndex];
+    int rootPartition = ctkDICOMDisplayedFieldsRootPartition(parentPartitions, instanceIndex);
+    QHash<int, int>::iterator partitionIndexIt = partitionIndexForRootPartition.find(rootPartition);
+    if (partitionIndexIt == partitionIndexForRootPartition.end())
+    {
+      partitionIndexIt = partitionIndexForRootPartition.insert(rootPartition, partitions.size());
+      partitions.append(ctkDICOMDisplayedFieldsPartition());
     }
-    else
+    ctkDICOMDisplayedFieldsPartition& partition = partitions[partitionIndexIt.value()];
+    partition.Instances << instance;
+    if (!partition.Patients.contains(instance.PatientCompositeID))
     {
-      logger.error("Failed to find patient with PatientsName=" + currentPatient["PatientsName"] + " and PatientID=" + currentPatient["PatientID"]);
-      return false;
+      partition.Patients.insert(instance.PatientCompositeID, displayedFieldsMapPatient.value(instance.PatientCompositeID));
     }
-  } // For each patient in displayedFieldsVectorPatient
-
-  // Update study fields
-  foreach (QString currentStudyInstanceUid, displayedFieldsMapStudy.keys())
-  {
-    QMap<QString, QString> currentStudy = displayedFieldsMapStudy[currentStudyInstanceUid];
-    QSqlQuery displayStudiesQuery(this->Database);
-    displayStudiesQuery.prepare("SELECT StudyInstanceUID FROM Studies WHERE StudyInstanceUID = ? ;");
-    displayStudiesQuery.addBindValue(currentStudyInstanceUid);
-    if (!displayStudiesQuery.exec())
+    if (!partition.Studies.contains(instance.StudyInstanceUID))
     {
-      logger.error("SQLITE ERROR: " + displayStudiesQuery.lastError().driverText());
-      return false;
+      partition.Studies.insert(instance.StudyInstanceUID, displayedFieldsMapStudy.value(instance.StudyInstanceUID));
     }
-    if (displayStudiesQuery.next())
+    if (!partition.Series.contains(instance.SeriesInstanceUID))
     {
-      QString displayStudiesFieldUpdateString;
-      QList<QString> boundValues;
-      foreach (QString tagName, currentStudy.keys())
-      {
-        if (!tagName.compare("PatientCompositeID"))
-        {
-          displayStudiesFieldUpdateString.append( "PatientsUID = ? , " );
-          boundValues << QString::number(patientCompositeIdToPatientUidMap[currentStudy["PatientCompositeID"]]);
-        }
-        else
-        {
-          displayStudiesFieldUpdateString.append( tagName + " = ? , " );
-          boundValues << currentStudy[tagName];
-        }
-      }
-      // Trim the separators from the end
-      displayStudiesFieldUpdateString = displayStudiesFieldUpdateString.left(displayStudiesFieldUpdateString.size() - 3);
+      partition.Series.insert(instance.SeriesInstanceUID, displayedFieldsMapSeries.value(instance.SeriesInstanceUID));
+    }
+  }
+  validInstances.clear();
 
-      QSqlQuery updateDisplayStudyStatement(this->Database);
-      updateDisplayStudyStatement.prepare( QString("UPDATE Studies SET %1 WHERE StudyInstanceUID = ? ;").arg(displayStudiesFieldUpdateString) );
-      foreach (QString boundValue, boundValues)
-        {
-        updateDisplayStudyStatement.addBindValue(boundValue);
-        }
-      updateDisplayStudyStatement.addBindValue(currentStudy["StudyInstanceUID"]);
-      this->loggedExec(updateDisplayStudyStatement);
+  // Evaluate the rules (the rules only access the maps of the partition)
 
-      QSqlQuery updateDisplayedFieldsUpdatedTimestampStatement(this->Database);
-      updateDisplayedFieldsUpdatedTimestampStatement.prepare("UPDATE Studies SET DisplayedFieldsUpdatedTimestamp=CURRENT_TIMESTAMP WHERE StudyInstanceUID = ? ;");
-      updateDisplayedFieldsUpdatedTimestampStatement.addBindValue(currentStudy["StudyInstanceUID"]);
-      this->loggedExec(updateDisplayedFieldsUpdatedTimestampStatement);
-    }
-    else
+  if (partitions.size() == 1)
+  {
+    ctkDICOMDisplayedFieldsWorker(this->DisplayedFieldGenerator, partitions[0]).run();
+  }
+  else if (partitions.size() > 1)
+  {
+    QThreadPool threadPool;
+    for (int partitionIndex = 0; partitionIndex < partitions.size(); ++partitionIndex)
     {
-      logger.error("Failed to find study with StudyInstanceUID=" + currentStudyInstanceUid);
-      return false;
+      threadPool.start(new ctkDICOMDisplayedFieldsWorker(this->DisplayedFieldGenerator, partitions[partitionIndex]));
     }
-  } // For each study in displayedFieldsMapStudy
+    threadPool.waitForDone();
+  }
 
-  // Update series fields
-  foreach (QString currentSeriesInstanceUid, displayedFieldsMapSeries.keys())
+  // Collect the results
+
+  foreach (const ctkDICOMDisplayedFieldsPartition& partition, partitions)
   {
-    // Insert row into Series if does not exist
-    QMap<QString, QString> currentSeries = displayedFieldsMapSeries[currentSeriesInstanceUid];
-    QSqlQuery displaySeriesQuery(this->Database);
-    displaySeriesQuery.prepare("SELECT SeriesInstanceUID FROM Series WHERE SeriesInstanceUID = ? ;");
-    displaySeriesQuery.addBindValue(currentSeriesInstanceUid);
-    if (!displaySeriesQuery.exec())
+    for (QMap<QString, QMap<QString, QString> >::const_iterator it = partition.Patients.constBegin(); it != partition.Patients.constEnd(); ++it)
     {
-      logger.error("SQLITE ERROR: " + displaySeriesQuery.lastError().driverText());
-      return false;
+      displayedFieldsMapPatient[it.key()] = it.value();
     }
-    if (displaySeriesQuery.next())
+    for (QMap<QString, QMap<QString, QString> >::const_iterator it = partition.Studies.constBegin(); it != partition.Studies.constEnd(); ++it)
     {
-      QString displaySeriesFieldUpdateString;
-      QList<QString> boundValues;
-      foreach (QString tagName, currentSeries.keys())
-      {
-        displaySeriesFieldUpdateString.append( tagName + " = ? , " );
-        boundValues << currentSeries[tagName];
-      }
-      // Trim the separators from the end
-      displaySeriesFieldUpdateString = displaySeriesFieldUpdateString.left(displaySeriesFieldUpdateString.size() - 3);
-
-      QSqlQuery updateDisplaySeriesStatement(this->Database);
-      updateDisplaySeriesStatement.prepare( QString("UPDATE Series SET %1 WHERE SeriesInstanceUID = ? ;").arg(displaySeriesFieldUpdateString) );
-      foreach (QString boundValue, boundValues)
-        {
-        updateDisplaySeriesStatement.addBindValue(boundValue);
-        }
-      updateDisplaySeriesStatement.addBindValue(currentSeries["SeriesInstanceUID"]);
-      this->loggedExec(updateDisplaySeriesStatement);
-
-      QSqlQuery updateDisplayedFieldsUpdatedTimestampStatement(this->Database);
-      updateDisplayedFieldsUpdatedTimestampStatement.prepare("UPDATE Series SET DisplayedFieldsUpdatedTimestamp=CURRENT_TIMESTAMP WHERE SeriesInstanceUID = ? ;");
-      updateDisplayedFieldsUpdatedTimestampStatement.addBindValue(currentSeries["SeriesInstanceUID"]);
-      this->loggedExec(updateDisplayedFieldsUpdatedTimestampStatement);
+      displayedFieldsMapStudy[it.key()] = it.value();
     }
-    else
+    for (QMap<QString, QMap<QString, QString> >::const_iterator it = partition.Series.constBegin(); it != partition.Series.constEnd(); ++it)
     {
-      logger.error("Failed to find series with SeriesInstanceUID=" + currentSeriesInstanceUid);
-      return false;
+      displayedFieldsMapSeries[it.key()] = it.value();
     }
-  } // For each series in displayedFieldsMapSeries
-
-  return true;
+  }
 }
 
 //------------------------------------------------------------------------------
-void ctkDICOMDatabasePrivate::setCountToSeriesDisplayedFields(QMap<QString, QMap<QString, QString> > &displayedFieldsMapSeries)
+bool ctkDICOMDatabasePrivate::updateDisplayedFieldsRow(QHash<QString, QSqlQuery>& updateQueries, const QString& table,
+  const QString& keyField, const QMap<QString, QString>& fields, const QStringList& skippedFields)
 {
-  foreach (QString currentSeriesInstanceUid, displayedFieldsMapSeries.keys())
+  QString assignments;
+  QStringList values;
+  for (QMap<QString, QString>::const_iterator it = fields.constBegin(); it != fields.constEnd(); ++it)
   {
-    QSqlQuery countQuery(this->Database);
-    countQuery.prepare("SELECT COUNT(*) FROM Images WHERE SeriesInstanceUID = ? ;");
-    countQuery.addBindValue(currentSeriesInstanceUid);
-    if (!countQuery.exec())
+    if (it.key() == keyField || it.key() == "DisplayedFieldsUpdatedTimestamp" || skippedFields.contains(it.key()))
     {
-      logger.error("SQLITE ERROR: " + countQuery.lastError().driverText());
       continue;
     }
+    assignments.append(it.key() + " = ? , ");
+    values << it.value();
+  }
+  QString statement = QString("UPDATE %1 SET %2DisplayedFieldsUpdatedTimestamp = CURRENT_TIMESTAMP WHERE %3 = ? ;")
+    .arg(table).arg(assignments).arg(keyField);
+
+  // Rows of a table usually have the same fields, therefore the statement only needs to be prepared once
+  QHash<QString, QSqlQuery>::iterator queryIt = updateQueries.find(statement);
+  if (queryIt == updateQueries.end())
+  {
+    QSqlQuery updateQuery(this->Database);
+    updateQuery.prepare(statement);
+    queryIt = updateQueries.insert(statement, updateQuery);
+  }
+  QSqlQuery& updateQuery = queryIt.value();
+  for (int i = 0; i < values.size(); ++i)
+  {
+    updateQuery.bindValue(i, values[i]);
+  }
+  updateQuery.bindValue(values.size(), fields.value(keyField));
+  return this->loggedExec(updateQuery);
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMDatabasePrivate::applyDisplayedFieldsChanges( QMap<QString, QMap<QString, QString> > &displayedFieldsMapSeries,
+                                                           QMap<QString, QMap<QString, QString> > &displayedFieldsMapStudy,
+                                                           QMap<QString, QMap<QString, QString> > &displayedFieldsMapPatient)
+{
+  // The maps contain the UID of the rows that have been read from the tables (complete rows for patients)
+  // and the fields set by the rules, therefore the rows do not have to be looked up again.
+  bool success = true;
+  QHash<QString, QSqlQuery> updateQueries;
+
+  // Update patient fields
+  foreach (const QMap<QString, QString>& currentPatient, displayedFieldsMapPatient)
+  {
+    // Do not write patient index that is only used internally and temporarily
+    success = this->updateDisplayedFieldsRow(updateQueries, "Patients", "UID", currentPatient,
+      QStringList() << "PatientCompositeID") && success;
+  }
+
+  // Update study fields
+  foreach (const QMap<QString, QString>& currentStudy, displayedFieldsMapStudy)
+  {
+    // The patient of the study is not changed by the displayed fields
+    success = this->updateDisplayedFieldsRow(updateQueries, "Studies", "StudyInstanceUID", currentStudy,
+      QStringList() << "PatientCompositeID" << "PatientsUID") && success;
+  }
+
+  // Update series fields
+  foreach (const QMap<QString, QString>& currentSeries, displayedFieldsMapSeries)
+  {
+    success = this->updateDisplayedFieldsRow(updateQueries, "Series", "SeriesInstanceUID", currentSeries) && success;
+  }
+
+  return success;
+}
 
-    countQuery.first();
-    int currentCount = countQuery.value(0).toInt();
+//------------------------------------------------------------------------------
+void ctkDICOMDatabasePrivate::setCountToSeriesDisplayedFields(QMap<QString, QMap<QString, QString> > &displayedFieldsMapSeries)
+{
+  QHash<QString, int> imageCounts;
+  if (!this->rowCountsForKeys("Images", "SeriesInstanceUID", displayedFieldsMapSeries.keys(), imageCounts))
+  {
+    return;
+  }
+  for (QMap<QString, QMap<QString, QString> >::iterator it = displayedFieldsMapSeries.begin(); it != displayedFieldsMapSeries.end(); ++it)
+  {
+    it.value()["DisplayedCount"] = QString::number(imageCounts.value(it.key(), 0));
+  }
+}
 
-    QMap<QString, QString> displayedFieldsForCurrentSeries = displayedFieldsMapSeries[currentSeriesInstanceUid];
-    displayedFieldsForCurrentSeries["DisplayedCount"] = QString::number(currentCount);
-    displayedFieldsMapSeries[currentSeriesInstanceUid] = displayedFieldsForCurrentSeries;
+//------------------------------------------------------------------------------
+void ctkDICOMDatabasePrivate::setNumberOfSeriesToStudyDisplayedFields(QMap<QString, QMap<QString, QString> > &displayedFieldsMapStudy)
+{
+  QHash<QString, int> seriesCounts;
+  if (!this->rowCountsForKeys("Series", "StudyInstanceUID", displayedFieldsMapStudy.keys(), seriesCounts))
+  {
+    return;
+  }
+  for (QMap<QString, QMap<QString, QString> >::iterator it = displayedFieldsMapStudy.begin(); it != displayedFieldsMapStudy.end(); ++it)
+  {
+    it.value()["DisplayedNumberOfSeries"] = QString::number(seriesCounts.value(it.key(), 0));
   }
 }
 
 //------------------------------------------------------------------------------
-void ctkDICOMDatabasePrivate::setNumberOfSeriesToStudyDisplayedFields(QMap<QString, QMap<QString, QString> > &displayedFieldsMapStudy)
+void ctkDICOMDatabasePrivate::setNumberOfStudiesToPatientDisplayedFields(QMap<QString, QMap<QString, QString> >& displayedFieldsMapPatient)
 {
-  foreach (QString currentStudyInstanceUid, displayedFieldsMapStudy.keys())
+  QStringList patientUIDs;
+  foreach (const QMap<QString, QString>& displayedFieldsForCurrentPatient, displayedFieldsMapPatient)
   {
-    QSqlQuery numberOfSeriesQuery(this->Database);
-    numberOfSeriesQuery.prepare("SELECT COUNT(*) FROM Series WHERE StudyInstanceUID = ? ;");
-    numberOfSeriesQuery.addBindValue(currentStudyInstanceUid);
-    if (!numberOfSeriesQuery.exec())
-    {
-      logger.error("SQLITE ERROR: " + numberOfSeriesQuery.lastError().driverText());
-      continue;
-    }
+    patientUIDs << displayedFieldsForCurrentPatient.value("UID");
+  }
+  patientUIDs.removeDuplicates();
+  QHash<QString, int> studyCounts;
+  if (!this->rowCountsForKeys("Studies", "PatientsUID", patientUIDs, studyCounts))
+  {
+    return;
+  }
+  for (QMap<QString, QMap<QString, QString> >::iterator it = displayedFieldsMapPatient.begin(); it != displayedFieldsMapPatient.end(); ++it)
+  {
+    it.value()["DisplayedNumberOfStudies"] = QString::number(studyCounts.value(it.value().value("UID"), 0));
+  }
+}
 
-    numberOfSeriesQuery.first();
-    int currentNumberOfSeries = numberOfSeriesQuery.value(0).toInt();
+//------------------------------------------------------------------------------
+CTK_GET_CPP(ctkDICOMDatabase, bool, isDisplayedFieldsTableAvailable, DisplayedFieldsTableAvailable);
 
-    QMap<QString, QString> displayedFieldsForCurrentStudy = displayedFieldsMapStudy[currentStudyInstanceUid];
-    displayedFieldsForCurrentStudy["DisplayedNumberOfSeries"] = QString::number(currentNumberOfSeries);
-    displayedFieldsMapStudy[currentStudyInstanceUid] = displayedFieldsForCurrentStudy;
-  }
+//------------------------------------------------------------------------------
+ctkDICOMDatabase::IndexingMetrics ctkDICOMDatabase::indexingMetrics() const
+{
+  Q_D(const ctkDICOMDatabase);
+  return d->Metrics;
 }
 
 //------------------------------------------------------------------------------
-void ctkDICOMDatabasePrivate::setNumberOfStudiesToPatientDisplayedFields(QMap<QString, QMap<QString, QString> >& displayedFieldsMapPatient)
+void ctkDICOMDatabase::resetIndexingMetrics()
 {
-  foreach(QString compositeID, displayedFieldsMapPatient.keys())
-  {
-    QMap<QString, QString> displayedFieldsForCurrentPatient = displayedFieldsMapPatient[compositeID];
-    int patientUID = displayedFieldsForCurrentPatient["UID"].toInt();
-    QSqlQuery numberOfStudiesQuery(this->Database);
-    numberOfStudiesQuery.prepare("SELECT COUNT(*) FROM Studies WHERE PatientsUID = ? ;");
-    numberOfStudiesQuery.addBindValue(patientUID);
-    if (!numberOfStudiesQuery.exec())
-    {
-      logger.error("SQLITE ERROR: " + numberOfStudiesQuery.lastError().driverText());
-      continue;
-    }
+  Q_D(ctkDICOMDatabase);
+  d->Metrics.reset();
+}
 
-    numberOfStudiesQuery.first();
-    int currentNumberOfStudies = numberOfStudiesQuery.value(0).toInt();
+//------------------------------------------------------------------------------
+bool ctkDICOMDatabase::isSearchIndexAvailable(const QString& table) const
+{
+  Q_D(const ctkDICOMDatabase);
+  return d->SearchIndexTables.contains(table);
+}
 
-    displayedFieldsForCurrentPatient["DisplayedNumberOfStudies"] = QString::number(currentNumberOfStudies);
-    displayedFieldsMapPatient[compositeID] = displayedFieldsForCurrentPatient;
+//------------------------------------------------------------------------------
+QString ctkDICOMDatabase::searchIndexCondition(const QString& table, const QString& tableAlias) const
+{
+  Q_D(const ctkDICOMDatabase);
+  if (!d->SearchIndexTables.contains(table))
+  {
+    return QString();
   }
+  return QString("%1.rowid IN (SELECT rowid FROM %2SearchIndex WHERE SearchText LIKE ? ESCAPE '\\')")
+    .arg(tableAlias.isEmpty() ? table : tableAlias).arg(table);
 }
 
 //------------------------------------------------------------------------------
-CTK_GET_CPP(ctkDICOMDatabase, bool, isDisplayedFieldsTableAvailable, DisplayedFieldsTableAvailable);
+QString ctkDICOMDatabase::searchPattern(const QString& text)
+{
+  QString pattern = text.trimmed();
+  // Characters that have a special meaning in LIKE patterns are matched literally
+  pattern.replace('\\', "\\\\");
+  pattern.replace('%', "\\%");
+  pattern.replace('_', "\\_");
+  pattern.replace('*', '%');
+  pattern.replace('?', '_');
+  return QString("%%1%").arg(pattern);
+}
 
 //------------------------------------------------------------------------------
 // ctkDICOMDatabase methods
@@ -1563,6 +2628,7 @@ void ctkDICOMDatabase::openDatabase(const QString databaseFile, const QString& c
 {
   Q_D(ctkDICOMDatabase);
   bool wasOpen = this->isOpen();
+  d->clearCachedQueries();
   d->DatabaseFileName = databaseFile;
   QString verifiedConnectionName = connectionName;
   if (verifiedConnectionName.isEmpty())
@@ -1586,6 +2652,8 @@ void ctkDICOMDatabase::openDatabase(const QString databaseFile, const QString& c
   pragmaSyncQuery.exec("PRAGMA synchronous = OFF");
   pragmaSyncQuery.finish();
 
+  d->applyJournalMode(d->Database);
+
   if ( d->Database.tables().empty() )
   {
     if (!this->initializeDatabase())
@@ -1602,10 +2670,16 @@ void ctkDICOMDatabase::openDatabase(const QString databaseFile, const QString& c
 
   d->DisplayedFieldsTableAvailable = d->Database.tables().contains("ColumnDisplayProperties");
 
+  d->initializeSearchIndex();
+
+  delete d->DatabaseFileWatcher;
+  d->DatabaseFileWatcher = NULL;
   if (!isInMemory())
   {
-    QFileSystemWatcher* watcher = new QFileSystemWatcher(QStringList(databaseFile),this);
-    connect(watcher, SIGNAL(fileChanged(QString)),this, SIGNAL (databaseChanged()) );
+    d->DatabaseFileWatcher = new QFileSystemWatcher(this);
+    connect(d->DatabaseFileWatcher, SIGNAL(fileChanged(QString)), this, SLOT(onDatabaseFileChanged(QString)));
+    connect(d->DatabaseFileWatcher, SIGNAL(directoryChanged(QString)), this, SLOT(onDatabaseDirectoryChanged(QString)));
+    d->updateWatchedFiles();
   }
 
   // Set up the tag cache for use later
@@ -1673,12 +2747,14 @@ bool ctkDICOMDatabase::initializeDatabase(const char* sqlFileName/* = ":/dicom/d
   Q_D(ctkDICOMDatabase);
 
   d->resetLastInsertedValues();
+  d->clearCachedQueries();
 
   // remove any existing schema info - this handles the case where an
   // old schema should be loaded for testing.
   QSqlQuery dropSchemaInfo(d->Database);
   d->loggedExec( dropSchemaInfo, QString("DROP TABLE IF EXISTS 'SchemaInfo';") );
   const bool r = d->executeScript(sqlFileName);
+  d->initializeSearchIndex();
   emit databaseChanged();
   return r;
 }
@@ -1712,7 +2788,7 @@ QString ctkDICOMDatabase::schemaVersion()
   //   so that the ctkDICOMDatabasePrivate::filenames method
   //   still works.
   //
-  return QString("0.6.2");
+  return QString("0.6.3");
 };
 
 //------------------------------------------------------------------------------
@@ -1802,8 +2878,17 @@ void ctkDICOMDatabase::closeDatabase()
 {
   Q_D(ctkDICOMDatabase);
   bool wasOpen = this->isOpen();
+  if (d->ReadSnapshotDepth > 0)
+  {
+    logger.warn("Database is closed while a read snapshot is active");
+    d->ReadSnapshotDepth = 0;
+  }
+  d->clearCachedQueries();
+  d->SearchIndexTables.clear();
   d->Database.close();
   d->TagCacheDatabase.close();
+  delete d->DatabaseFileWatcher;
+  d->DatabaseFileWatcher = NULL;
   if (wasOpen)
   {
     emit closed();
@@ -2273,7 +3358,9 @@ void ctkDICOMDatabase::loadFileHeader (QString fileName)
   Q_D(ctkDICOMDatabase);
   d->LoadedHeader.clear();
   DcmFileFormat fileFormat;
-  OFCondition status = fileFormat.loadFile(fileName.toUtf8().data());
+  OFCondition status = d->MemoryMappedFileRead
+    ? ctkDICOMMappedInputStream::loadFile(fileFormat, fileName)
+    : fileFormat.loadFile(fileName.toUtf8().data());
   if (status.good())
   {
     DcmDataset *dataset = fileFormat.getDataset();
@@ -2401,6 +3488,7 @@ QString ctkDICOMDatabase::fileValue(const QString fileName, const unsigned short
   }
 
   ctkDICOMItem dataset;
+  dataset.SetMemoryMappedFileReadEnabled(d->MemoryMappedFileRead);
   dataset.InitializeFromFile(fileName);
   if (!dataset.IsInitialized())
   {
@@ -2518,6 +3606,7 @@ bool ctkDICOMDatabase::fileValueExists(const QString fileName, const unsigned sh
   }
 
   ctkDICOMItem dataset;
+  dataset.SetMemoryMappedFileReadEnabled(d->MemoryMappedFileRead);
   dataset.InitializeFromFile(fileName);
   if (!dataset.IsInitialized())
   {
@@ -2573,167 +3662,485 @@ QString ctkDICOMDatabase::groupElementToTag(const unsigned short& group, const u
 //
 
 //------------------------------------------------------------------------------
-void ctkDICOMDatabase::prepareInsert()
+void ctkDICOMDatabase::prepareInsert()
+{
+  Q_D(ctkDICOMDatabase);
+  // Although resetLastInsertedValues is called when items are deleted through
+  // this database connection, there may be concurrent database modifications
+  // (even in the same application) through other connections.
+  // Therefore, we cannot be sure that the last added patient, study, series,
+  // items are still in the database. We clear cached Last... IDs to make sure
+  // the patient, study, series items are created.
+  d->resetLastInsertedValues();
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMDatabase::insert( DcmItem *item, bool storeFile, bool generateThumbnail)
+{
+  if (!item)
+  {
+    return;
+  }
+  ctkDICOMItem dataset;
+  dataset.InitializeFromItem(item, false /* do not take ownership */);
+  this->insert(dataset,storeFile,generateThumbnail);
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMDatabase::insert( const ctkDICOMItem& dataset, bool storeFile, bool generateThumbnail)
+{
+  Q_D(ctkDICOMDatabase);
+  d->insert(dataset, QString(), storeFile, generateThumbnail);
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMDatabase::insert(const QString& filePath, const ctkDICOMItem& dataset,
+  bool storeFile, bool generateThumbnail)
+{
+  Q_D(ctkDICOMDatabase);
+  d->insert(dataset, filePath, storeFile, generateThumbnail);
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMDatabase::insert( const QString& filePath, bool storeFile, bool generateThumbnail, bool createHierarchy, const QString& destinationDirectoryName)
+{
+  Q_D(ctkDICOMDatabase);
+  Q_UNUSED(createHierarchy);
+  Q_UNUSED(destinationDirectoryName);
+
+  /// first we check if the file is already in the database
+  if (fileExistsAndUpToDate(filePath))
+  {
+    logger.debug( "File " + filePath + " already added.");
+    return;
+  }
+
+  if (d->LoggedExecVerbose)
+  {
+    logger.debug( "Processing " + filePath );
+  }
+
+  ctkDICOMItem dataset;
+  dataset.SetMemoryMappedFileReadEnabled(d->MemoryMappedFileRead);
+
+  // Only header information is stored in the database, no need to read the pixel data
+  dataset.InitializeFromFileHeader(filePath);
+  if ( dataset.IsInitialized() )
+  {
+    d->insert( dataset, filePath, storeFile, generateThumbnail );
+  }
+  else
+  {
+    logger.warn(QString("Could not read DICOM file:") + filePath);
+  }
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMDatabase::setTagsToPrecache(const QStringList tags)
+{
+  Q_D(ctkDICOMDatabase);
+  if (d->TagsToPrecache == tags)
+  {
+    return;
+  }
+  d->TagsToPrecache = tags;
+  emit tagsToPrecacheChanged();
+}
+
+//------------------------------------------------------------------------------
+const QStringList ctkDICOMDatabase::tagsToPrecache()
+{
+  Q_D(ctkDICOMDatabase);
+  return d->TagsToPrecache;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMDatabase::setTagsToExcludeFromStorage(const QStringList tags)
+{
+  Q_D(ctkDICOMDatabase);
+  if (d->TagsToExcludeFromStorage == tags)
+  {
+    return;
+  }
+  d->TagsToExcludeFromStorage = tags;
+  emit tagsToExcludeFromStorageChanged();
+}
+
+//------------------------------------------------------------------------------
+const QStringList ctkDICOMDatabase::tagsToExcludeFromStorage()
+{
+  Q_D(ctkDICOMDatabase);
+  return d->TagsToExcludeFromStorage;
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMDatabase::fileExistsAndUpToDate(const QString& filePath)
+{
+  Q_D(ctkDICOMDatabase);
+  bool result(false);
+
+  QSqlQuery check_filename_query(database());
+  check_filename_query.prepare("SELECT InsertTimestamp FROM Images WHERE Filename == ?");
+  check_filename_query.bindValue(0,filePath);
+  d->loggedExec(check_filename_query);
+  if ( check_filename_query.next() &&
+       QFileInfo(filePath).lastModified() < QDateTime::fromString(check_filename_query.value(0).toString(), Qt::ISODate) )
+  {
+    result = true;
+  }
+  check_filename_query.finish();
+  return result;
+}
+
+//------------------------------------------------------------------------------
+template<class ModifiedTimeContainer>
+static void getAllFilesModifiedTimes(QSqlQuery& allFilesModifiedQuery, ModifiedTimeContainer& modifiedTimeForFilepath)
+{
+  while (allFilesModifiedQuery.next())
+  {
+    QString filename = allFilesModifiedQuery.value(0).toString();
+    QDateTime modifiedTime = QDateTime::fromString(allFilesModifiedQuery.value(1).toString(), Qt::ISODate);
+    typename ModifiedTimeContainer::iterator it = modifiedTimeForFilepath.find(filename);
+    if (it == modifiedTimeForFilepath.end())
+    {
+      modifiedTimeForFilepath.insert(filename, modifiedTime);
+    }
+    else if (it.value() > modifiedTime)
+    {
+      it.value() = modifiedTime;
+    }
+  }
+  allFilesModifiedQuery.finish();
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMDatabase::allFilesModifiedTimes(QMap<QString, QDateTime>& modifiedTimeForFilepath)
+{
+  Q_D(ctkDICOMDatabase);
+  QSqlQuery allFilesModifiedQuery(database());
+  allFilesModifiedQuery.prepare("SELECT Filename, InsertTimestamp FROM Images;");
+  bool success = d->loggedExec(allFilesModifiedQuery);
+  getAllFilesModifiedTimes(allFilesModifiedQuery, modifiedTimeForFilepath);
+  return success;
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMDatabase::allFilesModifiedTimes(QHash<QString, QDateTime>& modifiedTimeForFilepath)
+{
+  Q_D(ctkDICOMDatabase);
+  QSqlQuery allFilesModifiedQuery(database());
+  allFilesModifiedQuery.prepare("SELECT Filename, InsertTimestamp FROM Images;");
+  bool success = d->loggedExec(allFilesModifiedQuery);
+  modifiedTimeForFilepath.reserve(modifiedTimeForFilepath.size() + this->imagesCount());
+  getAllFilesModifiedTimes(allFilesModifiedQuery, modifiedTimeForFilepath);
+  return success;
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMDatabase::allDirectoryFingerprints(QHash<QString, ctkDICOMDatabase::DirectoryFingerprint>& fingerprintForDirectory)
+{
+  Q_D(ctkDICOMDatabase);
+  QSqlQuery directoriesQuery(d->Database);
+  directoriesQuery.prepare("SELECT Dirname, ModifiedTime, EntryCount FROM Directories "
+    "WHERE ModifiedTime IS NOT NULL AND EntryCount IS NOT NULL;");
+  bool success = d->loggedExec(directoriesQuery);
+  while (directoriesQuery.next())
+  {
+    fingerprintForDirectory.insert(directoriesQuery.value(0).toString(),
+      ctkDICOMDatabase::DirectoryFingerprint(directoriesQuery.value(1).toLongLong(), directoriesQuery.value(2).toInt()));
+  }
+  directoriesQuery.finish();
+  return success;
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMDatabase::setDirectoryFingerprints(const QHash<QString, ctkDICOMDatabase::DirectoryFingerprint>& fingerprintForDirectory)
+{
+  Q_D(ctkDICOMDatabase);
+  if (fingerprintForDirectory.isEmpty())
+  {
+    return true;
+  }
+  QVariantList dirnames;
+  QVariantList modifiedTimes;
+  QVariantList entryCounts;
+  for (QHash<QString, DirectoryFingerprint>::const_iterator it = fingerprintForDirectory.constBegin();
+    it != fingerprintForDirectory.constEnd(); ++it)
+  {
+    dirnames << it.key();
+    modifiedTimes << it.value().modifiedTime;
+    entryCounts << it.value().entryCount;
+  }
+  QSqlQuery insertDirectoriesQuery(d->Database);
+  insertDirectoriesQuery.prepare("INSERT OR REPLACE INTO Directories (Dirname, ModifiedTime, EntryCount) VALUES (?, ?, ?);");
+  insertDirectoriesQuery.addBindValue(dirnames);
+  insertDirectoriesQuery.addBindValue(modifiedTimes);
+  insertDirectoriesQuery.addBindValue(entryCounts);
+  d->Database.transaction();
+  bool success = d->loggedExecBatch(insertDirectoriesQuery);
+  d->Database.commit();
+  return success;
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMDatabase::removeDirectoryFingerprints(const QStringList& directories)
+{
+  Q_D(ctkDICOMDatabase);
+  if (directories.isEmpty())
+  {
+    return true;
+  }
+  QVariantList dirnames;
+  foreach(const QString& directory, directories)
+  {
+    dirnames << directory;
+  }
+  QSqlQuery removeDirectoriesQuery(d->Database);
+  removeDirectoriesQuery.prepare("DELETE FROM Directories WHERE Dirname = ?;");
+  removeDirectoriesQuery.addBindValue(dirnames);
+  return d->loggedExecBatch(removeDirectoriesQuery);
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMDatabase::isOpen() const
+{
+  Q_D(const ctkDICOMDatabase);
+  return d->Database.isOpen();
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMDatabase::isInMemory() const
+{
+  Q_D(const ctkDICOMDatabase);
+  return d->DatabaseFileName == ":memory:";
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMDatabase::setFileStorageMode(ctkDICOMDatabase::FileStorageMode mode)
+{
+  Q_D(ctkDICOMDatabase);
+  d->StorageMode = mode;
+}
+
+//------------------------------------------------------------------------------
+ctkDICOMDatabase::FileStorageMode ctkDICOMDatabase::fileStorageMode() const
+{
+  Q_D(const ctkDICOMDatabase);
+  return d->StorageMode;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMDatabase::setFileStorageThreadCount(int count)
 {
   Q_D(ctkDICOMDatabase);
-  // Although resetLastInsertedValues is called when items are deleted through
-  // this database connection, there may be concurrent database modifications
-  // (even in the same application) through other connections.
-  // Therefore, we cannot be sure that the last added patient, study, series,
-  // items are still in the database. We clear cached Last... IDs to make sure
-  // the patient, study, series items are created.
-  d->resetLastInsertedValues();
+  d->StorageThreadCount = (count > 0 ? count : QThread::idealThreadCount());
+  d->StorageThreadPool.setMaxThreadCount(d->StorageThreadCount);
 }
 
 //------------------------------------------------------------------------------
-void ctkDICOMDatabase::insert( DcmItem *item, bool storeFile, bool generateThumbnail)
+int ctkDICOMDatabase::fileStorageThreadCount() const
 {
-  if (!item)
-  {
-    return;
-  }
-  ctkDICOMItem dataset;
-  dataset.InitializeFromItem(item, false /* do not take ownership */);
-  this->insert(dataset,storeFile,generateThumbnail);
+  Q_D(const ctkDICOMDatabase);
+  return d->StorageThreadCount;
 }
 
 //------------------------------------------------------------------------------
-void ctkDICOMDatabase::insert( const ctkDICOMItem& dataset, bool storeFile, bool generateThumbnail)
+CTK_GET_CPP(ctkDICOMDatabase, bool, isMemoryMappedFileReadEnabled, MemoryMappedFileRead);
+CTK_SET_CPP(ctkDICOMDatabase, bool, setMemoryMappedFileReadEnabled, MemoryMappedFileRead);
+
+//------------------------------------------------------------------------------
+void ctkDICOMDatabase::setWALModeEnabled(bool enabled)
 {
   Q_D(ctkDICOMDatabase);
-  d->insert(dataset, QString(), storeFile, generateThumbnail);
+  if (d->WALModeEnabled == enabled)
+  {
+    return;
+  }
+  d->WALModeEnabled = enabled;
+  d->applyJournalMode(d->Database);
+  d->applyJournalMode(d->TagCacheDatabase);
+  d->updateWatchedFiles();
 }
 
 //------------------------------------------------------------------------------
-void ctkDICOMDatabase::insert(const QString& filePath, const ctkDICOMItem& dataset,
-  bool storeFile, bool generateThumbnail)
+bool ctkDICOMDatabase::isWALModeEnabled() const
 {
-  Q_D(ctkDICOMDatabase);
-  d->insert(dataset, filePath, storeFile, generateThumbnail);
+  Q_D(const ctkDICOMDatabase);
+  return d->WALModeEnabled;
 }
 
 //------------------------------------------------------------------------------
-void ctkDICOMDatabase::insert( const QString& filePath, bool storeFile, bool generateThumbnail, bool createHierarchy, const QString& destinationDirectoryName)
+bool ctkDICOMDatabasePrivate::updateWatchedFiles()
 {
-  Q_D(ctkDICOMDatabase);
-  Q_UNUSED(createHierarchy);
-  Q_UNUSED(destinationDirectoryName);
-
-  /// first we check if the file is already in the database
-  if (fileExistsAndUpToDate(filePath))
+  if (!this->DatabaseFileWatcher)
   {
-    logger.debug( "File " + filePath + " already added.");
-    return;
+    return false;
   }
-
-  if (d->LoggedExecVerbose)
+  QStringList watchedFiles = this->DatabaseFileWatcher->files();
+  QStringList watchedDirectories = this->DatabaseFileWatcher->directories();
+  // Files are removed from the watcher when they are deleted or replaced
+  if (!watchedFiles.contains(this->DatabaseFileName) && QFileInfo(this->DatabaseFileName).exists())
   {
-    logger.debug( "Processing " + filePath );
+    this->DatabaseFileWatcher->addPath(this->DatabaseFileName);
   }
-
-  ctkDICOMItem dataset;
-
-  dataset.InitializeFromFile(filePath);
-  if ( dataset.IsInitialized() )
+  // In WAL mode the database file is only changed by checkpoints, changes are written into the log file
+  QString walFileName = this->DatabaseFileName + "-wal";
+  QString databaseDirectory = QFileInfo(this->DatabaseFileName).absolutePath();
+  bool walFileAdded = false;
+  if (this->WALModeEnabled)
   {
-    d->insert( dataset, filePath, storeFile, generateThumbnail );
+    if (!watchedDirectories.contains(databaseDirectory))
+    {
+      this->DatabaseFileWatcher->addPath(databaseDirectory);
+    }
+    if (!watchedFiles.contains(walFileName) && QFileInfo(walFileName).exists())
+    {
+      this->DatabaseFileWatcher->addPath(walFileName);
+      walFileAdded = true;
+    }
   }
   else
   {
-    logger.warn(QString("Could not read DICOM file:") + filePath);
+    if (watchedDirectories.contains(databaseDirectory))
+    {
+      this->DatabaseFileWatcher->removePath(databaseDirectory);
+    }
+    if (watchedFiles.contains(walFileName))
+    {
+      this->DatabaseFileWatcher->removePath(walFileName);
+    }
   }
+  return walFileAdded;
 }
 
 //------------------------------------------------------------------------------
-void ctkDICOMDatabase::setTagsToPrecache(const QStringList tags)
+void ctkDICOMDatabase::onDatabaseFileChanged(const QString& path)
 {
   Q_D(ctkDICOMDatabase);
-  if (d->TagsToPrecache == tags)
-  {
-    return;
-  }
-  d->TagsToPrecache = tags;
-  emit tagsToPrecacheChanged();
+  Q_UNUSED(path);
+  d->updateWatchedFiles();
+  emit databaseChanged();
 }
 
 //------------------------------------------------------------------------------
-const QStringList ctkDICOMDatabase::tagsToPrecache()
+void ctkDICOMDatabase::onDatabaseDirectoryChanged(const QString& path)
 {
   Q_D(ctkDICOMDatabase);
-  return d->TagsToPrecache;
+  Q_UNUSED(path);
+  // The log file is created by the first write of a connection, it may already contain changes
+  if (d->updateWatchedFiles())
+  {
+    emit databaseChanged();
+  }
 }
 
 //------------------------------------------------------------------------------
-void ctkDICOMDatabase::setTagsToExcludeFromStorage(const QStringList tags)
+void ctkDICOMDatabase::setWALAutoCheckpoint(int pages)
 {
   Q_D(ctkDICOMDatabase);
-  if (d->TagsToExcludeFromStorage == tags)
+  if (pages < 0)
+  {
+    pages = 0;
+  }
+  if (d->WALAutoCheckpoint == pages)
   {
     return;
   }
-  d->TagsToExcludeFromStorage = tags;
-  emit tagsToExcludeFromStorageChanged();
+  d->WALAutoCheckpoint = pages;
+  if (d->WALModeEnabled)
+  {
+    d->applyJournalMode(d->Database);
+    d->applyJournalMode(d->TagCacheDatabase);
+  }
 }
 
 //------------------------------------------------------------------------------
-const QStringList ctkDICOMDatabase::tagsToExcludeFromStorage()
+int ctkDICOMDatabase::walAutoCheckpoint() const
 {
-  Q_D(ctkDICOMDatabase);
-  return d->TagsToExcludeFromStorage;
+  Q_D(const ctkDICOMDatabase);
+  return d->WALAutoCheckpoint;
 }
 
 //------------------------------------------------------------------------------
-bool ctkDICOMDatabase::fileExistsAndUpToDate(const QString& filePath)
+bool ctkDICOMDatabase::checkpoint(bool truncate/*=false*/)
 {
   Q_D(ctkDICOMDatabase);
-  bool result(false);
-
-  QSqlQuery check_filename_query(database());
-  check_filename_query.prepare("SELECT InsertTimestamp FROM Images WHERE Filename == ?");
-  check_filename_query.bindValue(0,filePath);
-  d->loggedExec(check_filename_query);
-  if ( check_filename_query.next() &&
-       QFileInfo(filePath).lastModified() < QDateTime::fromString(check_filename_query.value(0).toString(), Qt::ISODate) )
+  if (!d->WALModeEnabled || !this->isOpen() || this->isInMemory())
   {
-    result = true;
+    return false;
   }
-  check_filename_query.finish();
-  return result;
+  QString statement = truncate ? "PRAGMA wal_checkpoint(TRUNCATE)" : "PRAGMA wal_checkpoint(PASSIVE)";
+  bool success = true;
+  QList<QSqlDatabase> databases;
+  databases << d->Database;
+  if (d->TagCacheDatabase.isOpen())
+  {
+    databases << d->TagCacheDatabase;
+  }
+  foreach(const QSqlDatabase& database, databases)
+  {
+    QSqlQuery checkpointQuery(database);
+    // The first column is non-zero if the checkpoint could not complete because the database was busy
+    if (!d->loggedExec(checkpointQuery, statement)
+      || (checkpointQuery.next() && checkpointQuery.value(0).toInt() != 0))
+    {
+      success = false;
+    }
+    checkpointQuery.finish();
+  }
+  return success;
 }
 
 //------------------------------------------------------------------------------
-bool ctkDICOMDatabase::allFilesModifiedTimes(QMap<QString, QDateTime>& modifiedTimeForFilepath)
+bool ctkDICOMDatabase::beginReadSnapshot()
 {
   Q_D(ctkDICOMDatabase);
-  QSqlQuery allFilesModifiedQuery(database());
-  allFilesModifiedQuery.prepare("SELECT Filename, InsertTimestamp FROM Images;");
-  bool success = d->loggedExec(allFilesModifiedQuery);
-  while (allFilesModifiedQuery.next())
+  if (d->ReadSnapshotDepth > 0)
   {
-    QString filename = allFilesModifiedQuery.value(0).toString();
-    QDateTime modifiedTime = QDateTime::fromString(allFilesModifiedQuery.value(1).toString(), Qt::ISODate);
-    if (modifiedTimeForFilepath.contains(filename) && modifiedTimeForFilepath[filename] <= modifiedTime)
-    {
-      continue;
-    }
-    modifiedTimeForFilepath[filename] = modifiedTime;
+    d->ReadSnapshotDepth++;
+    return true;
   }
-  allFilesModifiedQuery.finish();
-  return success;
+  if (!d->Database.transaction())
+  {
+    logger.error("Failed to start read snapshot: " + d->Database.lastError().text());
+    return false;
+  }
+  // A transaction only starts reading when the database is first accessed,
+  // access it now so that the snapshot is taken at this point.
+  QSqlQuery startReadQuery(d->Database);
+  if (!d->loggedExec(startReadQuery, "SELECT COUNT(*) FROM sqlite_master"))
+  {
+    startReadQuery.finish();
+    d->Database.rollback();
+    logger.error("Failed to start read snapshot");
+    return false;
+  }
+  startReadQuery.finish();
+  d->ReadSnapshotDepth = 1;
+  return true;
 }
 
 //------------------------------------------------------------------------------
-bool ctkDICOMDatabase::isOpen() const
+void ctkDICOMDatabase::endReadSnapshot()
 {
-  Q_D(const ctkDICOMDatabase);
-  return d->Database.isOpen();
+  Q_D(ctkDICOMDatabase);
+  if (d->ReadSnapshotDepth <= 0)
+  {
+    logger.warn("endReadSnapshot called without a matching beginReadSnapshot");
+    return;
+  }
+  d->ReadSnapshotDepth--;
+  if (d->ReadSnapshotDepth == 0)
+  {
+    d->Database.commit();
+  }
 }
 
 //------------------------------------------------------------------------------
-bool ctkDICOMDatabase::isInMemory() const
+bool ctkDICOMDatabase::isReadSnapshotActive() const
 {
   Q_D(const ctkDICOMDatabase);
-  return d->DatabaseFileName == ":memory:";
+  return d->ReadSnapshotDepth > 0;
 }
 
 //------------------------------------------------------------------------------
@@ -2791,9 +4198,12 @@ bool ctkDICOMDatabase::removeSeries(const QString& seriesInstanceUID, bool clear
 
   QPair<QString,QString> fileToRemove;
   QStringList foldersToRemove;
+  QSet<QString> modifiedDirectories;
   foreach (fileToRemove, removeList)
   {
     QString dbFilePath = fileToRemove.first;
+    // Files will have to be checked again if their directory is re-indexed
+    modifiedDirectories.insert(QFileInfo(dbFilePath).path());
     QString thumbnailToRemove = databaseDirectory() + "/thumbs/" + fileToRemove.second + ".png";
 
     // check that the file is below our internal storage
@@ -2843,6 +4253,8 @@ bool ctkDICOMDatabase::removeSeries(const QString& seriesInstanceUID, bool clear
     QDir().rmpath(folderToRemove);
   }
 
+  this->removeDirectoryFingerprints(modifiedDirectories.toList());
+
   this->cleanup();
 
   d->resetLastInsertedValues();
@@ -2863,6 +4275,8 @@ bool ctkDICOMDatabase::cleanup(bool vacuum/*=false*/)
     seriesCleanup.exec("VACUUM;");
     QSqlQuery tagcacheCleanup(d->TagCacheDatabase);
     seriesCleanup.exec("VACUUM;");
+    // Vacuum may change rowid of studies and series, which are used as keys in the search index
+    d->initializeSearchIndex(true);
   }
   return true;
 }
@@ -2945,10 +4359,12 @@ bool ctkDICOMDatabase::tagCacheExists()
     return false;
   }
 
-  // check that the table exists
+  // check that the tables exist (tag cache created by earlier versions, which
+  // stored each value in a separate row, is not detected and therefore it is re-created)
   QSqlQuery cacheExists( d->TagCacheDatabase );
-  cacheExists.prepare("SELECT * FROM TagCache LIMIT 1");
-  bool success = d->loggedExec(cacheExists);
+  bool success = d->loggedExec(cacheExists, "SELECT * FROM TagCacheInstances LIMIT 1");
+  cacheExists.finish();
+  success = success && d->loadTagCacheTagIDs();
   if (success)
   {
     d->TagCacheVerified = true;
@@ -2963,21 +4379,30 @@ bool ctkDICOMDatabase::initializeTagCache()
 {
   Q_D(ctkDICOMDatabase);
 
-  // First, drop any existing table
-  if ( this->tagCacheExists() )
+  d->clearCachedQueries();
+
+  if (!d->openTagCacheDatabase())
   {
-    qDebug() << "TagCacheDatabase drop existing table\n";
-    QSqlQuery dropCacheTable( d->TagCacheDatabase );
-    dropCacheTable.prepare( "DROP TABLE TagCache" );
-    d->loggedExec(dropCacheTable);
+    return false;
   }
+  d->TagCacheVerified = false;
+  d->TagCacheTagIDs.clear();
+  d->TagCacheTagNames.clear();
+
+  // First, drop any existing table (TagCache table was used by earlier versions)
+  qDebug() << "TagCacheDatabase drop existing table\n";
+  QSqlQuery dropCacheTable( d->TagCacheDatabase );
+  d->loggedExec(dropCacheTable, "DROP TABLE IF EXISTS TagCache");
+  d->loggedExec(dropCacheTable, "DROP TABLE IF EXISTS TagCacheInstances");
+  d->loggedExec(dropCacheTable, "DROP TABLE IF EXISTS TagCacheTags");
 
-  // now create a table
+  // now create the tables
   qDebug() << "TagCacheDatabase adding table\n";
   QSqlQuery createCacheTable( d->TagCacheDatabase );
-  createCacheTable.prepare(
-    "CREATE TABLE TagCache (SOPInstanceUID, Tag, Value, PRIMARY KEY (SOPInstanceUID, Tag))" );
-  bool success = d->loggedExec(createCacheTable);
+  bool success = d->loggedExec(createCacheTable,
+    "CREATE TABLE TagCacheTags (TagID INTEGER PRIMARY KEY, Tag TEXT UNIQUE NOT NULL)");
+  success = success && d->loggedExec(createCacheTable,
+    "CREATE TABLE TagCacheInstances (SOPInstanceUID TEXT PRIMARY KEY, TagValues BLOB)");
   if (!success)
   {
     return false;
@@ -2998,19 +4423,22 @@ QString ctkDICOMDatabase::cachedTag(const QString sopInstanceUID, const QString
       return( "" );
     }
   }
-  QSqlQuery selectValue( d->TagCacheDatabase );
-  selectValue.prepare( "SELECT Value FROM TagCache WHERE SOPInstanceUID = :sopInstanceUID AND Tag = :tag" );
-  selectValue.bindValue(":sopInstanceUID",sopInstanceUID);
-  selectValue.bindValue(":tag",tag);
-  d->loggedExec(selectValue);
-  QString result("");
-  if (selectValue.next())
+  QHash<QString, QHash<int, QString> > valuesForTagIDForInstance;
+  d->readTagCacheRecords(QStringList() << sopInstanceUID, valuesForTagIDForInstance);
+  if (valuesForTagIDForInstance.isEmpty())
   {
-    result = selectValue.value(0).toString();
-    if (result == QString(""))
-    {
-      result = ValueIsEmptyString;
-    }
+    return( "" );
+  }
+  int tagID = d->tagCacheTagID(tag, false);
+  QHash<int, QString>::const_iterator valueIt = valuesForTagIDForInstance.constBegin().value().constFind(tagID);
+  if (tagID < 0 || valueIt == valuesForTagIDForInstance.constBegin().value().constEnd())
+  {
+    return( "" );
+  }
+  QString result = valueIt.value();
+  if (result == QString(""))
+  {
+    result = ValueIsEmptyString;
   }
   return( result );
 }
@@ -3028,22 +4456,123 @@ void ctkDICOMDatabase::getCachedTags(const QString sopInstanceUID, QMap<QString,
       return;
     }
   }
-  QSqlQuery selectValue( d->TagCacheDatabase );
-  selectValue.prepare( "SELECT Tag, Value FROM TagCache WHERE SOPInstanceUID = :sopInstanceUID" );
-  selectValue.bindValue(":sopInstanceUID",sopInstanceUID);
-  d->loggedExec(selectValue);
-  QString tag;
-  QString value;
-  while (selectValue.next())
+  QHash<QString, QHash<int, QString> > valuesForTagIDForInstance;
+  d->readTagCacheRecords(QStringList() << sopInstanceUID, valuesForTagIDForInstance);
+  if (valuesForTagIDForInstance.isEmpty())
   {
-    tag = selectValue.value(0).toString();
-    value = selectValue.value(1).toString();
-    if (value == TagNotInInstance || value == ValueIsEmptyString || value == ValueIsNotStored)
+    return;
+  }
+  d->cachedTagsFromRecord(valuesForTagIDForInstance.constBegin().value(), cachedTags);
+}
+
+//------------------------------------------------------------------------------
+QList<QStringList> ctkDICOMDatabase::cachedTags(const QStringList& sopInstanceUIDs, const QStringList& tags)
+{
+  Q_D(ctkDICOMDatabase);
+  QList<QStringList> valuesForInstances;
+  QStringList emptyValues;
+  for (int tagIndex = 0; tagIndex < tags.size(); ++tagIndex)
+  {
+    emptyValues << QString();
+  }
+  if ( !this->tagCacheExists() )
+  {
+    if ( !this->initializeTagCache() )
     {
-      value = QString("");
+      for (int instanceIndex = 0; instanceIndex < sopInstanceUIDs.size(); ++instanceIndex)
+      {
+        valuesForInstances << emptyValues;
+      }
+      return valuesForInstances;
     }
-    cachedTags.insert(tag, value);
   }
+
+  QHash<QString, QHash<int, QString> > valuesForTagIDForInstance;
+  d->readTagCacheRecords(sopInstanceUIDs, valuesForTagIDForInstance);
+  QList<int> tagIDs;
+  foreach(const QString& tag, tags)
+  {
+    tagIDs << d->tagCacheTagID(tag, false);
+  }
+
+  foreach(const QString& sopInstanceUID, sopInstanceUIDs)
+  {
+    QHash<QString, QHash<int, QString> >::const_iterator instanceIt = valuesForTagIDForInstance.constFind(sopInstanceUID);
+    if (instanceIt == valuesForTagIDForInstance.constEnd())
+    {
+      valuesForInstances << emptyValues;
+      continue;
+    }
+    QStringList values;
+    foreach(int tagID, tagIDs)
+    {
+      QHash<int, QString>::const_iterator valueIt = instanceIt.value().constFind(tagID);
+      if (tagID < 0 || valueIt == instanceIt.value().constEnd())
+      {
+        values << QString();
+      }
+      else
+      {
+        values << (valueIt.value().isEmpty() ? ValueIsEmptyString : valueIt.value());
+      }
+    }
+    valuesForInstances << values;
+  }
+  return valuesForInstances;
+}
+
+//------------------------------------------------------------------------------
+QList<QStringList> ctkDICOMDatabase::instanceValues(const QStringList& sopInstanceUIDs, const QStringList& tags)
+{
+  Q_D(ctkDICOMDatabase);
+  QList<QStringList> valuesForInstances = this->cachedTags(sopInstanceUIDs, tags);
+
+  // Values missing from the tag cache are read from the files (each file is read at most once)
+  QHash<QString, QHash<QString, QString> > valuesToCache;
+  for (int instanceIndex = 0; instanceIndex < valuesForInstances.size(); ++instanceIndex)
+  {
+    QStringList& values = valuesForInstances[instanceIndex];
+    QScopedPointer<ctkDICOMItem> dataset;
+    for (int tagIndex = 0; tagIndex < values.size(); ++tagIndex)
+    {
+      if (!values[tagIndex].isEmpty())
+      {
+        continue;
+      }
+      if (dataset.isNull())
+      {
+        dataset.reset(new ctkDICOMItem);
+        dataset->SetMemoryMappedFileReadEnabled(d->MemoryMappedFileRead);
+        QString filePath = this->fileForInstance(sopInstanceUIDs[instanceIndex]);
+        if (!filePath.isEmpty())
+        {
+          dataset->InitializeFromFile(filePath);
+        }
+        if (!dataset->IsInitialized())
+        {
+          logger.error("File " + filePath + " could not be initialized.");
+          break;
+        }
+      }
+      values[tagIndex] = d->tagCacheValueFromDataset(*dataset, tags[tagIndex]);
+      valuesToCache[sopInstanceUIDs[instanceIndex]].insert(tags[tagIndex], values[tagIndex]);
+    }
+    for (int tagIndex = 0; tagIndex < values.size(); ++tagIndex)
+    {
+      if (values[tagIndex] == TagNotInInstance || values[tagIndex] == ValueIsEmptyString || values[tagIndex] == ValueIsNotStored)
+      {
+        values[tagIndex] = QString();
+      }
+    }
+  }
+
+  if (!valuesToCache.isEmpty())
+  {
+    d->TagCacheDatabase.transaction();
+    d->writeTagCacheValues(valuesToCache);
+    d->TagCacheDatabase.commit();
+  }
+  return valuesForInstances;
 }
 
 //------------------------------------------------------------------------------
@@ -3075,37 +4604,14 @@ bool ctkDICOMDatabase::cacheTags(const QStringList sopInstanceUIDs, const QStrin
       }
     }
 
-  d->TagCacheDatabase.transaction();
-
-  QSqlQuery insertTags(d->TagCacheDatabase);
-  insertTags.prepare( "INSERT OR REPLACE INTO TagCache VALUES(?,?,?)" );
-
-  QStringList::const_iterator sopInstanceUIDsIt = sopInstanceUIDs.begin();
-  QStringList::const_iterator tagsIt = tags.begin();
-  QStringList::const_iterator valuesIt = values.begin();
-  bool success = true;
+  QHash<QString, QHash<QString, QString> > valuesForTagForInstance;
   for (int i = 0; i<itemCount; ++i)
   {
-    insertTags.bindValue(0, *sopInstanceUIDsIt);
-    insertTags.bindValue(1, *tagsIt);
-    if (valuesIt->isEmpty())
-    {
-      // replace empty strings with special flag string
-      insertTags.bindValue(2, TagNotInInstance);
-    }
-    else
-    {
-      insertTags.bindValue(2, *valuesIt);
-    }
-    if (!insertTags.exec())
-    {
-      success = false;
-    }
-    ++sopInstanceUIDsIt;
-    ++tagsIt;
-    ++valuesIt;
+    valuesForTagForInstance[sopInstanceUIDs[i]].insert(tags[i], values[i]);
   }
 
+  d->TagCacheDatabase.transaction();
+  bool success = d->writeTagCacheValues(valuesForTagForInstance);
   d->TagCacheDatabase.commit();
 
   return success;
@@ -3119,25 +4625,44 @@ void ctkDICOMDatabase::removeCachedTags(const QString sopInstanceUID)
   {
     return;
   }
-  QSqlQuery deleteFile(d->TagCacheDatabase);
-  deleteFile.prepare("DELETE FROM TagCache WHERE SOPInstanceUID == :sopInstanceUID");
-  deleteFile.bindValue(":sopInstanceUID", sopInstanceUID);
+  QSqlQuery deleteFile = d->cachedQuery(d->TagCacheDatabase, "DELETE FROM TagCacheInstances WHERE SOPInstanceUID == ?");
+  deleteFile.bindValue(0, sopInstanceUID);
   bool success = deleteFile.exec();
   if (!success)
   {
     logger.error("SQLITE ERROR deleting tag cache row: " + deleteFile.lastError().driverText());
   }
+  deleteFile.finish();
 }
 
 //------------------------------------------------------------------------------
 void ctkDICOMDatabase::updateDisplayedFields()
 {
   Q_D(ctkDICOMDatabase);
+  QElapsedTimer displayedFieldsTimer;
+  displayedFieldsTimer.start();
 
   // Get the files for which the displayed fields have not been created yet (DisplayedFieldsUpdatedTimestamp is NULL)
   //TODO: handle cases when the values actually changed; now we only cover insertion and schema update
+  QStringList newSOPInstanceUIDs;
+  QStringList newSeriesInstanceUIDs; // in the order of first occurrence
+  QHash<QString, QStringList> newSOPInstanceUIDsForSeries;
   QSqlQuery newFilesQuery(d->Database);
   d->loggedExec(newFilesQuery,QString("SELECT SOPInstanceUID, SeriesInstanceUID FROM Images WHERE DisplayedFieldsUpdatedTimestamp IS NULL;"));
+  while (newFilesQuery.next())
+  {
+    QString sopInstanceUID = newFilesQuery.value(0).toString();
+    QString seriesInstanceUID = newFilesQuery.value(1).toString();
+    newSOPInstanceUIDs << sopInstanceUID;
+    QHash<QString, QStringList>::iterator seriesIt = newSOPInstanceUIDsForSeries.find(seriesInstanceUID);
+    if (seriesIt == newSOPInstanceUIDsForSeries.end())
+    {
+      newSeriesInstanceUIDs << seriesInstanceUID;
+      seriesIt = newSOPInstanceUIDsForSeries.insert(seriesInstanceUID, QStringList());
+    }
+    seriesIt.value() << sopInstanceUID;
+  }
+  newFilesQuery.finish();
 
   // Populate displayed fields maps from the current display tables
   QMap<QString /*SeriesInstanceUID*/, QMap<QString /*DisplayField*/, QString /*Value*/> > displayedFieldsMapSeries;
@@ -3149,65 +4674,31 @@ void ctkDICOMDatabase::updateDisplayedFields()
   int progressValue = 0;
   emit displayedFieldsUpdateProgress(++progressValue);
 
-  // Get display names for newly added files and add them into the display tables
-  while (newFilesQuery.next())
+  if (!newSOPInstanceUIDs.isEmpty() && !this->tagCacheExists())
   {
-    QString sopInstanceUID = newFilesQuery.value(0).toString();
-    QString seriesInstanceUID = newFilesQuery.value(1).toString();
-    QMap<QString, QString> cachedTags;
-    this->getCachedTags(sopInstanceUID, cachedTags);
-
-    // Patient
-    QString patientsName = cachedTags[ctkDICOMItem::TagKeyStripped(DCM_PatientName)];
-    QString patientID = cachedTags[ctkDICOMItem::TagKeyStripped(DCM_PatientID)];
-    QString studyInstanceUID = cachedTags[ctkDICOMItem::TagKeyStripped(DCM_StudyInstanceUID)];
-    if (!d->uidsForDataSet(patientsName, patientID, studyInstanceUID))
-    {
-      // error occurred, message is already logged
-      continue;
-    }
-    QString patientsBirthDate = cachedTags[ctkDICOMItem::TagKeyStripped(DCM_PatientBirthDate)];
-
-    QString compositeId = d->getDisplayPatientFieldsKey(patientID, patientsName, patientsBirthDate, displayedFieldsMapPatient);
-    if (compositeId.isEmpty())
-    {
-      logger.error("Failed to find patient for SOP Instance UID = " + sopInstanceUID);
-      continue;
-    }
-    QMap<QString, QString> displayedFieldsForCurrentPatient = displayedFieldsMapPatient[compositeId];
-
-    // Study
-    QString displayedFieldsKeyForCurrentStudy = d->getDisplayStudyFieldsKey(
-      cachedTags[ctkDICOMItem::TagKeyStripped(DCM_StudyInstanceUID)],
-      displayedFieldsMapStudy );
-    if (displayedFieldsKeyForCurrentStudy.isEmpty())
-    {
-      logger.error("Failed to find study for SOP Instance UID = " + sopInstanceUID);
-      continue;
-    }
-    QMap<QString, QString> displayedFieldsForCurrentStudy = displayedFieldsMapStudy[ displayedFieldsKeyForCurrentStudy ];
-    displayedFieldsForCurrentStudy["PatientCompositeID"] = compositeId;
+    this->initializeTagCache();
+  }
 
-    // Series
-    QString displayedFieldsKeyForCurrentSeries = d->getDisplaySeriesFieldsKey(
-      seriesInstanceUID,
-      displayedFieldsMapSeries );
-    if (displayedFieldsKeyForCurrentSeries.isEmpty())
+  // Get display names for newly added files. Complete series are processed together,
+  // in batches, to limit the number of cached tags that are kept in memory.
+  int seriesIndex = 0;
+  while (seriesIndex < newSeriesInstanceUIDs.size())
+  {
+    QList<ctkDICOMDisplayedFieldsInstance> instances;
+    while (seriesIndex < newSeriesInstanceUIDs.size() && instances.size() < DISPLAYED_FIELDS_BATCH_SIZE)
     {
-      logger.error("Failed to find series for SOP Instance UID = " + sopInstanceUID);
-      continue;
+      const QString& seriesInstanceUID = newSeriesInstanceUIDs[seriesIndex++];
+      foreach (const QString& sopInstanceUID, newSOPInstanceUIDsForSeries.value(seriesInstanceUID))
+      {
+        ctkDICOMDisplayedFieldsInstance instance;
+        instance.SOPInstanceUID = sopInstanceUID;
+        instance.SeriesInstanceUID = seriesInstanceUID;
+        instances << instance;
+      }
     }
-    QMap<QString, QString> displayedFieldsForCurrentSeries = displayedFieldsMapSeries[ displayedFieldsKeyForCurrentSeries ];
-
-    // Do the update of the displayed fields using the roles
-    d->DisplayedFieldGenerator.updateDisplayedFieldsForInstance(sopInstanceUID, cachedTags,
-      displayedFieldsForCurrentSeries, displayedFieldsForCurrentStudy, displayedFieldsForCurrentPatient);
-
-    // Set updated fields to the series / study / patient displayed fields maps
-    displayedFieldsMapSeries[ displayedFieldsKeyForCurrentSeries ] = displayedFieldsForCurrentSeries;
-    displayedFieldsMapStudy[ displayedFieldsKeyForCurrentStudy ] = displayedFieldsForCurrentStudy;
-    displayedFieldsMapPatient[ compositeId ] = displayedFieldsForCurrentPatient;
-  } // For each instance
+    d->updateDisplayedFieldsForInstances(instances, displayedFieldsMapSeries, displayedFieldsMapStudy, displayedFieldsMapPatient);
+  }
+  newSOPInstanceUIDsForSeries.clear();
 
   emit displayedFieldsUpdateProgress(++progressValue);
 
@@ -3231,20 +4722,29 @@ void ctkDICOMDatabase::updateDisplayedFields()
     if (d->applyDisplayedFieldsChanges(displayedFieldsMapSeries, displayedFieldsMapStudy, displayedFieldsMapPatient))
     {
       // Update image timestamp
-      newFilesQuery.first();
-      newFilesQuery.previous(); // Need to go one before the first record
-      while (newFilesQuery.next())
+      int firstIndex = 0;
+      while (firstIndex < newSOPInstanceUIDs.size())
       {
+        int statementUIDCount = qMin(MAXIMUM_SQL_VARIABLE_COUNT, newSOPInstanceUIDs.size() - firstIndex);
         QSqlQuery updateDisplayedFieldsUpdatedTimestampStatement(d->Database);
-        QString updateDisplayedFieldsUpdatedTimestampStatementString =
-          QString("UPDATE IMAGES SET DisplayedFieldsUpdatedTimestamp=CURRENT_TIMESTAMP WHERE SOPInstanceUID='%1';").arg(newFilesQuery.value(0).toString());
-        d->loggedExec(updateDisplayedFieldsUpdatedTimestampStatement, updateDisplayedFieldsUpdatedTimestampStatementString);
+        updateDisplayedFieldsUpdatedTimestampStatement.prepare(
+          QString("UPDATE Images SET DisplayedFieldsUpdatedTimestamp=CURRENT_TIMESTAMP WHERE SOPInstanceUID IN (?%1);")
+          .arg(QString(",?").repeated(statementUIDCount - 1)));
+        for (int i = 0; i < statementUIDCount; ++i)
+        {
+          updateDisplayedFieldsUpdatedTimestampStatement.bindValue(i, newSOPInstanceUIDs[firstIndex + i]);
+        }
+        d->loggedExec(updateDisplayedFieldsUpdatedTimestampStatement);
+        firstIndex += statementUIDCount;
       }
     }
 
     d->Database.commit();
   }
 
+  d->Metrics.addPhase(IndexingMetrics::DisplayedFieldsPhase, newSOPInstanceUIDs.size(),
+    displayedFieldsTimer.nsecsElapsed());
+
   emit displayedFieldsUpdated();
   emit databaseChanged();
 }
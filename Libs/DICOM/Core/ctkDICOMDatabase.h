@@ -27,6 +27,7 @@
 #include <QSqlDatabase>
 
 #include "ctkDICOMItem.h"
+#include "ctkDICOMHeaderRecord.h"
 #include "ctkDICOMCoreExport.h"
 
 class QDateTime;
@@ -53,6 +54,7 @@ class CTK_DICOM_CORE_EXPORT ctkDICOMDatabase : public QObject
 {
 
   Q_OBJECT
+  Q_ENUMS(FileStorageMode)
   Q_PROPERTY(bool isOpen READ isOpen)
   Q_PROPERTY(bool isInMemory READ isInMemory)
   Q_PROPERTY(QString lastError READ lastError)
@@ -63,14 +65,167 @@ class CTK_DICOM_CORE_EXPORT ctkDICOMDatabase : public QObject
   Q_PROPERTY(QStringList patientFieldNames READ patientFieldNames)
   Q_PROPERTY(QStringList studyFieldNames READ studyFieldNames)
   Q_PROPERTY(QStringList seriesFieldNames READ seriesFieldNames)
+  Q_PROPERTY(bool walModeEnabled READ isWALModeEnabled WRITE setWALModeEnabled)
+  Q_PROPERTY(int walAutoCheckpoint READ walAutoCheckpoint WRITE setWALAutoCheckpoint)
+  Q_PROPERTY(ctkDICOMDatabase::FileStorageMode fileStorageMode READ fileStorageMode WRITE setFileStorageMode)
+  Q_PROPERTY(int fileStorageThreadCount READ fileStorageThreadCount WRITE setFileStorageThreadCount)
+  Q_PROPERTY(bool memoryMappedFileReadEnabled READ isMemoryMappedFileReadEnabled WRITE setMemoryMappedFileReadEnabled)
 
 public:
+  /// Specifies how an existing file is stored in the database folder when it is inserted
+  /// with file storage enabled (storeFile or copyFile is true).
+  enum FileStorageMode
+  {
+    /// Copy the file (default).
+    CopyFileStorage,
+    /// Create a hard link to the original file. The file is copied if a hard link cannot
+    /// be created (e.g., the file is on a different volume than the database).
+    /// \warning Modifying the original file also modifies the file in the database.
+    HardLinkFileStorage,
+    /// Create a copy-on-write clone of the original file (reflink, on Linux file systems that
+    /// support FICLONE, such as Btrfs or XFS). The file is copied if it cannot be cloned.
+    ReflinkFileStorage,
+    /// Move the file into the database folder. The original file is removed.
+    MoveFileStorage
+  };
+
   struct IndexingResult
   {
+    IndexingResult()
+      : copyFile(false)
+      , overwriteExistingDataset(false)
+      , generateThumbnail(false)
+    {
+    }
     QString filePath;
+    /// Full dataset. Only needed if header is not initialized
+    /// or there is no file at filePath (then the file is created from the dataset).
     QSharedPointer<ctkDICOMItem> dataset;
+    /// Values of the dataset that are inserted into the database.
+    /// If not initialized then it is created from dataset.
+    ctkDICOMHeaderRecord header;
     bool copyFile;
     bool overwriteExistingDataset;
+    /// If true then a thumbnail is generated after the instance is inserted.
+    /// Indexing leaves it false, thumbnails are generated when they are first needed.
+    bool generateThumbnail;
+  };
+
+  /// Summary of a directory content, used for detecting if the directory
+  /// changed since it was last indexed.
+  struct DirectoryFingerprint
+  {
+    DirectoryFingerprint()
+      : modifiedTime(0)
+      , entryCount(-1)
+    {
+    }
+    DirectoryFingerprint(qint64 time, int count)
+      : modifiedTime(time)
+      , entryCount(count)
+    {
+    }
+    bool operator==(const DirectoryFingerprint& other) const
+    {
+      return this->modifiedTime == other.modifiedTime && this->entryCount == other.entryCount;
+    }
+    bool operator!=(const DirectoryFingerprint& other) const
+    {
+      return !(*this == other);
+    }
+    /// Last modification time of the directory (milliseconds since epoch)
+    qint64 modifiedTime;
+    /// Number of files and subdirectories in the directory
+    int entryCount;
+  };
+
+  /// Counters and cumulative processing times of the phases of indexing,
+  /// for measuring and tuning indexing performance.
+  /// Times of phases that are performed in multiple threads (parsing) are summed up
+  /// for all threads, therefore they may exceed the elapsed time.
+  struct IndexingMetrics
+  {
+    enum Phase
+    {
+      /// Listing content of directories
+      EnumeratePhase,
+      /// Getting modification time of files
+      StatPhase,
+      /// Parsing DICOM files
+      ParsePhase,
+      /// Waiting for parsing results in the database thread
+      QueueWaitPhase,
+      /// Inserting patients, studies, series, and images into the database
+      InsertPhase,
+      /// Writing values of precached tags into the tag cache
+      PrecachePhase,
+      /// Generating thumbnails
+      ThumbnailPhase,
+      /// Updating displayed fields
+      DisplayedFieldsPhase,
+      PhaseCount
+    };
+
+    IndexingMetrics()
+    {
+      this->reset();
+    }
+    void reset()
+    {
+      for (int phase = 0; phase < PhaseCount; ++phase)
+      {
+        this->counts[phase] = 0;
+        this->nanoseconds[phase] = 0;
+      }
+      this->fileCount = 0;
+      this->bytesRead = 0;
+      this->elapsedNanoseconds = 0;
+    }
+    void addPhase(Phase phase, qint64 count, qint64 phaseNanoseconds)
+    {
+      this->counts[phase] += count;
+      this->nanoseconds[phase] += phaseNanoseconds;
+    }
+    /// Add counters and times of all phases. File count, bytes read, and elapsed time are also summed.
+    IndexingMetrics& operator+=(const IndexingMetrics& other)
+    {
+      for (int phase = 0; phase < PhaseCount; ++phase)
+      {
+        this->counts[phase] += other.counts[phase];
+        this->nanoseconds[phase] += other.nanoseconds[phase];
+      }
+      this->fileCount += other.fileCount;
+      this->bytesRead += other.bytesRead;
+      this->elapsedNanoseconds += other.elapsedNanoseconds;
+      return *this;
+    }
+    double seconds(Phase phase) const
+    {
+      return this->nanoseconds[phase] / 1.0e9;
+    }
+    /// Number of processed files per second of elapsed time
+    double filesPerSecond() const
+    {
+      return this->elapsedNanoseconds > 0 ? this->fileCount * 1.0e9 / this->elapsedNanoseconds : 0.0;
+    }
+    static const char* phaseName(Phase phase)
+    {
+      static const char* const names[PhaseCount] = { "enumerate", "stat", "parse", "queue wait",
+        "insert", "precache", "thumbnail", "displayed fields" };
+      return (phase >= 0 && phase < PhaseCount) ? names[phase] : "";
+    }
+
+    /// Number of items processed in each phase (directories, files, or instances)
+    qint64 counts[PhaseCount];
+    /// Cumulative time spent in each phase
+    qint64 nanoseconds[PhaseCount];
+    /// Number of files that were processed (parsed or skipped because they were already indexed)
+    qint64 fileCount;
+    /// Total size of the parsed files. Pixel data is not read during indexing,
+    /// therefore actual amount of data read from disk may be less.
+    qint64 bytesRead;
+    /// Wall-clock time of indexing
+    qint64 elapsedNanoseconds;
   };
 
   explicit ctkDICOMDatabase(QObject *parent = 0);
@@ -98,6 +253,69 @@ public:
   /// @return True if in memory mode, false otherwise.
   bool isInMemory() const;
 
+  /// Use write-ahead logging (WAL) journal mode. Disabled by default.
+  /// In WAL mode readers do not block writers and writers do not block readers,
+  /// therefore the database can be browsed while the indexer inserts files in the background.
+  /// The setting is applied when the database is opened, or immediately if the database is already open.
+  /// Switching back from WAL mode only succeeds if no other connection uses the database.
+  /// \sa setWALAutoCheckpoint, checkpoint, beginReadSnapshot
+  Q_INVOKABLE void setWALModeEnabled(bool enabled);
+  Q_INVOKABLE bool isWALModeEnabled() const;
+
+  /// Size of the write-ahead log (in pages) that triggers an automatic checkpoint
+  /// when a transaction is committed. Larger values make bulk inserts faster but
+  /// increase the size of the log file. If set to 0 then automatic checkpoints are disabled
+  /// and checkpoint() has to be called explicitly. Default is 1000 (SQLite default).
+  /// Only used in WAL mode.
+  Q_INVOKABLE void setWALAutoCheckpoint(int pages);
+  Q_INVOKABLE int walAutoCheckpoint() const;
+
+  /// Method of storing existing files in the database folder. Default is CopyFileStorage.
+  /// Hard links, clones, and moves only require updating file system metadata if the
+  /// imported files are on the same volume as the database.
+  Q_INVOKABLE void setFileStorageMode(ctkDICOMDatabase::FileStorageMode mode);
+  Q_INVOKABLE ctkDICOMDatabase::FileStorageMode fileStorageMode() const;
+
+  /// Number of threads that store files in the database folder when a batch of
+  /// indexing results is inserted (e.g., by ctkDICOMIndexer). Using multiple threads
+  /// speeds up importing when files have to be copied from another volume.
+  /// Setting a value <= 0 uses the number of processor cores (QThread::idealThreadCount()).
+  /// Default is 1, which stores files in the thread that inserts the results.
+  Q_INVOKABLE void setFileStorageThreadCount(int count);
+  Q_INVOKABLE int fileStorageThreadCount() const;
+
+  /// Read DICOM files through a memory mapping when they are parsed by the database
+  /// (element values, file headers) and by ctkDICOMIndexer.
+  /// This is faster for files on local storage or in the file system cache.
+  /// It is not recommended for files on network shares, as the files may be modified
+  /// while they are mapped. Disabled by default.
+  /// \sa ctkDICOMItem::SetMemoryMappedFileReadEnabled
+  Q_INVOKABLE void setMemoryMappedFileReadEnabled(bool enabled);
+  Q_INVOKABLE bool isMemoryMappedFileReadEnabled() const;
+
+  /// Transfer content of the write-ahead log into the database file.
+  /// If truncate is false then a passive checkpoint is performed, which does not wait for
+  /// readers or writers. If truncate is true then ongoing reads and writes are waited for
+  /// and the log file is truncated to zero size.
+  /// Only used in WAL mode. Returns false if the checkpoint failed.
+  Q_INVOKABLE bool checkpoint(bool truncate = false);
+
+  /// \brief Start a read snapshot.
+  ///
+  /// All queries that are run through this object until endReadSnapshot() is called see the
+  /// database content as it was when the snapshot was started, even if other connections
+  /// (such as the background indexer) modify the database meanwhile.
+  /// Calls may be nested, the snapshot ends when endReadSnapshot is called the same number of times.
+  ///
+  /// \warning The database must not be modified through this object while a snapshot is active.
+  /// If WAL mode is disabled then other connections cannot write the database while a snapshot
+  /// is active, therefore snapshots should be kept as short as possible.
+  ///
+  /// Returns false if the snapshot could not be started.
+  Q_INVOKABLE bool beginReadSnapshot();
+  Q_INVOKABLE void endReadSnapshot();
+  Q_INVOKABLE bool isReadSnapshotActive() const;
+
   /// Set thumbnail generator object
   Q_INVOKABLE void setThumbnailGenerator(ctkDICOMAbstractThumbnailGenerator* generator);
   /// Get thumbnail generator object
@@ -189,6 +407,17 @@ public:
   Q_INVOKABLE QStringList allFiles();
 
   bool allFilesModifiedTimes(QMap<QString, QDateTime>& modifiedTimeForFilepath);
+  bool allFilesModifiedTimes(QHash<QString, QDateTime>& modifiedTimeForFilepath);
+
+  /// \brief Get fingerprints of directories that have been completely indexed.
+  /// If the fingerprint of a directory is unchanged then files in that directory
+  /// do not have to be checked again when the directory is re-indexed.
+  bool allDirectoryFingerprints(QHash<QString, ctkDICOMDatabase::DirectoryFingerprint>& fingerprintForDirectory);
+  /// \brief Store fingerprints of directories that have been completely indexed.
+  bool setDirectoryFingerprints(const QHash<QString, ctkDICOMDatabase::DirectoryFingerprint>& fingerprintForDirectory);
+  /// \brief Remove stored fingerprints of directories, for example because
+  /// files have been removed from the database.
+  bool removeDirectoryFingerprints(const QStringList& directories);
 
   /// \brief Load the header from a file and allow access to elements
   /// @param sopInstanceUID A string with the uid for a given instance
@@ -233,6 +462,8 @@ public:
   ///                  be stored to disk. Note that in case of a memory-only
   ///                  database, this flag is ignored. Usually, this flag
   ///                  does only make sense if a full object is received.
+  ///                  If the file path is specified then the file is stored
+  ///                  as specified by fileStorageMode.
   /// @param @generateThumbnail If true, a thumbnail is generated.
   ///
   Q_INVOKABLE void insert( const ctkDICOMItem& ctkDataset,
@@ -260,6 +491,28 @@ public:
   /// that did not contain ColumnDisplayProperties table.
   Q_INVOKABLE bool isDisplayedFieldsTableAvailable() const;
 
+  /// Counters and cumulative times of database update phases (insert, precache,
+  /// thumbnail, and displayed fields) performed by this database connection
+  /// since it was created or the metrics were reset.
+  ctkDICOMDatabase::IndexingMetrics indexingMetrics() const;
+  void resetIndexingMetrics();
+
+  /// Get if the search index of the Patients, Studies, and Series tables is available.
+  /// The index is created when the database is opened and it is kept up-to-date by the database
+  /// (when records are inserted, updated, or removed).
+  Q_INVOKABLE bool isSearchIndexAvailable(const QString& table) const;
+
+  /// Get an SQL condition that selects rows of the table (Patients, Studies, or Series)
+  /// that contain the text specified by a bound value (see searchPattern()) in any of the searched fields.
+  /// The table may be referred to by tableAlias in the query (by default the table name is used).
+  /// Returns empty string if search index is not available for the table.
+  Q_INVOKABLE QString searchIndexCondition(const QString& table, const QString& tableAlias = QString()) const;
+
+  /// Convert a filter text to a pattern that can be bound to the searchIndexCondition().
+  /// Wildcards '*' and '?' of the filter text are supported, other characters
+  /// (including '%' and '_') are matched literally.
+  Q_INVOKABLE static QString searchPattern(const QString& text);
+
   /// Reset cached item IDs to make sure previous
   /// inserts do not interfere with upcoming insert operations.
   /// Typically, it should be call just before a batch of files
@@ -332,6 +585,15 @@ public:
   Q_INVOKABLE QString cachedTag (const QString sopInstanceUID, const QString tag);
   /// Return the list of all cached tags and values for the specified sopInstanceUID. Returns with empty string if the tag is not present in the cache.
   Q_INVOKABLE void getCachedTags(const QString sopInstanceUID, QMap<QString, QString> &cachedTags);
+  /// Return values of cached tags for multiple instances, using a single database query
+  /// (for each 999 instances). The returned list contains a list of values for each
+  /// instance, in the order of sopInstanceUIDs and tags. Values follow the same convention
+  /// as cachedTag: empty string is returned for tags that are not present in the cache.
+  Q_INVOKABLE QList<QStringList> cachedTags(const QStringList& sopInstanceUIDs, const QStringList& tags);
+  /// Return values of tags for multiple instances. Values that are not found in the tag cache
+  /// are read from the files (each file is read at most once) and are added to the cache in one batch.
+  /// Empty string is returned if element is missing or excluded from storage, as in instanceValue.
+  Q_INVOKABLE QList<QStringList> instanceValues(const QStringList& sopInstanceUIDs, const QStringList& tags);
   /// Insert an instance tag's value into to the cache
   Q_INVOKABLE bool cacheTag (const QString sopInstanceUID, const QString tag, const QString value);
   /// Insert lists of tags into the cache as a batch query operation
@@ -412,6 +674,12 @@ Q_SIGNALS:
   /// Indicate displayed fields update finished
   void displayedFieldsUpdated();
 
+protected Q_SLOTS:
+  /// Emit databaseChanged when the database file or the write-ahead log file is modified
+  void onDatabaseFileChanged(const QString& path);
+  /// Start watching the write-ahead log file when SQLite re-creates it
+  void onDatabaseDirectoryChanged(const QString& path);
+
 protected:
   QScopedPointer<ctkDICOMDatabasePrivate> d_ptr;
 
@@ -420,5 +688,7 @@ private:
   Q_DISABLE_COPY(ctkDICOMDatabase);
 };
 
+Q_DECLARE_METATYPE(ctkDICOMDatabase::IndexingMetrics)
+
 #endif
 
@@ -60,7 +60,9 @@ public:
   /// Collect the DICOM tags required by all the registered rules
   Q_INVOKABLE QStringList getRequiredTags();
 
-  /// Update displayed fields for an instance, invoking all registered rules
+  /// Update displayed fields for an instance, invoking all registered rules.
+  /// The database calls this method from multiple threads at the same time (for instances
+  /// that do not share any series, study, or patient).
   Q_INVOKABLE void updateDisplayedFieldsForInstance(const QString& sopInstanceUID,
                                                     const QMap<QString, QString> &cachedTags,
                                                     QMap<QString, QString> &displayedFieldsForCurrentSeries,
@@ -47,6 +47,8 @@ public:
   /// Generate displayed fields for a certain instance based on its cached tags
   /// Each rule plugin has the chance to fill any field in the series, study, and patient fields.
   /// The way these generated fields will be used is defined by \sa mergeDisplayedFieldsForInstance
+  /// \warning This method and mergeDisplayedFieldsForInstance are called from multiple threads
+  /// at the same time, therefore they must not modify the state of the rule.
   virtual void getDisplayedFieldsForInstance(const QMap<QString, QString> &cachedTagsForInstance, QMap<QString, QString> &displayedFieldsForCurrentSeries,
     QMap<QString, QString> &displayedFieldsForCurrentStudy, QMap<QString, QString> &displayedFieldsForCurrentPatient)=0;
 
@@ -0,0 +1,338 @@
+/*=========================================================================
+
+  Library:   CTK
+
+  Copyright (c) Kitware Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0.txt
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+=========================================================================*/
+
+// Qt includes
+#include <QSharedData>
+#include <QVector>
+
+// CTK DICOM Core
+#include "ctkDICOMHeaderRecord.h"
+#include "ctkDICOMItem.h"
+
+// DCMTK includes
+#include <dcmtk/dcmdata/dcdeftag.h>
+
+// STD includes
+#include <algorithm>
+
+namespace
+{
+
+/// Value length of elements that are present in the dataset but their value is not stored
+const int ValueNotStoredLength = -1;
+/// Value length of elements that were not read from the file
+const int NotParsedLength = -2;
+/// Value length of elements that are not present in the dataset
+const int NotPresentLength = -3;
+
+//------------------------------------------------------------------------------
+struct ctkDICOMHeaderRecordEntry
+{
+  quint32 Key;
+  int Offset;
+  int Length;
+  int FirstValueLength;
+
+  bool operator<(const ctkDICOMHeaderRecordEntry& other) const
+  {
+    return this->Key < other.Key;
+  }
+};
+
+//------------------------------------------------------------------------------
+quint32 ctkDICOMHeaderRecordKey(const DcmTagKey& tag)
+{
+  return (quint32(tag.getGroup()) << 16) | quint32(tag.getElement());
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMHeaderRecordParseTag(const QString& tag, DcmTagKey& tagKey)
+{
+  int separatorIndex = tag.indexOf(',');
+  if (separatorIndex < 0)
+  {
+    return false;
+  }
+  bool groupOk = false;
+  bool elementOk = false;
+  unsigned short group = tag.left(separatorIndex).toUShort(&groupOk, 16);
+  unsigned short element = tag.mid(separatorIndex + 1).toUShort(&elementOk, 16);
+  if (!groupOk || !elementOk)
+  {
+    return false;
+  }
+  tagKey = DcmTagKey(group, element);
+  return true;
+}
+
+} // end of anonymous namespace
+
+//------------------------------------------------------------------------------
+class ctkDICOMHeaderRecordData : public QSharedData
+{
+public:
+  const ctkDICOMHeaderRecordEntry* entry(const DcmTagKey& tag) const;
+  void addEntry(const ctkDICOMItem& dataset, const DcmTagKey& tag, bool presenceOnly);
+
+  /// Sorted by tag key
+  QVector<ctkDICOMHeaderRecordEntry> m_Entries;
+  /// Decoded values of all elements, concatenated
+  QString m_Values;
+};
+
+//------------------------------------------------------------------------------
+const ctkDICOMHeaderRecordEntry* ctkDICOMHeaderRecordData::entry(const DcmTagKey& tag) const
+{
+  ctkDICOMHeaderRecordEntry searchedEntry;
+  searchedEntry.Key = ctkDICOMHeaderRecordKey(tag);
+  QVector<ctkDICOMHeaderRecordEntry>::const_iterator it =
+    std::lower_bound(m_Entries.constBegin(), m_Entries.constEnd(), searchedEntry);
+  if (it == m_Entries.constEnd() || it->Key != searchedEntry.Key)
+  {
+    return 0;
+  }
+  return &(*it);
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMHeaderRecordData::addEntry(const ctkDICOMItem& dataset, const DcmTagKey& tag, bool presenceOnly)
+{
+  ctkDICOMHeaderRecordEntry newEntry;
+  newEntry.Key = ctkDICOMHeaderRecordKey(tag);
+  newEntry.Offset = m_Values.size();
+  newEntry.Length = 0;
+  newEntry.FirstValueLength = 0;
+
+  if (!dataset.IsTagParsed(tag))
+  {
+    newEntry.Length = NotParsedLength;
+    m_Entries << newEntry;
+    return;
+  }
+  DcmTag dcmTag(tag);
+  DcmElement* element = 0;
+  if (!dataset.findAndGetElement(dcmTag, element).good() || !element)
+  {
+    newEntry.Length = NotPresentLength;
+    m_Entries << newEntry;
+    return;
+  }
+  if (presenceOnly)
+  {
+    newEntry.Length = ValueNotStoredLength;
+    m_Entries << newEntry;
+    return;
+  }
+
+  QString values = dataset.GetAllElementValuesAsString(dcmTag);
+  newEntry.Length = values.size();
+  newEntry.FirstValueLength = values.size();
+  if (element->getVM() > 1)
+  {
+    // Backslash is the value separator, it cannot occur within the values of multi-valued elements
+    int separatorIndex = values.indexOf('\\');
+    if (separatorIndex >= 0)
+    {
+      newEntry.FirstValueLength = separatorIndex;
+    }
+  }
+  m_Values.append(values);
+  m_Entries << newEntry;
+}
+
+//------------------------------------------------------------------------------
+ctkDICOMHeaderRecord::ctkDICOMHeaderRecord()
+{
+}
+
+//------------------------------------------------------------------------------
+ctkDICOMHeaderRecord::ctkDICOMHeaderRecord(const ctkDICOMItem& dataset, const QStringList& tags,
+  const QStringList& presenceOnlyTags)
+  : d(new ctkDICOMHeaderRecordData)
+{
+  QList<DcmTagKey> valueTags = ctkDICOMHeaderRecord::hierarchyTags();
+  foreach(const QString& tag, tags)
+  {
+    DcmTagKey tagKey;
+    if (ctkDICOMHeaderRecordParseTag(tag, tagKey) && !presenceOnlyTags.contains(tag))
+    {
+      valueTags << tagKey;
+    }
+  }
+  QList<DcmTagKey> storedPresenceOnlyTags;
+  foreach(const QString& tag, presenceOnlyTags)
+  {
+    DcmTagKey tagKey;
+    if (ctkDICOMHeaderRecordParseTag(tag, tagKey))
+    {
+      storedPresenceOnlyTags << tagKey;
+    }
+  }
+
+  d->m_Entries.reserve(valueTags.size() + storedPresenceOnlyTags.size());
+  foreach(const DcmTagKey& tag, valueTags)
+  {
+    d->addEntry(dataset, tag, false);
+  }
+  foreach(const DcmTagKey& tag, storedPresenceOnlyTags)
+  {
+    d->addEntry(dataset, tag, true);
+  }
+
+  // Keep only the first entry of tags that are specified multiple times
+  std::stable_sort(d->m_Entries.begin(), d->m_Entries.end());
+  int uniqueEntryCount = 0;
+  for (int entryIndex = 0; entryIndex < d->m_Entries.size(); ++entryIndex)
+  {
+    if (uniqueEntryCount > 0 && d->m_Entries[uniqueEntryCount - 1].Key == d->m_Entries[entryIndex].Key)
+    {
+      continue;
+    }
+    d->m_Entries[uniqueEntryCount++] = d->m_Entries[entryIndex];
+  }
+  d->m_Entries.resize(uniqueEntryCount);
+  d->m_Entries.squeeze();
+  d->m_Values.squeeze();
+}
+
+//------------------------------------------------------------------------------
+ctkDICOMHeaderRecord::ctkDICOMHeaderRecord(const ctkDICOMHeaderRecord& other)
+  : d(other.d)
+{
+}
+
+//------------------------------------------------------------------------------
+ctkDICOMHeaderRecord& ctkDICOMHeaderRecord::operator=(const ctkDICOMHeaderRecord& other)
+{
+  d = other.d;
+  return *this;
+}
+
+//------------------------------------------------------------------------------
+ctkDICOMHeaderRecord::~ctkDICOMHeaderRecord()
+{
+}
+
+//------------------------------------------------------------------------------
+const QList<DcmTagKey>& ctkDICOMHeaderRecord::hierarchyTags()
+{
+  static const QList<DcmTagKey> tags = QList<DcmTagKey>()
+    // patient
+    << DCM_PatientName << DCM_PatientID << DCM_PatientBirthDate << DCM_PatientBirthTime
+    << DCM_PatientSex << DCM_PatientAge << DCM_PatientComments
+    // study
+    << DCM_StudyInstanceUID << DCM_StudyID << DCM_StudyDate << DCM_StudyTime
+    << DCM_AccessionNumber << DCM_ModalitiesInStudy << DCM_InstitutionName
+    << DCM_PerformingPhysicianName << DCM_ReferringPhysicianName << DCM_StudyDescription
+    // series
+    << DCM_SeriesInstanceUID << DCM_SeriesDate << DCM_SeriesTime << DCM_SeriesDescription
+    << DCM_Modality << DCM_BodyPartExamined << DCM_FrameOfReferenceUID << DCM_ContrastBolusAgent
+    << DCM_ScanningSequence << DCM_SeriesNumber << DCM_AcquisitionNumber << DCM_EchoNumbers
+    << DCM_TemporalPositionIdentifier
+    // instance
+    << DCM_SOPInstanceUID;
+  return tags;
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMHeaderRecord::IsInitialized() const
+{
+  return d.constData() != 0;
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMHeaderRecord::IsTagParsed(const DcmTagKey& tag) const
+{
+  if (!d)
+  {
+    return false;
+  }
+  const ctkDICOMHeaderRecordEntry* entry = d->entry(tag);
+  return entry && entry->Length != NotParsedLength;
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMHeaderRecord::TagExists(const DcmTagKey& tag) const
+{
+  if (!d)
+  {
+    return false;
+  }
+  const ctkDICOMHeaderRecordEntry* entry = d->entry(tag);
+  return entry && entry->Length >= ValueNotStoredLength;
+}
+
+//------------------------------------------------------------------------------
+QString ctkDICOMHeaderRecord::GetElementAsString(const DcmTagKey& tag) const
+{
+  if (!d)
+  {
+    return QString::null;
+  }
+  const ctkDICOMHeaderRecordEntry* entry = d->entry(tag);
+  if (!entry || entry->Length < 0)
+  {
+    return QString::null;
+  }
+  if (entry->FirstValueLength == 0)
+  {
+    return QString("");
+  }
+  return d->m_Values.mid(entry->Offset, entry->FirstValueLength);
+}
+
+//------------------------------------------------------------------------------
+QString ctkDICOMHeaderRecord::GetAllElementValuesAsString(const DcmTagKey& tag) const
+{
+  if (!d)
+  {
+    return QString::null;
+  }
+  const ctkDICOMHeaderRecordEntry* entry = d->entry(tag);
+  if (!entry || entry->Length < 0)
+  {
+    return QString::null;
+  }
+  if (entry->Length == 0)
+  {
+    return QString("");
+  }
+  return d->m_Values.mid(entry->Offset, entry->Length);
+}
+
+//------------------------------------------------------------------------------
+long ctkDICOMHeaderRecord::GetElementAsInteger(const DcmTagKey& tag) const
+{
+  bool ok = false;
+  long value = this->GetElementAsString(tag).trimmed().toLong(&ok);
+  return ok ? value : 0;
+}
+
+//------------------------------------------------------------------------------
+int ctkDICOMHeaderRecord::memorySize() const
+{
+  if (!d)
+  {
+    return 0;
+  }
+  return int(sizeof(ctkDICOMHeaderRecordData))
+    + d->m_Entries.capacity() * int(sizeof(ctkDICOMHeaderRecordEntry))
+    + d->m_Values.capacity() * int(sizeof(QChar));
+}
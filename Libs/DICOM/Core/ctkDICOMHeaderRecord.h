@@ -0,0 +1,105 @@
+/*=========================================================================
+
+  Library:   CTK
+
+  Copyright (c) Kitware Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0.txt
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+=========================================================================*/
+
+#ifndef __ctkDICOMHeaderRecord_h
+#define __ctkDICOMHeaderRecord_h
+
+#include "ctkDICOMCoreExport.h"
+
+// Qt includes
+#include <QExplicitlySharedDataPointer>
+#include <QStringList>
+
+// DCMTK includes
+#include <dcmtk/dcmdata/dctagkey.h>
+
+class ctkDICOMHeaderRecordData;
+class ctkDICOMItem;
+
+/// \ingroup DICOM_Core
+///
+/// \brief Compact, immutable copy of the header values of a DICOM instance
+/// that are needed for inserting the instance into the database.
+///
+/// The record contains the values of the patient, study, series, and instance
+/// identification tags (see hierarchyTags()) and of the additionally specified tags
+/// (typically the tags to precache). Values are decoded using the specific character set
+/// once, when the record is created, and they are stored in a single string buffer.
+/// This requires a small fraction of the memory of a ctkDICOMItem, therefore
+/// many records can be kept in memory while they are waiting to be inserted
+/// into the database.
+///
+/// Copying a record is cheap, as the data is shared between the copies.
+///
+/// The getter methods have the same names and return the same values as the ones in
+/// ctkDICOMItem, for the tags that were specified when the record was created.
+/// Other tags are reported as not parsed (IsTagParsed returns false).
+///
+class CTK_DICOM_CORE_EXPORT ctkDICOMHeaderRecord
+{
+public:
+  /// Create an empty record. IsInitialized() returns false.
+  ctkDICOMHeaderRecord();
+
+  /// Create a record from the values stored in the dataset.
+  /// \param tags Values of these tags are stored in addition to the hierarchy tags.
+  ///   Tags are specified in "gggg,eeee" format.
+  /// \param presenceOnlyTags For these tags only the presence of the element
+  ///   is stored (the value is not needed, for example pixel data).
+  ctkDICOMHeaderRecord(const ctkDICOMItem& dataset, const QStringList& tags = QStringList(),
+    const QStringList& presenceOnlyTags = QStringList());
+
+  ctkDICOMHeaderRecord(const ctkDICOMHeaderRecord& other);
+  ctkDICOMHeaderRecord& operator=(const ctkDICOMHeaderRecord& other);
+
+  virtual ~ctkDICOMHeaderRecord();
+
+  /// Tags that are always stored in the record: patient, study, series,
+  /// and instance level values that are stored in the database tables.
+  static const QList<DcmTagKey>& hierarchyTags();
+
+  /// Returns true if the record was created from a dataset.
+  bool IsInitialized() const;
+
+  /// Returns false if the element was not specified when the record was created,
+  /// or the element was not read from the file (see ctkDICOMItem::IsTagParsed).
+  bool IsTagParsed(const DcmTagKey& tag) const;
+
+  /// Returns true if the element is present in the dataset.
+  bool TagExists(const DcmTagKey& tag) const;
+
+  /// Value at position 0. Null string if the element is not present.
+  QString GetElementAsString(const DcmTagKey& tag) const;
+
+  /// All values, separated by backslash. Null string if the element is not present.
+  QString GetAllElementValuesAsString(const DcmTagKey& tag) const;
+
+  /// Value at position 0, converted to integer (type IS). Returns 0 if the element
+  /// is not present or it does not contain an integer.
+  long GetElementAsInteger(const DcmTagKey& tag) const;
+
+  /// Approximate number of bytes used by the record.
+  int memorySize() const;
+
+private:
+  QExplicitlySharedDataPointer<ctkDICOMHeaderRecordData> d;
+};
+
+#endif
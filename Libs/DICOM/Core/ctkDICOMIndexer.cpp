@@ -61,8 +61,61 @@ static int REQUEST_RESULTS_CACHE_MAXIMUM_SIZE = 5000;
 
 
 //------------------------------------------------------------------------------
-// ctkDICOMIndexerPrivate methods
+// ctkDICOMIndexerPrivateParseTask methods
+
+//------------------------------------------------------------------------------
+ctkDICOMIndexerPrivateParseTask::ctkDICOMIndexerPrivateParseTask(DICOMIndexingQueue* queue, QSemaphore* parsedFiles,
+  const QString& filePath, qint64 fileSize, bool copyFile, bool overwriteExistingDataset)
+: RequestQueue(queue)
+, ParsedFiles(parsedFiles)
+, FilePath(filePath)
+, FileSize(fileSize)
+, CopyFile(copyFile)
+, OverwriteExistingDataset(overwriteExistingDataset)
+{
+}
 
+//------------------------------------------------------------------------------
+ctkDICOMIndexerPrivateParseTask::~ctkDICOMIndexerPrivateParseTask()
+{
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMIndexerPrivateParseTask::run()
+{
+  // Pending tasks are skipped if indexing is cancelled
+  if (!this->RequestQueue->isStopRequested())
+  {
+    QElapsedTimer parseTimer;
+    parseTimer.start();
+    ctkDICOMDatabase::IndexingResult indexingResult;
+    ctkDICOMItem dataset;
+    dataset.SetMemoryMappedFileReadEnabled(this->RequestQueue->isMemoryMappedFileReadEnabled());
+    // Only header information is needed for indexing, skip reading of pixel data
+    dataset.InitializeFromFileHeader(this->FilePath);
+    if (dataset.IsInitialized())
+    {
+      // Keep only the values that are inserted into the database, as results are queued
+      // until they are written to the database and full datasets would use lots of memory.
+      indexingResult.header = ctkDICOMHeaderRecord(dataset,
+        this->RequestQueue->tagsToPrecache(), this->RequestQueue->tagsToExcludeFromStorage());
+      indexingResult.filePath = this->FilePath;
+      indexingResult.copyFile = this->CopyFile;
+      indexingResult.overwriteExistingDataset = this->OverwriteExistingDataset;
+      this->RequestQueue->addParseMetrics(parseTimer.nsecsElapsed(), this->FileSize);
+      this->RequestQueue->pushIndexingResult(indexingResult);
+    }
+    else
+    {
+      this->RequestQueue->addParseMetrics(parseTimer.nsecsElapsed(), this->FileSize);
+      logger.warn(QString("Could not read DICOM file:") + this->FilePath);
+    }
+  }
+  this->ParsedFiles->release();
+}
+
+//------------------------------------------------------------------------------
+// ctkDICOMIndexerPrivateWorker methods
 
 //------------------------------------------------------------------------------
 ctkDICOMIndexerPrivateWorker::ctkDICOMIndexerPrivateWorker(DICOMIndexingQueue* queue)
@@ -70,6 +123,8 @@ ctkDICOMIndexerPrivateWorker::ctkDICOMIndexerPrivateWorker(DICOMIndexingQueue* q
 , TimePercentageIndexing(95.0)
 , RemainingRequestCount(0)
 , CompletedRequestCount(0)
+, CurrentRequestFileCount(0)
+, CurrentRequestProcessedFileCount(0)
 {
 }
 
@@ -77,6 +132,7 @@ ctkDICOMIndexerPrivateWorker::ctkDICOMIndexerPrivateWorker(DICOMIndexingQueue* q
 ctkDICOMIndexerPrivateWorker::~ctkDICOMIndexerPrivateWorker()
 {
   this->RequestQueue->setStopRequested(true);
+  this->ParsingThreadPool.waitForDone();
 }
 
 //------------------------------------------------------------------------------
@@ -84,9 +140,21 @@ void ctkDICOMIndexerPrivateWorker::start()
 {
   emit updatingDatabase(true);
   ctkDICOMDatabase database;
+  // Use the same journal mode as the application's database connection
+  database.setWALModeEnabled(this->RequestQueue->isWALModeEnabled());
+  database.setWALAutoCheckpoint(this->RequestQueue->walAutoCheckpoint());
   database.openDatabase(this->RequestQueue->databaseFilename());
   database.setTagsToPrecache(this->RequestQueue->tagsToPrecache());
   database.setTagsToExcludeFromStorage(this->RequestQueue->tagsToExcludeFromStorage());
+  database.setFileStorageMode(this->RequestQueue->fileStorageMode());
+  database.setFileStorageThreadCount(this->RequestQueue->fileStorageThreadCount());
+  database.setMemoryMappedFileReadEnabled(this->RequestQueue->isMemoryMappedFileReadEnabled());
+  this->ParsingThreadPool.setMaxThreadCount(qMax(1, this->RequestQueue->parsingThreadCount()));
+
+  this->RequestQueue->resetMetrics();
+  this->WorkerMetrics.reset();
+  database.resetIndexingMetrics();
+  this->IndexingTimer.start();
 
   int patientsCountBefore = database.patientsCount();
   int studiesCountBefore = database.studiesCount();
@@ -103,12 +171,15 @@ void ctkDICOMIndexerPrivateWorker::start()
     emit progress(0);
     // Make a local copy to avoid the need of frequent locking
     this->RequestQueue->modifiedTimeForFilepath(this->ModifiedTimeForFilepath);
+    this->RequestQueue->fingerprintForDirectory(this->FingerprintForDirectory);
     this->CompletedRequestCount = 0;
     do
     {
       if (this->RequestQueue->isStopRequested())
       {
         this->RequestQueue->clear();
+        this->PendingFingerprintForDirectory.clear();
+        this->CompletionRequests.clear();
         this->RequestQueue->setStopRequested(false);
       }
       DICOMIndexingQueue::IndexingRequest indexingRequest;
@@ -117,9 +188,6 @@ void ctkDICOMIndexerPrivateWorker::start()
       this->CompletedRequestCount++;
     } while (!this->RequestQueue->isEmpty());
 
-    QTime timeProbe;
-    timeProbe.start();
-
     // Update displayed fields according to inserted DICOM datasets
     emit progressStep("Updating database displayed fields");
     emit progress(this->TimePercentageIndexing);
@@ -129,17 +197,44 @@ void ctkDICOMIndexerPrivateWorker::start()
     studiesCountAfter = database.studiesCount();
     seriesCountAfter = database.seriesCount();
     imagesCountAfter = database.imagesCount();
+    this->reportMetrics(database);
 
-    double elapsedTimeInSeconds = timeProbe.elapsed() / 1000.0;
-    qDebug() << QString("DICOM indexer has updated display fields for %1 files [%2s]")
-      .arg(imagesCountAfter-imagesCountBefore).arg(QString::number(elapsedTimeInSeconds, 'f', 2));
+    // Parse the files of partial datasets now that the partial datasets are in the database.
+    // Re-inserted instances have no displayed fields, therefore the displayed fields are
+    // updated again when the completion requests are processed.
+    if (!this->RequestQueue->isStopRequested())
+    {
+      foreach (const DICOMIndexingQueue::IndexingRequest& completionRequest, this->CompletionRequests)
+      {
+        this->RequestQueue->pushIndexingRequest(completionRequest);
+      }
+    }
+    this->CompletionRequests.clear();
 
   // restart if new requests has been queued during displayed fields update
   } while (!this->RequestQueue->isEmpty());
 
+  if (database.isWALModeEnabled())
+  {
+    // Keep the write-ahead log small, without waiting for readers
+    database.checkpoint();
+  }
   database.closeDatabase();
   emit updatingDatabase(false);
 
+  ctkDICOMDatabase::IndexingMetrics metrics = this->RequestQueue->metrics();
+  QStringList phaseSummaries;
+  for (int phase = 0; phase < ctkDICOMDatabase::IndexingMetrics::PhaseCount; ++phase)
+  {
+    phaseSummaries << QString("%1: %2 [%3s]")
+      .arg(ctkDICOMDatabase::IndexingMetrics::phaseName(ctkDICOMDatabase::IndexingMetrics::Phase(phase)))
+      .arg(metrics.counts[phase])
+      .arg(QString::number(metrics.seconds(ctkDICOMDatabase::IndexingMetrics::Phase(phase)), 'f', 2));
+  }
+  logger.debug(QString("DICOM indexer has processed %1 files in %2s (%3 files/s), %4")
+    .arg(metrics.fileCount).arg(QString::number(metrics.elapsedNanoseconds / 1.0e9, 'f', 2))
+    .arg(QString::number(metrics.filesPerSecond(), 'f', 1)).arg(phaseSummaries.join(", ")));
+
   this->RequestQueue->setIndexing(false);
   emit progress(100);
   emit progressStep("Indexing complete");
@@ -150,89 +245,271 @@ void ctkDICOMIndexerPrivateWorker::start()
 //------------------------------------------------------------------------------
 void ctkDICOMIndexerPrivateWorker::processIndexingRequest(DICOMIndexingQueue::IndexingRequest& indexingRequest, ctkDICOMDatabase& database)
 {
+  QHash<QString, ctkDICOMDatabase::DirectoryFingerprint> directoryFingerprints;
   if (!indexingRequest.inputFolderPath.isEmpty())
   {
-    QDir::Filters filters = QDir::Files;
-    if (indexingRequest.includeHidden)
-    {
-      filters |= QDir::Hidden;
-    }
-    QDirIterator it(indexingRequest.inputFolderPath, filters, QDirIterator::Subdirectories);
-    while (it.hasNext())
-    {
-      indexingRequest.inputFilesPath << it.next();
-    }
+    QElapsedTimer enumerateTimer;
+    enumerateTimer.start();
+    int fileCountBefore = indexingRequest.inputFilesPath.size();
+    this->addFilesInFolder(indexingRequest, directoryFingerprints);
+    this->WorkerMetrics.addPhase(ctkDICOMDatabase::IndexingMetrics::EnumeratePhase,
+      indexingRequest.inputFilesPath.size() - fileCountBefore, enumerateTimer.nsecsElapsed());
   }
 
-  QTime timeProbe;
-  timeProbe.start();
+  this->CurrentRequestFileCount = indexingRequest.inputFilesPath.size();
+  this->CurrentRequestProcessedFileCount = 0;
 
-  int currentFileIndex = 0;
+  // Files are parsed in the thread pool. The number of files waiting for parsing
+  // is limited so that results can be written into the database while parsing is in progress
+  // and cancel requests are processed quickly.
+  const int maximumPendingParseTaskCount = 2 * this->ParsingThreadPool.maxThreadCount();
+  int pendingParseTaskCount = 0;
   int alreadyAddedFileCount = 0;
   QStringList alreadyAddedFiles;
-  foreach(const QString& filePath, indexingRequest.inputFilesPath)
+  // Files inserted from partial datasets, which are parsed by the completion request
+  QStringList partialDatasetFiles;
+  QElapsedTimer statTimer;
+  for (int fileIndex = 0; fileIndex < indexingRequest.inputFilesPath.size(); ++fileIndex)
   {
-    int percent = int(this->TimePercentageIndexing * (this->CompletedRequestCount + double(currentFileIndex++) / double(indexingRequest.inputFilesPath.size()))
-      / double(this->CompletedRequestCount + this->RemainingRequestCount + 1));
-    emit this->progress(percent);
-    emit progressDetail(filePath);
+    const QString& filePath = indexingRequest.inputFilesPath[fileIndex];
+    if (this->RequestQueue->isStopRequested())
+    {
+      break;
+    }
 
-    QDateTime fileModifiedTime = QFileInfo(filePath).lastModified();
-    bool datasetAlreadyInDatabase = this->ModifiedTimeForFilepath.contains(filePath);
-    if (datasetAlreadyInDatabase && this->ModifiedTimeForFilepath[filePath] >= fileModifiedTime)
+    statTimer.start();
+    QFileInfo fileInfo(filePath);
+    QDateTime fileModifiedTime = fileInfo.lastModified();
+    // File information is cached, getting the size does not access the file system again
+    qint64 fileSize = fileInfo.size();
+    this->WorkerMetrics.addPhase(ctkDICOMDatabase::IndexingMetrics::StatPhase, 1, statTimer.nsecsElapsed());
+    QHash<QString, QDateTime>::iterator modifiedTimeIt = this->ModifiedTimeForFilepath.find(filePath);
+    bool datasetAlreadyInDatabase = (modifiedTimeIt != this->ModifiedTimeForFilepath.end());
+    if (datasetAlreadyInDatabase && modifiedTimeIt.value() >= fileModifiedTime
+      && !indexingRequest.completePartialDatasets)
     {
       alreadyAddedFileCount++;
       if (alreadyAddedFileCount < 10)
       {
         alreadyAddedFiles << filePath;
       }
+      this->CurrentRequestProcessedFileCount++;
+      this->updateProgress();
       continue;
     }
-    this->ModifiedTimeForFilepath[filePath] = fileModifiedTime;
+    if (datasetAlreadyInDatabase)
+    {
+      modifiedTimeIt.value() = fileModifiedTime;
+    }
+    else
+    {
+      this->ModifiedTimeForFilepath.insert(filePath, fileModifiedTime);
+    }
 
-    ctkDICOMDatabase::IndexingResult indexingResult;
-    indexingResult.dataset = QSharedPointer<ctkDICOMItem>(new ctkDICOMItem);
-    indexingResult.dataset->InitializeFromFile(filePath);
-    if (indexingResult.dataset->IsInitialized())
+    while (pendingParseTaskCount >= maximumPendingParseTaskCount)
     {
+      pendingParseTaskCount -= this->collectParsedFiles(database);
+    }
+
+    emit progressDetail(filePath);
+    if (!indexingRequest.inputDatasets.isEmpty())
+    {
+      // The dataset is already available, the file does not have to be parsed
+      QElapsedTimer parseTimer;
+      parseTimer.start();
+      ctkDICOMDatabase::IndexingResult indexingResult;
       indexingResult.filePath = filePath;
+      indexingResult.header = ctkDICOMHeaderRecord(*indexingRequest.inputDatasets[fileIndex],
+        this->RequestQueue->tagsToPrecache(), this->RequestQueue->tagsToExcludeFromStorage());
+      this->WorkerMetrics.addPhase(ctkDICOMDatabase::IndexingMetrics::ParsePhase, 1, parseTimer.nsecsElapsed());
       indexingResult.copyFile = indexingRequest.copyFile;
       indexingResult.overwriteExistingDataset = datasetAlreadyInDatabase;
-      int resultsCount = this->RequestQueue->pushIndexingResult(indexingResult);
-      if (resultsCount >= REQUEST_RESULTS_CACHE_MAXIMUM_SIZE)
+      partialDatasetFiles << filePath;
+      this->CurrentRequestProcessedFileCount++;
+      this->updateProgress();
+      if (this->RequestQueue->pushIndexingResult(indexingResult) >= REQUEST_RESULTS_CACHE_MAXIMUM_SIZE)
       {
         emit progressStep("Updating database fields");
         this->writeIndexingResultsToDatabase(database);
         emit progressStep("Parsing DICOM files");
       }
+      continue;
     }
-    else
+    this->ParsingThreadPool.start(new ctkDICOMIndexerPrivateParseTask(this->RequestQueue, &this->ParsedFiles,
+      filePath, fileSize, indexingRequest.copyFile, datasetAlreadyInDatabase || indexingRequest.completePartialDatasets));
+    pendingParseTaskCount++;
+  }
+
+  // Wait for all files of this request to be parsed
+  while (pendingParseTaskCount > 0)
+  {
+    pendingParseTaskCount -= this->collectParsedFiles(database);
+  }
+
+  if (alreadyAddedFileCount > 0)
+  {
+    logger.debug(QString("Skipped %1 files that were already in the database: %2...").arg(
+      alreadyAddedFileCount).arg(alreadyAddedFiles.join(", ")));
+  }
+
+  if (!partialDatasetFiles.isEmpty() && !this->RequestQueue->isStopRequested())
+  {
+    // Tags that are not in the partial datasets (such as the series description or
+    // patient birth date) are read from the files later. Files that were skipped
+    // because they are already in the database are not parsed again.
+    DICOMIndexingQueue::IndexingRequest completionRequest;
+    completionRequest.inputFilesPath = partialDatasetFiles;
+    completionRequest.includeHidden = indexingRequest.includeHidden;
+    completionRequest.copyFile = indexingRequest.copyFile;
+    completionRequest.completePartialDatasets = true;
+    this->CompletionRequests << completionRequest;
+  }
+
+  // Directories are only marked as indexed if all their files have been processed
+  if (!this->RequestQueue->isStopRequested())
+  {
+    for (QHash<QString, ctkDICOMDatabase::DirectoryFingerprint>::const_iterator it = directoryFingerprints.constBegin();
+      it != directoryFingerprints.constEnd(); ++it)
     {
-      logger.warn(QString("Could not read DICOM file:") + filePath);
+      this->FingerprintForDirectory.insert(it.key(), it.value());
+      this->PendingFingerprintForDirectory.insert(it.key(), it.value());
     }
+  }
+
+  if (this->RequestQueue->isIndexingRequestsEmpty())
+  {
+    emit progressStep("Updating database fields");
+    this->writeIndexingResultsToDatabase(database);
+    emit progressStep("Parsing DICOM files");
+  }
+
+  this->WorkerMetrics.fileCount += this->CurrentRequestProcessedFileCount;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMIndexerPrivateWorker::addFilesInFolder(DICOMIndexingQueue::IndexingRequest& indexingRequest,
+  QHash<QString, ctkDICOMDatabase::DirectoryFingerprint>& directoryFingerprints)
+{
+  // Copied files are stored in the database with a different path, therefore they cannot be
+  // looked up by their original path and the content of their directory must always be checked.
+  bool skipUnchangedDirectories = !indexingRequest.copyFile;
 
+  QDir::Filters filters = QDir::Files | QDir::Dirs | QDir::NoDotAndDotDot;
+  if (indexingRequest.includeHidden)
+  {
+    filters |= QDir::Hidden;
+  }
+
+  int skippedDirectoryCount = 0;
+  QStringList directoriesToVisit;
+  directoriesToVisit << QDir::cleanPath(indexingRequest.inputFolderPath);
+  while (!directoriesToVisit.isEmpty())
+  {
     if (this->RequestQueue->isStopRequested())
     {
-      break;
+      return;
     }
+    QString directory = directoriesToVisit.takeLast();
+
+    // Listing a directory does not require reading the status of each file,
+    // which is what makes rescanning large folders slow (especially on network shares).
+    QStringList filesInDirectory;
+    int entryCount = 0;
+    QDirIterator it(directory, filters);
+    while (it.hasNext())
+    {
+      QString path = it.next();
+      entryCount++;
+      QFileInfo fileInfo = it.fileInfo();
+      if (fileInfo.isDir())
+      {
+        // Symbolic links to directories are not followed
+        if (!fileInfo.isSymLink())
+        {
+          directoriesToVisit << path;
+        }
+      }
+      else
+      {
+        filesInDirectory << path;
+      }
+    }
+
+    if (!skipUnchangedDirectories)
+    {
+      indexingRequest.inputFilesPath << filesInDirectory;
+      continue;
+    }
+
+    // Adding, removing, or renaming a file changes the modified time of its directory.
+    // Entry count is checked, too, to detect changes on file systems with coarse time resolution.
+    ctkDICOMDatabase::DirectoryFingerprint fingerprint(
+      QFileInfo(directory).lastModified().toMSecsSinceEpoch(), entryCount);
+    QHash<QString, ctkDICOMDatabase::DirectoryFingerprint>::const_iterator fingerprintIt =
+      this->FingerprintForDirectory.constFind(directory);
+    if (fingerprintIt != this->FingerprintForDirectory.constEnd() && fingerprintIt.value() == fingerprint)
+    {
+      skippedDirectoryCount++;
+      continue;
+    }
+    directoryFingerprints.insert(directory, fingerprint);
+    indexingRequest.inputFilesPath << filesInDirectory;
   }
 
-  if (alreadyAddedFileCount > 0)
+  if (skippedDirectoryCount > 0)
   {
-    logger.debug(QString("Skipped %1 files that were already in the database: %2...").arg(
-      alreadyAddedFileCount).arg(alreadyAddedFiles.join(", ")));
+    logger.debug(QString("Skipped %1 directories that have not changed since last indexed in %2").arg(
+      skippedDirectoryCount).arg(indexingRequest.inputFolderPath));
   }
+}
 
-  if (this->RequestQueue->isIndexingRequestsEmpty())
+//------------------------------------------------------------------------------
+int ctkDICOMIndexerPrivateWorker::collectParsedFiles(ctkDICOMDatabase& database)
+{
+  // Use a timeout to keep reporting progress while files are being parsed
+  int parsedFileCount = 0;
+  QElapsedTimer queueWaitTimer;
+  queueWaitTimer.start();
+  bool parsedFileAvailable = this->ParsedFiles.tryAcquire(1, 100);
+  this->WorkerMetrics.addPhase(ctkDICOMDatabase::IndexingMetrics::QueueWaitPhase,
+    parsedFileAvailable ? 1 : 0, queueWaitTimer.nsecsElapsed());
+  if (parsedFileAvailable)
+  {
+    parsedFileCount = 1;
+    int additionalParsedFileCount = this->ParsedFiles.available();
+    if (additionalParsedFileCount > 0 && this->ParsedFiles.tryAcquire(additionalParsedFileCount))
+    {
+      parsedFileCount += additionalParsedFileCount;
+    }
+  }
+  if (parsedFileCount == 0)
+  {
+    return 0;
+  }
+
+  this->CurrentRequestProcessedFileCount += parsedFileCount;
+  this->updateProgress();
+
+  if (this->RequestQueue->indexingResultsCount() >= REQUEST_RESULTS_CACHE_MAXIMUM_SIZE)
   {
     emit progressStep("Updating database fields");
     this->writeIndexingResultsToDatabase(database);
     emit progressStep("Parsing DICOM files");
   }
+  return parsedFileCount;
+}
 
-  float elapsedTimeInSeconds = timeProbe.elapsed() / 1000.0;
-  qDebug() << QString("DICOM indexer has successfully processed %1 files [%2s]")
-    .arg(currentFileIndex).arg(QString::number(elapsedTimeInSeconds, 'f', 2));
+//------------------------------------------------------------------------------
+void ctkDICOMIndexerPrivateWorker::updateProgress()
+{
+  double currentRequestProgress = 0.0;
+  if (this->CurrentRequestFileCount > 0)
+  {
+    currentRequestProgress = double(this->CurrentRequestProcessedFileCount) / double(this->CurrentRequestFileCount);
+  }
+  int percent = int(this->TimePercentageIndexing * (this->CompletedRequestCount + currentRequestProgress)
+    / double(this->CompletedRequestCount + this->RemainingRequestCount + 1));
+  emit this->progress(percent);
 }
 
 
@@ -243,22 +520,42 @@ void ctkDICOMIndexerPrivateWorker::writeIndexingResultsToDatabase(ctkDICOMDataba
   this->RequestQueue->popAllIndexingResults(indexingResults);
   if (indexingResults.isEmpty())
   {
+    this->writeDirectoryFingerprintsToDatabase(database);
     return;
   }
 
-  QTime timeProbe;
-  timeProbe.start();
-
   this->NumberOfInstancesToInsert = indexingResults.size();
   this->NumberOfInstancesInserted = 0;
   database.insert(indexingResults);
   this->NumberOfInstancesToInsert = 0;
   this->NumberOfInstancesInserted = 0;
 
-  float elapsedTimeInSeconds = timeProbe.elapsed() / 1000.0;
-  qDebug() << QString("DICOM indexer has successfully inserted %1 files [%2s]")
-    .arg(indexingResults.count()).arg(QString::number(elapsedTimeInSeconds, 'f', 2));
+  // Directories are marked as indexed after all their files are inserted
+  this->writeDirectoryFingerprintsToDatabase(database);
 
+  this->reportMetrics(database);
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMIndexerPrivateWorker::reportMetrics(ctkDICOMDatabase& database)
+{
+  ctkDICOMDatabase::IndexingMetrics metrics = this->WorkerMetrics;
+  metrics += this->RequestQueue->parseMetrics();
+  metrics += database.indexingMetrics();
+  metrics.elapsedNanoseconds = this->IndexingTimer.nsecsElapsed();
+  this->RequestQueue->setMetrics(metrics);
+  emit indexingMetricsUpdated(metrics);
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMIndexerPrivateWorker::writeDirectoryFingerprintsToDatabase(ctkDICOMDatabase& database)
+{
+  if (this->PendingFingerprintForDirectory.isEmpty())
+  {
+    return;
+  }
+  database.setDirectoryFingerprints(this->PendingFingerprintForDirectory);
+  this->PendingFingerprintForDirectory.clear();
 }
 
 //------------------------------------------------------------------------------
@@ -269,7 +566,10 @@ ctkDICOMIndexerPrivate::ctkDICOMIndexerPrivate(ctkDICOMIndexer& o)
   : q_ptr(&o)
   , Database(nullptr)
   , BackgroundImportEnabled(false)
+  , FastDicomdirIndexingEnabled(false)
 {
+  // Metrics are reported from the worker thread
+  qRegisterMetaType<ctkDICOMDatabase::IndexingMetrics>("ctkDICOMDatabase::IndexingMetrics");
   ctkDICOMIndexerPrivateWorker* worker = new ctkDICOMIndexerPrivateWorker(&this->RequestQueue);
   worker->moveToThread(&this->WorkerThread);
   
@@ -282,6 +582,7 @@ ctkDICOMIndexerPrivate::ctkDICOMIndexerPrivate(ctkDICOMIndexer& o)
   connect(worker, &ctkDICOMIndexerPrivateWorker::progressStep, q_ptr, &ctkDICOMIndexer::progressStep);
   connect(worker, &ctkDICOMIndexerPrivateWorker::updatingDatabase, q_ptr, &ctkDICOMIndexer::updatingDatabase);
   connect(worker, &ctkDICOMIndexerPrivateWorker::indexingComplete, q_ptr, &ctkDICOMIndexer::indexingComplete);
+  connect(worker, &ctkDICOMIndexerPrivateWorker::indexingMetricsUpdated, q_ptr, &ctkDICOMIndexer::indexingMetricsUpdated);
 
   this->WorkerThread.start();
 }
@@ -305,9 +606,15 @@ void ctkDICOMIndexerPrivate::pushIndexingRequest(const DICOMIndexingQueue::Index
   {
     // Start background indexing
     this->RequestQueue.setIndexing(true);
-    QMap<QString, QDateTime> modifiedTimeForFilepath;
+    this->RequestQueue.setJournalMode(this->Database->isWALModeEnabled(), this->Database->walAutoCheckpoint());
+    this->RequestQueue.setFileStorage(this->Database->fileStorageMode(), this->Database->fileStorageThreadCount());
+    this->RequestQueue.setMemoryMappedFileReadEnabled(this->Database->isMemoryMappedFileReadEnabled());
+    QHash<QString, QDateTime> modifiedTimeForFilepath;
     this->Database->allFilesModifiedTimes(modifiedTimeForFilepath);
     this->RequestQueue.setModifiedTimeForFilepath(modifiedTimeForFilepath);
+    QHash<QString, ctkDICOMDatabase::DirectoryFingerprint> fingerprintForDirectory;
+    this->Database->allDirectoryFingerprints(fingerprintForDirectory);
+    this->RequestQueue.setFingerprintForDirectory(fingerprintForDirectory);
     emit startWorker();
   }
 }
@@ -315,6 +622,29 @@ void ctkDICOMIndexerPrivate::pushIndexingRequest(const DICOMIndexingQueue::Index
 //------------------------------------------------------------------------------
 CTK_GET_CPP(ctkDICOMIndexer, bool, isBackgroundImportEnabled, BackgroundImportEnabled);
 CTK_SET_CPP(ctkDICOMIndexer, bool, setBackgroundImportEnabled, BackgroundImportEnabled);
+CTK_GET_CPP(ctkDICOMIndexer, bool, isFastDicomdirIndexingEnabled, FastDicomdirIndexingEnabled);
+CTK_SET_CPP(ctkDICOMIndexer, bool, setFastDicomdirIndexingEnabled, FastDicomdirIndexingEnabled);
+
+//------------------------------------------------------------------------------
+ctkDICOMDatabase::IndexingMetrics ctkDICOMIndexer::indexingMetrics() const
+{
+  Q_D(const ctkDICOMIndexer);
+  return d->RequestQueue.metrics();
+}
+
+//------------------------------------------------------------------------------
+int ctkDICOMIndexer::parsingThreadCount() const
+{
+  Q_D(const ctkDICOMIndexer);
+  return d->RequestQueue.parsingThreadCount();
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMIndexer::setParsingThreadCount(int count)
+{
+  Q_D(ctkDICOMIndexer);
+  d->RequestQueue.setParsingThreadCount(count > 0 ? count : QThread::idealThreadCount());
+}
 
 //------------------------------------------------------------------------------
 // ctkDICOMIndexer methods
@@ -495,9 +825,34 @@ bool ctkDICOMIndexer::addDicomdir(ctkDICOMDatabase* db, const QString& directory
   return this->addDicomdir(directoryName, copyFile);
 }
 
+//------------------------------------------------------------------------------
+static void ctkDICOMIndexerCopyDicomdirRecordElements(DcmDirectoryRecord* record, DcmDataset* dataset)
+{
+  if (!record)
+  {
+    return;
+  }
+  // Group 0004 elements describe the directory structure, they are not part of the instance
+  for (unsigned long elementIndex = 0; elementIndex < record->card(); ++elementIndex)
+  {
+    DcmElement* element = record->getElement(elementIndex);
+    if (!element || element->getGTag() == 0x0004)
+    {
+      continue;
+    }
+    DcmElement* elementCopy = OFstatic_cast(DcmElement*, element->clone());
+    if (dataset->insert(elementCopy, true /* replaceOld */).bad())
+    {
+      delete elementCopy;
+    }
+  }
+}
+
 //------------------------------------------------------------------------------
 bool ctkDICOMIndexer::addDicomdir(const QString& directoryName, bool copyFile/*=false*/)
 {
+  Q_D(ctkDICOMIndexer);
+
   //Initialize dicomdir with directory path
   QString dcmFilePath = directoryName;
   dcmFilePath.append("/DICOMDIR");
@@ -509,6 +864,7 @@ bool ctkDICOMIndexer::addDicomdir(const QString& directoryName, bool copyFile/*=
   //Variables for progress operations
   QString instanceFilePath;
   QStringList listOfInstances;
+  QList<QSharedPointer<ctkDICOMItem> > listOfDatasets;
 
   DcmDirectoryRecord* rootRecord = &(dicomDir->getRootRecord());
   DcmDirectoryRecord* patientRecord = NULL;
@@ -575,6 +931,26 @@ bool ctkDICOMIndexer::addDicomdir(const QString& directoryName, bool copyFile/*=
             instanceFilePath.append(QString( referencedFileName.c_str() ));
             instanceFilePath.replace("\\","/");
             listOfInstances << instanceFilePath;
+
+            if (d->FastDicomdirIndexingEnabled)
+            {
+              // Create the dataset from the DICOMDIR records instead of reading the file
+              DcmDataset* dataset = new DcmDataset();
+              ctkDICOMIndexerCopyDicomdirRecordElements(patientRecord, dataset);
+              ctkDICOMIndexerCopyDicomdirRecordElements(studyRecord, dataset);
+              ctkDICOMIndexerCopyDicomdirRecordElements(seriesRecord, dataset);
+              ctkDICOMIndexerCopyDicomdirRecordElements(fileRecord, dataset);
+              dataset->putAndInsertOFStringArray(DCM_SOPInstanceUID, sopInstanceUID);
+              OFString sopClassUID;
+              if (fileRecord->findAndGetOFStringArray(DCM_ReferencedSOPClassUIDInFile, sopClassUID).good())
+              {
+                dataset->putAndInsertOFStringArray(DCM_SOPClassUID, sopClassUID);
+              }
+              QSharedPointer<ctkDICOMItem> item(new ctkDICOMItem);
+              item->InitializeFromItem(dataset, true /* takeOwnership */);
+              item->SetPartial(true);
+              listOfDatasets << item;
+            }
           }
         }
       }
@@ -584,8 +960,25 @@ bool ctkDICOMIndexer::addDicomdir(const QString& directoryName, bool copyFile/*=
         << QString("DICOM indexer has successfully processed DICOMDIR in %1 [%2s]")
            .arg(directoryName)
            .arg(QString::number(elapsedTimeInSeconds,'f', 2));
-    this->addListOfFiles(listOfInstances, copyFile);
+    if (d->FastDicomdirIndexingEnabled)
+    {
+      DICOMIndexingQueue::IndexingRequest request;
+      request.inputFilesPath = listOfInstances;
+      request.inputDatasets = listOfDatasets;
+      request.includeHidden = true;
+      request.copyFile = copyFile;
+      d->pushIndexingRequest(request);
+      if (!d->BackgroundImportEnabled)
+      {
+        this->waitForImportFinished();
+      }
+    }
+    else
+    {
+      this->addListOfFiles(listOfInstances, copyFile);
+    }
   }
+  delete dicomDir;
   return success;
 }
 
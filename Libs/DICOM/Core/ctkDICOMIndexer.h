@@ -39,6 +39,8 @@ class CTK_DICOM_CORE_EXPORT ctkDICOMIndexer : public QObject
   Q_OBJECT
   Q_PROPERTY(bool backgroundImportEnabled READ isBackgroundImportEnabled WRITE setBackgroundImportEnabled)
   Q_PROPERTY(bool importing READ isImporting)
+  Q_PROPERTY(int parsingThreadCount READ parsingThreadCount WRITE setParsingThreadCount)
+  Q_PROPERTY(bool fastDicomdirIndexingEnabled READ isFastDicomdirIndexingEnabled WRITE setFastDicomdirIndexingEnabled)
 
 public:
   explicit ctkDICOMIndexer(QObject *parent = 0);
@@ -57,6 +59,30 @@ public:
   /// Returns with true if background importing is currently in progress.
   bool isImporting();
 
+  /// Number of threads that are used for parsing DICOM files during indexing.
+  /// Parsing results are still written into the database by a single thread.
+  /// Setting a value <= 0 uses the number of processor cores (QThread::idealThreadCount()),
+  /// which is also the default. Changes take effect when the next indexing is started.
+  void setParsingThreadCount(int count);
+  int parsingThreadCount() const;
+
+  /// If enabled, addDicomdir populates the database from the patient, study, series, and
+  /// image records of the DICOMDIR file, without reading the referenced files.
+  /// This makes indexing of removable media (CD, DVD, USB drive) much faster.
+  /// Once the displayed fields of these instances are updated, the referenced files
+  /// are indexed in the background to add the tags that are not stored in the
+  /// DICOMDIR records (such as series description and patient birth date),
+  /// and the displayed fields are updated again.
+  /// Disabled by default.
+  void setFastDicomdirIndexingEnabled(bool);
+  bool isFastDicomdirIndexingEnabled() const;
+
+  /// Counters and cumulative times of the phases of the current (or last completed)
+  /// indexing, including the database update phases performed by the indexer.
+  /// Metrics are reset when indexing starts.
+  /// \sa indexingMetricsUpdated
+  ctkDICOMDatabase::IndexingMetrics indexingMetrics() const;
+
   ///
   /// \brief Adds directory to database and optionally copies files to
   /// destinationDirectory.
@@ -68,6 +94,15 @@ public:
   /// DICOM folders may be created based on series or study name, which sometimes start
   /// with a . character, therefore it is advisable to include hidden files and folders.
   ///
+  /// If files are not copied then modified time and number of entries of each directory
+  /// are stored in the database and files in directories that have not changed since
+  /// they were last indexed are not checked again. Files that are modified in place
+  /// (without adding, removing, or renaming files in the directory) are therefore not re-indexed.
+  ///
+  /// If copyFile is true then files are stored in the database folder as specified by
+  /// ctkDICOMDatabase::fileStorageMode (copy, hard link, clone, or move) using
+  /// ctkDICOMDatabase::fileStorageThreadCount threads.
+  ///
   Q_INVOKABLE void addDirectory(const QString& directoryName, bool copyFile = false, bool includeHidden = true);
   /// Kept for backward compatibility
   Q_INVOKABLE void addDirectory(ctkDICOMDatabase* db, const QString& directoryName, bool copyFile = false, bool includeHidden = true);
@@ -123,6 +158,9 @@ Q_SIGNALS:
   void progress(int);
   /// Indexing is completed.
   void indexingComplete(int patientsAdded, int studiesAdded, int seriesAdded, int imagesAdded);
+  /// Indexing metrics are updated (after each batch of files is inserted into the database
+  /// and when indexing is completed).
+  void indexingMetricsUpdated(const ctkDICOMDatabase::IndexingMetrics& metrics);
   void updatingDatabase(bool);
 
 public Q_SLOTS:
@@ -21,7 +21,11 @@
 #ifndef CTKDICOMINDEXERPRIVATE_H
 #define CTKDICOMINDEXERPRIVATE_H
 
+#include <QElapsedTimer>
 #include <QObject>
+#include <QRunnable>
+#include <QSemaphore>
+#include <QThreadPool>
 
 #include "ctkDICOMIndexer.h"
 #include "ctkDICOMItem.h"
@@ -34,20 +38,41 @@ class DICOMIndexingQueue
 public:
   struct IndexingRequest
   {
+    IndexingRequest()
+      : includeHidden(true)
+      , copyFile(false)
+      , completePartialDatasets(false)
+    {
+    }
+
     /// Either inputFolderPath or inputFilesPath is used
     QString inputFolderPath;
     QStringList inputFilesPath;
     /// If inputFolderPath is specified, includeHidden is used to decide
     /// if hidden files and folders are imported or not.
     bool includeHidden;
-    /// Make a copy of the indexed file into the database.
-    /// If false then only a link to the existing file is added.
+    /// Store the indexed file in the database folder (as specified by the file storage
+    /// mode of the database). If false then only a link to the existing file is added.
     bool copyFile;
+    /// If not empty then it contains the dataset of each file in inputFilesPath
+    /// (such as datasets created from DICOMDIR records) and the files are not parsed.
+    /// Once the displayed fields of the datasets are updated, the files are indexed
+    /// again to complete the partial datasets.
+    QList<QSharedPointer<ctkDICOMItem> > inputDatasets;
+    /// The files have been indexed from partial datasets. They are parsed and their
+    /// instances are replaced in the database, even if the files have not changed.
+    bool completePartialDatasets;
   };
 
   DICOMIndexingQueue()
     : IsIndexing(false)
     , StopRequested(false)
+    , ParsingThreadCount(QThread::idealThreadCount())
+    , WALModeEnabled(false)
+    , WALAutoCheckpoint(1000)
+    , FileStorageMode(ctkDICOMDatabase::CopyFileStorage)
+    , FileStorageThreadCount(1)
+    , MemoryMappedFileRead(false)
     , Mutex(QMutex::Recursive)
   {
   }
@@ -92,6 +117,68 @@ public:
     this->TagsToExcludeFromStorage = tags;
   }
 
+  int parsingThreadCount() const
+  {
+    QMutexLocker locker(&this->Mutex);
+    return this->ParsingThreadCount;
+  }
+
+  void setParsingThreadCount(int count)
+  {
+    QMutexLocker locker(&this->Mutex);
+    this->ParsingThreadCount = count;
+  }
+
+  bool isWALModeEnabled() const
+  {
+    QMutexLocker locker(&this->Mutex);
+    return this->WALModeEnabled;
+  }
+
+  int walAutoCheckpoint() const
+  {
+    QMutexLocker locker(&this->Mutex);
+    return this->WALAutoCheckpoint;
+  }
+
+  void setJournalMode(bool walModeEnabled, int walAutoCheckpoint)
+  {
+    QMutexLocker locker(&this->Mutex);
+    this->WALModeEnabled = walModeEnabled;
+    this->WALAutoCheckpoint = walAutoCheckpoint;
+  }
+
+  ctkDICOMDatabase::FileStorageMode fileStorageMode() const
+  {
+    QMutexLocker locker(&this->Mutex);
+    return this->FileStorageMode;
+  }
+
+  int fileStorageThreadCount() const
+  {
+    QMutexLocker locker(&this->Mutex);
+    return this->FileStorageThreadCount;
+  }
+
+  void setFileStorage(ctkDICOMDatabase::FileStorageMode mode, int threadCount)
+  {
+    QMutexLocker locker(&this->Mutex);
+    this->FileStorageMode = mode;
+    this->FileStorageThreadCount = threadCount;
+  }
+
+  bool isMemoryMappedFileReadEnabled() const
+  {
+    QMutexLocker locker(&this->Mutex);
+    return this->MemoryMappedFileRead;
+  }
+
+  void setMemoryMappedFileReadEnabled(bool enabled)
+  {
+    QMutexLocker locker(&this->Mutex);
+    this->MemoryMappedFileRead = enabled;
+  }
+
   void clear()
   {
     QMutexLocker locker(&this->Mutex);
@@ -136,18 +223,30 @@ public:
     return this->IndexingResults.size();
   }
 
-  void modifiedTimeForFilepath(QMap<QString, QDateTime>& timesForPaths)
+  void modifiedTimeForFilepath(QHash<QString, QDateTime>& timesForPaths)
   {
     QMutexLocker locker(&this->Mutex);
     timesForPaths = this->ModifiedTimeForFilepath;
   }
 
-  void setModifiedTimeForFilepath(const QMap<QString, QDateTime>& timesForPaths)
+  void setModifiedTimeForFilepath(const QHash<QString, QDateTime>& timesForPaths)
   {
     QMutexLocker locker(&this->Mutex);
     this->ModifiedTimeForFilepath = timesForPaths;
   }
 
+  void fingerprintForDirectory(QHash<QString, ctkDICOMDatabase::DirectoryFingerprint>& fingerprints)
+  {
+    QMutexLocker locker(&this->Mutex);
+    fingerprints = this->FingerprintForDirectory;
+  }
+
+  void setFingerprintForDirectory(const QHash<QString, ctkDICOMDatabase::DirectoryFingerprint>& fingerprints)
+  {
+    QMutexLocker locker(&this->Mutex);
+    this->FingerprintForDirectory = fingerprints;
+  }
+
   void setIndexing(bool indexing)
   {
     QMutexLocker locker(&this->Mutex);
@@ -172,6 +271,40 @@ public:
     return this->IndexingRequests.isEmpty();
   }
 
+  /// Add the metrics of parsing a file. Called from the parsing threads.
+  void addParseMetrics(qint64 nanoseconds, qint64 bytesRead)
+  {
+    QMutexLocker locker(&this->Mutex);
+    this->ParseMetrics.addPhase(ctkDICOMDatabase::IndexingMetrics::ParsePhase, 1, nanoseconds);
+    this->ParseMetrics.bytesRead += bytesRead;
+  }
+
+  ctkDICOMDatabase::IndexingMetrics parseMetrics()
+  {
+    QMutexLocker locker(&this->Mutex);
+    return this->ParseMetrics;
+  }
+
+  /// Latest metrics of the indexing session, reported by the worker
+  ctkDICOMDatabase::IndexingMetrics metrics() const
+  {
+    QMutexLocker locker(&this->Mutex);
+    return this->Metrics;
+  }
+
+  void setMetrics(const ctkDICOMDatabase::IndexingMetrics& metrics)
+  {
+    QMutexLocker locker(&this->Mutex);
+    this->Metrics = metrics;
+  }
+
+  void resetMetrics()
+  {
+    QMutexLocker locker(&this->Mutex);
+    this->ParseMetrics.reset();
+    this->Metrics.reset();
+  }
+
   bool isStopRequested()
   {
     return this->StopRequested;
@@ -184,7 +317,9 @@ public:
 
 protected:
   // List of already indexed file paths and oldest file modified time in the database
-  QMap<QString, QDateTime> ModifiedTimeForFilepath;
+  QHash<QString, QDateTime> ModifiedTimeForFilepath;
+  // Fingerprints of directories that have been completely indexed
+  QHash<QString, ctkDICOMDatabase::DirectoryFingerprint> FingerprintForDirectory;
 
   QList<IndexingRequest> IndexingRequests;
   QList<ctkDICOMDatabase::IndexingResult> IndexingResults;
@@ -195,11 +330,47 @@ protected:
 
   bool IsIndexing;
   bool StopRequested;
+  int ParsingThreadCount;
+  bool WALModeEnabled;
+  int WALAutoCheckpoint;
+  ctkDICOMDatabase::FileStorageMode FileStorageMode;
+  int FileStorageThreadCount;
+  bool MemoryMappedFileRead;
+
+  /// Metrics collected by the parsing threads
+  ctkDICOMDatabase::IndexingMetrics ParseMetrics;
+  /// Metrics of all the phases, as last reported by the worker
+  ctkDICOMDatabase::IndexingMetrics Metrics;
 
   mutable QMutex Mutex;
 };
 
 
+//------------------------------------------------------------------------------
+/// Parses a single DICOM file in the parsing thread pool of the indexer worker
+/// and adds the result to the indexing queue. Database access is left to the
+/// indexer worker thread.
+class ctkDICOMIndexerPrivateParseTask : public QRunnable
+{
+public:
+  ctkDICOMIndexerPrivateParseTask(DICOMIndexingQueue* queue, QSemaphore* parsedFiles,
+    const QString& filePath, qint64 fileSize, bool copyFile, bool overwriteExistingDataset);
+  virtual ~ctkDICOMIndexerPrivateParseTask();
+
+  virtual void run();
+
+private:
+  DICOMIndexingQueue* RequestQueue;
+  /// Released each time a task is completed (even if parsing fails or is skipped)
+  QSemaphore* ParsedFiles;
+  QString FilePath;
+  qint64 FileSize;
+  bool CopyFile;
+  bool OverwriteExistingDataset;
+};
+
+
+//------------------------------------------------------------------------------
 class ctkDICOMIndexerPrivateWorker : public QObject
 {
   Q_OBJECT
@@ -217,11 +388,30 @@ Q_SIGNALS:
   void progressStep(QString);
   void updatingDatabase(bool);
   void indexingComplete(int, int, int, int);
+  void indexingMetricsUpdated(const ctkDICOMDatabase::IndexingMetrics&);
 
 private:
 
   void processIndexingRequest(DICOMIndexingQueue::IndexingRequest& request, ctkDICOMDatabase& database);
+
+  /// Add files of the request input folder (and its subfolders) to the request input files.
+  /// Files are not added from directories that have not changed since they were last indexed.
+  /// Fingerprints of directories that will be completely indexed when all the added files
+  /// are processed are returned in directoryFingerprints.
+  void addFilesInFolder(DICOMIndexingQueue::IndexingRequest& request,
+    QHash<QString, ctkDICOMDatabase::DirectoryFingerprint>& directoryFingerprints);
   void writeIndexingResultsToDatabase(ctkDICOMDatabase& database);
+  void writeDirectoryFingerprintsToDatabase(ctkDICOMDatabase& database);
+
+  /// Wait for parsing tasks to complete, report progress, and write results
+  /// into the database if the results cache is full.
+  /// Returns the number of parsing tasks that have been completed.
+  int collectParsedFiles(ctkDICOMDatabase& database);
+  void updateProgress();
+
+  /// Combine metrics of the worker, parsing threads, and database, store them in the queue
+  /// (where they can be queried from) and notify observers.
+  void reportMetrics(ctkDICOMDatabase& database);
 
   DICOMIndexingQueue* RequestQueue;
   int NumberOfInstancesToInsert;
@@ -232,9 +422,30 @@ private:
   int RemainingRequestCount; // the current request in progress is not included
   int CompletedRequestCount; // the current request in progress is not included
 
+  int CurrentRequestFileCount; // number of files in the current request
+  int CurrentRequestProcessedFileCount; // number of files parsed or skipped in the current request
+
+  /// Metrics of the phases that are performed in the worker thread (enumerate, stat, queue wait)
+  ctkDICOMDatabase::IndexingMetrics WorkerMetrics;
+  /// Measures elapsed time since indexing started
+  QElapsedTimer IndexingTimer;
+
+  /// Files are parsed concurrently in this thread pool, while results are
+  /// inserted into the database from the worker thread.
+  QThreadPool ParsingThreadPool;
+  QSemaphore ParsedFiles;
+
   // List of already indexed file paths and oldest file modified time in the database.
   // Cached here to avoid locking/unlocking a mutex each time a file is looked up.
-  QMap<QString, QDateTime> ModifiedTimeForFilepath;
+  QHash<QString, QDateTime> ModifiedTimeForFilepath;
+  // Fingerprints of directories that have been completely indexed.
+  QHash<QString, ctkDICOMDatabase::DirectoryFingerprint> FingerprintForDirectory;
+  // Fingerprints of directories that have been completely indexed, to be stored
+  // in the database along with the pending indexing results.
+  QHash<QString, ctkDICOMDatabase::DirectoryFingerprint> PendingFingerprintForDirectory;
+  // Requests to complete partial datasets, queued after the displayed fields are updated
+  // so that the partial datasets are shown while the files are parsed.
+  QList<DICOMIndexingQueue::IndexingRequest> CompletionRequests;
 };
 
 
@@ -264,6 +475,7 @@ public:
   QThread WorkerThread;
   ctkDICOMDatabase* Database;
   bool BackgroundImportEnabled;
+  bool FastDicomdirIndexingEnabled;
 };
 
 
@@ -20,6 +20,7 @@
 =============================================================================*/
 
 #include "ctkDICOMItem.h"
+#include "ctkDICOMMappedInputStream_p.h"
 
 #include <dcmtk/dcmdata/dcuid.h>
 #include <dcmtk/dcmdata/dctk.h>
@@ -33,7 +34,7 @@ class ctkDICOMItemPrivate
 {
   public:
 
-    ctkDICOMItemPrivate() : m_DcmItem(0), m_TakeOwnership(true) {}
+    ctkDICOMItemPrivate() : m_DcmItem(0), m_TakeOwnership(true), m_Partial(false), m_MemoryMappedFileRead(false) {}
 
     QString m_SpecificCharacterSet;
 
@@ -42,6 +43,13 @@ class ctkDICOMItemPrivate
 
     DcmItem* m_DcmItem;
     bool m_TakeOwnership;
+
+    /// Elements from this tag are not read from the file (undefined tag key if all elements are read)
+    DcmTagKey m_ParsingStoppedAtTag;
+    /// Only the elements that are in the item are known to be present in the file
+    bool m_Partial;
+    /// Read files through a memory mapping
+    bool m_MemoryMappedFileRead;
 };
 
 
@@ -69,6 +77,9 @@ void ctkDICOMItem::InitializeFromItem(DcmItem *dataset, bool takeOwnership)
 {
   Q_D(ctkDICOMItem);
 
+  d->m_ParsingStoppedAtTag = DCM_UndefinedTagKey;
+  d->m_Partial = false;
+
   if(d->m_DcmItem != dataset)
   {
     if (d->m_TakeOwnership)
@@ -113,10 +124,49 @@ void ctkDICOMItem::InitializeFromFile(const QString& filename,
                                          const Uint32 maxReadLength,
                                          const E_FileReadMode readMode)
 {
+  Q_D(ctkDICOMItem);
   DcmDataset *dataset;
 
   DcmFileFormat fileformat;
-  OFCondition status = fileformat.loadFile(filename.toUtf8().data(), readXfer, groupLength, maxReadLength, readMode);
+  OFCondition status;
+  if (d->m_MemoryMappedFileRead)
+  {
+    status = ctkDICOMMappedInputStream::loadFile(fileformat, filename, readXfer, groupLength, maxReadLength, readMode);
+  }
+  else
+  {
+    status = fileformat.loadFile(filename.toUtf8().data(), readXfer, groupLength, maxReadLength, readMode);
+  }
+  dataset = fileformat.getAndRemoveDataset();
+
+  if (!status.good())
+  {
+    qDebug() << "Could not load " << filename << "\nDCMTK says: " << status.text();
+    delete dataset;
+    return;
+  }
+
+  InitializeFromItem(dataset, true);
+}
+
+void ctkDICOMItem::InitializeFromFileHeader(const QString& filename)
+{
+#if OFFIS_DCMTK_VERSION_NUMBER >= 362
+  Q_D(ctkDICOMItem);
+  DcmDataset *dataset;
+
+  DcmFileFormat fileformat;
+  OFCondition status;
+  if (d->m_MemoryMappedFileRead)
+  {
+    status = ctkDICOMMappedInputStream::loadFile(fileformat, filename, EXS_Unknown, EGL_noChange,
+      DCM_MaxReadLength, ERM_autoDetect, DCM_PixelData);
+  }
+  else
+  {
+    status = fileformat.loadFileUntilTag(filename.toUtf8().data(), EXS_Unknown, EGL_noChange,
+      DCM_MaxReadLength, ERM_autoDetect, DCM_PixelData);
+  }
   dataset = fileformat.getAndRemoveDataset();
 
   if (!status.good())
@@ -127,6 +177,45 @@ void ctkDICOMItem::InitializeFromFile(const QString& filename,
   }
 
   InitializeFromItem(dataset, true);
+  d->m_ParsingStoppedAtTag = DCM_PixelData;
+#else
+  // This DCMTK version cannot stop parsing at a given tag, but values that are
+  // longer than DCM_MaxReadLength (such as pixel data) are still not loaded into memory.
+  InitializeFromFile(filename);
+#endif
+}
+
+void ctkDICOMItem::SetPartial(bool partial)
+{
+  Q_D(ctkDICOMItem);
+  d->m_Partial = partial;
+}
+
+void ctkDICOMItem::SetMemoryMappedFileReadEnabled(bool enabled)
+{
+  Q_D(ctkDICOMItem);
+  d->m_MemoryMappedFileRead = enabled;
+}
+
+bool ctkDICOMItem::IsMemoryMappedFileReadEnabled() const
+{
+  Q_D(const ctkDICOMItem);
+  return d->m_MemoryMappedFileRead;
+}
+
+bool ctkDICOMItem::IsTagParsed(const DcmTagKey& tag) const
+{
+  Q_D(const ctkDICOMItem);
+  if (d->m_Partial)
+  {
+    EnsureDcmDataSetIsInitialized();
+    return GetDcmItem().tagExists(tag, true);
+  }
+  if (d->m_ParsingStoppedAtTag == DCM_UndefinedTagKey)
+  {
+    return true;
+  }
+  return tag < d->m_ParsingStoppedAtTag;
 }
 
 void ctkDICOMItem::Serialize()
@@ -135,7 +224,12 @@ void ctkDICOMItem::Serialize()
   EnsureDcmDataSetIsInitialized();
 
   // store content of current DcmDataset (our parent) as QByteArray into m_ctkDICOMItem
-  Uint32 buffersize = 1024*1024; // reserve 1MB
+  // (reserve the encoded size of the item instead of a fixed size buffer)
+  Uint32 buffersize = d->m_DcmItem->calcElementLength(EXS_LittleEndianImplicit, EET_UndefinedLength);
+  if (buffersize == 0 || buffersize == DCM_UndefinedLength)
+  {
+    buffersize = 1024*1024;
+  }
   char* writebuffer = new char[buffersize];
 
   // write into buffer
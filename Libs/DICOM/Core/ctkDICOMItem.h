@@ -93,6 +93,42 @@ public:
                     const Uint32 maxReadLength = DCM_MaxReadLength,
                     const E_FileReadMode readMode = ERM_autoDetect);
 
+    ///
+    /// \brief Initialize from the header of a file.
+    ///
+    /// Parsing stops at the pixel data element, therefore neither the pixel data nor
+    /// elements stored after it are read. This is much faster than InitializeFromFile
+    /// for large images (enhanced multi-frame, whole slide images, ...) when only
+    /// header information is needed, such as during indexing.
+    /// Use IsTagParsed to check if the presence of an element in the file is known.
+    ///
+    virtual void InitializeFromFileHeader(const QString& filename);
+
+    ///
+    /// \brief Returns false if the item was initialized using InitializeFromFileHeader
+    /// and parsing stopped before reaching the element with the given tag.
+    /// In this case it is not known if the element is present in the file.
+    ///
+    bool IsTagParsed(const DcmTagKey& tag) const;
+
+    ///
+    /// \brief Specify that the item only contains some of the elements of the file,
+    /// such as the values that are stored in DICOMDIR records.
+    /// IsTagParsed returns false for elements that are not in a partial item,
+    /// as it is not known if they are present in the file.
+    /// Initializing the item clears the flag.
+    ///
+    void SetPartial(bool partial);
+
+    ///
+    /// \brief Read files through a memory mapping in InitializeFromFile and InitializeFromFileHeader.
+    ///
+    /// This avoids buffered file reading, which makes parsing of files that are on fast
+    /// local storage or in the file system cache faster. If the file cannot be mapped then
+    /// it is read as usual. Disabled by default.
+    ///
+    void SetMemoryMappedFileReadEnabled(bool enabled);
+    bool IsMemoryMappedFileReadEnabled() const;
 
 
     /// \brief Save dataset to file
@@ -0,0 +1,265 @@
+/*=========================================================================
+
+  Library:   CTK
+
+  Copyright (c) Kitware Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0.txt
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+=========================================================================*/
+
+// Qt includes
+#include <QtGlobal>
+
+// CTK includes
+#include "ctkDICOMMappedInputStream_p.h"
+
+// DCMTK includes
+#include <dcmtk/dcmdata/dcerror.h>
+#include <dcmtk/dcmdata/dcfilefo.h>
+#include <dcmtk/dcmdata/dcistrmf.h>
+
+// STD includes
+#include <cstring>
+
+#ifdef Q_OS_UNIX
+#include <sys/mman.h>
+#endif
+
+//------------------------------------------------------------------------------
+// ctkDICOMMappedFileProducer methods
+
+//------------------------------------------------------------------------------
+ctkDICOMMappedFileProducer::ctkDICOMMappedFileProducer(const QString& fileName, offile_off_t offset)
+  : File(fileName)
+  , Data(0)
+  , Size(0)
+  , Position(0)
+  , Status(EC_Normal)
+{
+  if (!this->File.open(QIODevice::ReadOnly))
+  {
+    this->Status = EC_InvalidFilename;
+    return;
+  }
+  this->Size = this->File.size();
+  // Empty files cannot be mapped
+  if (this->Size > 0)
+  {
+    this->Data = this->File.map(0, this->Size);
+  }
+  if (!this->Data)
+  {
+    this->Status = EC_InvalidStream;
+    this->File.close();
+    this->Size = 0;
+    return;
+  }
+#ifdef Q_OS_UNIX
+  // The file is parsed from the beginning to the end, let the kernel read ahead aggressively.
+  // The hint is not essential, therefore errors are ignored.
+  posix_madvise(const_cast<uchar*>(this->Data), static_cast<size_t>(this->Size), POSIX_MADV_SEQUENTIAL);
+#endif
+  if (offset > this->Size)
+  {
+    this->Status = EC_InvalidStream;
+    return;
+  }
+  this->Position = offset;
+}
+
+//------------------------------------------------------------------------------
+ctkDICOMMappedFileProducer::~ctkDICOMMappedFileProducer()
+{
+  if (this->Data)
+  {
+    this->File.unmap(const_cast<uchar*>(this->Data));
+  }
+}
+
+//------------------------------------------------------------------------------
+OFBool ctkDICOMMappedFileProducer::good() const
+{
+  return this->Status.good();
+}
+
+//------------------------------------------------------------------------------
+OFCondition ctkDICOMMappedFileProducer::status() const
+{
+  return this->Status;
+}
+
+//------------------------------------------------------------------------------
+OFBool ctkDICOMMappedFileProducer::eos()
+{
+  return this->Position >= this->Size;
+}
+
+//------------------------------------------------------------------------------
+offile_off_t ctkDICOMMappedFileProducer::avail()
+{
+  return this->Status.good() ? this->Size - this->Position : 0;
+}
+
+//------------------------------------------------------------------------------
+offile_off_t ctkDICOMMappedFileProducer::read(void* buf, offile_off_t buflen)
+{
+  offile_off_t length = qMin(buflen, this->avail());
+  if (length > 0 && buf)
+  {
+    memcpy(buf, this->Data + this->Position, static_cast<size_t>(length));
+    this->Position += length;
+  }
+  return length;
+}
+
+//------------------------------------------------------------------------------
+offile_off_t ctkDICOMMappedFileProducer::skip(offile_off_t skiplen)
+{
+  offile_off_t length = qMin(skiplen, this->avail());
+  this->Position += length;
+  return length;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMMappedFileProducer::putback(offile_off_t num)
+{
+  if (!this->Status.good())
+  {
+    return;
+  }
+  if (num > this->Position)
+  {
+    this->Status = EC_PutbackFailed;
+    return;
+  }
+  this->Position -= num;
+}
+
+//------------------------------------------------------------------------------
+// ctkDICOMMappedInputStream methods
+
+//------------------------------------------------------------------------------
+ctkDICOMMappedInputStream::ctkDICOMMappedInputStream(const QString& fileName, offile_off_t offset)
+  // The base class only stores the producer pointer, it is not accessed before the producer is constructed
+  : DcmInputStream(&Producer)
+  , Producer(fileName, offset)
+  , FileName(fileName)
+{
+}
+
+//------------------------------------------------------------------------------
+ctkDICOMMappedInputStream::~ctkDICOMMappedInputStream()
+{
+}
+
+//------------------------------------------------------------------------------
+DcmInputStreamFactory* ctkDICOMMappedInputStream::newFactory() const
+{
+  // Position in the file is not known if a compression filter is installed
+  if (this->currentProducer() != &this->Producer)
+  {
+    return 0;
+  }
+  return new ctkDICOMMappedInputStreamFactory(this->FileName, this->tell());
+}
+
+//------------------------------------------------------------------------------
+OFCondition ctkDICOMMappedInputStream::loadFile(DcmFileFormat& fileFormat, const QString& fileName,
+  E_TransferSyntax readXfer, E_GrpLenEncoding groupLength, Uint32 maxReadLength, E_FileReadMode readMode,
+  const DcmTagKey& stopParsingAtElement)
+{
+  ctkDICOMMappedInputStream stream(fileName);
+  if (!stream.good())
+  {
+    // File cannot be mapped (for example, it is empty or the file system does not support mapping)
+#if OFFIS_DCMTK_VERSION_NUMBER >= 362
+    if (stopParsingAtElement != DCM_UndefinedTagKey)
+    {
+      return fileFormat.loadFileUntilTag(fileName.toUtf8().data(), readXfer, groupLength,
+        maxReadLength, readMode, stopParsingAtElement);
+    }
+#endif
+    return fileFormat.loadFile(fileName.toUtf8().data(), readXfer, groupLength, maxReadLength, readMode);
+  }
+
+  // Same as DcmFileFormat::loadFile, but using the mapped stream
+  OFCondition status = EC_InvalidStream;
+  if (readMode == ERM_dataset)
+  {
+    DcmDataset* dataset = fileFormat.getDataset();
+    dataset->transferInit();
+#if OFFIS_DCMTK_VERSION_NUMBER >= 362
+    if (stopParsingAtElement != DCM_UndefinedTagKey)
+    {
+      status = dataset->readUntilTag(stream, readXfer, groupLength, maxReadLength, stopParsingAtElement);
+    }
+    else
+#endif
+    {
+      status = dataset->read(stream, readXfer, groupLength, maxReadLength);
+    }
+    dataset->transferEnd();
+  }
+  else
+  {
+    fileFormat.setReadMode(readMode);
+    fileFormat.transferInit();
+#if OFFIS_DCMTK_VERSION_NUMBER >= 362
+    if (stopParsingAtElement != DCM_UndefinedTagKey)
+    {
+      status = fileFormat.readUntilTag(stream, readXfer, groupLength, maxReadLength, stopParsingAtElement);
+    }
+    else
+#endif
+    {
+      status = fileFormat.read(stream, readXfer, groupLength, maxReadLength);
+    }
+    fileFormat.transferEnd();
+    fileFormat.setReadMode(ERM_autoDetect);
+  }
+  return status;
+}
+
+//------------------------------------------------------------------------------
+// ctkDICOMMappedInputStreamFactory methods
+
+//------------------------------------------------------------------------------
+ctkDICOMMappedInputStreamFactory::ctkDICOMMappedInputStreamFactory(const QString& fileName, offile_off_t offset)
+  : FileName(fileName)
+  , Offset(offset)
+{
+}
+
+//------------------------------------------------------------------------------
+ctkDICOMMappedInputStreamFactory::~ctkDICOMMappedInputStreamFactory()
+{
+}
+
+//------------------------------------------------------------------------------
+DcmInputStream* ctkDICOMMappedInputStreamFactory::create() const
+{
+  ctkDICOMMappedInputStream* stream = new ctkDICOMMappedInputStream(this->FileName, this->Offset);
+  if (stream->good())
+  {
+    return stream;
+  }
+  delete stream;
+  return new DcmInputFileStream(this->FileName.toUtf8().data(), this->Offset);
+}
+
+//------------------------------------------------------------------------------
+DcmInputStreamFactory* ctkDICOMMappedInputStreamFactory::clone() const
+{
+  return new ctkDICOMMappedInputStreamFactory(this->FileName, this->Offset);
+}
@@ -0,0 +1,113 @@
+/*=========================================================================
+
+  Library:   CTK
+
+  Copyright (c) Kitware Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0.txt
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+=========================================================================*/
+
+#ifndef __ctkDICOMMappedInputStream_p_h
+#define __ctkDICOMMappedInputStream_p_h
+
+// Qt includes
+#include <QFile>
+#include <QString>
+
+// DCMTK includes
+#include <dcmtk/dcmdata/dcistrma.h>
+#include <dcmtk/dcmdata/dctagkey.h>
+#include <dcmtk/dcmdata/dctypes.h>
+#include <dcmtk/dcmdata/dcxfer.h>
+
+class DcmFileFormat;
+
+/// \ingroup DICOM_Core
+///
+/// DCMTK producer that reads a file through a memory mapping.
+/// Data is copied directly from the mapped pages into the parser's buffers,
+/// which avoids the stdio buffering and the read system calls of DcmInputFileStream.
+class ctkDICOMMappedFileProducer : public DcmProducer
+{
+public:
+  ctkDICOMMappedFileProducer(const QString& fileName, offile_off_t offset = 0);
+  virtual ~ctkDICOMMappedFileProducer();
+
+  virtual OFBool good() const;
+  virtual OFCondition status() const;
+  virtual OFBool eos();
+  virtual offile_off_t avail();
+  virtual offile_off_t read(void* buf, offile_off_t buflen);
+  virtual offile_off_t skip(offile_off_t skiplen);
+  virtual void putback(offile_off_t num);
+
+private:
+  QFile File;
+  const uchar* Data;
+  offile_off_t Size;
+  offile_off_t Position;
+  OFCondition Status;
+
+  ctkDICOMMappedFileProducer(const ctkDICOMMappedFileProducer&);
+  ctkDICOMMappedFileProducer& operator=(const ctkDICOMMappedFileProducer&);
+};
+
+/// \ingroup DICOM_Core
+///
+/// DCMTK input stream that reads a file through a memory mapping.
+class ctkDICOMMappedInputStream : public DcmInputStream
+{
+public:
+  ctkDICOMMappedInputStream(const QString& fileName, offile_off_t offset = 0);
+  virtual ~ctkDICOMMappedInputStream();
+
+  /// Factory that is used for loading values that were not read during parsing
+  /// (values longer than the maximum read length).
+  virtual DcmInputStreamFactory* newFactory() const;
+
+  /// Read a file into fileFormat using a memory-mapped stream.
+  /// Arguments have the same meaning as in DcmFileFormat::loadFile and loadFileUntilTag.
+  /// If the file cannot be mapped then it is loaded using DcmFileFormat::loadFile.
+  static OFCondition loadFile(DcmFileFormat& fileFormat, const QString& fileName,
+    E_TransferSyntax readXfer = EXS_Unknown, E_GrpLenEncoding groupLength = EGL_noChange,
+    Uint32 maxReadLength = DCM_MaxReadLength, E_FileReadMode readMode = ERM_autoDetect,
+    const DcmTagKey& stopParsingAtElement = DCM_UndefinedTagKey);
+
+private:
+  ctkDICOMMappedFileProducer Producer;
+  QString FileName;
+
+  ctkDICOMMappedInputStream(const ctkDICOMMappedInputStream&);
+  ctkDICOMMappedInputStream& operator=(const ctkDICOMMappedInputStream&);
+};
+
+/// \ingroup DICOM_Core
+///
+/// Creates memory-mapped input streams of a file, starting at a given offset.
+class ctkDICOMMappedInputStreamFactory : public DcmInputStreamFactory
+{
+public:
+  ctkDICOMMappedInputStreamFactory(const QString& fileName, offile_off_t offset);
+  virtual ~ctkDICOMMappedInputStreamFactory();
+
+  /// Falls back to DcmInputFileStream if the file cannot be mapped.
+  virtual DcmInputStream* create() const;
+  virtual DcmInputStreamFactory* clone() const;
+
+private:
+  QString FileName;
+  offile_off_t Offset;
+};
+
+#endif
@@ -19,12 +19,14 @@
 =========================================================================*/
 
 // Qt includes
+#include <QSet>
 #include <QStringList>
 #include <QSqlDriver>
 #include <QSqlError>
 #include <QSqlQuery>
 #include <QSqlRecord>
 #include <QSqlResult>
+#include <QThread>
 
 #include <QTime>
 #include <QDebug>
@@ -34,14 +36,198 @@
 
 // ctkDICOMCore includes
 #include "ctkDICOMModel.h"
+#include "ctkDICOMModel_p.h"
 #include "ctkLogger.h"
 
+// STD includes
+#include <climits>
+
 static ctkLogger logger ( "org.commontk.dicom.DICOMModel" );
 struct Node;
 
 Q_DECLARE_METATYPE(Qt::CheckState);
 Q_DECLARE_METATYPE(QStringList);
 
+/// Number of rows that are fetched from the database at once
+static const int FETCH_BLOCK_SIZE = 256;
+
+//------------------------------------------------------------------------------
+// ctkDICOMModelFetcher methods
+
+//------------------------------------------------------------------------------
+ctkDICOMModelFetcher::ctkDICOMModelFetcher(const QString& connectionName)
+  : ConnectionName(connectionName)
+  , MinimumNodeID(0)
+{
+}
+
+//------------------------------------------------------------------------------
+ctkDICOMModelFetcher::~ctkDICOMModelFetcher()
+{
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMModelFetcher::fetchRows(const QSqlDatabase& database, const QString& query,
+  const QString& sortColumn, Qt::SortOrder sortOrder, const QVariantList& previousKey,
+  int offset, int count, QStringList& fieldNames, QVariantList& rows)
+{
+  rows.clear();
+  if (query.isEmpty() || !database.isOpen())
+    {
+    return false;
+    }
+  // Keyset paging: the rows after the previous row are found using the
+  // index of the table, OFFSET would read all the rows before the block.
+  QString blockQueryString = QString("SELECT * FROM (%1)").arg(query);
+  QString order = "RowID";
+  QVariantList bindValues;
+  bool useKey = (previousKey.size() == (sortColumn.isEmpty() ? 1 : 2));
+  if (!sortColumn.isEmpty())
+    {
+    const QString column = QString("\"%1\"").arg(sortColumn);
+    const bool descending = (sortOrder == Qt::DescendingOrder);
+    order = column + (descending ? " DESC, RowID" : " ASC, RowID");
+    if (useKey)
+      {
+      // NULL values are sorted before any other value
+      const QVariant& sortValue = previousKey[1];
+      if (sortValue.isNull())
+        {
+        blockQueryString += descending ?
+          QString(" WHERE (%1 IS NULL AND RowID > ?)").arg(column) :
+          QString(" WHERE ((%1 IS NULL AND RowID > ?) OR %1 IS NOT NULL)").arg(column);
+        }
+      else
+        {
+        blockQueryString += descending ?
+          QString(" WHERE (%1 < ? OR (%1 = ? AND RowID > ?) OR %1 IS NULL)").arg(column) :
+          QString(" WHERE (%1 > ? OR (%1 = ? AND RowID > ?))").arg(column);
+        bindValues << sortValue << sortValue;
+        }
+      bindValues << previousKey[0];
+      }
+    }
+  else if (useKey)
+    {
+    blockQueryString += " WHERE RowID > ?";
+    bindValues << previousKey[0];
+    }
+  blockQueryString += QString(" ORDER BY %1 LIMIT %2").arg(order).arg(count);
+  if (!useKey && offset > 0)
+    {
+    blockQueryString += QString(" OFFSET %1").arg(offset);
+    }
+
+  QSqlQuery blockQuery(database);
+  blockQuery.setForwardOnly(true);
+  blockQuery.prepare(blockQueryString);
+  foreach(const QVariant& value, bindValues)
+    {
+    blockQuery.addBindValue(value);
+    }
+  // The query is finished after each block, so that no read lock is kept
+  // on the database between blocks.
+  if (!blockQuery.exec())
+    {
+    logger.error("Failed to fetch rows: " + blockQuery.lastError().text());
+    return false;
+    }
+  QSqlRecord record = blockQuery.record();
+  fieldNames.clear();
+  for (int field = 0; field < record.count(); ++field)
+    {
+    fieldNames << record.fieldName(field);
+    }
+  while (blockQuery.next())
+    {
+    QVariantList values;
+    for (int field = 0; field < record.count(); ++field)
+      {
+      values << blockQuery.value(field);
+      }
+    rows << QVariant(values);
+    }
+  blockQuery.finish();
+  return true;
+}
+
+//------------------------------------------------------------------------------
+int ctkDICOMModelFetcher::countRows(const QSqlDatabase& database, const QString& query)
+{
+  if (query.isEmpty() || !database.isOpen())
+    {
+    return -1;
+    }
+  QSqlQuery countQuery(database);
+  if (!countQuery.exec(QString("SELECT COUNT(*) FROM (%1)").arg(query)) || !countQuery.next())
+    {
+    logger.error("Failed to count rows: " + countQuery.lastError().text());
+    return -1;
+    }
+  int count = countQuery.value(0).toInt();
+  countQuery.finish();
+  return count;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMModelFetcher::setMinimumNodeID(int nodeID)
+{
+  this->MinimumNodeID.fetchAndStoreOrdered(nodeID);
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMModelFetcher::openDatabase(const QString& driverName, const QString& databaseName,
+  const QString& hostName, int port, const QString& userName, const QString& password,
+  const QString& connectOptions)
+{
+  QSqlDatabase database = QSqlDatabase::addDatabase(driverName, this->ConnectionName);
+  database.setDatabaseName(databaseName);
+  database.setHostName(hostName);
+  database.setPort(port);
+  database.setUserName(userName);
+  database.setPassword(password);
+  database.setConnectOptions(connectOptions);
+  if (!database.open())
+    {
+    logger.error("Failed to open database " + databaseName + " for fetching: " + database.lastError().text());
+    }
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMModelFetcher::closeDatabase()
+{
+  {
+    QSqlDatabase database = QSqlDatabase::database(this->ConnectionName, false);
+    if (database.isOpen())
+      {
+      database.close();
+      }
+  }
+  QSqlDatabase::removeDatabase(this->ConnectionName);
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMModelFetcher::fetchRows(int nodeID, const QString& query, const QString& sortColumn,
+  int sortOrder, const QVariantList& previousKey, int offset, int count, bool countRows)
+{
+  if (nodeID < this->MinimumNodeID.load())
+    {
+    // the requesting node has been deleted since the request was made
+    return;
+    }
+  QSqlDatabase database = QSqlDatabase::database(this->ConnectionName, false);
+  int totalRowCount = -1;
+  if (countRows)
+    {
+    totalRowCount = qMax(ctkDICOMModelFetcher::countRows(database, query), 0);
+    }
+  QStringList fieldNames;
+  QVariantList rows;
+  ctkDICOMModelFetcher::fetchRows(database, query, sortColumn, static_cast<Qt::SortOrder>(sortOrder),
+    previousKey, offset, count, fieldNames, rows);
+  emit rowsFetched(nodeID, offset, fieldNames, rows, totalRowCount);
+}
+
 //------------------------------------------------------------------------------
 class ctkDICOMModelPrivate
 {
@@ -55,7 +241,25 @@ public:
   void init();
 
   void fetch(const QModelIndex& indexValue, int limit);
+  /// Make sure the row is fetched. In asynchronous mode the row (and the rows
+  /// after it) are requested and they become available later.
+  void fetchRow(const QModelIndex& parentValue, int row);
+  /// Request the block containing the row and the next block from the database thread
+  void requestRows(Node* parentNode, int row);
+  /// Request a block of rows from the database thread. If the previous block is
+  /// being fetched then by default the block is requested when it arrives, with the
+  /// key of its last row.
+  void requestBlock(Node* parentNode, int block, bool waitForPreviousBlock = true);
+  /// Column that the children of the node are sorted by (empty if not sorted)
+  QString sortColumn(Node* parentNode)const;
+  /// Paging key of a fetched row (see ctkDICOMModelFetcher::fetchRows()),
+  /// empty if the row is not fetched.
+  QVariantList rowKey(Node* parentNode, int row, const QString& sortColumn)const;
+  bool isRowFetched(Node* parentNode, int row)const;
   Node* createNode(int row, const QModelIndex& parentValue)const;
+  void deleteRootNode();
+  /// Delete the child nodes of the node, results of their pending requests are ignored
+  void deleteChildren(Node* node);
   Node* nodeFromIndex(const QModelIndex& indexValue)const;
   //QModelIndexList indexListFromNode(const Node* node)const;
   //QModelIndexList modelIndexList(Node* node = 0)const;
@@ -66,14 +270,31 @@ public:
   QString  generateQuery(const QString& fields, const QString& table, const QString& conditions = QString())const;
   void updateQueries(Node* node)const;
 
+  /// Start the database thread if asynchronous fetch is enabled and the database can be
+  /// opened by another connection (in-memory databases cannot)
+  void updateFetcher();
+  void stopFetcher();
+  bool isAsynchronous()const;
+
   Node*        RootNode;
   QSqlDatabase DataBase;
   QList<QMap<int, QVariant> > Headers;
-  QString      Sort;
+  QString       SortColumn;
+  Qt::SortOrder SortOrder;
   QMap<QString, QVariant> SearchParameters;
 
   ctkDICOMModel::IndexType StartLevel;
   ctkDICOMModel::IndexType EndLevel;
+
+  bool AsynchronousFetch;
+  QThread* FetchThread;
+  ctkDICOMModelFetcher* Fetcher;
+  /// Connection settings of the database that the fetcher uses
+  QString FetcherDatabaseName;
+  QString FetcherConnectionName;
+  /// Nodes by ID, for finding the nodes of fetched rows
+  mutable QHash<int, Node*> NodesByID;
+  mutable int NextNodeID;
 };
 
 //------------------------------------------------------------------------------
@@ -92,12 +313,25 @@ struct Node
   ctkDICOMModel::IndexType Type;
   Node*                           Parent;
   QVector<Node*>                  Children;
+  QHash<int, Node*>               ChildrenByRow;
   int                             Row;
-  QSqlQuery                       Query;
+  int                             ID;
+  /// Query of the children
+  QString                         Query;
+  /// Column names and fetched values of the children.
+  /// Empty list in Rows means that the row is not fetched yet.
+  QStringList                     FieldNames;
+  QVector<QVariantList>           Rows;
+  /// Blocks of rows that have been requested from the database thread
+  QSet<int>                       RequestedBlocks;
+  /// Blocks that are requested when the previous block arrives
+  QSet<int>                       DeferredBlocks;
   QString                         UID;
   int                             RowCount;
   bool                            AtEnd;
   bool                            Fetching;
+  /// Children were requested while the node was a placeholder (its query was not known yet)
+  bool                            FetchPending;
   QMap<int, QVariant>             Data;
 };
 
@@ -107,11 +341,17 @@ ctkDICOMModelPrivate::ctkDICOMModelPrivate(ctkDICOMModel& o):q_ptr(&o)
   this->RootNode     = 0;
   this->StartLevel = ctkDICOMModel::RootType;
   this->EndLevel = ctkDICOMModel::ImageType;
+  this->SortOrder = Qt::AscendingOrder;
+  this->AsynchronousFetch = false;
+  this->FetchThread = 0;
+  this->Fetcher = 0;
+  this->NextNodeID = 0;
 }
 
 //------------------------------------------------------------------------------
 ctkDICOMModelPrivate::~ctkDICOMModelPrivate()
 {
+  this->stopFetcher();
   delete this->RootNode;
   this->RootNode = 0;
 }
@@ -235,13 +475,17 @@ Node* ctkDICOMModelPrivate::createNode(int row, const QModelIndex& parentValue)c
     {
     nodeParent = this->nodeFromIndex(parentValue);
     nodeParent->Children.push_back(node);
+    nodeParent->ChildrenByRow[row] = node;
     node->Parent = nodeParent;
     node->Type = ctkDICOMModel::IndexType(nodeParent->Type + 1);
     }
   node->Row = row;
+  node->ID = this->NextNodeID++;
+  this->NodesByID[node->ID] = node;
   if (node->Type != ctkDICOMModel::RootType)
     {
     int field = 0;//nodeParent->Query.record().indexOf("UID");
+    // In asynchronous mode the UID is empty until the row is fetched
     node->UID = this->value(parentValue, row, field).toString();
 #if CHECKABLE_COLUMNS
     node->Data[Qt::CheckStateRole] = node->Parent->Data[Qt::CheckStateRole];
@@ -251,6 +495,7 @@ Node* ctkDICOMModelPrivate::createNode(int row, const QModelIndex& parentValue)c
   node->RowCount = 0;
   node->AtEnd = false;
   node->Fetching = false;
+  node->FetchPending = false;
 
   this->updateQueries(node);
 
@@ -258,47 +503,73 @@ Node* ctkDICOMModelPrivate::createNode(int row, const QModelIndex& parentValue)c
 }
 
 //------------------------------------------------------------------------------
-QVariant ctkDICOMModelPrivate::value(const QModelIndex& parentValue, int row, int column) const
+void ctkDICOMModelPrivate::deleteRootNode()
 {
-  Node* node = this->nodeFromIndex(parentValue);
-  if (row >= node->RowCount)
+  delete this->RootNode;
+  this->RootNode = 0;
+  this->NodesByID.clear();
+  if (this->Fetcher)
+    {
+    // results of pending requests are not needed anymore
+    this->Fetcher->setMinimumNodeID(this->NextNodeID);
+    }
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMModelPrivate::deleteChildren(Node* node)
+{
+  QList<Node*> descendants;
+  descendants << node->Children.toList();
+  while (!descendants.isEmpty())
     {
-    const_cast<ctkDICOMModelPrivate *>(this)->fetch(parentValue, row + 256);
+    Node* descendant = descendants.takeFirst();
+    this->NodesByID.remove(descendant->ID);
+    descendants << descendant->Children.toList();
     }
-  return this->value(node, row, column);
+  qDeleteAll(node->Children);
+  node->Children.clear();
+  node->ChildrenByRow.clear();
+}
+
+//------------------------------------------------------------------------------
+QVariant ctkDICOMModelPrivate::value(const QModelIndex& parentValue, int row, int column) const
+{
+  const_cast<ctkDICOMModelPrivate *>(this)->fetchRow(parentValue, row);
+  return this->value(this->nodeFromIndex(parentValue), row, column);
 }
 
 //------------------------------------------------------------------------------
 QVariant ctkDICOMModelPrivate::value(Node* parentNode, int row, int column) const
 {
-  if (row < 0 || column < 0 || !parentNode || row >= parentNode->RowCount)
+  if (row < 0 || column < 0 || !parentNode || row >= parentNode->RowCount
+    || row >= parentNode->Rows.size())
     {
     return QVariant();
     }
-
-  if (!parentNode->Query.seek(row))
+  const QVariantList& rowValues = parentNode->Rows[row];
+  if (column >= rowValues.size())
     {
-    qDebug() << parentNode->Query.lastError();
-    Q_ASSERT(parentNode->Query.seek(row));
+    // not fetched yet
     return QVariant();
     }
-  QVariant res = parentNode->Query.value(column);
-  Q_ASSERT(res.isValid());
-  return res;
+  return rowValues[column];
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMModelPrivate::isRowFetched(Node* parentNode, int row) const
+{
+  return parentNode && row >= 0 && row < parentNode->Rows.size() && !parentNode->Rows[row].isEmpty();
 }
 
 //------------------------------------------------------------------------------
 QString ctkDICOMModelPrivate::generateQuery(const QString& fields, const QString& table, const QString& conditions)const
 {
-  QString res = QString("SELECT ") + fields + QString(" FROM ") + table;
+  // Rows are ordered when they are fetched, RowID is used for paging
+  QString res = QString("SELECT ") + fields + QString(", rowid as RowID FROM ") + table;
   if (!conditions.isEmpty())
     {
     res += QString(" WHERE ") + conditions;
     }
-  if (!this->Sort.isEmpty())
-    {
-    res += QString(" ORDER BY ") + this->Sort;
-    }
   logger.debug ( "ctkDICOMModelPrivate::generateQuery: query is: " + res );
   return res;
 }
@@ -362,7 +633,12 @@ void ctkDICOMModelPrivate::updateQueries(Node* node)const
     case ctkDICOMModel::ImageType:
       break;
     }
-  node->Query = QSqlQuery(query, this->DataBase);
+  // The UID of placeholder nodes is not known until their row is fetched
+  if (node->Type != ctkDICOMModel::RootType && node->UID.isEmpty())
+    {
+    query.clear();
+    }
+  node->Query = query;
   foreach(Node* child, node->Children)
     {
     this->updateQueries(child);
@@ -374,52 +650,221 @@ void ctkDICOMModelPrivate::fetch(const QModelIndex& indexValue, int limit)
 {
   Q_Q(ctkDICOMModel);
   Node* node = this->nodeFromIndex(indexValue);
-  if (node->AtEnd || limit <= node->RowCount || node->Fetching/*|| bottom.column() == -1*/)
+  if (!node || node->AtEnd || limit <= node->RowCount || node->Fetching/*|| bottom.column() == -1*/)
     {
     return;
     }
+  if (this->isAsynchronous())
+    {
+    // rows are inserted when the database thread has counted them
+    this->requestRows(node, 0);
+    return;
+    }
   node->Fetching = true;
 
-  int newRowCount;
   const int oldRowCount = node->RowCount;
-
-  // try to seek directly
-  if (node->Query.seek(limit - 1))
+  QStringList fieldNames;
+  QVariantList rows;
+  const QString sortColumn = this->sortColumn(node);
+  bool success = ctkDICOMModelFetcher::fetchRows(this->DataBase, node->Query,
+    sortColumn, this->SortOrder, this->rowKey(node, oldRowCount - 1, sortColumn),
+    oldRowCount, limit - oldRowCount, fieldNames, rows);
+  if (!fieldNames.isEmpty())
     {
-    newRowCount = limit;
+    node->FieldNames = fieldNames;
     }
-  else
+  if (!success || rows.size() < limit - oldRowCount)
     {
-    newRowCount = qMax(oldRowCount, 1);
-    if (node->Query.seek(newRowCount - 1))
-      {
-      while (node->Query.next())
-        {
-        ++newRowCount;
-        }
-      }
-    else
-      {
-      // empty or invalid query
-      newRowCount = 0;
-      }
     node->AtEnd = true; // this is the end.
     }
-  if (newRowCount > 0 && newRowCount > node->RowCount)
+  int newRowCount = oldRowCount + rows.size();
+  if (newRowCount > oldRowCount)
     {
-    q->beginInsertRows(indexValue, node->RowCount, newRowCount - 1);
+    q->beginInsertRows(indexValue, oldRowCount, newRowCount - 1);
+    foreach(const QVariant& rowValues, rows)
+      {
+      node->Rows.append(rowValues.toList());
+      }
     node->RowCount = newRowCount;
     node->Fetching = false;
     q->endInsertRows();
     }
   else
     {
-    node->RowCount = newRowCount;
     node->Fetching = false;
     }
 }
 
+//------------------------------------------------------------------------------
+void ctkDICOMModelPrivate::fetchRow(const QModelIndex& parentValue, int row)
+{
+  Node* node = this->nodeFromIndex(parentValue);
+  if (!node || row < 0 || this->isRowFetched(node, row))
+    {
+    return;
+    }
+  if (this->isAsynchronous())
+    {
+    this->requestRows(node, row);
+    }
+  else if (row >= node->RowCount)
+    {
+    this->fetch(parentValue, row + FETCH_BLOCK_SIZE);
+    }
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMModelPrivate::requestRows(Node* node, int row)
+{
+  if (!this->Fetcher || !node)
+    {
+    return;
+    }
+  if (node->Query.isEmpty())
+    {
+    // the query of placeholder nodes is set when their row is fetched,
+    // the children are requested then
+    node->FetchPending = true;
+    return;
+    }
+  if (!node->AtEnd)
+    {
+    // number of rows is not known yet, count them and get the first block
+    if (!node->Fetching)
+      {
+      node->Fetching = true;
+      node->RequestedBlocks.insert(0);
+      QMetaObject::invokeMethod(this->Fetcher, "fetchRows", Qt::QueuedConnection,
+        Q_ARG(int, node->ID), Q_ARG(QString, node->Query),
+        Q_ARG(QString, this->sortColumn(node)), Q_ARG(int, this->SortOrder),
+        Q_ARG(QVariantList, QVariantList()), Q_ARG(int, 0),
+        Q_ARG(int, FETCH_BLOCK_SIZE), Q_ARG(bool, true));
+      }
+    return;
+    }
+  // get the block of the row and prefetch the next block
+  const int block = row / FETCH_BLOCK_SIZE;
+  this->requestBlock(node, block);
+  this->requestBlock(node, block + 1);
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMModelPrivate::requestBlock(Node* node, int block, bool waitForPreviousBlock)
+{
+  const int offset = block * FETCH_BLOCK_SIZE;
+  if (!this->Fetcher || !node || offset >= node->RowCount || node->RequestedBlocks.contains(block))
+    {
+    return;
+    }
+  if (waitForPreviousBlock && block > 0 && !this->isRowFetched(node, offset - 1)
+    && node->RequestedBlocks.contains(block - 1))
+    {
+    // the block is read after the last row of the previous block, see onRowsFetched()
+    node->DeferredBlocks.insert(block);
+    return;
+    }
+  node->RequestedBlocks.insert(block);
+  node->DeferredBlocks.remove(block);
+  const QString sortColumn = this->sortColumn(node);
+  QMetaObject::invokeMethod(this->Fetcher, "fetchRows", Qt::QueuedConnection,
+    Q_ARG(int, node->ID), Q_ARG(QString, node->Query),
+    Q_ARG(QString, sortColumn), Q_ARG(int, this->SortOrder),
+    Q_ARG(QVariantList, this->rowKey(node, offset - 1, sortColumn)), Q_ARG(int, offset),
+    Q_ARG(int, FETCH_BLOCK_SIZE), Q_ARG(bool, false));
+}
+
+//------------------------------------------------------------------------------
+QString ctkDICOMModelPrivate::sortColumn(Node* node)const
+{
+  // Not all the columns are in the record of each level. Until the fields are
+  // known the column name is sorted as a constant, which does not change the order.
+  if (!node->FieldNames.isEmpty() && !node->FieldNames.contains(this->SortColumn))
+    {
+    return QString();
+    }
+  return this->SortColumn;
+}
+
+//------------------------------------------------------------------------------
+QVariantList ctkDICOMModelPrivate::rowKey(Node* node, int row, const QString& sortColumn)const
+{
+  QVariantList key;
+  const int rowIDField = node->FieldNames.indexOf("RowID");
+  if (!this->isRowFetched(node, row) || rowIDField < 0)
+    {
+    return key;
+    }
+  key << this->value(node, row, rowIDField);
+  if (!sortColumn.isEmpty())
+    {
+    key << this->value(node, row, node->FieldNames.indexOf(sortColumn));
+    }
+  return key;
+}
 
+//------------------------------------------------------------------------------
+bool ctkDICOMModelPrivate::isAsynchronous()const
+{
+  return this->Fetcher != 0;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMModelPrivate::updateFetcher()
+{
+  Q_Q(ctkDICOMModel);
+  bool useFetcher = this->AsynchronousFetch && this->DataBase.isOpen()
+    && !this->DataBase.databaseName().isEmpty() && this->DataBase.databaseName() != ":memory:";
+  if (this->Fetcher && (!useFetcher || this->FetcherDatabaseName != this->DataBase.databaseName()
+    || this->FetcherConnectionName != this->DataBase.connectionName()))
+    {
+    this->stopFetcher();
+    }
+  if (!useFetcher || this->Fetcher)
+    {
+    return;
+    }
+  this->FetcherDatabaseName = this->DataBase.databaseName();
+  this->FetcherConnectionName = this->DataBase.connectionName();
+
+  this->FetchThread = new QThread;
+  this->Fetcher = new ctkDICOMModelFetcher(
+    QString("ctkDICOMModel_%1").arg(reinterpret_cast<quintptr>(q), 0, 16));
+  this->Fetcher->setMinimumNodeID(this->NextNodeID);
+  this->Fetcher->moveToThread(this->FetchThread);
+  QObject::connect(this->Fetcher, SIGNAL(rowsFetched(int,int,QStringList,QVariantList,int)),
+    q, SLOT(onRowsFetched(int,int,QStringList,QVariantList,int)));
+  this->FetchThread->start();
+  QMetaObject::invokeMethod(this->Fetcher, "openDatabase", Qt::QueuedConnection,
+    Q_ARG(QString, this->DataBase.driverName()), Q_ARG(QString, this->DataBase.databaseName()),
+    Q_ARG(QString, this->DataBase.hostName()), Q_ARG(int, this->DataBase.port()),
+    Q_ARG(QString, this->DataBase.userName()), Q_ARG(QString, this->DataBase.password()),
+    Q_ARG(QString, this->DataBase.connectOptions()));
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMModelPrivate::stopFetcher()
+{
+  if (!this->Fetcher)
+    {
+    return;
+    }
+  // skip all pending requests
+  this->Fetcher->setMinimumNodeID(INT_MAX);
+  QMetaObject::invokeMethod(this->Fetcher, "closeDatabase", Qt::BlockingQueuedConnection);
+  this->FetchThread->quit();
+  this->FetchThread->wait();
+  delete this->Fetcher;
+  this->Fetcher = 0;
+  delete this->FetchThread;
+  this->FetchThread = 0;
+  // nodes that requested rows from the fetcher will need to request them again
+  foreach(Node* node, this->NodesByID)
+    {
+    node->RequestedBlocks.clear();
+    node->DeferredBlocks.clear();
+    node->Fetching = false;
+    }
+}
 
 //------------------------------------------------------------------------------
 ctkDICOMModel::ctkDICOMModel(QObject* parentObject)
@@ -433,6 +878,8 @@ ctkDICOMModel::ctkDICOMModel(QObject* parentObject)
 //------------------------------------------------------------------------------
 ctkDICOMModel::~ctkDICOMModel()
 {
+  Q_D(ctkDICOMModel);
+  d->stopFetcher();
 }
 
 //------------------------------------------------------------------------------
@@ -487,12 +934,14 @@ QVariant ctkDICOMModel::data ( const QModelIndex & dataIndex, int role ) const
     }
   QModelIndex parentIndex = this->parent(dataIndex);
   Node* parentNode = d->nodeFromIndex(parentIndex);
-  if (dataIndex.row() >= parentNode->RowCount)
+  const_cast<ctkDICOMModelPrivate *>(d)->fetchRow(parentIndex, dataIndex.row());
+  QString columnName = d->Headers[dataIndex.column()][Qt::DisplayRole].toString();
+  if (!d->isRowFetched(parentNode, dataIndex.row()))
     {
-    const_cast<ctkDICOMModelPrivate *>(d)->fetch(dataIndex, dataIndex.row());
+    // placeholder until the row is fetched by the database thread
+    return columnName.compare("Name") == 0 ? tr("Loading...") : QString();
     }
-  QString columnName = d->Headers[dataIndex.column()][Qt::DisplayRole].toString();
-  int field = parentNode->Query.record().indexOf(columnName);
+  int field = parentNode->FieldNames.indexOf(columnName);
   if (field < 0)
     {
     // Not all the columns are in the record, it's ok to have no field here.
@@ -501,7 +950,7 @@ QVariant ctkDICOMModel::data ( const QModelIndex & dataIndex, int role ) const
     return QString();
     }
 
-  QVariant dataValue=d->value(parentIndex, dataIndex.row(), field);
+  QVariant dataValue=d->value(parentNode, dataIndex.row(), field);
   if (dataValue.isNull())
   {
     if (columnName.compare("Name")==0)
@@ -564,7 +1013,7 @@ void ctkDICOMModel::fetchMore ( const QModelIndex & parentValue )
 {
   Q_D(ctkDICOMModel);
   Node* node = d->nodeFromIndex(parentValue);
-  d->fetch(parentValue, qMax(node->RowCount, 0) + 256);
+  d->fetch(parentValue, qMax(node->RowCount, 0) + FETCH_BLOCK_SIZE);
 }
 
 //------------------------------------------------------------------------------
@@ -613,7 +1062,17 @@ bool ctkDICOMModel::hasChildren ( const QModelIndex & parentIndex ) const
     // We don't want to fetch the data because we don't want to add children
     // to the index yet (it would be a mess to add rows inside a hasChildren)
     //const_cast<qCTKDCMTKModelPrivate*>(d)->fetch(parentIndex, 1);
-    bool res = node->Query.seek(0);
+    if (d->isAsynchronous())
+      {
+      // Checking would block the GUI thread, children are counted when the
+      // node is expanded.
+      return true;
+      }
+    QStringList fieldNames;
+    QVariantList rows;
+    bool res = ctkDICOMModelFetcher::fetchRows(d->DataBase, node->Query, QString(), Qt::AscendingOrder,
+      QVariantList(), 0, 1, fieldNames, rows)
+      && !rows.isEmpty();
     if (!res)
       {
       // now we know there is no children to the node, don't try next time.
@@ -653,17 +1112,9 @@ QModelIndex ctkDICOMModel::index ( int row, int column, const QModelIndex & pare
     return QModelIndex();
     }
   Node* parentNode = d->nodeFromIndex(parentIndex);
-  int field = 0;// always 0//parentNode->Query.record().indexOf("UID");
-  QString uid = d->value(parentIndex, row, field).toString();
-  Node* node = 0;
-  foreach(Node* tmpNode, parentNode->Children)
-    {
-    if (tmpNode->UID == uid)
-      {
-      node = tmpNode;
-      break;
-      }
-    }
+  // Rows do not change position until the model is reset, therefore nodes can be
+  // found by row (UID may not be available yet if the row is not fetched yet).
+  Node* node = parentNode->ChildrenByRow.value(row, 0);
   // TODO: Here it is assumed that ctkDICOMModel::index is called with valid
   // arguments, we should probably be a bit more careful.
   if (node == 0)
@@ -849,8 +1300,8 @@ void ctkDICOMModel::setDatabase(const QSqlDatabase &db)
   this->beginResetModel();
   d->DataBase = db;
 
-  delete d->RootNode;
-  d->RootNode = 0;
+  d->deleteRootNode();
+  d->updateFetcher();
 
   if (d->DataBase.tables().empty())
     {
@@ -863,17 +1314,7 @@ void ctkDICOMModel::setDatabase(const QSqlDatabase &db)
 
   this->endResetModel();
 
-  // TODO, use hasQuerySize everywhere, not only in setDataBase()
-  bool hasQuerySize = d->RootNode->Query.driver()->hasFeature(QSqlDriver::QuerySize);
-  if (hasQuerySize && d->RootNode->Query.size() > 0)
-    {
-    int newRowCount= d->RootNode->Query.size();
-    beginInsertRows(QModelIndex(), 0, qMax(0, newRowCount - 1));
-    d->RootNode->RowCount = newRowCount;
-    d->RootNode->AtEnd = true;
-    endInsertRows();
-    }
-  d->fetch(QModelIndex(), 256);
+  d->fetch(QModelIndex(), FETCH_BLOCK_SIZE);
 }
 
 //------------------------------------------------------------------------------
@@ -885,8 +1326,8 @@ void ctkDICOMModel::setDatabase(const QSqlDatabase &db,const QMap<QString, QVari
   d->DataBase = db;
   d->SearchParameters = parameters;
 
-  delete d->RootNode;
-  d->RootNode = 0;
+  d->deleteRootNode();
+  d->updateFetcher();
 
   if (d->DataBase.tables().empty())
     {
@@ -899,17 +1340,7 @@ void ctkDICOMModel::setDatabase(const QSqlDatabase &db,const QMap<QString, QVari
 
   this->endResetModel();
 
-  // TODO, use hasQuerySize everywhere, not only in setDataBase()
-  bool hasQuerySize = d->RootNode->Query.driver()->hasFeature(QSqlDriver::QuerySize);
-  if (hasQuerySize && d->RootNode->Query.size() > 0)
-    {
-    int newRowCount= d->RootNode->Query.size();
-    beginInsertRows(QModelIndex(), 0, qMax(0, newRowCount - 1));
-    d->RootNode->RowCount = newRowCount;
-    d->RootNode->AtEnd = true;
-    endInsertRows();
-    }
-  d->fetch(QModelIndex(), 256);
+  d->fetch(QModelIndex(), FETCH_BLOCK_SIZE);
 }
 
 //------------------------------------------------------------------------------
@@ -926,6 +1357,115 @@ void ctkDICOMModel::setEndLevel(ctkDICOMModel::IndexType level)
   d->EndLevel = level;
 }
 
+//------------------------------------------------------------------------------
+bool ctkDICOMModel::isAsynchronousFetchEnabled()const
+{
+  Q_D(const ctkDICOMModel);
+  return d->AsynchronousFetch;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMModel::setAsynchronousFetchEnabled(bool enabled)
+{
+  Q_D(ctkDICOMModel);
+  if (d->AsynchronousFetch == enabled)
+    {
+    return;
+    }
+  d->AsynchronousFetch = enabled;
+  if (d->RootNode)
+    {
+    // repopulate the model using the new fetch mode
+    this->reset();
+    }
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMModel::onRowsFetched(int nodeID, int offset, const QStringList& fieldNames,
+  const QVariantList& rows, int totalRowCount)
+{
+  Q_D(ctkDICOMModel);
+  Node* node = d->NodesByID.value(nodeID, 0);
+  if (!node)
+    {
+    // the model has been reset since the rows were requested
+    return;
+    }
+  QModelIndex parentIndex = (node == d->RootNode ? QModelIndex() : this->createIndex(node->Row, 0, node));
+  if (!fieldNames.isEmpty())
+    {
+    node->FieldNames = fieldNames;
+    }
+
+  if (totalRowCount >= 0)
+    {
+    // first block: all the rows are inserted, the ones that are not fetched yet are placeholders
+    node->Fetching = false;
+    node->AtEnd = true;
+    if (totalRowCount > 0)
+      {
+      this->beginInsertRows(parentIndex, 0, totalRowCount - 1);
+      node->Rows.resize(totalRowCount);
+      for (int row = 0; row < rows.size() && row < totalRowCount; ++row)
+        {
+        node->Rows[row] = rows[row].toList();
+        }
+      node->RowCount = totalRowCount;
+      this->endInsertRows();
+      }
+    // prefetch the next block
+    d->requestRows(node, 0);
+    return;
+    }
+
+  const int lastRow = qMin(offset + rows.size(), node->RowCount) - 1;
+  for (int row = offset; row <= lastRow; ++row)
+    {
+    node->Rows[row] = rows[row - offset].toList();
+    // nodes created for placeholder rows get their UID and query now
+    Node* childNode = node->ChildrenByRow.value(row, 0);
+    if (childNode && childNode->UID.isEmpty())
+      {
+      if (childNode->RowCount > 0)
+        {
+        // children of the placeholder are not valid
+        this->beginRemoveRows(this->createIndex(row, 0, childNode), 0, childNode->RowCount - 1);
+        d->deleteChildren(childNode);
+        childNode->Rows.clear();
+        childNode->RowCount = 0;
+        this->endRemoveRows();
+        }
+      else
+        {
+        d->deleteChildren(childNode);
+        childNode->Rows.clear();
+        }
+      childNode->AtEnd = false;
+      childNode->Fetching = false;
+      childNode->RequestedBlocks.clear();
+      childNode->DeferredBlocks.clear();
+      childNode->UID = d->value(node, row, 0).toString();
+      d->updateQueries(childNode);
+      if (childNode->FetchPending)
+        {
+        childNode->FetchPending = false;
+        d->requestRows(childNode, 0);
+        }
+      }
+    }
+  // The next block was waiting for the key of the last row of this block.
+  // It is read from its offset if this block could not be fetched.
+  const int nextBlock = offset / FETCH_BLOCK_SIZE + 1;
+  if (node->DeferredBlocks.contains(nextBlock))
+    {
+    d->requestBlock(node, nextBlock, false);
+    }
+  if (lastRow >= offset)
+    {
+    emit dataChanged(this->index(offset, 0, parentIndex), this->index(lastRow, d->Headers.size() - 1, parentIndex));
+    }
+}
+
 //------------------------------------------------------------------------------
 void ctkDICOMModel::reset()
 {
@@ -954,11 +1494,9 @@ void ctkDICOMModel::sort(int column, Qt::SortOrder order)
   emit layoutChanged();
   */
   this->beginResetModel();
-  delete d->RootNode;
-  d->RootNode = 0;
-  d->Sort = QString("\"%1\" %2")
-    .arg(d->Headers[column][Qt::DisplayRole].toString())
-    .arg(order == Qt::AscendingOrder ? "ASC" : "DESC");
+  d->deleteRootNode();
+  d->SortColumn = d->Headers[column][Qt::DisplayRole].toString();
+  d->SortOrder = order;
   d->RootNode = d->createNode(-1, QModelIndex());
 
   this->endResetModel();
@@ -41,6 +41,7 @@ class CTK_DICOM_CORE_EXPORT ctkDICOMModel
   Q_ENUMS(IndexType)
   /// startLevel contains the hierarchy depth the model contains
   Q_PROPERTY(IndexType endLevel READ endLevel WRITE setEndLevel);
+  Q_PROPERTY(bool asynchronousFetch READ isAsynchronousFetchEnabled WRITE setAsynchronousFetchEnabled);
 public:
 
   enum {
@@ -66,6 +67,17 @@ public:
   ctkDICOMModel::IndexType endLevel()const;
   void setEndLevel(ctkDICOMModel::IndexType level);
 
+  /// If enabled, queries are executed in a separate database thread (using a
+  /// separate connection to the database) and rows are added to the model when
+  /// the results arrive. Rows that are not fetched yet are displayed as placeholders,
+  /// and the rows following the displayed ones are prefetched.
+  /// Since rows are not available immediately after fetchMore(), code that traverses
+  /// the model directly should use synchronous fetching.
+  /// In-memory databases are always queried synchronously.
+  /// Disabled by default. Changing the value resets the model.
+  bool isAsynchronousFetchEnabled()const;
+  void setAsynchronousFetchEnabled(bool enabled);
+
   virtual bool canFetchMore ( const QModelIndex & parent ) const;
   virtual int columnCount ( const QModelIndex & parent = QModelIndex() ) const;
   virtual QVariant data ( const QModelIndex & index, int role = Qt::DisplayRole ) const;
@@ -84,6 +96,10 @@ public:
   virtual void sort(int column, Qt::SortOrder order = Qt::AscendingOrder);
 public Q_SLOTS:
   virtual void reset();
+protected Q_SLOTS:
+  /// Called when the database thread has fetched rows of a node.
+  void onRowsFetched(int nodeID, int offset, const QStringList& fieldNames,
+    const QVariantList& rows, int totalRowCount);
 protected:
   QScopedPointer<ctkDICOMModelPrivate> d_ptr;
 
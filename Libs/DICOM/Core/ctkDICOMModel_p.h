@@ -0,0 +1,82 @@
+/*=========================================================================
+
+  Library:   CTK
+
+  Copyright (c) Kitware Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0.txt
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+=========================================================================*/
+
+#ifndef __ctkDICOMModel_p_h
+#define __ctkDICOMModel_p_h
+
+// Qt includes
+#include <QAtomicInt>
+#include <QObject>
+#include <QSqlDatabase>
+#include <QStringList>
+#include <QVariant>
+
+/// \ingroup DICOM_Core
+///
+/// Executes the queries of ctkDICOMModel in the thread it lives in (the database
+/// thread of the model), using its own database connection.
+/// Results are delivered in blocks of rows by the rowsFetched signal.
+class ctkDICOMModelFetcher : public QObject
+{
+  Q_OBJECT
+public:
+  ctkDICOMModelFetcher(const QString& connectionName);
+  virtual ~ctkDICOMModelFetcher();
+
+  /// Get rows [offset, offset + count) of the query result.
+  /// The query must have a RowID column, rows are ordered by sortColumn (if not empty)
+  /// and then by RowID. If previousKey is the key of the row before offset (its RowID,
+  /// followed by its sortColumn value if sorted) then the rows after that key are read
+  /// instead of skipping offset rows, so reading a block does not depend on its position.
+  /// Each item of rows is a QVariantList that contains the values of a row.
+  /// Returns false if the query failed.
+  static bool fetchRows(const QSqlDatabase& database, const QString& query,
+    const QString& sortColumn, Qt::SortOrder sortOrder, const QVariantList& previousKey,
+    int offset, int count, QStringList& fieldNames, QVariantList& rows);
+
+  /// Get number of rows in the result of the query. Returns -1 if the query failed.
+  static int countRows(const QSqlDatabase& database, const QString& query);
+
+  /// Requests of nodes with ID below this value are ignored (the nodes do not exist anymore).
+  /// Can be called from any thread.
+  void setMinimumNodeID(int nodeID);
+
+public Q_SLOTS:
+  /// Open a connection with the same settings as the database of the model.
+  void openDatabase(const QString& driverName, const QString& databaseName, const QString& hostName,
+    int port, const QString& userName, const QString& password, const QString& connectOptions);
+  void closeDatabase();
+
+  /// Fetch rows [offset, offset + count) of the query of a node.
+  /// If countRows is true then the total number of rows is also determined.
+  /// sortOrder is a Qt::SortOrder, see the static fetchRows() for the other arguments.
+  void fetchRows(int nodeID, const QString& query, const QString& sortColumn, int sortOrder,
+    const QVariantList& previousKey, int offset, int count, bool countRows);
+
+Q_SIGNALS:
+  /// totalRowCount is -1 if the rows were not counted.
+  void rowsFetched(int nodeID, int offset, const QStringList& fieldNames, const QVariantList& rows, int totalRowCount);
+
+protected:
+  QString ConnectionName;
+  QAtomicInt MinimumNodeID;
+};
+
+#endif
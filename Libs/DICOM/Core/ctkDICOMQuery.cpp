@@ -28,9 +28,17 @@
 #include <QFile>
 #include <QDirIterator>
 #include <QFileInfo>
+#include <QAtomicInt>
 #include <QDebug>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QRunnable>
+#include <QThreadPool>
+#include <QTime>
+#include <QWaitCondition>
 
 // ctkDICOMCore includes
+#include "ctkDICOMItem.h"
 #include "ctkDICOMQuery.h"
 #include "ctkDICOMUtil.h"
 #include "ctkLogger.h"
@@ -53,6 +61,14 @@
 
 static ctkLogger logger ( "org.commontk.dicom.DICOMQuery" );
 
+/// Number of query results that are stored in the database in one transaction
+static const int QUERY_RESULT_BATCH_SIZE = 100;
+/// Maximum time (in milliseconds) that received query results are kept before storing them
+/// in the database (results are stored more frequently if batches are filled up faster).
+static const int QUERY_RESULT_STORE_INTERVAL_MSEC = 500;
+
+class ctkDICOMQueryPrivate;
+
 //------------------------------------------------------------------------------
 // A customized implemenation so that Qt signals can be emitted
 // when query results are obtained
@@ -67,51 +83,196 @@ public:
   ~ctkDICOMQuerySCUPrivate() {};
   virtual OFCondition handleFINDResponse(const T_ASC_PresentationContextID  presID,
                                          QRResponse *response,
-                                         OFBool &waitForNextResponse)
-    {
-      if (this->query)
-        {
-        logger.debug ( "FIND RESPONSE" );
-        emit this->query->debug("Got a find response!");
-        return this->DcmSCU::handleFINDResponse(presID, response, waitForNextResponse);
-        }
-      return DIMSE_NULLKEY;
-    };
+                                         OFBool &waitForNextResponse);
+};
+
+//------------------------------------------------------------------------------
+/// Datasets received by C-FIND requests, waiting to be stored in the database.
+/// Datasets can be added from any thread, they are stored in the thread of the database.
+class ctkDICOMQueryResultQueue
+{
+public:
+  void add(DcmDataset* dataset)
+  {
+    QMutexLocker locker(&this->Mutex);
+    ctkDICOMItem* item = new ctkDICOMItem;
+    item->InitializeFromItem(dataset, true /* take ownership */);
+    this->Datasets.append(QSharedPointer<ctkDICOMItem>(item));
+    this->DatasetAdded.wakeAll();
+  }
+
+  int size()
+  {
+    QMutexLocker locker(&this->Mutex);
+    return this->Datasets.size();
+  }
+
+  /// Wait until datasets are added or the timeout expires.
+  void waitForDatasets(unsigned long msecTimeout)
+  {
+    QMutexLocker locker(&this->Mutex);
+    if (this->Datasets.isEmpty())
+      {
+      this->DatasetAdded.wait(&this->Mutex, msecTimeout);
+      }
+  }
+
+  /// Wake up threads that are waiting for datasets (e.g., because the query is canceled).
+  void wakeAll()
+  {
+    QMutexLocker locker(&this->Mutex);
+    this->DatasetAdded.wakeAll();
+  }
+
+  QList<QSharedPointer<ctkDICOMItem> > takeAll()
+  {
+    QMutexLocker locker(&this->Mutex);
+    QList<QSharedPointer<ctkDICOMItem> > datasets = this->Datasets;
+    this->Datasets.clear();
+    return datasets;
+  }
+
+protected:
+  QMutex Mutex;
+  QWaitCondition DatasetAdded;
+  QList<QSharedPointer<ctkDICOMItem> > Datasets;
+};
+
+//------------------------------------------------------------------------------
+/// Series level query of a study
+struct ctkDICOMQuerySeriesRequest
+{
+  QString StudyInstanceUID;
+  // patient elements are not provided by series level queries
+  OFString PatientName;
+  OFString PatientID;
 };
 
 //------------------------------------------------------------------------------
 class ctkDICOMQueryPrivate
 {
+  Q_DECLARE_PUBLIC(ctkDICOMQuery);
+protected:
+  ctkDICOMQuery* const q_ptr;
+
 public:
-  ctkDICOMQueryPrivate();
+  ctkDICOMQueryPrivate(ctkDICOMQuery& obj);
   ~ctkDICOMQueryPrivate();
 
   /// Add a StudyInstanceUID to be queried
-  void addStudyInstanceUIDAndDataset(const QString& StudyInstanceUID, DcmDataset* dataset );
+  void addStudyInstanceUID(const QString& studyInstanceUID, const OFString& patientName, const OFString& patientID);
+
+  /// Called by the SCU for each received C-FIND response
+  void handleFINDResponse(DcmDataset* dataset);
+
+  /// Set elements of a series level query
+  void initializeSeriesQuery(DcmDataset& seriesQuery)const;
+  void addPatientElements(DcmDataset* dataset, const ctkDICOMQuerySeriesRequest& request)const;
+
+  /// Store received query results in the database.
+  /// Unless force is true, results are only stored if a batch is complete or
+  /// they have been waiting longer than the store interval.
+  void storeQueryResults(bool force);
+
+  /// Get the next study to query series for. Waits until a study is available.
+  /// Returns false if there are no more studies to process.
+  bool takeSeriesRequest(ctkDICOMQuerySeriesRequest& request);
+  void seriesRequestCompleted(bool success);
+  /// Thread-safe, can be called by the series workers
+  bool isCanceled();
+  /// Perform series level queries in a worker thread, using a separate association.
+  void runSeriesQueries();
 
   QString                 CallingAETitle;
   QString                 CalledAETitle;
   QString                 Host;
   int                     Port;
   bool                    PreferCGET;
+  int                     MaximumAssociationCount;
   QMap<QString,QVariant>  Filters;
   ctkDICOMQuerySCUPrivate SCU;
   DcmDataset*             Query;
   QStringList             StudyInstanceUIDList;
-  QList<DcmDataset*>      StudyDatasetList;
-  bool                    Canceled;
+  QList<ctkDICOMQuerySeriesRequest> SeriesRequests;
+  /// Set by cancel() from any thread, read by the series workers
+  QAtomicInt              Canceled;
+
+  // State of the current query() call
+  ctkDICOMDatabase*       Database;
+  ctkDICOMQueryResultQueue ResultQueue;
+  QTime                   LastStoreTime;
+  /// Query level of responses received by the SCU ("STUDY" or "SERIES")
+  QString                 QueryLevel;
+  ctkDICOMQuerySeriesRequest CurrentSeriesRequest;
+  QString                 SeriesDescription;
+
+  // Series queries performed in parallel by worker threads, protected by SeriesMutex
+  bool                    ParallelSeriesQueries;
+  QMutex                  SeriesMutex;
+  QWaitCondition          SeriesRequestAdded;
+  QList<ctkDICOMQuerySeriesRequest> PendingSeriesRequests;
+  bool                    StudyQueryCompleted;
+  int                     ActiveSeriesWorkerCount;
+  int                     CompletedSeriesRequestCount;
+  int                     FailedSeriesRequestCount;
+};
+
+//------------------------------------------------------------------------------
+class ctkDICOMQuerySeriesWorker : public QRunnable
+{
+public:
+  ctkDICOMQuerySeriesWorker(ctkDICOMQueryPrivate* query)
+    : Query(query)
+  {
+  }
+  virtual void run()
+  {
+    this->Query->runSeriesQueries();
+  }
+protected:
+  ctkDICOMQueryPrivate* Query;
 };
 
+//------------------------------------------------------------------------------
+OFCondition ctkDICOMQuerySCUPrivate::handleFINDResponse(const T_ASC_PresentationContextID  presID,
+                                                         QRResponse *response,
+                                                         OFBool &waitForNextResponse)
+{
+  if (!this->query)
+    {
+    return DIMSE_NULLKEY;
+    }
+  logger.debug ( "FIND RESPONSE" );
+  emit this->query->debug("Got a find response!");
+  OFCondition result = this->DcmSCU::handleFINDResponse(presID, response, waitForNextResponse);
+  if (result.good() && response && response->m_dataset)
+    {
+    // the response is processed right away, it is not kept until the query is completed
+    DcmDataset* dataset = response->m_dataset;
+    response->m_dataset = NULL;
+    this->query->d_func()->handleFINDResponse(dataset);
+    }
+  return result;
+}
+
 //------------------------------------------------------------------------------
 // ctkDICOMQueryPrivate methods
 
 //------------------------------------------------------------------------------
-ctkDICOMQueryPrivate::ctkDICOMQueryPrivate()
+ctkDICOMQueryPrivate::ctkDICOMQueryPrivate(ctkDICOMQuery& obj)
+  : q_ptr(&obj)
 {
   this->Query = new DcmDataset();
   this->Port = 0;
-  this->Canceled = false;
+  this->Canceled.fetchAndStoreOrdered(0);
   this->PreferCGET = false;
+  this->MaximumAssociationCount = 1;
+  this->Database = 0;
+  this->ParallelSeriesQueries = false;
+  this->StudyQueryCompleted = false;
+  this->ActiveSeriesWorkerCount = 0;
+  this->CompletedSeriesRequestCount = 0;
+  this->FailedSeriesRequestCount = 0;
 }
 
 //------------------------------------------------------------------------------
@@ -121,10 +282,208 @@ ctkDICOMQueryPrivate::~ctkDICOMQueryPrivate()
 }
 
 //------------------------------------------------------------------------------
-void ctkDICOMQueryPrivate::addStudyInstanceUIDAndDataset( const QString& s, DcmDataset* dataset )
+void ctkDICOMQueryPrivate::addStudyInstanceUID(const QString& studyInstanceUID,
+  const OFString& patientName, const OFString& patientID)
+{
+  this->StudyInstanceUIDList.append(studyInstanceUID);
+  ctkDICOMQuerySeriesRequest request;
+  request.StudyInstanceUID = studyInstanceUID;
+  request.PatientName = patientName;
+  request.PatientID = patientID;
+  if (this->ParallelSeriesQueries)
+    {
+    // start querying series of the study while other studies are still being received
+    QMutexLocker locker(&this->SeriesMutex);
+    this->PendingSeriesRequests.append(request);
+    this->SeriesRequestAdded.wakeOne();
+    }
+  else
+    {
+    this->SeriesRequests.append(request);
+    }
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMQueryPrivate::handleFINDResponse(DcmDataset* dataset)
+{
+  Q_Q(ctkDICOMQuery);
+  if (this->QueryLevel == "STUDY")
+    {
+    OFString studyInstanceUID, patientName, patientID;
+    dataset->findAndGetOFString(DCM_StudyInstanceUID, studyInstanceUID);
+    dataset->findAndGetOFStringArray(DCM_PatientName, patientName);
+    dataset->findAndGetOFStringArray(DCM_PatientID, patientID);
+    // the study is stored before any of its series
+    this->ResultQueue.add(dataset);
+    this->addStudyInstanceUID(studyInstanceUID.c_str(), patientName, patientID);
+    emit q->progress(QString("Processing: ") + QString(studyInstanceUID.c_str()));
+    }
+  else
+    {
+    this->addPatientElements(dataset, this->CurrentSeriesRequest);
+    this->ResultQueue.add(dataset);
+    }
+  this->storeQueryResults(false);
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMQueryPrivate::initializeSeriesQuery(DcmDataset& seriesQuery)const
+{
+  /* Only ask for series attributes now. This requires kicking out the rest of former query. */
+  seriesQuery.clear();
+  seriesQuery.insertEmptyElement ( DCM_SeriesNumber );
+  seriesQuery.insertEmptyElement ( DCM_SeriesDescription );
+  seriesQuery.insertEmptyElement ( DCM_SeriesInstanceUID );
+  seriesQuery.insertEmptyElement ( DCM_SeriesDate );
+  seriesQuery.insertEmptyElement ( DCM_SeriesTime );
+  seriesQuery.insertEmptyElement ( DCM_Modality );
+  seriesQuery.insertEmptyElement ( DCM_NumberOfSeriesRelatedInstances ); // Number of images in the series
+
+  /* Add user-defined filters */
+  seriesQuery.putAndInsertOFStringArray(DCM_SeriesDescription, this->SeriesDescription.toLatin1().data());
+
+  // Now search each within each Study that was identified
+  seriesQuery.putAndInsertString ( DCM_QueryRetrieveLevel, "SERIES" );
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMQueryPrivate::addPatientElements(DcmDataset* dataset, const ctkDICOMQuerySeriesRequest& request)const
+{
+  // add the patient elements not provided for the series level query
+  dataset->putAndInsertOFStringArray(DCM_PatientName, request.PatientName);
+  dataset->putAndInsertOFStringArray(DCM_PatientID, request.PatientID);
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMQueryPrivate::storeQueryResults(bool force)
+{
+  Q_Q(ctkDICOMQuery);
+  if (!this->Database)
+    {
+    return;
+    }
+  if (!force && this->ResultQueue.size() < QUERY_RESULT_BATCH_SIZE
+    && this->LastStoreTime.elapsed() < QUERY_RESULT_STORE_INTERVAL_MSEC)
+    {
+    return;
+    }
+  this->LastStoreTime.restart();
+  QList<QSharedPointer<ctkDICOMItem> > datasets = this->ResultQueue.takeAll();
+  if (datasets.isEmpty())
+    {
+    return;
+    }
+  QList<ctkDICOMDatabase::IndexingResult> indexingResults;
+  foreach(QSharedPointer<ctkDICOMItem> dataset, datasets)
+    {
+    ctkDICOMDatabase::IndexingResult indexingResult;
+    indexingResult.dataset = dataset;
+    indexingResult.copyFile = false; // do not store to disk
+    indexingResult.overwriteExistingDataset = false;
+    indexingResults.append(indexingResult);
+    }
+  // all results of the batch are inserted in a single transaction
+  this->Database->insert(indexingResults);
+  emit q->resultsStored(indexingResults.size());
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMQueryPrivate::isCanceled()
+{
+  return this->Canceled.fetchAndAddOrdered(0) != 0;
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMQueryPrivate::takeSeriesRequest(ctkDICOMQuerySeriesRequest& request)
+{
+  QMutexLocker locker(&this->SeriesMutex);
+  while (this->PendingSeriesRequests.isEmpty() && !this->StudyQueryCompleted && !this->isCanceled())
+    {
+    this->SeriesRequestAdded.wait(&this->SeriesMutex);
+    }
+  if (this->PendingSeriesRequests.isEmpty() || this->isCanceled())
+    {
+    return false;
+    }
+  request = this->PendingSeriesRequests.takeFirst();
+  return true;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMQueryPrivate::seriesRequestCompleted(bool success)
 {
-  this->StudyInstanceUIDList.append ( s );
-  this->StudyDatasetList.append ( dataset );
+  QMutexLocker locker(&this->SeriesMutex);
+  this->CompletedSeriesRequestCount++;
+  if (!success)
+    {
+    this->FailedSeriesRequestCount++;
+    }
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMQueryPrivate::runSeriesQueries()
+{
+  DcmSCU scu;
+  scu.setAETitle(OFString(this->CallingAETitle.toStdString().c_str()));
+  scu.setPeerAETitle(OFString(this->CalledAETitle.toStdString().c_str()));
+  scu.setPeerHostName(OFString(this->Host.toStdString().c_str()));
+  scu.setPeerPort(this->Port);
+  scu.setACSETimeout(this->SCU.getACSETimeout());
+  scu.setDIMSETimeout(this->SCU.getDIMSETimeout());
+  scu.setDIMSEBlockingMode(this->SCU.getDIMSEBlockingMode());
+  scu.setMaxReceivePDULength(this->SCU.getMaxReceivePDULength());
+  OFList<OFString> transferSyntaxes;
+  transferSyntaxes.push_back ( UID_LittleEndianExplicitTransferSyntax );
+  transferSyntaxes.push_back ( UID_BigEndianExplicitTransferSyntax );
+  transferSyntaxes.push_back ( UID_LittleEndianImplicitTransferSyntax );
+  scu.addPresentationContext(UID_FINDStudyRootQueryRetrieveInformationModel, transferSyntaxes);
+  T_ASC_PresentationContextID presentationContext = 0;
+  if (scu.initNetwork().good() && scu.negotiateAssociation().good())
+    {
+    presentationContext = scu.findPresentationContextID(UID_FINDStudyRootQueryRetrieveInformationModel, "");
+    }
+  if (presentationContext == 0)
+    {
+    // studies are left to the other workers, or to the association of the
+    // study level query if no worker could negotiate one
+    logger.error("Failed to negotiate association for series level queries");
+    }
+  else
+    {
+    DcmDataset seriesQuery;
+    this->initializeSeriesQuery(seriesQuery);
+    ctkDICOMQuerySeriesRequest request;
+    while (this->takeSeriesRequest(request))
+      {
+      seriesQuery.putAndInsertString(DCM_StudyInstanceUID, request.StudyInstanceUID.toStdString().c_str());
+      OFList<QRResponse *> responses;
+      OFCondition status = scu.sendFINDRequest(presentationContext, &seriesQuery, &responses);
+      for (OFListIterator(QRResponse*) it = responses.begin(); it != responses.end(); it++)
+        {
+        DcmDataset *dataset = (*it)->m_dataset;
+        if (dataset != NULL && status.good())
+          {
+          this->addPatientElements(dataset, request);
+          // the result queue takes ownership of the dataset
+          (*it)->m_dataset = NULL;
+          this->ResultQueue.add(dataset);
+          }
+        delete *it;
+        }
+      if (!status.good())
+        {
+        logger.error("Find on Series level failed for Study: " + request.StudyInstanceUID);
+        }
+      this->seriesRequestCompleted(status.good());
+      }
+    scu.closeAssociation(DCMSCU_RELEASE_ASSOCIATION);
+    }
+
+  QMutexLocker locker(&this->SeriesMutex);
+  this->ActiveSeriesWorkerCount--;
+  locker.unlock();
+  // let the query thread know that the worker has finished
+  this->ResultQueue.wakeAll();
 }
 
 //------------------------------------------------------------------------------
@@ -133,7 +492,7 @@ void ctkDICOMQueryPrivate::addStudyInstanceUIDAndDataset( const QString& s, DcmD
 //------------------------------------------------------------------------------
 ctkDICOMQuery::ctkDICOMQuery(QObject* parentObject)
   : QObject(parentObject)
-  , d_ptr(new ctkDICOMQueryPrivate)
+  , d_ptr(new ctkDICOMQueryPrivate(*this))
 {
   Q_D(ctkDICOMQuery);
   d->SCU.query = this; // give the dcmtk level access to this for emitting signals
@@ -258,9 +617,10 @@ bool ctkDICOMQuery::query(ctkDICOMDatabase& database )
     emit progress("DB not open in Query");
     }
   emit progress(0);
-  if (d->Canceled) {return false;}
+  if (d->isCanceled()) {return false;}
 
   d->StudyInstanceUIDList.clear();
+  d->SeriesRequests.clear();
   d->SCU.setAETitle ( OFString(this->callingAETitle().toStdString().c_str()) );
   d->SCU.setPeerAETitle ( OFString(this->calledAETitle().toStdString().c_str()) );
   d->SCU.setPeerHostName ( OFString(this->host().toStdString().c_str()) );
@@ -269,7 +629,7 @@ bool ctkDICOMQuery::query(ctkDICOMDatabase& database )
   logger.error ( "Setting Transfer Syntaxes" );
   emit progress("Setting Transfer Syntaxes");
   emit progress(10);
-  if (d->Canceled) {return false;}
+  if (d->isCanceled()) {return false;}
 
   OFList<OFString> transferSyntaxes;
   transferSyntaxes.push_back ( UID_LittleEndianExplicitTransferSyntax );
@@ -288,7 +648,7 @@ bool ctkDICOMQuery::query(ctkDICOMDatabase& database )
   logger.debug ( "Negotiating Association" );
   emit progress("Negotiating Association");
   emit progress(20);
-  if (d->Canceled) {return false;}
+  if (d->isCanceled()) {return false;}
 
   OFCondition result = d->SCU.negotiateAssociation();
   if (result.bad())
@@ -325,7 +685,7 @@ bool ctkDICOMQuery::query(ctkDICOMDatabase& database )
    * overwrite empty keys with value. For now, only Patient's Name, Patient ID,
    * Study Description, Modalities in Study, and Study Date are used.
    */
-  QString seriesDescription;
+  d->SeriesDescription.clear();
   foreach( QString key, d->Filters.keys() )
     {
     if ( key == QString("Name") && !d->Filters[key].toString().isEmpty())
@@ -362,7 +722,7 @@ bool ctkDICOMQuery::query(ctkDICOMDatabase& database )
     else if ( key == QString("Series") && !d->Filters[key].toString().isEmpty())
       {
       // make the filter a wildcard in dicom style
-      seriesDescription = "*" + d->Filters[key].toString() + "*";
+      d->SeriesDescription = "*" + d->Filters[key].toString() + "*";
       }
     else
       {
@@ -379,9 +739,7 @@ bool ctkDICOMQuery::query(ctkDICOMDatabase& database )
     logger.debug("Query on study date " + dateRange);
     }
   emit progress(30);
-  if (d->Canceled) {return false;}
-
-  OFList<QRResponse *> responses;
+  if (d->isCanceled()) {return false;}
 
   Uint16 presentationContext = 0;
   // Check for any accepted presentation context for FIND in study root (dont care about transfer syntax)
@@ -397,89 +755,142 @@ bool ctkDICOMQuery::query(ctkDICOMDatabase& database )
     emit progress("Found useful presentation context");
     }
   emit progress(40);
-  if (d->Canceled) {return false;}
+  if (d->isCanceled()) {return false;}
+
+  // Responses are stored in the database in batches, as they are received.
+  // If multiple associations are allowed then series of each study are queried
+  // by worker threads as soon as the study is received.
+  d->Database = &database;
+  d->LastStoreTime.start();
+  d->ParallelSeriesQueries = (d->MaximumAssociationCount > 1);
+  d->StudyQueryCompleted = false;
+  d->PendingSeriesRequests.clear();
+  d->ActiveSeriesWorkerCount = 0;
+  d->CompletedSeriesRequestCount = 0;
+  d->FailedSeriesRequestCount = 0;
+  QThreadPool seriesQueryThreadPool;
+  if (d->ParallelSeriesQueries)
+    {
+    seriesQueryThreadPool.setMaxThreadCount(d->MaximumAssociationCount);
+    d->ActiveSeriesWorkerCount = d->MaximumAssociationCount;
+    for (int i = 0; i < d->MaximumAssociationCount; ++i)
+      {
+      seriesQueryThreadPool.start(new ctkDICOMQuerySeriesWorker(d));
+      }
+    }
 
+  d->QueryLevel = "STUDY";
+  OFList<QRResponse *> responses;
   OFCondition status = d->SCU.sendFINDRequest ( presentationContext, d->Query, &responses );
-  if ( !status.good() )
+  for ( OFListIterator(QRResponse*) it = responses.begin(); it != responses.end(); it++ )
+    {
+    // datasets have already been processed by handleFINDResponse
+    delete *it;
+    }
+  responses.clear();
+
+  // the study query is completed, workers can finish when there are no more studies
+  {
+    QMutexLocker locker(&d->SeriesMutex);
+    d->StudyQueryCompleted = true;
+    d->SeriesRequestAdded.wakeAll();
+  }
+
+  if ( !status.good() || d->isCanceled() )
     {
-    logger.error ( "Find failed" );
-    emit progress("Find failed");
+    if (!status.good())
+      {
+      logger.error ( "Find failed" );
+      emit progress("Find failed");
+      }
+    seriesQueryThreadPool.waitForDone();
+    d->storeQueryResults(true);
     d->SCU.closeAssociation ( DCMSCU_RELEASE_ASSOCIATION );
+    d->Database = 0;
     emit progress(100);
     return false;
     }
   logger.debug ( "Find succeded");
   emit progress("Find succeded");
   emit progress(50);
-  if (d->Canceled) {return false;}
 
-  for ( OFListIterator(QRResponse*) it = responses.begin(); it != responses.end(); it++ )
+  if (d->ParallelSeriesQueries)
     {
-    DcmDataset *dataset = (*it)->m_dataset;
-    if ( dataset != NULL ) // the last response is always empty
+    // Store results of the workers while they are running
+    forever
       {
-      database.insert ( dataset, false /* do not store to disk*/, false /* no thumbnail*/);
-      OFString StudyInstanceUID;
-      dataset->findAndGetOFString ( DCM_StudyInstanceUID, StudyInstanceUID );
-      d->addStudyInstanceUIDAndDataset ( StudyInstanceUID.c_str(), dataset );
-      emit progress(QString("Processing: ") + QString(StudyInstanceUID.c_str()));
-      emit progress(50);
-      if (d->Canceled) {return false;}
+      QMutexLocker locker(&d->SeriesMutex);
+      int activeWorkerCount = d->ActiveSeriesWorkerCount;
+      int completedCount = d->CompletedSeriesRequestCount;
+      locker.unlock();
+      if (activeWorkerCount == 0)
+        {
+        break;
+        }
+      d->ResultQueue.waitForDatasets(100);
+      d->storeQueryResults(false);
+      emit progress(QString("Series queries completed for %1 of %2 studies")
+        .arg(completedCount).arg(d->StudyInstanceUIDList.count()));
+      emit progress(50 + 50 * completedCount / qMax(1, d->StudyInstanceUIDList.count()));
+      if (d->isCanceled())
+        {
+        // workers stop after their current request
+        QMutexLocker cancelLocker(&d->SeriesMutex);
+        d->SeriesRequestAdded.wakeAll();
+        }
+      }
+    seriesQueryThreadPool.waitForDone();
+    if (d->FailedSeriesRequestCount > 0)
+      {
+      logger.error(QString("Find on Series level failed for %1 studies").arg(d->FailedSeriesRequestCount));
+      }
+    // Studies are left over if none of the workers could negotiate an
+    // association (e.g. the server limits the number of associations).
+    // Their series are queried using the association of the study query.
+    d->SeriesRequests = d->PendingSeriesRequests;
+    d->PendingSeriesRequests.clear();
+    if (d->SeriesRequests.isEmpty() || d->isCanceled())
+      {
+      d->storeQueryResults(true);
+      d->Database = 0;
+      d->SCU.closeAssociation ( DCMSCU_RELEASE_ASSOCIATION );
+      emit progress(100);
+      return !d->isCanceled();
       }
+    logger.warn(QString("Querying series of %1 studies using the study query association")
+      .arg(d->SeriesRequests.count()));
     }
 
-  /* Only ask for series attributes now. This requires kicking out the rest of former query. */
-  d->Query->clear();
-  d->Query->insertEmptyElement ( DCM_SeriesNumber );
-  d->Query->insertEmptyElement ( DCM_SeriesDescription );
-  d->Query->insertEmptyElement ( DCM_SeriesInstanceUID );
-  d->Query->insertEmptyElement ( DCM_SeriesDate );
-  d->Query->insertEmptyElement ( DCM_SeriesTime );
-  d->Query->insertEmptyElement ( DCM_Modality );
-  d->Query->insertEmptyElement ( DCM_NumberOfSeriesRelatedInstances ); // Number of images in the series
-
-  /* Add user-defined filters */
-  d->Query->putAndInsertOFStringArray(DCM_SeriesDescription, seriesDescription.toLatin1().data());
+  // Query series of each study using the same association
+  d->QueryLevel = "SERIES";
+  d->initializeSeriesQuery(*d->Query);
+  float progressRatio = 25. / d->SeriesRequests.count();
+  int i = 0;
 
-  // Now search each within each Study that was identified
-  d->Query->putAndInsertString ( DCM_QueryRetrieveLevel, "SERIES" );
-  float progressRatio = 25. / d->StudyInstanceUIDList.count();
-  int i = 0; 
-
-  QListIterator<DcmDataset*> datasetIterator(d->StudyDatasetList);
-  foreach ( QString StudyInstanceUID, d->StudyInstanceUIDList )
+  foreach ( const ctkDICOMQuerySeriesRequest& seriesRequest, d->SeriesRequests )
     {
-    DcmDataset *studyDataset = datasetIterator.next();
-    DcmElement *patientName, *patientID;
-    studyDataset->findAndGetElement(DCM_PatientName, patientName);
-    studyDataset->findAndGetElement(DCM_PatientID, patientID);
+    QString StudyInstanceUID = seriesRequest.StudyInstanceUID;
+    d->CurrentSeriesRequest = seriesRequest;
 
     logger.debug ( "Starting Series C-FIND for Study: " + StudyInstanceUID );
     emit progress(QString("Starting Series C-FIND for Study: ") + StudyInstanceUID);
     emit progress(50 + (progressRatio * i++));
-    if (d->Canceled) {return false;}
+    if (d->isCanceled()) {break;}
 
     d->Query->putAndInsertString ( DCM_StudyInstanceUID, StudyInstanceUID.toStdString().c_str() );
     OFList<QRResponse *> responses;
     status = d->SCU.sendFINDRequest ( presentationContext, d->Query, &responses );
+    for ( OFListIterator(QRResponse*) it = responses.begin(); it != responses.end(); it++ )
+      {
+      // datasets have already been processed by handleFINDResponse
+      delete *it;
+      }
     if ( status.good() )
       {
-      for ( OFListIterator(QRResponse*) it = responses.begin(); it != responses.end(); it++ )
-        {
-        DcmDataset *dataset = (*it)->m_dataset;
-        if ( dataset != NULL )
-          {
-          // add the patient elements not provided for the series level query
-          dataset->insert( patientName, true );
-          dataset->insert( patientID, true );
-          // insert series dataset 
-          database.insert ( dataset, false /* do not store */, false /* no thumbnail */ );
-          }
-        }
       logger.debug ( "Find succeded on Series level for Study: " + StudyInstanceUID );
       emit progress(QString("Find succeded on Series level for Study: ") + StudyInstanceUID);
       emit progress(50 + (progressRatio * i++));
-      if (d->Canceled) {return false;}
+      if (d->isCanceled()) {break;}
       }
     else
       {
@@ -487,16 +898,35 @@ bool ctkDICOMQuery::query(ctkDICOMDatabase& database )
       emit progress(QString("Find on Series level failed for Study: ") + StudyInstanceUID);
       }
     emit progress(50 + (progressRatio * i++));
-    if (d->Canceled) {return false;}
+    if (d->isCanceled()) {break;}
     }
+  d->storeQueryResults(true);
+  d->Database = 0;
   d->SCU.closeAssociation ( DCMSCU_RELEASE_ASSOCIATION );
   emit progress(100);
-  return true;
+  return !d->isCanceled();
+}
+
+//----------------------------------------------------------------------------
+void ctkDICOMQuery::setMaximumAssociationCount(int count)
+{
+  Q_D(ctkDICOMQuery);
+  d->MaximumAssociationCount = qMax(1, count);
+}
+
+//----------------------------------------------------------------------------
+int ctkDICOMQuery::maximumAssociationCount()const
+{
+  Q_D(const ctkDICOMQuery);
+  return d->MaximumAssociationCount;
 }
 
 //----------------------------------------------------------------------------
 void ctkDICOMQuery::cancel()
 {
   Q_D(ctkDICOMQuery);
-  d->Canceled = true;
+  d->Canceled.fetchAndStoreOrdered(1);
+  // wake up series workers waiting for studies
+  QMutexLocker locker(&d->SeriesMutex);
+  d->SeriesRequestAdded.wakeAll();
 }
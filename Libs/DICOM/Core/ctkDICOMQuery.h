@@ -44,6 +44,7 @@ class CTK_DICOM_CORE_EXPORT ctkDICOMQuery : public QObject
   Q_PROPERTY(QString host READ host WRITE setHost);
   Q_PROPERTY(int port READ port WRITE setPort);
   Q_PROPERTY(bool preferCGET READ preferCGET WRITE setPreferCGET);
+  Q_PROPERTY(int maximumAssociationCount READ maximumAssociationCount WRITE setMaximumAssociationCount);
 
 public:
   explicit ctkDICOMQuery(QObject* parent = 0);
@@ -68,9 +69,24 @@ public:
   /// false by default
   void setPreferCGET ( bool preferCGET );
   bool preferCGET()const;
+  /// Maximum number of associations used for series level queries.
+  /// If larger than 1 then series of each study are queried by parallel
+  /// associations, as soon as the study is received.
+  /// If 1 then series are queried after all studies are received, using
+  /// the association of the study level query.
+  /// Studies that cannot be queried because the server refuses additional
+  /// associations are queried using the association of the study level query.
+  /// Network timeouts of the additional associations are the ones of the
+  /// study level query.
+  /// 1 by default.
+  void setMaximumAssociationCount(int count);
+  int maximumAssociationCount()const;
 
   /// Query a remote DICOM Image Store SCP
   /// You must at least set the host and port before calling query()
+  /// Results are stored in the database in batches while the query is in progress
+  /// (resultsStored is emitted after each batch), therefore the database must be used
+  /// in the thread that calls query().
   bool query(ctkDICOMDatabase& database);
 
   /// Access the list of study instance UIDs from the last query
@@ -111,6 +127,10 @@ Q_SIGNALS:
   /// Signal is emitted inside the query() function when finished with value 
   /// true for success or false for error
   void done(const bool& error);
+  /// Signal is emitted inside the query() function each time a batch of query
+  /// results has been stored in the database. It allows displaying partial results
+  /// before the query is completed.
+  void resultsStored(int count);
 
 public Q_SLOTS:
   void cancel();
@@ -21,8 +21,16 @@
 #include <stdexcept>
 
 // Qt includes
+#include <QAtomicInt>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QRunnable>
+#include <QThread>
+#include <QThreadPool>
+#include <QWaitCondition>
 
 // ctkDICOMCore includes
+#include "ctkDICOMItem.h"
 #include "ctkDICOMRetrieve.h"
 #include "ctkLogger.h"
 
@@ -49,6 +57,196 @@
 
 static ctkLogger logger("org.commontk.dicom.DICOMRetrieve");
 
+/// Maximum number of received datasets that are written into the database in one transaction
+static const int INGEST_MAXIMUM_BATCH_SIZE = 200;
+
+//------------------------------------------------------------------------------
+// Writes datasets received by C-GET into the database in a separate thread, so that
+// network transfer continues while files are written and database transactions are committed.
+// Datasets that arrive while a batch is written are collected and written in the next batch.
+// The queue is bounded: if it is full then enqueue() blocks until the writer catches up.
+class ctkDICOMRetrieveIngestWriter : public QThread
+{
+public:
+  ctkDICOMRetrieveIngestWriter(ctkDICOMRetrieve* retrieve, ctkDICOMDatabase& database, int maximumQueueSize);
+  ~ctkDICOMRetrieveIngestWriter();
+
+  /// Add a received dataset to the queue. Blocks while the queue is full.
+  /// Returns false if the dataset was not accepted (retrieve was canceled or the database could not be opened).
+  bool enqueue(QSharedPointer<ctkDICOMItem> dataset);
+
+  /// Wait until all queued datasets are written and stop the thread.
+  /// If discardPending is true then datasets that are not written yet are discarded.
+  void finish(bool discardPending);
+
+  int storedDatasetCount() const;
+
+protected:
+  virtual void run();
+
+  ctkDICOMRetrieve* Retrieve;
+
+  // Database connection parameters. A separate connection is opened in the writer thread,
+  // because database connections can only be used in the thread where they were created.
+  // Insert signals of that connection are forwarded to the database of the retrieve.
+  ctkDICOMDatabase* Database;
+  ctkDICOMAbstractThumbnailGenerator* ThumbnailGenerator;
+  QString DatabaseFilename;
+  QStringList TagsToPrecache;
+  QStringList TagsToExcludeFromStorage;
+  bool WALModeEnabled;
+  int WALAutoCheckpoint;
+
+  mutable QMutex Mutex;
+  QWaitCondition QueueNotEmpty;
+  QWaitCondition QueueNotFull;
+  QList<QSharedPointer<ctkDICOMItem> > Queue;
+  int MaximumQueueSize;
+  bool Finishing;
+  bool Stopped;
+  int StoredDatasetCount;
+};
+
+//------------------------------------------------------------------------------
+ctkDICOMRetrieveIngestWriter::ctkDICOMRetrieveIngestWriter(ctkDICOMRetrieve* retrieve,
+  ctkDICOMDatabase& database, int maximumQueueSize)
+  : Retrieve(retrieve)
+  , Database(&database)
+  , ThumbnailGenerator(database.thumbnailGenerator())
+  , DatabaseFilename(database.databaseFilename())
+  , TagsToPrecache(database.tagsToPrecache())
+  , TagsToExcludeFromStorage(database.tagsToExcludeFromStorage())
+  , WALModeEnabled(database.isWALModeEnabled())
+  , WALAutoCheckpoint(database.walAutoCheckpoint())
+  , MaximumQueueSize(qMax(1, maximumQueueSize))
+  , Finishing(false)
+  , Stopped(false)
+  , StoredDatasetCount(0)
+{
+}
+
+//------------------------------------------------------------------------------
+ctkDICOMRetrieveIngestWriter::~ctkDICOMRetrieveIngestWriter()
+{
+  this->finish(true);
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMRetrieveIngestWriter::enqueue(QSharedPointer<ctkDICOMItem> dataset)
+{
+  QMutexLocker locker(&this->Mutex);
+  while (this->Queue.size() >= this->MaximumQueueSize && !this->Stopped)
+  {
+    // Wait for the writer but check regularly if the retrieve has been canceled
+    this->QueueNotFull.wait(&this->Mutex, 100);
+    if (this->Retrieve->wasCanceled())
+    {
+      return false;
+    }
+  }
+  if (this->Stopped || this->Finishing)
+  {
+    return false;
+  }
+  this->Queue.append(dataset);
+  this->QueueNotEmpty.wakeOne();
+  return true;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMRetrieveIngestWriter::finish(bool discardPending)
+{
+  {
+    QMutexLocker locker(&this->Mutex);
+    this->Finishing = true;
+    if (discardPending)
+    {
+      this->Queue.clear();
+      this->Stopped = true;
+    }
+    this->QueueNotEmpty.wakeAll();
+    this->QueueNotFull.wakeAll();
+  }
+  this->wait();
+}
+
+//------------------------------------------------------------------------------
+int ctkDICOMRetrieveIngestWriter::storedDatasetCount() const
+{
+  QMutexLocker locker(&this->Mutex);
+  return this->StoredDatasetCount;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMRetrieveIngestWriter::run()
+{
+  ctkDICOMDatabase database;
+  database.setWALModeEnabled(this->WALModeEnabled);
+  database.setWALAutoCheckpoint(this->WALAutoCheckpoint);
+  database.openDatabase(this->DatabaseFilename);
+  if (!database.isOpen())
+  {
+    logger.error("Failed to open database for storing retrieved datasets: " + this->DatabaseFilename);
+    QMutexLocker locker(&this->Mutex);
+    this->Stopped = true;
+    this->QueueNotFull.wakeAll();
+    return;
+  }
+  database.setTagsToPrecache(this->TagsToPrecache);
+  database.setTagsToExcludeFromStorage(this->TagsToExcludeFromStorage);
+  database.setThumbnailGenerator(this->ThumbnailGenerator);
+
+  // Views of the database of the retrieve are updated when these signals are emitted.
+  // The connections are queued, the signals are emitted in the thread of that database.
+  QObject::connect(&database, SIGNAL(patientAdded(int,QString,QString,QString)),
+    this->Database, SIGNAL(patientAdded(int,QString,QString,QString)), Qt::QueuedConnection);
+  QObject::connect(&database, SIGNAL(studyAdded(QString)),
+    this->Database, SIGNAL(studyAdded(QString)), Qt::QueuedConnection);
+  QObject::connect(&database, SIGNAL(seriesAdded(QString)),
+    this->Database, SIGNAL(seriesAdded(QString)), Qt::QueuedConnection);
+  QObject::connect(&database, SIGNAL(instanceAdded(QString)),
+    this->Database, SIGNAL(instanceAdded(QString)), Qt::QueuedConnection);
+
+  forever
+  {
+    QList<ctkDICOMDatabase::IndexingResult> indexingResults;
+    {
+      QMutexLocker locker(&this->Mutex);
+      while (this->Queue.isEmpty() && !this->Finishing)
+      {
+        this->QueueNotEmpty.wait(&this->Mutex);
+      }
+      if (this->Queue.isEmpty())
+      {
+        // finishing and all datasets are written
+        break;
+      }
+      int batchSize = qMin(this->Queue.size(), INGEST_MAXIMUM_BATCH_SIZE);
+      for (int i = 0; i < batchSize; ++i)
+      {
+        ctkDICOMDatabase::IndexingResult indexingResult;
+        indexingResult.dataset = this->Queue.takeFirst();
+        indexingResult.copyFile = true; // dataset has no file yet, it is saved into the database folder
+        indexingResult.overwriteExistingDataset = false;
+        indexingResult.generateThumbnail = true;
+        indexingResults.append(indexingResult);
+      }
+      this->QueueNotFull.wakeAll();
+    }
+
+    database.insert(indexingResults);
+
+    QMutexLocker locker(&this->Mutex);
+    this->StoredDatasetCount += indexingResults.size();
+  }
+
+  if (database.isWALModeEnabled())
+  {
+    database.checkpoint();
+  }
+  database.closeDatabase();
+}
+
 //------------------------------------------------------------------------------
 // A customized local implemenation of the DcmSCU so that Qt signals can be emitted
 // when retrieve results are obtained
@@ -56,9 +254,12 @@ class ctkDICOMRetrieveSCUPrivate : public DcmSCU
 {
 public:
   ctkDICOMRetrieve *retrieve;
+  /// If set then received datasets are stored in the database by this writer
+  ctkDICOMRetrieveIngestWriter *ingestWriter;
   ctkDICOMRetrieveSCUPrivate()
     {
     this->retrieve = 0;
+    this->ingestWriter = 0;
     };
   ~ctkDICOMRetrieveSCUPrivate() {};
 
@@ -94,8 +295,38 @@ public:
         emit this->retrieve->progress("Got STORE request for " + qInstanceUID);
         emit this->retrieve->progress(0);
         continueCGETSession = !this->retrieve->wasCanceled();
+        if (this->ingestWriter)
+          {
+          // The incoming object is deleted when this method returns, therefore a copy is queued
+          QSharedPointer<ctkDICOMItem> dataset(new ctkDICOMItem);
+          dataset->InitializeFromItem(new DcmDataset(*incomingObject), true /* take ownership */);
+          if (this->ingestWriter->enqueue(dataset))
+            {
+            return EC_Normal;
+            }
+          if (this->retrieve->wasCanceled())
+            {
+            continueCGETSession = false;
+            return EC_Normal;
+            }
+          if (!this->retrieve->database())
+            {
+            // sub-operation of a parallel retrieve, datasets can only be stored by the writer
+            logger.error("Failed to store received dataset " + qInstanceUID);
+            cStoreReturnStatus = STATUS_STORE_Refused_OutOfResources;
+            return EC_Normal;
+            }
+          // the writer cannot store the dataset, store it directly
+          }
         if (this->retrieve && this->retrieve->database())
           {
+          if (this->retrieve->database()->thread() != QThread::currentThread())
+            {
+            // database connection can only be used in the thread that created it
+            logger.error("Failed to store received dataset " + qInstanceUID);
+            cStoreReturnStatus = STATUS_STORE_Refused_OutOfResources;
+            return EC_Normal;
+            }
           this->retrieve->database()->insert(incomingObject);
           return EC_Normal;
           }
@@ -139,15 +370,20 @@ protected:
 public:
   ctkDICOMRetrievePrivate(ctkDICOMRetrieve& obj);
   ~ctkDICOMRetrievePrivate();
+  /// Set by cancel(), which may be called while worker threads of a parallel retrieve read it
+  QAtomicInt    WasCanceled;
   /// Keep the currently negotiated connection to the 
   /// peer host open unless the connection parameters change
-  bool          WasCanceled;
   bool          KeepAssociationOpen;
   bool          ConnectionParamsChanged;
   bool          LastRetrieveType;
+  int           IngestQueueSize;
+  int           MaximumAssociationCount;
   QSharedPointer<ctkDICOMDatabase> Database;
   ctkDICOMRetrieveSCUPrivate        SCU;
   QString MoveDestinationAETitle;
+  /// Set for retrieves that perform a sub-operation of a parallel study retrieve
+  ctkDICOMRetrieve* ParentRetrieve;
   // do the retrieve, handling both series and study retrieves
   enum RetrieveType { RetrieveNone, RetrieveSeries, RetrieveStudy };
   bool initializeSCU(const QString& studyInstanceUID,
@@ -160,6 +396,46 @@ public:
   bool get ( const QString& studyInstanceUID,
                   const QString& seriesInstanceUID,
                   const RetrieveType retrieveType );
+
+  /// Get list of series of a study using C-FIND
+  bool findSeriesInstanceUIDs(const QString& studyInstanceUID, QStringList& seriesInstanceUIDs);
+  /// Retrieve a study by retrieving its series using multiple associations in parallel.
+  /// Returns false if any of the series could not be retrieved.
+  bool retrieveSeriesInParallel(const QString& studyInstanceUID, const QStringList& seriesInstanceUIDs, bool useGet);
+  /// Called from worker threads of the parallel retrieve. Retrieves series from the
+  /// pending list, using a single association, until there are no more series left.
+  void retrievePendingSeries(bool useGet, ctkDICOMRetrieveIngestWriter* ingestWriter);
+
+  // State of the parallel retrieve, protected by ParallelRetrieveMutex
+  QMutex ParallelRetrieveMutex;
+  QString ParallelRetrieveStudyInstanceUID;
+  QStringList PendingSeriesInstanceUIDs;
+  int CompletedSeriesCount;
+  int FailedSeriesCount;
+  int SeriesCount;
+};
+
+//------------------------------------------------------------------------------
+// Runs sub-operations of a parallel study retrieve
+class ctkDICOMRetrieveSeriesWorker : public QRunnable
+{
+public:
+  ctkDICOMRetrieveSeriesWorker(ctkDICOMRetrievePrivate* retrieve, bool useGet, ctkDICOMRetrieveIngestWriter* ingestWriter)
+    : Retrieve(retrieve)
+    , UseGet(useGet)
+    , IngestWriter(ingestWriter)
+  {
+  }
+
+  virtual void run()
+  {
+    this->Retrieve->retrievePendingSeries(this->UseGet, this->IngestWriter);
+  }
+
+protected:
+  ctkDICOMRetrievePrivate* Retrieve;
+  bool UseGet;
+  ctkDICOMRetrieveIngestWriter* IngestWriter;
 };
 
 //------------------------------------------------------------------------------
@@ -170,10 +446,16 @@ ctkDICOMRetrievePrivate::ctkDICOMRetrievePrivate(ctkDICOMRetrieve& obj)
   : q_ptr(&obj)
 {
   this->Database = QSharedPointer<ctkDICOMDatabase> (0);
-  this->WasCanceled = false;
+  this->WasCanceled.fetchAndStoreOrdered(0);
   this->KeepAssociationOpen = true;
   this->ConnectionParamsChanged = false;
   this->LastRetrieveType = RetrieveNone;
+  this->IngestQueueSize = 100;
+  this->MaximumAssociationCount = 1;
+  this->ParentRetrieve = 0;
+  this->CompletedSeriesCount = 0;
+  this->FailedSeriesCount = 0;
+  this->SeriesCount = 0;
 
   // Register the JPEG libraries in case we need them
   // (registration only happens once, so it's okay to call repeatedly)
@@ -411,10 +693,30 @@ bool ctkDICOMRetrievePrivate::get ( const QString& studyInstanceUID,
   emit q->progress("Found Presentation Context");
   emit q->progress(1);
 
+  // Received datasets are stored by a separate thread (in-memory databases
+  // cannot be shared between threads, so they are updated directly)
+  // (the ingest writer is already set if this is a sub-operation of a parallel retrieve)
+  QScopedPointer<ctkDICOMRetrieveIngestWriter> ingestWriter;
+  if (!this->SCU.ingestWriter && this->Database && this->Database->isOpen()
+    && !this->Database->isInMemory() && this->IngestQueueSize > 0)
+    {
+    ingestWriter.reset(new ctkDICOMRetrieveIngestWriter(q, *this->Database, this->IngestQueueSize));
+    ingestWriter->start();
+    this->SCU.ingestWriter = ingestWriter.data();
+    }
+
   // do the actual move request
   OFCondition status = this->SCU.sendCGETRequest ( 
                           presID, retrieveParameters, &responses );
 
+  if (ingestWriter)
+    {
+    emit q->progress("Storing Retrieved Datasets");
+    this->SCU.ingestWriter = 0;
+    ingestWriter->finish(q->wasCanceled());
+    logger.debug(QString("Stored %1 retrieved datasets").arg(ingestWriter->storedDatasetCount()));
+    }
+
   emit q->progress("Sent Get Request");
   emit q->progress(2);
 
@@ -499,6 +801,166 @@ bool ctkDICOMRetrievePrivate::get ( const QString& studyInstanceUID,
   return true;
 }
 
+//------------------------------------------------------------------------------
+bool ctkDICOMRetrievePrivate::findSeriesInstanceUIDs(const QString& studyInstanceUID, QStringList& seriesInstanceUIDs)
+{
+  seriesInstanceUIDs.clear();
+
+  // Use a separate association, as C-FIND is not negotiated for retrieve associations
+  DcmSCU findSCU;
+  findSCU.setAETitle(this->SCU.getAETitle());
+  findSCU.setPeerAETitle(this->SCU.getPeerAETitle());
+  findSCU.setPeerHostName(this->SCU.getPeerHostName());
+  findSCU.setPeerPort(this->SCU.getPeerPort());
+  OFList<OFString> transferSyntaxes;
+  transferSyntaxes.push_back ( UID_LittleEndianExplicitTransferSyntax );
+  transferSyntaxes.push_back ( UID_BigEndianExplicitTransferSyntax );
+  transferSyntaxes.push_back ( UID_LittleEndianImplicitTransferSyntax );
+  findSCU.addPresentationContext(UID_FINDStudyRootQueryRetrieveInformationModel, transferSyntaxes);
+  if (!findSCU.initNetwork().good() || !findSCU.negotiateAssociation().good())
+    {
+    logger.error("Error negotiating association for finding series of study " + studyInstanceUID);
+    return false;
+    }
+  T_ASC_PresentationContextID presID = findSCU.findPresentationContextID(
+    UID_FINDStudyRootQueryRetrieveInformationModel, "" /* don't care about transfer syntax */);
+  if (presID == 0)
+    {
+    logger.error("FIND Request failed: No valid Study Root FIND Presentation Context available");
+    findSCU.closeAssociation(DCMSCU_RELEASE_ASSOCIATION);
+    return false;
+    }
+
+  DcmDataset findParameters;
+  findParameters.putAndInsertString(DCM_QueryRetrieveLevel, "SERIES");
+  findParameters.putAndInsertString(DCM_StudyInstanceUID, studyInstanceUID.toStdString().c_str());
+  findParameters.insertEmptyElement(DCM_SeriesInstanceUID);
+  OFList<QRResponse*> responses;
+  OFCondition status = findSCU.sendFINDRequest(presID, &findParameters, &responses);
+  for (OFListIterator(QRResponse*) it = responses.begin(); it != responses.end(); it++)
+    {
+    DcmDataset *dataset = (*it)->m_dataset;
+    OFString seriesInstanceUID;
+    if (dataset != NULL // the last response is always empty
+      && dataset->findAndGetOFString(DCM_SeriesInstanceUID, seriesInstanceUID).good()
+      && !seriesInstanceUID.empty())
+      {
+      seriesInstanceUIDs << QString(seriesInstanceUID.c_str());
+      }
+    delete *it;
+    }
+  findSCU.closeAssociation(DCMSCU_RELEASE_ASSOCIATION);
+  seriesInstanceUIDs.removeDuplicates();
+  return status.good();
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMRetrievePrivate::retrieveSeriesInParallel(const QString& studyInstanceUID,
+  const QStringList& seriesInstanceUIDs, bool useGet)
+{
+  Q_Q(ctkDICOMRetrieve);
+
+  {
+    QMutexLocker locker(&this->ParallelRetrieveMutex);
+    this->ParallelRetrieveStudyInstanceUID = studyInstanceUID;
+    this->PendingSeriesInstanceUIDs = seriesInstanceUIDs;
+    this->SeriesCount = seriesInstanceUIDs.size();
+    this->CompletedSeriesCount = 0;
+    this->FailedSeriesCount = 0;
+  }
+  emit q->progress(QString("Retrieving %1 series using %2 associations")
+    .arg(seriesInstanceUIDs.size()).arg(qMin(this->MaximumAssociationCount, seriesInstanceUIDs.size())));
+  emit q->progress(0);
+
+  // A single writer stores all the datasets received by all the associations,
+  // so that database transactions of the associations do not block each other.
+  QScopedPointer<ctkDICOMRetrieveIngestWriter> ingestWriter;
+  if (useGet && this->Database && this->Database->isOpen() && !this->Database->isInMemory())
+    {
+    ingestWriter.reset(new ctkDICOMRetrieveIngestWriter(q, *this->Database, qMax(1, this->IngestQueueSize)));
+    ingestWriter->start();
+    }
+
+  QThreadPool threadPool;
+  int associationCount = qMin(this->MaximumAssociationCount, seriesInstanceUIDs.size());
+  threadPool.setMaxThreadCount(associationCount);
+  for (int i = 0; i < associationCount; ++i)
+    {
+    threadPool.start(new ctkDICOMRetrieveSeriesWorker(this, useGet, ingestWriter.data()));
+    }
+  threadPool.waitForDone();
+
+  if (ingestWriter)
+    {
+    emit q->progress("Storing Retrieved Datasets");
+    ingestWriter->finish(q->wasCanceled());
+    }
+
+  QMutexLocker locker(&this->ParallelRetrieveMutex);
+  logger.debug(QString("Parallel retrieve of study %1: %2 series retrieved, %3 failed")
+    .arg(studyInstanceUID).arg(this->CompletedSeriesCount - this->FailedSeriesCount).arg(this->FailedSeriesCount));
+  bool success = (this->FailedSeriesCount == 0 && this->CompletedSeriesCount == this->SeriesCount);
+  locker.unlock();
+
+  emit q->progress("Finished Parallel Retrieve");
+  emit q->progress(100);
+  return success;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMRetrievePrivate::retrievePendingSeries(bool useGet, ctkDICOMRetrieveIngestWriter* ingestWriter)
+{
+  Q_Q(ctkDICOMRetrieve);
+
+  // Each worker uses its own association, which is kept open for all the series it retrieves
+  ctkDICOMRetrieve seriesRetrieve;
+  ctkDICOMRetrievePrivate* seriesRetrievePrivate = seriesRetrieve.d_func();
+  seriesRetrieve.setCallingAETitle(q->callingAETitle());
+  seriesRetrieve.setCalledAETitle(q->calledAETitle());
+  seriesRetrieve.setHost(q->host());
+  seriesRetrieve.setPort(q->port());
+  seriesRetrieve.setMoveDestinationAETitle(this->MoveDestinationAETitle);
+  seriesRetrieve.setKeepAssociationOpen(true);
+  // The database is not passed to the worker: its connection can only be used in the thread
+  // that created it. Received datasets are stored by the ingest writer, which opens its own connection.
+  seriesRetrievePrivate->ParentRetrieve = q;
+  seriesRetrievePrivate->SCU.ingestWriter = ingestWriter;
+
+  forever
+    {
+    QString studyInstanceUID;
+    QString seriesInstanceUID;
+    {
+      QMutexLocker locker(&this->ParallelRetrieveMutex);
+      if (this->PendingSeriesInstanceUIDs.isEmpty() || q->wasCanceled())
+        {
+        break;
+        }
+      studyInstanceUID = this->ParallelRetrieveStudyInstanceUID;
+      seriesInstanceUID = this->PendingSeriesInstanceUIDs.takeFirst();
+    }
+
+    bool success = useGet ? seriesRetrieve.getSeries(studyInstanceUID, seriesInstanceUID)
+      : seriesRetrieve.moveSeries(studyInstanceUID, seriesInstanceUID);
+
+    QMutexLocker locker(&this->ParallelRetrieveMutex);
+    this->CompletedSeriesCount++;
+    if (!success)
+      {
+      this->FailedSeriesCount++;
+      logger.error("Failed to retrieve series " + seriesInstanceUID);
+      }
+    int progressPercentage = 100 * this->CompletedSeriesCount / qMax(1, this->SeriesCount);
+    int completedSeriesCount = this->CompletedSeriesCount;
+    locker.unlock();
+    emit q->progress(QString("Retrieved series %1 of %2").arg(completedSeriesCount).arg(this->SeriesCount));
+    emit q->progress(progressPercentage);
+    }
+
+  // do not leave the ingest writer in the SCU, it is owned by the parent retrieve
+  seriesRetrievePrivate->SCU.ingestWriter = 0;
+}
+
 //------------------------------------------------------------------------------
 // ctkDICOMRetrieve methods
 
@@ -651,14 +1113,43 @@ bool ctkDICOMRetrieve::keepAssociationOpen()
 void ctkDICOMRetrieve::setWasCanceled(const bool wasCanceled)
 {
   Q_D(ctkDICOMRetrieve);
-  d->WasCanceled = wasCanceled;
+  d->WasCanceled.fetchAndStoreOrdered(wasCanceled ? 1 : 0);
 }
 
 //------------------------------------------------------------------------------
-bool ctkDICOMRetrieve::wasCanceled()
+void ctkDICOMRetrieve::setIngestQueueSize(int count)
+{
+  Q_D(ctkDICOMRetrieve);
+  d->IngestQueueSize = count;
+}
+
+//------------------------------------------------------------------------------
+int ctkDICOMRetrieve::ingestQueueSize() const
+{
+  Q_D(const ctkDICOMRetrieve);
+  return d->IngestQueueSize;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMRetrieve::setMaximumAssociationCount(int count)
+{
+  Q_D(ctkDICOMRetrieve);
+  d->MaximumAssociationCount = qMax(1, count);
+}
+
+//------------------------------------------------------------------------------
+int ctkDICOMRetrieve::maximumAssociationCount() const
 {
   Q_D(const ctkDICOMRetrieve);
-  return d->WasCanceled;
+  return d->MaximumAssociationCount;
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMRetrieve::wasCanceled()
+{
+  Q_D(ctkDICOMRetrieve);
+  // sub-operations of a parallel retrieve are canceled with their parent
+  return d->WasCanceled.fetchAndAddOrdered(0) != 0 || (d->ParentRetrieve && d->ParentRetrieve->wasCanceled());
 }
 
 //------------------------------------------------------------------------------
@@ -671,6 +1162,12 @@ bool ctkDICOMRetrieve::moveStudy(const QString& studyInstanceUID)
     }
   Q_D(ctkDICOMRetrieve);
   logger.info ( "Starting moveStudy" );
+  QStringList seriesInstanceUIDs;
+  if (d->MaximumAssociationCount > 1
+    && d->findSeriesInstanceUIDs(studyInstanceUID, seriesInstanceUIDs) && seriesInstanceUIDs.size() > 1)
+    {
+    return d->retrieveSeriesInParallel(studyInstanceUID, seriesInstanceUIDs, false);
+    }
   return d->move ( studyInstanceUID, "", ctkDICOMRetrievePrivate::RetrieveStudy );
 }
 
@@ -684,6 +1181,14 @@ bool ctkDICOMRetrieve::getStudy(const QString& studyInstanceUID)
     }
   Q_D(ctkDICOMRetrieve);
   logger.info ( "Starting getStudy" );
+  // datasets received by parallel associations are stored by a writer thread,
+  // which requires a database file (in-memory database cannot be shared between threads)
+  QStringList seriesInstanceUIDs;
+  if (d->MaximumAssociationCount > 1 && d->Database && d->Database->isOpen() && !d->Database->isInMemory()
+    && d->findSeriesInstanceUIDs(studyInstanceUID, seriesInstanceUIDs) && seriesInstanceUIDs.size() > 1)
+    {
+    return d->retrieveSeriesInParallel(studyInstanceUID, seriesInstanceUIDs, true);
+    }
   return d->get ( studyInstanceUID, "", ctkDICOMRetrievePrivate::RetrieveStudy );
 }
 
@@ -719,6 +1224,6 @@ bool ctkDICOMRetrieve::getSeries(const QString& studyInstanceUID,
 void ctkDICOMRetrieve::cancel()
 {
   Q_D(ctkDICOMRetrieve);
-  d->WasCanceled = true;
+  d->WasCanceled.fetchAndStoreOrdered(1);
 }
 
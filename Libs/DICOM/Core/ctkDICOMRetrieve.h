@@ -45,6 +45,8 @@ class CTK_DICOM_CORE_EXPORT ctkDICOMRetrieve : public QObject
   Q_PROPERTY(QString moveDestinationAETitle READ moveDestinationAETitle WRITE setMoveDestinationAETitle);
   Q_PROPERTY(bool keepAssociationOpen READ keepAssociationOpen WRITE setKeepAssociationOpen);
   Q_PROPERTY(bool wasCanceled READ wasCanceled WRITE setWasCanceled);
+  Q_PROPERTY(int ingestQueueSize READ ingestQueueSize WRITE setIngestQueueSize);
+  Q_PROPERTY(int maximumAssociationCount READ maximumAssociationCount WRITE setMaximumAssociationCount);
 
 public:
   explicit ctkDICOMRetrieve(QObject* parent = 0);
@@ -83,6 +85,25 @@ public:
   Q_INVOKABLE void setDatabase(ctkDICOMDatabase& dicomDatabase);
   void setDatabase(QSharedPointer<ctkDICOMDatabase> dicomDatabase);
   Q_INVOKABLE QSharedPointer<ctkDICOMDatabase> database()const;
+  /// Maximum number of datasets received by get that are waiting to be stored in the database.
+  /// Datasets are stored in batches by a separate thread while the transfer continues.
+  /// When the limit is reached, receiving is paused until the datasets are stored.
+  /// Set to 0 to store each dataset before the next one is received.
+  /// Datasets that are not stored yet when the retrieve is canceled are discarded.
+  /// The insert signals of the database (patientAdded, instanceAdded, ...) are emitted
+  /// in the thread of the database after the datasets are stored, and thumbnails are
+  /// generated by the thumbnail generator of the database (it must be usable from any thread).
+  /// Default is 100.
+  Q_INVOKABLE void setIngestQueueSize(int count);
+  Q_INVOKABLE int ingestQueueSize() const;
+  /// Maximum number of associations that getStudy and moveStudy use in parallel.
+  /// If larger than 1 then the series of the study are found by a C-FIND request
+  /// and the series are retrieved by separate series-level requests, distributed
+  /// between the associations. Progress is reported for the whole study and cancel()
+  /// stops all the associations. Default is 1 (the study is retrieved by a single
+  /// study-level request).
+  Q_INVOKABLE void setMaximumAssociationCount(int count);
+  Q_INVOKABLE int maximumAssociationCount() const;
 
 public Q_SLOTS:
   /// Use CMOVE to ask peer host to store data to move destination
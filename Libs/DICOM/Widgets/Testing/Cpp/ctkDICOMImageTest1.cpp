@@ -58,6 +58,42 @@ int ctkDICOMImageTest1( int argc, char * argv [] )
   qtImage.setPixmap(pixmap);
   qtImage.show();
 
+  // The wrapped DicomImage is not accessed from background threads by default
+  if (ctkImage.prefetchFrameCount() != 0)
+    {
+    std::cerr << "ctkDICOMImage::prefetchFrameCount() failed: prefetching is enabled for a wrapped DicomImage" << std::endl;
+    return EXIT_FAILURE;
+    }
+  // Cached frames are not returned after the window is changed
+  if (dcmtkImage.isMonochrome())
+    {
+    QImage defaultWindowFrame = ctkImage.frame(0);
+    double windowCenter = 0.0;
+    double windowWidth = 0.0;
+    dcmtkImage.getWindow(windowCenter, windowWidth);
+    dcmtkImage.setWindow(windowCenter + windowWidth, windowWidth / 10.0 + 1.0);
+    if (ctkImage.frame(0) == defaultWindowFrame)
+      {
+      std::cerr << "ctkDICOMImage::frame() failed: window change is ignored" << std::endl;
+      return EXIT_FAILURE;
+      }
+    }
+
+  // Frames decoded on demand from the file
+  ctkDICOMImage fileImage(QString::fromLocal8Bit(argv[1]));
+  if (fileImage.frameCount() != ctkImage.frameCount()
+    || fileImage.frame(0).size() != ctkImage.frame(0).size())
+    {
+    std::cerr << "ctkDICOMImage created from file path does not match the DicomImage" << std::endl;
+    return EXIT_FAILURE;
+    }
+  QImage preview = fileImage.previewFrame(0, QSize(64, 64));
+  if (preview.isNull() || preview.width() > 64 || preview.height() > 64)
+    {
+    std::cerr << "ctkDICOMImage::previewFrame() failed" << std::endl;
+    return EXIT_FAILURE;
+    }
+
   if (argc > 2 && QString(argv[2]) == "-I")
     {
     return app.exec();
@@ -0,0 +1,96 @@
+/*=========================================================================
+
+  Library:   CTK
+
+  Copyright (c) Kitware Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0.txt
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+=========================================================================*/
+
+// Qt includes
+#include <QApplication>
+#include <QSqlQuery>
+#include <QTableView>
+#include <QVariant>
+
+// ctkDICOMCore includes
+#include "ctkDICOMDatabase.h"
+
+// ctkDICOMWidgets includes
+#include "ctkDICOMTableView.h"
+
+// STD includes
+#include <cstdlib>
+#include <iostream>
+
+int ctkDICOMTableViewTest1( int argc, char * argv [] )
+{
+  QApplication app(argc, argv);
+
+  ctkDICOMDatabase database;
+  database.openDatabase(":memory:");
+  if (!database.isOpen())
+    {
+    std::cerr << "ctkDICOMDatabase::openDatabase() failed: "
+              << qPrintable(database.lastError()) << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // More series than QSqlQueryModel fetches at once
+  const int seriesCount = 1000;
+  QSqlQuery insertQuery(database.database());
+  database.database().transaction();
+  insertQuery.exec("INSERT INTO Patients (UID, PatientsName, PatientID, InsertTimestamp) VALUES (1, 'Test^Patient', 'P1', '2020-01-01')");
+  insertQuery.exec("INSERT INTO Studies (StudyInstanceUID, PatientsUID, InsertTimestamp) VALUES ('1.2.3', 1, '2020-01-01')");
+  insertQuery.prepare("INSERT INTO Series (SeriesInstanceUID, StudyInstanceUID, InsertTimestamp) VALUES (?, '1.2.3', '2020-01-01')");
+  for (int series = 0; series < seriesCount; ++series)
+    {
+    insertQuery.bindValue(0, QString("1.2.3.%1").arg(series));
+    insertQuery.exec();
+    }
+  database.database().commit();
+
+  ctkDICOMTableView tableView(&database, "Series");
+  tableView.setQuery();
+
+  // Rows are fetched incrementally by the model, as the view is scrolled
+  QAbstractItemModel* model = tableView.tableView()->model();
+  if (model->rowCount() <= 0 || model->rowCount() >= seriesCount || !model->canFetchMore(QModelIndex()))
+    {
+    std::cerr << "ctkDICOMTableView::setQuery() failed: " << model->rowCount()
+              << " rows are loaded instead of the first block of rows" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // UIDs of all rows are read from the database, without loading the rows into the model
+  int loadedRowCount = model->rowCount();
+  if (tableView.uidsForAllRows().size() != seriesCount || model->rowCount() != loadedRowCount)
+    {
+    std::cerr << "ctkDICOMTableView::uidsForAllRows() failed" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  while (model->canFetchMore(QModelIndex()))
+    {
+    model->fetchMore(QModelIndex());
+    }
+  if (model->rowCount() != seriesCount)
+    {
+    std::cerr << "ctkDICOMTableView: " << model->rowCount() << " rows are loaded instead of "
+              << seriesCount << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,87 @@
+/*=========================================================================
+
+  Library:   CTK
+
+  Copyright (c) Kitware Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0.txt
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+=========================================================================*/
+
+// Qt includes
+#include <QApplication>
+#include <QDir>
+#include <QFileInfo>
+#include <QImage>
+#include <QSignalSpy>
+
+// ctkDICOMWidgets includes
+#include "ctkDICOMThumbnailService.h"
+
+// STD includes
+#include <iostream>
+
+int ctkDICOMThumbnailServiceTest1( int argc, char * argv [] )
+{
+  QApplication app(argc, argv);
+
+  QDir databaseDirectory = QDir::temp();
+  QString directory = databaseDirectory.absoluteFilePath("ctkDICOMThumbnailServiceTest1");
+  QString thumbnailPath = ctkDICOMThumbnailService::thumbnailPath(directory, "1.2", "1.2.3", "1.2.3.4");
+  QDir().mkpath(QFileInfo(thumbnailPath).absolutePath());
+  QImage image(64, 32, QImage::Format_RGB32);
+  image.fill(Qt::red);
+  if (!image.save(thumbnailPath, "PNG"))
+    {
+    std::cerr << "Failed to write thumbnail file " << qPrintable(thumbnailPath) << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  ctkDICOMThumbnailService service;
+  service.setDatabaseDirectory(directory);
+  QSignalSpy readySpy(&service, SIGNAL(thumbnailReady(QString,QPixmap)));
+  QSignalSpy failedSpy(&service, SIGNAL(thumbnailFailed(QString)));
+
+  // existing thumbnail is loaded, missing one cannot be generated (no file is available)
+  service.requestThumbnail("1.2", "1.2.3", "1.2.3.4");
+  service.requestThumbnail("1.2", "1.2.3", "1.2.3.5");
+  service.waitForDone();
+  QApplication::processEvents();
+
+  if (readySpy.count() != 1 || failedSpy.count() != 1
+    || readySpy.at(0).at(0).toString() != "1.2.3.4"
+    || failedSpy.at(0).at(0).toString() != "1.2.3.5")
+    {
+    std::cerr << "ctkDICOMThumbnailService::requestThumbnail() failed: "
+              << readySpy.count() << " ready, " << failedSpy.count() << " failed" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  QPixmap thumbnail = service.cachedThumbnail("1.2.3.4");
+  if (thumbnail.width() != 64 || thumbnail.height() != 32)
+    {
+    std::cerr << "ctkDICOMThumbnailService::cachedThumbnail() failed" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // cached thumbnail is returned immediately
+  service.requestThumbnail("1.2", "1.2.3", "1.2.3.4");
+  if (readySpy.count() != 2 || service.pendingRequestCount() != 0)
+    {
+    std::cerr << "ctkDICOMThumbnailService::requestThumbnail() did not use the cache" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  QDir(directory).removeRecursively();
+  return EXIT_SUCCESS;
+}
@@ -53,6 +53,7 @@
 // ctkDICOMWidgets includes
 #include "ctkDICOMAppWidget.h"
 #include "ctkDICOMThumbnailGenerator.h"
+#include "ctkDICOMThumbnailService.h"
 #include "ctkThumbnailLabel.h"
 #include "ctkDICOMQueryResultsTabWidget.h"
 #include "ctkDICOMQueryRetrieveWidget.h"
@@ -258,6 +259,9 @@ ctkDICOMAppWidget::ctkDICOMAppWidget(QWidget* _parent):Superclass(_parent),
 
   d->ThumbnailsWidget->setThumbnailSize(
     QSize(d->ThumbnailWidthSlider->value(), d->ThumbnailWidthSlider->value()));
+  // missing thumbnails are generated in the background when they are displayed
+  d->ThumbnailsWidget->thumbnailService()->setDatabase(d->DICOMDatabase.data());
+  d->ThumbnailsWidget->thumbnailService()->setThumbnailGenerator(d->ThumbnailGenerator.data());
 
   // Treeview signals
   connect(d->TreeView, SIGNAL(collapsed(QModelIndex)), this, SLOT(onTreeCollapsed(QModelIndex)));
@@ -20,8 +20,15 @@
 =========================================================================*/
 
 // Qt includes
+#include <QCache>
 #include <QDebug>
+#include <QDir>
+#include <QMutex>
+#include <QRunnable>
+#include <QSet>
 #include <QString>
+#include <QThread>
+#include <QThreadPool>
 
 // ctkDICOMCore includes
 #include "ctkDICOMImage.h"
@@ -41,7 +48,60 @@ class ctkDICOMImagePrivate
 public:
   ctkDICOMImagePrivate(ctkDICOMImage&);
 
+  /// Select first window defined in image. If none, compute min/max window as best guess.
+  /// Only relevant for monochrome.
+  void initializeWindow();
+
+  /// Render a frame to an 8-bit image. If maximumSize is valid then the frame
+  /// is scaled down to fit into it. Can be called from any thread.
+  QImage renderFrame(int frame, const QSize& maximumSize = QSize()) const;
+
+  /// Convert a frame of a DicomImage to QImage
+  static QImage imageFromDicomImage(DicomImage* dicomImage, unsigned long frame);
+
+  /// Get a frame from the cache. Returns null image if the frame is not cached.
+  QImage cachedFrame(int frame) const;
+  /// Add a frame to the cache, unless the cache has been cleared since
+  /// the frame was requested (generation is different).
+  void cacheFrame(int frame, const QImage& image, int generation) const;
+  int cacheGeneration() const;
+
+  /// Clear the cache if the window or polarity of the wrapped DicomImage
+  /// has changed since the cached frames were rendered.
+  void updateRenderingState() const;
+
+  /// Queue rendering of the frames that follow the requested frame
+  void prefetchFrames(int requestedFrame) const;
+  /// Called by prefetch workers
+  void renderPrefetchedFrame(int frame, int generation) const;
+
   ::DicomImage* DicomImage;
+  /// Set if frames are decoded from a file on demand
+  QString FilePath;
+  /// First frame of the file, owned by this object (if frames are decoded on demand)
+  QScopedPointer< ::DicomImage> FirstFrameImage;
+  unsigned long NumberOfFrames;
+  bool WindowValid;
+  double WindowCenter;
+  double WindowWidth;
+
+  /// DicomImage is not thread-safe, rendering of its frames must be serialized
+  mutable QMutex DicomImageMutex;
+
+  mutable QMutex CacheMutex;
+  mutable QCache<int, QImage> FrameCache;
+  mutable QSet<int> PendingFrames;
+  mutable int LastRequestedFrame;
+  /// Incremented each time the cache is cleared
+  mutable int CacheGeneration;
+  /// Rendering parameters of the wrapped DicomImage used for the cached frames
+  mutable double RenderedWindowCenter;
+  mutable double RenderedWindowWidth;
+  mutable EP_Polarity RenderedPolarity;
+
+  int PrefetchFrameCount;
+  int PrefetchThreadCount;
+  mutable QThreadPool PrefetchThreadPool;
 
 protected:
   ctkDICOMImage* const q_ptr;
@@ -51,8 +111,280 @@ private:
 };
 
 //------------------------------------------------------------------------------
-ctkDICOMImagePrivate::ctkDICOMImagePrivate(ctkDICOMImage& o):q_ptr(&o)
+class ctkDICOMImagePrefetchWorker : public QRunnable
+{
+public:
+  ctkDICOMImagePrefetchWorker(const ctkDICOMImagePrivate* image, int frame, int generation)
+    : Image(image)
+    , Frame(frame)
+    , Generation(generation)
+  {
+  }
+
+  virtual void run()
+  {
+    this->Image->renderPrefetchedFrame(this->Frame, this->Generation);
+  }
+
+protected:
+  const ctkDICOMImagePrivate* Image;
+  int Frame;
+  int Generation;
+};
+
+//------------------------------------------------------------------------------
+ctkDICOMImagePrivate::ctkDICOMImagePrivate(ctkDICOMImage& o)
+  : DicomImage(0)
+  , NumberOfFrames(0)
+  , WindowValid(false)
+  , WindowCenter(0.0)
+  , WindowWidth(0.0)
+  , FrameCache(32)
+  , LastRequestedFrame(-1)
+  , CacheGeneration(0)
+  , RenderedWindowCenter(0.0)
+  , RenderedWindowWidth(0.0)
+  , RenderedPolarity(EPP_Normal)
+  , PrefetchFrameCount(4)
+  , PrefetchThreadCount(2)
+  , q_ptr(&o)
+{
+  this->PrefetchThreadPool.setMaxThreadCount(this->PrefetchThreadCount);
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMImagePrivate::initializeWindow()
+{
+  if (!this->DicomImage || !this->DicomImage->isMonochrome())
+  {
+    return;
+  }
+  if (this->DicomImage->getWindowCount() > 0)
+  {
+    this->DicomImage->setWindow(0);
+  }
+  else
+  {
+    this->DicomImage->setMinMaxWindow(OFTrue /* ignore extreme values */);
+  }
+  // Frames that are decoded on demand use the same window as the first frame
+  // (a min/max window computed for each frame would make the intensity flicker).
+  this->WindowValid = this->DicomImage->getWindow(this->WindowCenter, this->WindowWidth);
+}
+
+//------------------------------------------------------------------------------
+QImage ctkDICOMImagePrivate::imageFromDicomImage(::DicomImage* dicomImage, unsigned long frame)
+{
+  // this way of converting the dicom image to a qpixmap was adopted from some code from
+  // the DCMTK forum, posted by Joerg Riesmayer, see http://forum.dcmtk.org/viewtopic.php?t=120
+  QImage image;
+  if ((dicomImage == NULL) || (dicomImage->getStatus() != EIS_Normal))
+  {
+    return image;
+  }
+  /* get image extension and prepare image header */
+  const unsigned long width = dicomImage->getWidth();
+  const unsigned long height = dicomImage->getHeight();
+  QString header;
+  unsigned long samplesPerPixel = 1;
+  if (dicomImage->isMonochrome())
+  {
+    // write PGM header (binary monochrome image format)
+    header = QString("P5 %1 %2 255\n").arg(width).arg(height);
+  }
+  else
+  {
+    // write PPM header (binary color image format)
+    header = QString("P6 %1 %2 255\n").arg(width).arg(height);
+    samplesPerPixel = 3;
+  }
+  const unsigned long offset = header.length();
+  const unsigned long length = width * height * samplesPerPixel + offset;
+  /* create output buffer for DicomImage class */
+  QByteArray buffer;
+  buffer.append(header);
+  buffer.resize(length);
+
+  /* render pixel data to buffer */
+  if (dicomImage->getOutputData(static_cast<void *>(buffer.data() + offset), length - offset, 8, frame))
+  {
+    if (!image.loadFromData( buffer ))
+    {
+      logger.error("QImage couldn't created");
+    }
+  }
+  return image;
+}
+
+//------------------------------------------------------------------------------
+QImage ctkDICOMImagePrivate::renderFrame(int frame, const QSize& maximumSize) const
+{
+  unsigned long width = 0;
+  unsigned long height = 0;
+  if (maximumSize.isValid() && this->DicomImage)
+  {
+    const double imageWidth = this->DicomImage->getWidth();
+    const double imageHeight = this->DicomImage->getHeight();
+    const double scale = qMin(maximumSize.width() / imageWidth, maximumSize.height() / imageHeight);
+    if (scale < 1.0)
+    {
+      width = qMax(1ul, static_cast<unsigned long>(imageWidth * scale));
+      height = qMax(1ul, static_cast<unsigned long>(imageHeight * scale));
+    }
+  }
+
+  if (this->FilePath.isEmpty())
+  {
+    // Frames of the wrapped image are scaled after rendering, as scaling of
+    // the DicomImage would process all of its frames.
+    QImage image;
+    {
+      QMutexLocker locker(&this->DicomImageMutex);
+      image = imageFromDicomImage(this->DicomImage, frame);
+    }
+    if (width > 0 && !image.isNull())
+    {
+      image = image.scaled(static_cast<int>(width), static_cast<int>(height), Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+    }
+    return image;
+  }
+
+  // Decode only the requested frame. Each thread uses its own DicomImage, so frames can be
+  // decoded in parallel.
+  ::DicomImage frameImage(QDir::toNativeSeparators(this->FilePath).toUtf8(), CIF_UsePartialAccessToPixelData, frame, 1);
+  if (frameImage.getStatus() != EIS_Normal)
+  {
+    logger.error(QString("Failed to decode frame %1 of %2: %3")
+      .arg(frame).arg(this->FilePath).arg(::DicomImage::getString(frameImage.getStatus())));
+    return QImage();
+  }
+  if (this->WindowValid && frameImage.isMonochrome())
+  {
+    frameImage.setWindow(this->WindowCenter, this->WindowWidth);
+  }
+  if (width > 0)
+  {
+    // Render the scaled image, to reduce rendering time and memory usage of the output
+    QScopedPointer< ::DicomImage> scaledImage(frameImage.createScaledImage(width, height, 1 /* interpolate */));
+    if (!scaledImage.isNull())
+    {
+      return imageFromDicomImage(scaledImage.data(), 0);
+    }
+  }
+  return imageFromDicomImage(&frameImage, 0);
+}
+
+//------------------------------------------------------------------------------
+QImage ctkDICOMImagePrivate::cachedFrame(int frame) const
+{
+  QMutexLocker locker(&this->CacheMutex);
+  QImage* image = this->FrameCache.object(frame);
+  return image ? *image : QImage();
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMImagePrivate::cacheFrame(int frame, const QImage& image, int generation) const
+{
+  if (image.isNull())
+  {
+    return;
+  }
+  QMutexLocker locker(&this->CacheMutex);
+  if (generation != this->CacheGeneration)
+  {
+    // the frame may have been rendered with obsolete rendering parameters
+    return;
+  }
+  this->FrameCache.insert(frame, new QImage(image));
+}
+
+//------------------------------------------------------------------------------
+int ctkDICOMImagePrivate::cacheGeneration() const
+{
+  QMutexLocker locker(&this->CacheMutex);
+  return this->CacheGeneration;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMImagePrivate::updateRenderingState() const
+{
+  if (!this->FilePath.isEmpty() || !this->DicomImage)
+  {
+    // frames decoded from the file are always rendered with the initial window
+    return;
+  }
+  double windowCenter = 0.0;
+  double windowWidth = 0.0;
+  EP_Polarity polarity = EPP_Normal;
+  {
+    QMutexLocker locker(&this->DicomImageMutex);
+    this->DicomImage->getWindow(windowCenter, windowWidth);
+    polarity = this->DicomImage->getPolarity();
+  }
+  QMutexLocker locker(&this->CacheMutex);
+  if (windowCenter == this->RenderedWindowCenter
+    && windowWidth == this->RenderedWindowWidth
+    && polarity == this->RenderedPolarity)
+  {
+    return;
+  }
+  this->FrameCache.clear();
+  this->CacheGeneration++;
+  this->RenderedWindowCenter = windowCenter;
+  this->RenderedWindowWidth = windowWidth;
+  this->RenderedPolarity = polarity;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMImagePrivate::prefetchFrames(int requestedFrame) const
 {
+  const int frameCount = static_cast<int>(this->NumberOfFrames);
+  QMutexLocker locker(&this->CacheMutex);
+  int direction = (requestedFrame < this->LastRequestedFrame) ? -1 : 1;
+  this->LastRequestedFrame = requestedFrame;
+  if (this->PrefetchFrameCount <= 0 || frameCount <= 1)
+  {
+    return;
+  }
+  int prefetchFrameCount = qMin(this->PrefetchFrameCount, frameCount - 1);
+  for (int i = 1; i <= prefetchFrameCount; ++i)
+  {
+    // wrap around, as cine playback loops through the frames
+    int frame = ((requestedFrame + direction * i) % frameCount + frameCount) % frameCount;
+    if (this->FrameCache.contains(frame) || this->PendingFrames.contains(frame))
+    {
+      continue;
+    }
+    this->PendingFrames.insert(frame);
+    this->PrefetchThreadPool.start(new ctkDICOMImagePrefetchWorker(this, frame, this->CacheGeneration));
+  }
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMImagePrivate::renderPrefetchedFrame(int frame, int generation) const
+{
+  Q_Q(const ctkDICOMImage);
+  bool alreadyCached = false;
+  {
+    QMutexLocker locker(&this->CacheMutex);
+    alreadyCached = this->FrameCache.contains(frame) || generation != this->CacheGeneration;
+  }
+  QImage image;
+  if (!alreadyCached)
+  {
+    image = this->renderFrame(frame);
+    this->cacheFrame(frame, image, generation);
+  }
+  bool cached = false;
+  {
+    QMutexLocker locker(&this->CacheMutex);
+    this->PendingFrames.remove(frame);
+    cached = (generation == this->CacheGeneration);
+  }
+  if (!image.isNull() && cached)
+  {
+    emit const_cast<ctkDICOMImage*>(q)->frameReady(frame);
+  }
 }
 
 //------------------------------------------------------------------------------
@@ -62,36 +394,52 @@ ctkDICOMImage::ctkDICOMImage(DicomImage* dicomImage, QObject* parentValue)
   Q_UNUSED(parentValue);
   Q_D(ctkDICOMImage);
   d->DicomImage = dicomImage;
+  // The DicomImage may be used by the caller, which is not safe while frames
+  // are rendered in the background
+  d->PrefetchFrameCount = 0;
   if (d->DicomImage)
-    // Select first window defined in image. If none, compute min/max window as best guess.
-    // Only relevant for monochrome.
-    if (d->DicomImage->isMonochrome())
-    {
-        if (d->DicomImage->getWindowCount() > 0)
-        {
-          d->DicomImage->setWindow(0);
-        }
-        else
-        {
-          d->DicomImage->setMinMaxWindow(OFTrue /* ignore extreme values */);
-        }
-    }
+  {
+    d->NumberOfFrames = d->DicomImage->getFrameCount();
+    d->initializeWindow();
+    d->updateRenderingState();
+  }
+}
+
+//------------------------------------------------------------------------------
+ctkDICOMImage::ctkDICOMImage(const QString& filePath, QObject* parentValue)
+  : d_ptr(new ctkDICOMImagePrivate(*this))
+{
+  Q_UNUSED(parentValue);
+  Q_D(ctkDICOMImage);
+  // Only the first frame is decoded, it is used for getting image properties
+  d->FirstFrameImage.reset(new ::DicomImage(QDir::toNativeSeparators(filePath).toUtf8(),
+    CIF_UsePartialAccessToPixelData, 0, 1));
+  if (d->FirstFrameImage->getStatus() != EIS_Normal)
+  {
+    logger.error(QString("Failed to load image %1: %2")
+      .arg(filePath).arg(::DicomImage::getString(d->FirstFrameImage->getStatus())));
+    d->FirstFrameImage.reset();
+    return;
+  }
+  d->DicomImage = d->FirstFrameImage.data();
+  d->FilePath = filePath;
+  d->NumberOfFrames = d->DicomImage->getNumberOfFrames();
+  d->initializeWindow();
 }
 
 //------------------------------------------------------------------------------
 ctkDICOMImage::~ctkDICOMImage()
 {
+  Q_D(ctkDICOMImage);
+  d->PrefetchThreadPool.clear();
+  d->PrefetchThreadPool.waitForDone();
 }
 
 //------------------------------------------------------------------------------
 unsigned long ctkDICOMImage::frameCount() const
 {
   Q_D(const ctkDICOMImage);
-  if (d->DicomImage)
-    {
-    return d->DicomImage->getFrameCount();
-    }
-  return 0;
+  return d->NumberOfFrames;
 }
 
 //------------------------------------------------------------------------------
@@ -105,33 +453,97 @@ DicomImage* ctkDICOMImage::dicomImage() const
 QImage ctkDICOMImage::frame(int frame) const
 {
   Q_D(const ctkDICOMImage);
+  if (frame < 0 || static_cast<unsigned long>(frame) >= d->NumberOfFrames)
+  {
+    return QImage();
+  }
+  d->updateRenderingState();
+  int generation = d->cacheGeneration();
+  QImage image = d->cachedFrame(frame);
+  if (image.isNull())
+  {
+    image = d->renderFrame(frame);
+    d->cacheFrame(frame, image, generation);
+  }
+  d->prefetchFrames(frame);
+  return image;
+}
 
-  // this way of converting the dicom image to a qpixmap was adopted from some code from
-  // the DCMTK forum, posted by Joerg Riesmayer, see http://forum.dcmtk.org/viewtopic.php?t=120
-  QImage image;
-  if ((d->DicomImage != NULL) && (d->DicomImage->getStatus() == EIS_Normal))
+//------------------------------------------------------------------------------
+QImage ctkDICOMImage::previewFrame(int frame, const QSize& maximumSize) const
+{
+  Q_D(const ctkDICOMImage);
+  if (frame < 0 || static_cast<unsigned long>(frame) >= d->NumberOfFrames)
+  {
+    return QImage();
+  }
+  // Use the full resolution frame if it is already rendered
+  d->updateRenderingState();
+  QImage image = d->cachedFrame(frame);
+  if (!image.isNull())
+  {
+    if (image.width() > maximumSize.width() || image.height() > maximumSize.height())
     {
-    /* get image extension */
-    const unsigned long width = d->DicomImage->getWidth();
-    const unsigned long height = d->DicomImage->getHeight();
-    QString header = QString("P5 %1 %2 255\n").arg(width).arg(height);
-    const unsigned long offset = header.length();
-    const unsigned long length = width * height + offset;
-    /* create output buffer for DicomImage class */
-    QByteArray buffer;
-    buffer.append(header);
-    buffer.resize(length);
-
-    /* copy PGM header to buffer */
-
-    if (d->DicomImage->getOutputData(static_cast<void *>(buffer.data() + offset), length - offset, 8, frame))
-      {
-
-      if (!image.loadFromData( buffer ))
-        {
-        logger.error("QImage couldn't created");
-        }
-      }
+      image = image.scaled(maximumSize, Qt::KeepAspectRatio, Qt::FastTransformation);
     }
-  return image;
+    return image;
+  }
+  return d->renderFrame(frame, maximumSize);
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMImage::setFrameCacheSize(int count)
+{
+  Q_D(ctkDICOMImage);
+  QMutexLocker locker(&d->CacheMutex);
+  d->FrameCache.setMaxCost(qMax(1, count));
+}
+
+//------------------------------------------------------------------------------
+int ctkDICOMImage::frameCacheSize() const
+{
+  Q_D(const ctkDICOMImage);
+  QMutexLocker locker(&d->CacheMutex);
+  return d->FrameCache.maxCost();
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMImage::setPrefetchFrameCount(int count)
+{
+  Q_D(ctkDICOMImage);
+  QMutexLocker locker(&d->CacheMutex);
+  d->PrefetchFrameCount = count;
+}
+
+//------------------------------------------------------------------------------
+int ctkDICOMImage::prefetchFrameCount() const
+{
+  Q_D(const ctkDICOMImage);
+  QMutexLocker locker(&d->CacheMutex);
+  return d->PrefetchFrameCount;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMImage::setPrefetchThreadCount(int count)
+{
+  Q_D(ctkDICOMImage);
+  d->PrefetchThreadCount = count;
+  d->PrefetchThreadPool.setMaxThreadCount(count > 0 ? count : QThread::idealThreadCount());
+}
+
+//------------------------------------------------------------------------------
+int ctkDICOMImage::prefetchThreadCount() const
+{
+  Q_D(const ctkDICOMImage);
+  return d->PrefetchThreadCount;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMImage::clearFrameCache()
+{
+  Q_D(ctkDICOMImage);
+  QMutexLocker locker(&d->CacheMutex);
+  d->FrameCache.clear();
+  // frames that are being rendered in the background are not added to the cache
+  d->CacheGeneration++;
 }
@@ -25,6 +25,7 @@
 // Qt includes
 #include <QObject>
 #include <QImage>
+#include <QSize>
 
 #include "ctkDICOMWidgetsExport.h"
 
@@ -37,16 +38,43 @@ class DicomImage;
 ///
 /// This class wraps a DicomImage object and exposes it as a Qt class.
 ///
+/// Rendered frames are kept in a bounded cache (least recently used frames are
+/// dropped when frameCacheSize is reached). When a frame is requested then the
+/// next frames in the direction of browsing are rendered in background threads,
+/// so that scrolling through frames or cine playback does not have to wait for decoding.
+/// frameReady signal is emitted when a frame is rendered in the background.
+///
+/// Cached frames of a wrapped DicomImage are dropped when its window or polarity
+/// changes. clearFrameCache() must be called after other changes of the rendering
+/// parameters of the DicomImage (such as VOI LUT or presentation LUT).
+///
+/// If the image is constructed from a file path then frames are decoded on demand,
+/// one by one, using partial access to pixel data, so that multi-frame images
+/// (ultrasound cine, enhanced CT, tomosynthesis) are not fully loaded into memory
+/// and multiple frames can be decoded in parallel.
+///
 class CTK_DICOM_WIDGETS_EXPORT ctkDICOMImage : public QObject
 {
   Q_OBJECT
   Q_PROPERTY(unsigned long frameCount READ frameCount);
+  Q_PROPERTY(int frameCacheSize READ frameCacheSize WRITE setFrameCacheSize);
+  Q_PROPERTY(int prefetchFrameCount READ prefetchFrameCount WRITE setPrefetchFrameCount);
+  Q_PROPERTY(int prefetchThreadCount READ prefetchThreadCount WRITE setPrefetchThreadCount);
 public:
   ///  \brief Construct a ctkDICOMImage
   /// The dicomImage pointer must remain valid during all the life of
   /// the constructed ctkDICOMImage.
+  /// As DicomImage is not thread-safe, the dicomImage must not be used
+  /// by other threads while frames are rendered in the background.
+  /// Therefore prefetching is disabled by default (prefetchFrameCount is 0).
   ///
   explicit ctkDICOMImage(DicomImage* dicomImage, QObject* parent = 0);
+
+  ///  \brief Construct a ctkDICOMImage that decodes frames of a file on demand.
+  /// Only the frames that are requested (and prefetched) are decoded.
+  ///
+  explicit ctkDICOMImage(const QString& filePath, QObject* parent = 0);
+
   virtual ~ctkDICOMImage();
 
   ///
@@ -63,6 +91,44 @@ public:
   ///
   QImage frame(int frame = 0) const;
 
+  ///
+  /// \brief Returns a specific frame of the dicom image, scaled down to fit
+  /// into maximumSize (aspect ratio is preserved).
+  ///
+  /// It is faster than frame() and uses less memory for large images, therefore
+  /// it is recommended for previews (such as thumbnails or scroll bar previews).
+  /// Returns the full resolution frame if it is smaller than maximumSize.
+  ///
+  QImage previewFrame(int frame, const QSize& maximumSize) const;
+
+  ///
+  /// \brief Maximum number of rendered frames kept in memory. Default is 32.
+  ///
+  void setFrameCacheSize(int count);
+  int frameCacheSize() const;
+
+  ///
+  /// \brief Number of frames rendered in the background after a frame is requested.
+  /// Frames are prefetched in the direction of browsing, wrapping around at the
+  /// first and last frame (as in cine playback). 0 disables prefetching.
+  /// Default is 4 if the image is constructed from a file path, 0 otherwise.
+  ///
+  void setPrefetchFrameCount(int count);
+  int prefetchFrameCount() const;
+
+  ///
+  /// \brief Maximum number of threads that render frames in the background.
+  /// Setting a value <= 0 uses the number of processor cores. Default is 2.
+  /// If the image wraps a DicomImage then frames are rendered one at a time.
+  ///
+  void setPrefetchThreadCount(int count);
+  int prefetchThreadCount() const;
+
+  ///
+  /// \brief Remove all rendered frames from memory.
+  ///
+  Q_INVOKABLE void clearFrameCache();
+
   ///
   /// \brief Returns the number of frames contained in the dicom image.
   /// \sa DicomImage::getFrameCount()
@@ -73,6 +139,13 @@ public:
   ///
   unsigned long frameCount() const;
 
+Q_SIGNALS:
+  ///
+  /// \brief Emitted when a frame was rendered in the background.
+  /// The frame can be retrieved quickly by calling frame().
+  ///
+  void frameReady(int frame);
+
 protected:
   QScopedPointer<ctkDICOMImagePrivate> d_ptr;
 
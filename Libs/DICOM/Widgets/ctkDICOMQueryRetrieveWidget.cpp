@@ -70,6 +70,7 @@ public:
   QProgressDialog*                  ProgressDialog;
   QString                           CurrentServer;
     bool                              UseProgressDialog;
+  int                               MaximumAssociationCount;
 };
 
 //----------------------------------------------------------------------------
@@ -81,6 +82,7 @@ ctkDICOMQueryRetrieveWidgetPrivate::ctkDICOMQueryRetrieveWidgetPrivate(
   : q_ptr(&obj)
 {
   this->ProgressDialog = 0;
+  this->MaximumAssociationCount = 1;
 }
 
 //----------------------------------------------------------------------------
@@ -147,6 +149,20 @@ void ctkDICOMQueryRetrieveWidget::useProgressDialog(bool enable)
     d->UseProgressDialog=enable;
 }
 
+//----------------------------------------------------------------------------
+void ctkDICOMQueryRetrieveWidget::setMaximumAssociationCount(int count)
+{
+  Q_D(ctkDICOMQueryRetrieveWidget);
+  d->MaximumAssociationCount = qMax(1, count);
+}
+
+//----------------------------------------------------------------------------
+int ctkDICOMQueryRetrieveWidget::maximumAssociationCount()const
+{
+  Q_D(const ctkDICOMQueryRetrieveWidget);
+  return d->MaximumAssociationCount;
+}
+
 //----------------------------------------------------------------------------
 void ctkDICOMQueryRetrieveWidget::query()
 {
@@ -207,6 +223,7 @@ void ctkDICOMQueryRetrieveWidget::query()
     query->setHost(parameters["Address"].toString());
     query->setPort(parameters["Port"].toInt());
     query->setPreferCGET(parameters["CGET"].toBool());
+    query->setMaximumAssociationCount(d->MaximumAssociationCount);
 
     // populate the query with the current search options
     query->setFilters( d->QueryWidget->parameters() );
@@ -218,6 +235,8 @@ void ctkDICOMQueryRetrieveWidget::query()
               progressLabel, SLOT(setText(QString)));
       connect(query, SIGNAL(progress(int)),
               this, SLOT(onQueryProgressChanged(int)));
+      connect(query, SIGNAL(resultsStored(int)),
+              this, SLOT(onQueryResultsStored()));
 
       // run the query against the selected server and put results in database
       bool wasBatchUpdate = d->dicomTableManager->setBatchUpdate(true);
@@ -228,6 +247,8 @@ void ctkDICOMQueryRetrieveWidget::query()
                  progressLabel, SLOT(setText(QString)));
       disconnect(query, SIGNAL(progress(int)),
                  this, SLOT(onQueryProgressChanged(int)));
+      disconnect(query, SIGNAL(resultsStored(int)),
+                 this, SLOT(onQueryResultsStored()));
       disconnect(&progress, SIGNAL(canceled()), query, SLOT(cancel()));
       }
     catch (std::exception e)
@@ -401,6 +422,15 @@ void ctkDICOMQueryRetrieveWidget::cancel()
   emit canceled();
 }
 
+//----------------------------------------------------------------------------
+void ctkDICOMQueryRetrieveWidget::onQueryResultsStored()
+{
+  Q_D(ctkDICOMQueryRetrieveWidget);
+  // Table views are in batch update mode during the query, refresh them explicitly
+  d->dicomTableManager->setDICOMDatabase(&(d->QueryResultDatabase));
+  d->dicomTableManager->updateTableViews();
+}
+
 //----------------------------------------------------------------------------
 void ctkDICOMQueryRetrieveWidget::onQueryProgressChanged(int value)
 {
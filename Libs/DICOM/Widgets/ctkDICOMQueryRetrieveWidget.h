@@ -41,6 +41,10 @@ class CTK_DICOM_WIDGETS_EXPORT ctkDICOMQueryRetrieveWidget : public QWidget
 {
 Q_OBJECT;
 Q_PROPERTY(ctkDICOMTableManager* dicomTableManager READ dicomTableManager)
+/// Maximum number of associations opened per server for series level queries.
+/// \sa ctkDICOMQuery::maximumAssociationCount
+/// 1 by default.
+Q_PROPERTY(int maximumAssociationCount READ maximumAssociationCount WRITE setMaximumAssociationCount)
 public:
   typedef QWidget Superclass;
   explicit ctkDICOMQueryRetrieveWidget(QWidget* parent=0);
@@ -54,6 +58,9 @@ public:
   /// enable or disable ctk progress bars
   void                   useProgressDialog(bool enable);
 
+  void setMaximumAssociationCount(int count);
+  int maximumAssociationCount()const;
+
 public Q_SLOTS:
   void setRetrieveDatabase(QSharedPointer<ctkDICOMDatabase> retrieveDatabase);
   void query();
@@ -70,6 +77,8 @@ Q_SIGNALS:
 
 protected Q_SLOTS:
   void onQueryProgressChanged(int value);
+  /// Display results that are already received while the query is in progress
+  void onQueryResultsStored();
   void updateRetrieveProgress(int value);
 
 protected:
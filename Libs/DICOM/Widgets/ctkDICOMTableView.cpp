@@ -26,7 +26,15 @@
 #include <QJsonObject>
 #include <QMouseEvent>
 #include <QSortFilterProxyModel>
+#include <QSqlError>
+#include <QSqlQuery>
 #include <QSqlQueryModel>
+#include <QSqlRecord>
+
+// CTK includes
+#include <ctkLogger.h>
+
+static ctkLogger logger("org.commontk.DICOM.Widgets.ctkDICOMTableView");
 
 //------------------------------------------------------------------------------
 class ctkDICOMTableViewPrivate : public Ui_ctkDICOMTableView
@@ -48,12 +56,22 @@ public:
 
   void applyColumnProperties();
 
+  /// Returns true if filtering is performed in the database (using the search index)
+  /// instead of filtering all the rows in the proxy model.
+  bool isSearchIndexUsed() const;
+
   ctkDICOMDatabase* dicomDatabase;
   QSqlQueryModel dicomSQLModel;
   QSortFilterProxyModel* dicomSQLFilterModel;
   QString queryTableName;
   QString queryForeignKey;
 
+  /// Last query that was set in the SQL model, used for getting UIDs of all matching rows
+  QString currentQuery;
+  QVariantList currentQueryBindValues;
+  /// UIDs that were used in the last setQuery call
+  QStringList currentQueryUids;
+
   QStringList currentSelection;
 
   bool batchUpdate;
@@ -150,6 +168,13 @@ void ctkDICOMTableViewPrivate::showFilterActiveWarning(bool showWarning)
   this->leSearchBox->setPalette(palette);
 }
 
+//----------------------------------------------------------------------------
+bool ctkDICOMTableViewPrivate::isSearchIndexUsed() const
+{
+  return this->dicomDatabase && this->dicomDatabase->isOpen()
+    && this->dicomDatabase->isSearchIndexAvailable(this->queryTableName);
+}
+
 //----------------------------------------------------------------------------
 void ctkDICOMTableViewPrivate::applyColumnProperties()
 {
@@ -491,12 +516,21 @@ void ctkDICOMTableView::onFilterChanged(const QString& filterText)
 {
   Q_D(ctkDICOMTableView);
 
-  d->dicomSQLFilterModel->setFilterWildcard(filterText);
+  if (d->isSearchIndexUsed())
+  {
+    // Filter in the database, only the matching rows are loaded into the model
+    d->dicomSQLFilterModel->setFilterWildcard(QString());
+    this->setQuery(d->currentQueryUids);
+  }
+  else
+  {
+    d->dicomSQLFilterModel->setFilterWildcard(filterText);
+  }
 
   const QStringList uids = this->uidsForAllRows();
 
   bool showWarning = d->dicomSQLFilterModel->rowCount() == 0 &&
-    d->dicomSQLModel.rowCount() != 0;
+    (d->dicomSQLModel.rowCount() != 0 || (d->isSearchIndexUsed() && !filterText.isEmpty()));
   d->showFilterActiveWarning(showWarning);
   emit showFilterActiveWarning(showWarning);
 
@@ -567,6 +601,9 @@ bool ctkDICOMTableView::eventFilter(QObject *obj, QEvent *event)
 void ctkDICOMTableView::setQuery(const QStringList &uids)
 {
   Q_D(ctkDICOMTableView);
+  d->currentQueryUids = uids;
+  d->currentQuery.clear();
+  d->currentQueryBindValues.clear();
   QString query = ("select distinct %1.* from Patients, Series, Studies where "
                    "Patients.UID = Studies.PatientsUID and Studies.StudyInstanceUID = Series.StudyInstanceUID");
   int columnCountBefore = d->dicomSQLModel.columnCount();
@@ -591,7 +628,27 @@ void ctkDICOMTableView::setQuery(const QStringList &uids)
   if (d->dicomDatabase != 0 && d->dicomDatabase->isOpen()
     && (d->queryForeignKey.isEmpty() || !uids.empty()) )
   {
-    d->dicomSQLModel.setQuery(query.arg(d->queryTableName), d->dicomDatabase->database());
+    query = query.arg(d->queryTableName);
+    QString filterText = d->leSearchBox->text().trimmed();
+    if (!filterText.isEmpty() && d->isSearchIndexUsed())
+    {
+      query += " and " + d->dicomDatabase->searchIndexCondition(d->queryTableName);
+      d->currentQueryBindValues << ctkDICOMDatabase::searchPattern(filterText);
+    }
+    QSqlQuery sqlQuery(d->dicomDatabase->database());
+    sqlQuery.prepare(query);
+    foreach(const QVariant& value, d->currentQueryBindValues)
+    {
+      sqlQuery.addBindValue(value);
+    }
+    if (!sqlQuery.exec())
+    {
+      logger.error("Query failed: " + query + " (" + sqlQuery.lastError().text() + ")");
+    }
+    // The model does not load all the rows: SQLite does not report the size of the result,
+    // therefore QSqlQueryModel fetches rows in blocks when the view is scrolled to them.
+    d->dicomSQLModel.setQuery(sqlQuery);
+    d->currentQuery = query;
     if (columnCountBefore==0)
     {
       // columns have not been initialized yet
@@ -622,9 +679,35 @@ void ctkDICOMTableView::addSqlWhereCondition(const QString column, const QString
 QStringList ctkDICOMTableView::uidsForAllRows() const
 {
   Q_D(const ctkDICOMTableView);
+  QStringList uids;
+  if (!d->currentQuery.isEmpty() && d->dicomSQLFilterModel->filterRegExp().isEmpty())
+  {
+    // All rows of the model are selected by the query, therefore the UIDs can be retrieved
+    // from the database without fetching all the rows into the model.
+    QString uidField = d->dicomSQLModel.record().fieldName(0);
+    QSqlQuery uidsQuery(d->dicomDatabase->database());
+    uidsQuery.setForwardOnly(true);
+    uidsQuery.prepare(QString("SELECT \"%1\" FROM (%2)").arg(uidField).arg(d->currentQuery));
+    foreach(const QVariant& value, d->currentQueryBindValues)
+    {
+      uidsQuery.addBindValue(value);
+    }
+    if (!uidField.isEmpty() && uidsQuery.exec())
+    {
+      while (uidsQuery.next())
+      {
+        uids << uidsQuery.value(0).toString();
+      }
+      if (uids.isEmpty())
+      {
+        //Return invalid UID if there are no rows
+        uids << QString("#");
+      }
+      return uids;
+    }
+  }
   QAbstractItemModel* tableModel = d->tblDicomDatabaseView->model();
   int numberOfRows = tableModel->rowCount();
-  QStringList uids;
   if (numberOfRows == 0)
   {
     //Return invalid UID if there are no rows
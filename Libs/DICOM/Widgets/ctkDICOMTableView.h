@@ -131,6 +131,8 @@ public:
 
   /**
    * @brief Getting the UIDs for all rows
+   * If the rows are not filtered by the view then the UIDs are read from the database,
+   * without fetching the rows into the model.
    * @return a QStringList with the uids for all rows
    */
   QStringList uidsForAllRows() const;
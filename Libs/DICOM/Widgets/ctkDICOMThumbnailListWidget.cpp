@@ -25,10 +25,13 @@
 #include <QFileInfo>
 #include <QGridLayout>
 #include <QMetaType>
+#include <QPainter>
 #include <QPersistentModelIndex>
 #include <QPixmap>
+#include <QPointer>
 #include <QPushButton>
 #include <QResizeEvent>
+#include <QScrollBar>
 
 // ctk includes
 #include "ctkLogger.h"
@@ -45,6 +48,7 @@
 
 // ctkDICOMWidgets includes
 #include "ctkDICOMThumbnailListWidget.h"
+#include "ctkDICOMThumbnailService.h"
 #include "ctkThumbnailLabel.h"
 
 // STD includes
@@ -69,6 +73,13 @@ public:
   QString DatabaseDirectory;
   QModelIndex CurrentSelectedModel;
 
+  ctkDICOMThumbnailService* ThumbnailService;
+  /// Thumbnail widgets that are waiting for their thumbnail, indexed by SOP instance UID
+  QHash<QString, QPointer<ctkThumbnailLabel> > PendingThumbnailLabels;
+  QPixmap PlaceholderPixmap;
+  /// Shown when the thumbnail cannot be loaded or generated
+  QPixmap NoPreviewPixmap;
+
   void addThumbnailWidget(const QModelIndex &imageIndex, const QModelIndex& sourceIndex, const QString& text);
 
   void addPatientThumbnails(const QModelIndex& patientIndex);
@@ -86,8 +97,17 @@ private:
 ctkDICOMThumbnailListWidgetPrivate
 ::ctkDICOMThumbnailListWidgetPrivate(ctkDICOMThumbnailListWidget* parent)
   : Superclass(parent)
+  , ThumbnailService(0)
 {
-
+  this->PlaceholderPixmap = QPixmap(128, 128);
+  this->PlaceholderPixmap.fill(Qt::darkGray);
+
+  this->NoPreviewPixmap = QPixmap(128, 128);
+  this->NoPreviewPixmap.fill(Qt::darkGray);
+  QPainter painter(&this->NoPreviewPixmap);
+  painter.setPen(Qt::lightGray);
+  painter.drawText(this->NoPreviewPixmap.rect(), Qt::AlignCenter | Qt::TextWordWrap,
+                   ctkDICOMThumbnailListWidget::tr("No preview"));
 }
 
 //----------------------------------------------------------------------------
@@ -181,11 +201,10 @@ void ctkDICOMThumbnailListWidgetPrivate
   QModelIndex seriesIndex = imageIndex.parent();
   QModelIndex studyIndex = seriesIndex.parent();
 
-  QString thumbnailPath = this->DatabaseDirectory +
-                          "/thumbs/" + model->data(studyIndex ,ctkDICOMModel::UIDRole).toString() + "/" +
-                          model->data(seriesIndex ,ctkDICOMModel::UIDRole).toString() + "/" +
-                          model->data(imageIndex, ctkDICOMModel::UIDRole).toString() + ".png";
-  if(!QFileInfo(thumbnailPath).exists())
+  QString studyInstanceUID = model->data(studyIndex ,ctkDICOMModel::UIDRole).toString();
+  QString seriesInstanceUID = model->data(seriesIndex ,ctkDICOMModel::UIDRole).toString();
+  QString sopInstanceUID = model->data(imageIndex, ctkDICOMModel::UIDRole).toString();
+  if (sopInstanceUID.isEmpty())
     {
     return;
     }
@@ -193,17 +212,28 @@ void ctkDICOMThumbnailListWidgetPrivate
 
   QString widgetLabel = text;
   widget->setText( widgetLabel );
-  QPixmap pix(thumbnailPath);
-  logger.debug("Setting pixmap to " + thumbnailPath);
   if(this->ThumbnailSize.isValid())
     {
     widget->setFixedSize(this->ThumbnailSize);
     }
-  widget->setPixmap(pix);
 
   QVariant var;
   var.setValue(QPersistentModelIndex(sourceIndex));
   widget->setProperty("sourceIndex", var);
+  widget->setProperty("sopInstanceUID", sopInstanceUID);
+
+  // Thumbnail is shown when it is loaded in the background
+  QPixmap pix = this->ThumbnailService->cachedThumbnail(sopInstanceUID);
+  if (pix.isNull())
+    {
+    widget->setPixmap(this->PlaceholderPixmap);
+    this->PendingThumbnailLabels[sopInstanceUID] = widget;
+    this->ThumbnailService->requestThumbnail(studyInstanceUID, seriesInstanceUID, sopInstanceUID);
+    }
+  else
+    {
+    widget->setPixmap(pix);
+    }
 
   this->addThumbnail(widget);
 }
@@ -215,7 +245,16 @@ void ctkDICOMThumbnailListWidgetPrivate
 ctkDICOMThumbnailListWidget::ctkDICOMThumbnailListWidget(QWidget* _parent)
   : Superclass(new ctkDICOMThumbnailListWidgetPrivate(this), _parent)
 {
-
+  Q_D(ctkDICOMThumbnailListWidget);
+  d->ThumbnailService = new ctkDICOMThumbnailService(this);
+  connect(d->ThumbnailService, SIGNAL(thumbnailReady(QString,QPixmap)),
+          this, SLOT(onThumbnailReady(QString,QPixmap)));
+  connect(d->ThumbnailService, SIGNAL(thumbnailFailed(QString)),
+          this, SLOT(onThumbnailFailed(QString)));
+  connect(d->ScrollArea->verticalScrollBar(), SIGNAL(valueChanged(int)),
+          this, SLOT(prioritizeVisibleThumbnails()));
+  connect(d->ScrollArea->horizontalScrollBar(), SIGNAL(valueChanged(int)),
+          this, SLOT(prioritizeVisibleThumbnails()));
 }
 
 //----------------------------------------------------------------------------
@@ -229,6 +268,14 @@ void ctkDICOMThumbnailListWidget::setDatabaseDirectory(const QString &directory)
   Q_D(ctkDICOMThumbnailListWidget);
 
   d->DatabaseDirectory = directory;
+  d->ThumbnailService->setDatabaseDirectory(directory);
+}
+
+//----------------------------------------------------------------------------
+ctkDICOMThumbnailService* ctkDICOMThumbnailListWidget::thumbnailService() const
+{
+  Q_D(const ctkDICOMThumbnailListWidget);
+  return d->ThumbnailService;
 }
 
 //----------------------------------------------------------------------------
@@ -272,6 +319,9 @@ void ctkDICOMThumbnailListWidget::addThumbnails(const QModelIndex &index)
   Q_D(ctkDICOMThumbnailListWidget);
 
   this->clearThumbnails();
+  // thumbnails of the previous selection are not needed anymore
+  d->ThumbnailService->cancelPendingRequests();
+  d->PendingThumbnailLabels.clear();
 
   ctkDICOMModel* model = const_cast<ctkDICOMModel*>(qobject_cast<const ctkDICOMModel*>(index.model()));
 
@@ -297,3 +347,55 @@ void ctkDICOMThumbnailListWidget::addThumbnails(const QModelIndex &index)
 
   this->setCurrentThumbnail(0);
 }
+
+//----------------------------------------------------------------------------
+void ctkDICOMThumbnailListWidget::onThumbnailReady(const QString& sopInstanceUID, const QPixmap& thumbnail)
+{
+  Q_D(ctkDICOMThumbnailListWidget);
+  QPointer<ctkThumbnailLabel> widget = d->PendingThumbnailLabels.take(sopInstanceUID);
+  if (!widget)
+    {
+    // thumbnail widget has been removed since the thumbnail was requested
+    return;
+    }
+  widget->setPixmap(thumbnail);
+}
+
+//----------------------------------------------------------------------------
+void ctkDICOMThumbnailListWidget::onThumbnailFailed(const QString& sopInstanceUID)
+{
+  Q_D(ctkDICOMThumbnailListWidget);
+  QPointer<ctkThumbnailLabel> widget = d->PendingThumbnailLabels.take(sopInstanceUID);
+  if (!widget)
+    {
+    // thumbnail widget has been removed since the thumbnail was requested
+    return;
+    }
+  widget->setPixmap(d->NoPreviewPixmap);
+}
+
+//----------------------------------------------------------------------------
+void ctkDICOMThumbnailListWidget::prioritizeVisibleThumbnails()
+{
+  Q_D(ctkDICOMThumbnailListWidget);
+  if (d->PendingThumbnailLabels.isEmpty())
+    {
+    return;
+    }
+  QStringList visibleSOPInstanceUIDs;
+  int count = d->ScrollAreaContentWidget->layout()->count();
+  for (int i = 0; i < count; i++)
+    {
+    QWidget* thumbnailWidget = d->ScrollAreaContentWidget->layout()->itemAt(i)->widget();
+    if (!thumbnailWidget || thumbnailWidget->visibleRegion().isEmpty())
+      {
+      continue;
+      }
+    QString sopInstanceUID = thumbnailWidget->property("sopInstanceUID").toString();
+    if (d->PendingThumbnailLabels.contains(sopInstanceUID))
+      {
+      visibleSOPInstanceUIDs << sopInstanceUID;
+      }
+    }
+  d->ThumbnailService->prioritizeRequests(visibleSOPInstanceUIDs);
+}
@@ -26,9 +26,15 @@
 
 class QModelIndex;
 class ctkDICOMThumbnailListWidgetPrivate;
+class ctkDICOMThumbnailService;
 class ctkThumbnailWidget;
 
 /// \ingroup DICOM_Widgets
+///
+/// Thumbnails are loaded (and generated, if needed) in background threads by a
+/// ctkDICOMThumbnailService. Thumbnail widgets are added immediately with a placeholder
+/// image, which is replaced when the thumbnail becomes available. Thumbnails of
+/// widgets that are visible in the scroll area are loaded first.
 class CTK_DICOM_WIDGETS_EXPORT ctkDICOMThumbnailListWidget : public ctkThumbnailListWidget
 {
   Q_OBJECT
@@ -41,12 +47,23 @@ public:
 
   void selectThumbnailFromIndex(const QModelIndex& index);
 
+  /// Service that loads the thumbnails. It can be used to set the database
+  /// (so that missing thumbnails can be generated) and the thumbnail generator.
+  ctkDICOMThumbnailService* thumbnailService() const;
+
 private:
   Q_DECLARE_PRIVATE(ctkDICOMThumbnailListWidget);
   Q_DISABLE_COPY(ctkDICOMThumbnailListWidget);
 
 public Q_SLOTS:
   void addThumbnails(const QModelIndex& index);
+
+protected Q_SLOTS:
+  void onThumbnailReady(const QString& sopInstanceUID, const QPixmap& thumbnail);
+  /// Show a "no preview" image if the thumbnail cannot be loaded or generated
+  void onThumbnailFailed(const QString& sopInstanceUID);
+  /// Move requests of thumbnails that are visible in the scroll area to the front of the queue
+  void prioritizeVisibleThumbnails();
 };
 
 #endif
@@ -0,0 +1,491 @@
+/*=========================================================================
+
+  Library:   CTK
+
+  Copyright (c) Kitware Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0.txt
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+=========================================================================*/
+
+// Qt includes
+#include <QCache>
+#include <QDir>
+#include <QFileInfo>
+#include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QPointer>
+#include <QRunnable>
+#include <QSet>
+#include <QThread>
+#include <QThreadPool>
+#include <QVector>
+
+// ctk includes
+#include "ctkLogger.h"
+
+// ctkDICOMCore includes
+#include "ctkDICOMDatabase.h"
+
+// ctkDICOMWidgets includes
+#include "ctkDICOMThumbnailGenerator.h"
+#include "ctkDICOMThumbnailService.h"
+
+// DCMTK includes
+#include <dcmtk/dcmimgle/dcmimage.h>
+
+static ctkLogger logger("org.commontk.DICOM.Widgets.ctkDICOMThumbnailService");
+
+/// Images are scaled down to this size before rendering (ctkDICOMThumbnailGenerator
+/// stores thumbnails of this size)
+static const unsigned long THUMBNAIL_DECODE_SIZE = 128;
+
+//----------------------------------------------------------------------------
+struct ctkDICOMThumbnailRequest
+{
+  QString SOPInstanceUID;
+  QString FilePath;
+  QString ThumbnailPath;
+  ctkDICOMAbstractThumbnailGenerator* ThumbnailGenerator;
+};
+
+//----------------------------------------------------------------------------
+class ctkDICOMThumbnailServicePrivate
+{
+  Q_DECLARE_PUBLIC(ctkDICOMThumbnailService);
+protected:
+  ctkDICOMThumbnailService* const q_ptr;
+
+public:
+  ctkDICOMThumbnailServicePrivate(ctkDICOMThumbnailService& o);
+  ~ctkDICOMThumbnailServicePrivate();
+
+  /// Get the next request from the queue. Returns false if there are no more requests,
+  /// in this case the calling worker must stop.
+  bool takeNextRequest(ctkDICOMThumbnailRequest& request);
+  /// Called from worker threads
+  QImage loadThumbnail(const ctkDICOMThumbnailRequest& request);
+  bool generateThumbnailFile(const ctkDICOMThumbnailRequest& request);
+  void notifyThumbnailLoaded(const QString& sopInstanceUID, const QImage& thumbnail);
+
+  QString thumbnailsDirectory() const;
+
+  QString DatabaseDirectory;
+  QPointer<ctkDICOMDatabase> Database;
+  QScopedPointer<ctkDICOMThumbnailGenerator> DefaultThumbnailGenerator;
+  ctkDICOMAbstractThumbnailGenerator* ThumbnailGenerator;
+
+  QCache<QString, QPixmap> ThumbnailCache;
+
+  QThreadPool ThreadPool;
+  int MaximumThreadCount;
+
+  // Pending requests and number of running workers, protected by RequestsMutex
+  mutable QMutex RequestsMutex;
+  QList<ctkDICOMThumbnailRequest> PendingRequests;
+  QSet<QString> PendingSOPInstanceUIDs;
+  int ActiveWorkerCount;
+};
+
+//----------------------------------------------------------------------------
+class ctkDICOMThumbnailServiceWorker : public QRunnable
+{
+public:
+  ctkDICOMThumbnailServiceWorker(ctkDICOMThumbnailServicePrivate* service)
+    : Service(service)
+  {
+  }
+
+  virtual void run()
+  {
+    ctkDICOMThumbnailRequest request;
+    while (this->Service->takeNextRequest(request))
+    {
+      QImage thumbnail = this->Service->loadThumbnail(request);
+      this->Service->notifyThumbnailLoaded(request.SOPInstanceUID, thumbnail);
+    }
+  }
+
+protected:
+  ctkDICOMThumbnailServicePrivate* Service;
+};
+
+//----------------------------------------------------------------------------
+// ctkDICOMThumbnailServicePrivate methods
+
+//----------------------------------------------------------------------------
+ctkDICOMThumbnailServicePrivate::ctkDICOMThumbnailServicePrivate(ctkDICOMThumbnailService& o)
+  : q_ptr(&o)
+  , DefaultThumbnailGenerator(new ctkDICOMThumbnailGenerator)
+  , ThumbnailGenerator(0)
+  , MaximumThreadCount(2)
+  , ActiveWorkerCount(0)
+{
+  this->ThumbnailCache.setMaxCost(500);
+  this->ThreadPool.setMaxThreadCount(this->MaximumThreadCount);
+}
+
+//----------------------------------------------------------------------------
+ctkDICOMThumbnailServicePrivate::~ctkDICOMThumbnailServicePrivate()
+{
+  {
+    QMutexLocker locker(&this->RequestsMutex);
+    this->PendingRequests.clear();
+    this->PendingSOPInstanceUIDs.clear();
+  }
+  // Workers access this object, so they must be finished before it is deleted
+  this->ThreadPool.waitForDone();
+}
+
+//----------------------------------------------------------------------------
+QString ctkDICOMThumbnailServicePrivate::thumbnailsDirectory() const
+{
+  if (this->Database)
+  {
+    return this->Database->databaseDirectory();
+  }
+  return this->DatabaseDirectory;
+}
+
+//----------------------------------------------------------------------------
+bool ctkDICOMThumbnailServicePrivate::takeNextRequest(ctkDICOMThumbnailRequest& request)
+{
+  QMutexLocker locker(&this->RequestsMutex);
+  if (this->PendingRequests.isEmpty())
+  {
+    // the worker stops, a new one will be started when a request is added
+    this->ActiveWorkerCount--;
+    return false;
+  }
+  request = this->PendingRequests.takeFirst();
+  this->PendingSOPInstanceUIDs.remove(request.SOPInstanceUID);
+  return true;
+}
+
+//----------------------------------------------------------------------------
+QImage ctkDICOMThumbnailServicePrivate::loadThumbnail(const ctkDICOMThumbnailRequest& request)
+{
+  QImage thumbnail;
+  QFileInfo thumbnailInfo(request.ThumbnailPath);
+  bool thumbnailUpToDate = thumbnailInfo.exists()
+    && (request.FilePath.isEmpty() || thumbnailInfo.lastModified() >= QFileInfo(request.FilePath).lastModified());
+  if (thumbnailUpToDate && thumbnail.load(request.ThumbnailPath))
+  {
+    return thumbnail;
+  }
+  if (!this->generateThumbnailFile(request))
+  {
+    return QImage();
+  }
+  if (!thumbnail.load(request.ThumbnailPath))
+  {
+    logger.warn("Failed to load thumbnail " + request.ThumbnailPath);
+  }
+  return thumbnail;
+}
+
+//----------------------------------------------------------------------------
+bool ctkDICOMThumbnailServicePrivate::generateThumbnailFile(const ctkDICOMThumbnailRequest& request)
+{
+  if (request.FilePath.isEmpty() || !request.ThumbnailGenerator)
+  {
+    return false;
+  }
+  QDir().mkpath(QFileInfo(request.ThumbnailPath).absolutePath());
+
+  // Only a single frame is needed: use partial access to avoid reading
+  // and decompressing all the frames of multi-frame images.
+  DicomImage dcmImage(QDir::toNativeSeparators(request.FilePath).toUtf8(), CIF_UsePartialAccessToPixelData, 0, 1);
+  if (dcmImage.getStatus() != EIS_Normal)
+  {
+    logger.warn(QString("Failed to load image for thumbnail from %1: %2")
+      .arg(request.FilePath).arg(DicomImage::getString(dcmImage.getStatus())));
+    return false;
+  }
+
+  // Scale down before rendering, so that windowing and conversion to 8-bit
+  // is only performed on a thumbnail-size image.
+  DicomImage* scaledImage = 0;
+  if (dcmImage.getWidth() > THUMBNAIL_DECODE_SIZE || dcmImage.getHeight() > THUMBNAIL_DECODE_SIZE)
+  {
+    // aspect ratio is preserved if either the width or the height is 0
+    if (dcmImage.getWidth() >= dcmImage.getHeight())
+    {
+      scaledImage = dcmImage.createScaledImage(THUMBNAIL_DECODE_SIZE, 0UL, 1 /* interpolate */);
+    }
+    else
+    {
+      scaledImage = dcmImage.createScaledImage(0UL, THUMBNAIL_DECODE_SIZE, 1 /* interpolate */);
+    }
+  }
+  bool success = request.ThumbnailGenerator->generateThumbnail(scaledImage ? scaledImage : &dcmImage, request.ThumbnailPath);
+  delete scaledImage;
+  return success;
+}
+
+//----------------------------------------------------------------------------
+void ctkDICOMThumbnailServicePrivate::notifyThumbnailLoaded(const QString& sopInstanceUID, const QImage& thumbnail)
+{
+  // QPixmap can only be created in the GUI thread, therefore only the image is passed
+  QMetaObject::invokeMethod(this->q_ptr, "onThumbnailLoaded", Qt::QueuedConnection,
+    Q_ARG(QString, sopInstanceUID), Q_ARG(QImage, thumbnail));
+}
+
+//----------------------------------------------------------------------------
+// ctkDICOMThumbnailService methods
+
+//----------------------------------------------------------------------------
+ctkDICOMThumbnailService::ctkDICOMThumbnailService(QObject* parent)
+  : QObject(parent)
+  , d_ptr(new ctkDICOMThumbnailServicePrivate(*this))
+{
+}
+
+//----------------------------------------------------------------------------
+ctkDICOMThumbnailService::~ctkDICOMThumbnailService()
+{
+}
+
+//----------------------------------------------------------------------------
+void ctkDICOMThumbnailService::setDatabaseDirectory(const QString& directory)
+{
+  Q_D(ctkDICOMThumbnailService);
+  d->DatabaseDirectory = directory;
+}
+
+//----------------------------------------------------------------------------
+QString ctkDICOMThumbnailService::databaseDirectory() const
+{
+  Q_D(const ctkDICOMThumbnailService);
+  return d->thumbnailsDirectory();
+}
+
+//----------------------------------------------------------------------------
+void ctkDICOMThumbnailService::setDatabase(ctkDICOMDatabase* database)
+{
+  Q_D(ctkDICOMThumbnailService);
+  d->Database = database;
+}
+
+//----------------------------------------------------------------------------
+ctkDICOMDatabase* ctkDICOMThumbnailService::database() const
+{
+  Q_D(const ctkDICOMThumbnailService);
+  return d->Database;
+}
+
+//----------------------------------------------------------------------------
+void ctkDICOMThumbnailService::setThumbnailGenerator(ctkDICOMAbstractThumbnailGenerator* generator)
+{
+  Q_D(ctkDICOMThumbnailService);
+  QMutexLocker locker(&d->RequestsMutex);
+  d->ThumbnailGenerator = generator;
+}
+
+//----------------------------------------------------------------------------
+ctkDICOMAbstractThumbnailGenerator* ctkDICOMThumbnailService::thumbnailGenerator() const
+{
+  Q_D(const ctkDICOMThumbnailService);
+  QMutexLocker locker(&d->RequestsMutex);
+  return d->ThumbnailGenerator ? d->ThumbnailGenerator : d->DefaultThumbnailGenerator.data();
+}
+
+//----------------------------------------------------------------------------
+void ctkDICOMThumbnailService::setMaximumThreadCount(int count)
+{
+  Q_D(ctkDICOMThumbnailService);
+  QMutexLocker locker(&d->RequestsMutex);
+  d->MaximumThreadCount = count;
+  d->ThreadPool.setMaxThreadCount(count > 0 ? count : QThread::idealThreadCount());
+}
+
+//----------------------------------------------------------------------------
+int ctkDICOMThumbnailService::maximumThreadCount() const
+{
+  Q_D(const ctkDICOMThumbnailService);
+  QMutexLocker locker(&d->RequestsMutex);
+  return d->MaximumThreadCount;
+}
+
+//----------------------------------------------------------------------------
+void ctkDICOMThumbnailService::setCacheSize(int count)
+{
+  Q_D(ctkDICOMThumbnailService);
+  d->ThumbnailCache.setMaxCost(count);
+}
+
+//----------------------------------------------------------------------------
+int ctkDICOMThumbnailService::cacheSize() const
+{
+  Q_D(const ctkDICOMThumbnailService);
+  return d->ThumbnailCache.maxCost();
+}
+
+//----------------------------------------------------------------------------
+QString ctkDICOMThumbnailService::thumbnailPath(const QString& databaseDirectory, const QString& studyInstanceUID,
+  const QString& seriesInstanceUID, const QString& sopInstanceUID)
+{
+  return databaseDirectory + "/thumbs/" + studyInstanceUID + "/" + seriesInstanceUID + "/" + sopInstanceUID + ".png";
+}
+
+//----------------------------------------------------------------------------
+QPixmap ctkDICOMThumbnailService::cachedThumbnail(const QString& sopInstanceUID) const
+{
+  Q_D(const ctkDICOMThumbnailService);
+  QPixmap* thumbnail = d->ThumbnailCache.object(sopInstanceUID);
+  return thumbnail ? *thumbnail : QPixmap();
+}
+
+//----------------------------------------------------------------------------
+void ctkDICOMThumbnailService::requestThumbnail(const QString& studyInstanceUID, const QString& seriesInstanceUID,
+  const QString& sopInstanceUID, const QString& filePath /* = QString() */, bool highPriority /* = false */)
+{
+  Q_D(ctkDICOMThumbnailService);
+  QPixmap* cachedThumbnail = d->ThumbnailCache.object(sopInstanceUID);
+  if (cachedThumbnail)
+  {
+    emit thumbnailReady(sopInstanceUID, *cachedThumbnail);
+    return;
+  }
+
+  ctkDICOMThumbnailRequest request;
+  request.SOPInstanceUID = sopInstanceUID;
+  request.ThumbnailPath = ctkDICOMThumbnailService::thumbnailPath(d->thumbnailsDirectory(),
+    studyInstanceUID, seriesInstanceUID, sopInstanceUID);
+  request.FilePath = filePath;
+  if (request.FilePath.isEmpty() && d->Database && !QFileInfo(request.ThumbnailPath).exists())
+  {
+    // The database can only be accessed from this thread, so the file path is retrieved here
+    // (only if the thumbnail has to be generated).
+    request.FilePath = d->Database->fileForInstance(sopInstanceUID);
+  }
+
+  QMutexLocker locker(&d->RequestsMutex);
+  request.ThumbnailGenerator = d->ThumbnailGenerator ? d->ThumbnailGenerator : d->DefaultThumbnailGenerator.data();
+  if (d->PendingSOPInstanceUIDs.contains(sopInstanceUID))
+  {
+    if (highPriority)
+    {
+      locker.unlock();
+      this->prioritizeRequests(QStringList() << sopInstanceUID);
+    }
+    return;
+  }
+  if (highPriority)
+  {
+    d->PendingRequests.prepend(request);
+  }
+  else
+  {
+    d->PendingRequests.append(request);
+  }
+  d->PendingSOPInstanceUIDs.insert(sopInstanceUID);
+
+  if (d->ActiveWorkerCount < d->ThreadPool.maxThreadCount())
+  {
+    d->ActiveWorkerCount++;
+    d->ThreadPool.start(new ctkDICOMThumbnailServiceWorker(d));
+  }
+}
+
+//----------------------------------------------------------------------------
+void ctkDICOMThumbnailService::prioritizeRequests(const QStringList& sopInstanceUIDs)
+{
+  Q_D(ctkDICOMThumbnailService);
+  QMutexLocker locker(&d->RequestsMutex);
+  QHash<QString, int> priorityForSOPInstanceUID;
+  for (int i = 0; i < sopInstanceUIDs.size(); ++i)
+  {
+    if (d->PendingSOPInstanceUIDs.contains(sopInstanceUIDs[i]) && !priorityForSOPInstanceUID.contains(sopInstanceUIDs[i]))
+    {
+      priorityForSOPInstanceUID[sopInstanceUIDs[i]] = i;
+    }
+  }
+  if (priorityForSOPInstanceUID.isEmpty())
+  {
+    return;
+  }
+  QVector<ctkDICOMThumbnailRequest> prioritizedRequests(sopInstanceUIDs.size());
+  QVector<bool> prioritizedRequestFound(sopInstanceUIDs.size(), false);
+  QList<ctkDICOMThumbnailRequest> otherRequests;
+  foreach(const ctkDICOMThumbnailRequest& request, d->PendingRequests)
+  {
+    QHash<QString, int>::const_iterator priorityIt = priorityForSOPInstanceUID.constFind(request.SOPInstanceUID);
+    if (priorityIt == priorityForSOPInstanceUID.constEnd())
+    {
+      otherRequests.append(request);
+    }
+    else
+    {
+      prioritizedRequests[priorityIt.value()] = request;
+      prioritizedRequestFound[priorityIt.value()] = true;
+    }
+  }
+  d->PendingRequests.clear();
+  for (int i = 0; i < prioritizedRequests.size(); ++i)
+  {
+    if (prioritizedRequestFound[i])
+    {
+      d->PendingRequests.append(prioritizedRequests[i]);
+    }
+  }
+  d->PendingRequests.append(otherRequests);
+}
+
+//----------------------------------------------------------------------------
+void ctkDICOMThumbnailService::cancelPendingRequests()
+{
+  Q_D(ctkDICOMThumbnailService);
+  QMutexLocker locker(&d->RequestsMutex);
+  d->PendingRequests.clear();
+  d->PendingSOPInstanceUIDs.clear();
+}
+
+//----------------------------------------------------------------------------
+int ctkDICOMThumbnailService::pendingRequestCount() const
+{
+  Q_D(const ctkDICOMThumbnailService);
+  QMutexLocker locker(&d->RequestsMutex);
+  return d->PendingRequests.size();
+}
+
+//----------------------------------------------------------------------------
+bool ctkDICOMThumbnailService::waitForDone(int msecTimeout /* = -1 */)
+{
+  Q_D(ctkDICOMThumbnailService);
+  // workers only stop when there are no more pending requests
+  return d->ThreadPool.waitForDone(msecTimeout);
+}
+
+//----------------------------------------------------------------------------
+void ctkDICOMThumbnailService::clearCache()
+{
+  Q_D(ctkDICOMThumbnailService);
+  d->ThumbnailCache.clear();
+}
+
+//----------------------------------------------------------------------------
+void ctkDICOMThumbnailService::onThumbnailLoaded(const QString& sopInstanceUID, const QImage& thumbnail)
+{
+  Q_D(ctkDICOMThumbnailService);
+  if (thumbnail.isNull())
+  {
+    emit thumbnailFailed(sopInstanceUID);
+    return;
+  }
+  QPixmap pixmap = QPixmap::fromImage(thumbnail);
+  // QCache takes ownership of the inserted pixmap
+  d->ThumbnailCache.insert(sopInstanceUID, new QPixmap(pixmap));
+  emit thumbnailReady(sopInstanceUID, pixmap);
+}
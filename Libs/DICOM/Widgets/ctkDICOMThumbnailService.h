@@ -0,0 +1,142 @@
+/*=========================================================================
+
+  Library:   CTK
+
+  Copyright (c) Kitware Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0.txt
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+=========================================================================*/
+
+#ifndef __ctkDICOMThumbnailService_h
+#define __ctkDICOMThumbnailService_h
+
+// Qt includes
+#include <QImage>
+#include <QObject>
+#include <QPixmap>
+#include <QStringList>
+
+#include "ctkDICOMWidgetsExport.h"
+
+class ctkDICOMAbstractThumbnailGenerator;
+class ctkDICOMDatabase;
+class ctkDICOMThumbnailServicePrivate;
+
+/// \ingroup DICOM_Widgets
+///
+/// \brief Loads and generates thumbnails of DICOM instances in background threads.
+///
+/// Thumbnails are requested by SOP instance UID and are delivered by the
+/// thumbnailReady signal, in the thread of the service (typically the GUI thread).
+/// Requests are processed by a bounded pool of worker threads in the order they
+/// were requested, except that requests can be moved to the front of the queue
+/// (for example, when the corresponding items become visible).
+///
+/// Existing thumbnail files in the database directory are loaded as is. If the thumbnail
+/// file does not exist then a single frame of the image is decoded, scaled down to
+/// thumbnail size, and saved to the database directory using the thumbnail generator.
+/// Recently delivered thumbnails are kept in memory (least recently used ones
+/// are dropped when cacheSize is reached).
+///
+/// \warning The thumbnail generator is used by multiple threads at the same time,
+/// therefore generateThumbnail() must not modify the state of the generator.
+///
+class CTK_DICOM_WIDGETS_EXPORT ctkDICOMThumbnailService : public QObject
+{
+  Q_OBJECT
+  Q_PROPERTY(int maximumThreadCount READ maximumThreadCount WRITE setMaximumThreadCount)
+  Q_PROPERTY(int cacheSize READ cacheSize WRITE setCacheSize)
+  Q_PROPERTY(QString databaseDirectory READ databaseDirectory WRITE setDatabaseDirectory)
+
+public:
+  explicit ctkDICOMThumbnailService(QObject* parent = 0);
+  virtual ~ctkDICOMThumbnailService();
+
+  /// Directory that contains the "thumbs" folder where thumbnail files are stored.
+  void setDatabaseDirectory(const QString& directory);
+  QString databaseDirectory() const;
+
+  /// Database that is used for getting the file path of instances if the thumbnail
+  /// has to be generated and the file path is not specified in the request.
+  /// If the database is set then its directory is used as database directory.
+  Q_INVOKABLE void setDatabase(ctkDICOMDatabase* database);
+  Q_INVOKABLE ctkDICOMDatabase* database() const;
+
+  /// Generator that renders the thumbnail files.
+  /// If not set then a ctkDICOMThumbnailGenerator owned by the service is used.
+  Q_INVOKABLE void setThumbnailGenerator(ctkDICOMAbstractThumbnailGenerator* generator);
+  Q_INVOKABLE ctkDICOMAbstractThumbnailGenerator* thumbnailGenerator() const;
+
+  /// Maximum number of threads that load or generate thumbnails.
+  /// Setting a value <= 0 uses the number of processor cores (QThread::idealThreadCount()).
+  /// Default is 2, to leave processing capacity for other tasks.
+  void setMaximumThreadCount(int count);
+  int maximumThreadCount() const;
+
+  /// Maximum number of thumbnails kept in memory. Default is 500.
+  void setCacheSize(int count);
+  int cacheSize() const;
+
+  /// Get path of the thumbnail file of an instance
+  static QString thumbnailPath(const QString& databaseDirectory, const QString& studyInstanceUID,
+    const QString& seriesInstanceUID, const QString& sopInstanceUID);
+
+  /// Returns the thumbnail if it is in the memory cache, a null pixmap otherwise.
+  Q_INVOKABLE QPixmap cachedThumbnail(const QString& sopInstanceUID) const;
+
+  /// Request loading of a thumbnail. thumbnailReady or thumbnailFailed signal is emitted when
+  /// the request is processed. If the thumbnail is in the memory cache then thumbnailReady
+  /// is emitted before the method returns.
+  /// \param filePath Path of the DICOM file, used if the thumbnail has to be generated.
+  /// If empty then the file path is retrieved from the database (if it is set).
+  /// \param highPriority If true then the request is processed before all other pending requests.
+  Q_INVOKABLE void requestThumbnail(const QString& studyInstanceUID, const QString& seriesInstanceUID,
+    const QString& sopInstanceUID, const QString& filePath = QString(), bool highPriority = false);
+
+  /// Move pending requests of the specified instances to the front of the queue
+  /// (keeping the order of the specified instances).
+  Q_INVOKABLE void prioritizeRequests(const QStringList& sopInstanceUIDs);
+
+  /// Remove all pending requests. Requests that are being processed are completed.
+  Q_INVOKABLE void cancelPendingRequests();
+
+  /// Number of requests that are not processed yet.
+  Q_INVOKABLE int pendingRequestCount() const;
+
+  /// Wait until all pending requests are processed.
+  /// msecTimeout specifies a maximum timeout. If <0 then it means wait indefinitely.
+  /// Signals of processed requests are emitted when the event loop processes events.
+  Q_INVOKABLE bool waitForDone(int msecTimeout = -1);
+
+  /// Remove all thumbnails from the memory cache.
+  Q_INVOKABLE void clearCache();
+
+Q_SIGNALS:
+  void thumbnailReady(const QString& sopInstanceUID, const QPixmap& thumbnail);
+  void thumbnailFailed(const QString& sopInstanceUID);
+
+protected Q_SLOTS:
+  /// Called in the thread of the service when a worker thread completed a request.
+  /// Null image means that the thumbnail could not be loaded.
+  void onThumbnailLoaded(const QString& sopInstanceUID, const QImage& thumbnail);
+
+protected:
+  QScopedPointer<ctkDICOMThumbnailServicePrivate> d_ptr;
+
+private:
+  Q_DECLARE_PRIVATE(ctkDICOMThumbnailService);
+  Q_DISABLE_COPY(ctkDICOMThumbnailService);
+};
+
+#endif
@@ -0,0 +1,178 @@
+/*=============================================================================
+
+  Library: CTK
+
+  Copyright (c) German Cancer Research Center,
+    Division of Medical and Biological Informatics
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+=============================================================================*/
+
+#include <ctkPluginConstants.h>
+#include <ctkPluginContext.h>
+#include <ctkPluginException.h>
+#include <ctkPluginFrameworkLauncher.h>
+#include <ctkServiceReference.h>
+
+#include <QCoreApplication>
+#include <QDebug>
+#include <QFileInfo>
+#include <QLibrary>
+#include <QUrl>
+
+#include <cstdlib>
+
+//----------------------------------------------------------------------------
+static QSharedPointer<ctkPlugin> getPlugin(ctkPluginContext* context, const QString& symbolicName)
+{
+  foreach(QSharedPointer<ctkPlugin> plugin, context->getPlugins())
+  {
+    if (plugin->getSymbolicName() == symbolicName)
+    {
+      return plugin;
+    }
+  }
+  qCritical() << "Plug-in" << symbolicName << "is not installed";
+  return QSharedPointer<ctkPlugin>();
+}
+
+//----------------------------------------------------------------------------
+static qlonglong getServiceId(ctkPluginContext* context, const QString& clazz)
+{
+  QList<ctkServiceReference> references = context->getServiceReferences(clazz);
+  if (references.isEmpty())
+  {
+    return -1;
+  }
+  return references.front().getProperty(ctkPluginConstants::SERVICE_ID).toLongLong();
+}
+
+//----------------------------------------------------------------------------
+static bool checkActive(ctkPluginContext* context, const QString& symbolicName)
+{
+  QSharedPointer<ctkPlugin> plugin = getPlugin(context, symbolicName);
+  if (!plugin)
+  {
+    return false;
+  }
+  if (plugin->getState() != ctkPlugin::ACTIVE)
+  {
+    qCritical() << "Plug-in" << symbolicName << "is not active:" << plugin->getState();
+    return false;
+  }
+  return true;
+}
+
+//----------------------------------------------------------------------------
+static bool checkPlugins(ctkPluginContext* context)
+{
+  // pluginSL1 is not listed as a basic plug-in, it is started because
+  // pluginSL3 and pluginSL4 require it
+  if (!checkActive(context, "pluginSL1.test") ||
+      !checkActive(context, "pluginSL3.test") ||
+      !checkActive(context, "pluginSL4.test"))
+  {
+    return false;
+  }
+
+  // Service ids increase with each registration, the activators register
+  // their services in start()
+  qlonglong sl1Id = getServiceId(context, "ctkActivatorSL1");
+  qlonglong sl3Id = getServiceId(context, "ctkActivatorSL3");
+  qlonglong sl4Id = getServiceId(context, "org.commontk.test.FooService");
+  if (sl1Id < 0 || sl3Id < 0 || sl4Id < 0)
+  {
+    qCritical() << "Missing services registered by the activators:" << sl1Id << sl3Id << sl4Id;
+    return false;
+  }
+  if (sl1Id > sl3Id || sl1Id > sl4Id)
+  {
+    qCritical() << "pluginSL1 was activated after the plug-ins requiring it";
+    return false;
+  }
+
+  // The lazy plug-in waits for its first class load, its library must not
+  // have been loaded by the thread pool
+  QSharedPointer<ctkPlugin> lazyPlugin = getPlugin(context, "pluginL.test");
+  if (!lazyPlugin)
+  {
+    return false;
+  }
+  if (lazyPlugin->getState() != ctkPlugin::STARTING)
+  {
+    qCritical() << "Lazy plug-in is not in the STARTING state:" << lazyPlugin->getState();
+    return false;
+  }
+  if (getServiceId(context, "ctkActivatorL") >= 0)
+  {
+    qCritical() << "Lazy plug-in was activated";
+    return false;
+  }
+  QString libraryPath = QFileInfo(QUrl(lazyPlugin->getLocation()).toLocalFile()).canonicalFilePath();
+  if (QLibrary(libraryPath).isLoaded())
+  {
+    qCritical() << "Library of the lazy plug-in was loaded:" << libraryPath;
+    return false;
+  }
+  return true;
+}
+
+//----------------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+  QCoreApplication app(argc, argv);
+
+  app.setOrganizationName("CTK");
+  app.setOrganizationDomain("commontk.org");
+  app.setApplicationName("ctkPluginFrameworkParallelStartTests");
+
+  QString pluginDir;
+#ifdef CMAKE_INTDIR
+  pluginDir = qApp->applicationDirPath() + "/../test_plugins/" CMAKE_INTDIR "/";
+#else
+  pluginDir = qApp->applicationDirPath() + "/test_plugins/";
+#endif
+
+  ctkProperties fwProps;
+  fwProps.insert(ctkPluginConstants::FRAMEWORK_STORAGE_CLEAN, ctkPluginConstants::FRAMEWORK_STORAGE_CLEAN_ONFIRSTINIT);
+  fwProps.insert(ctkPluginFrameworkLauncher::PROP_PLUGINS, "pluginSL3_test,pluginL_test,pluginSL4_test");
+  fwProps.insert(ctkPluginFrameworkLauncher::PROP_PLUGINS_PARALLEL_START, 2);
+  fwProps.insert("org.commontk.pluginfw.debug.pluginfw", true);
+
+#if defined(Q_CC_GNU) && ((__GNUC__ < 4) || ((__GNUC__ == 4) && (__GNUC_MINOR__ < 5)))
+  fwProps.insert(ctkPluginConstants::FRAMEWORK_PLUGIN_LOAD_HINTS, QVariant::fromValue<QLibrary::LoadHints>(QLibrary::ExportExternalSymbolsHint));
+#endif
+
+  ctkPluginFrameworkLauncher::setFrameworkProperties(fwProps);
+  ctkPluginFrameworkLauncher::addSearchPath(pluginDir);
+
+  bool success = false;
+  try
+  {
+    ctkPluginContext* context = ctkPluginFrameworkLauncher::startup(NULL);
+    success = context != NULL && checkPlugins(context);
+  }
+  catch (const ctkException& e)
+  {
+    qCritical() << "Starting the plug-ins failed:" << e.printStackTrace();
+  }
+  ctkPluginFrameworkLauncher::shutdown();
+
+  if (!success)
+  {
+    return EXIT_FAILURE;
+  }
+  qDebug() << "Parallel start successful";
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,8 @@
+set(Plugin-ActivationPolicy "lazy")
+set(Plugin-Name "pluginL")
+set(Plugin-Version "1.0.0")
+set(Plugin-Description "Test plugin for framework, pluginL_test")
+set(Plugin-Vendor "CommonTK")
+set(Plugin-ContactAddress "http://www.commontk.org")
+set(Plugin-Category "test")
+set(Require-Plugin pluginSL1.test)
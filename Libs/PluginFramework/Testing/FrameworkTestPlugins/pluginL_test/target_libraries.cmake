@@ -0,0 +1,9 @@
+# See CMake/ctkFunctionGetTargetLibraries.cmake
+#
+# This file should list the libraries required to build the current CTK plugin.
+# For specifying required plugins, see the manifest_headers.cmake file.
+#
+
+set(target_libraries
+  CTKPluginFramework
+)
@@ -28,15 +28,65 @@
 #undef REGISTERED
 #include <ctkServiceEvent.h>
 
+#include <QAtomicInt>
+#include <QRunnable>
 #include <QTest>
+#include <QThread>
+#include <QThreadPool>
 #include <QDebug>
 
+//----------------------------------------------------------------------------
+// Looks up the services registered by registerServices()
+class ctkServiceLookupRunnable : public QRunnable
+{
+public:
+
+  ctkServiceLookupRunnable(ctkPluginContext* pc, int nServices, int nLookups,
+                           int seed, QAtomicInt* failures)
+    : pc(pc), nServices(nServices), nLookups(nLookups), seed(seed), failures(failures)
+  {}
+
+  void run()
+  {
+    QString pidFilter("(service.pid=my.service.%1)");
+    QString valueFilter("(&(perf.service.value>=%1)(perf.service.value<=%1))");
+    for(int i = 0; i < nLookups; i++)
+    {
+      int k = (seed * 7919 + i * 104729) % nServices;
+      QList<ctkServiceReference> refs;
+      // Mostly indexed lookups, with some lookups that evaluate the filter for all services
+      if (i % 100 == 0)
+      {
+        refs = pc->getServiceReferences<IPerfTestService>(valueFilter.arg(k + 1));
+      }
+      else
+      {
+        refs = pc->getServiceReferences<IPerfTestService>(pidFilter.arg(k));
+      }
+      if (refs.size() != 1)
+      {
+        failures->fetchAndAddOrdered(1);
+      }
+    }
+  }
+
+private:
+
+  ctkPluginContext* pc;
+  int nServices;
+  int nLookups;
+  int seed;
+  QAtomicInt* failures;
+};
+
 //----------------------------------------------------------------------------
 ctkPluginFrameworkPerfRegistryTestSuite::ctkPluginFrameworkPerfRegistryTestSuite(ctkPluginContext* context)
   : QObject(0)
   , pc(context)
   , nListeners(100)
   , nServices(1000)
+  , nLookups(10000)
+  , nBulkServices(20000)
   , nRegistered(0)
   , nUnregistering(0)
   , nModified(0)
@@ -136,6 +186,31 @@ void ctkPluginFrameworkPerfRegistryTestSuite::registerServices(int n)
   }
 }
 
+//----------------------------------------------------------------------------
+void ctkPluginFrameworkPerfRegistryTestSuite::testConcurrentLookups()
+{
+  int nThreads = qMax(2, QThread::idealThreadCount());
+  log() << "looking up services from" << nThreads << "threads,"
+        << nLookups << "lookups per thread";
+
+  QThreadPool pool;
+  pool.setMaxThreadCount(nThreads);
+  QAtomicInt failures(0);
+
+  ctkHighPrecisionTimer t;
+  t.start();
+  for(int i = 0; i < nThreads; i++)
+  {
+    pool.start(new ctkServiceLookupRunnable(pc, nServices, nLookups, i, &failures));
+  }
+  pool.waitForDone();
+  int ms = t.elapsedMilli();
+  log() << "concurrent lookups took" << ms << "ms,"
+        << static_cast<qint64>(nThreads) * nLookups * 1000 / qMax(ms, 1) << "lookups/s";
+  QVERIFY2(failures.fetchAndAddOrdered(0) == 0,
+           "Each lookup must find exactly one service");
+}
+
 //----------------------------------------------------------------------------
 void ctkPluginFrameworkPerfRegistryTestSuite::testModifyServices()
 {
@@ -194,6 +269,48 @@ void ctkPluginFrameworkPerfRegistryTestSuite::unregisterServices()
   regs.clear();
 }
 
+//----------------------------------------------------------------------------
+void ctkPluginFrameworkPerfRegistryTestSuite::testBulkRegistration()
+{
+  // The services do not match the filter of the listeners, this measures
+  // the registry. Each batch should take about the same time, whatever
+  // the number of services which are already registered.
+  int nBatches = 4;
+  int batchSize = nBulkServices / nBatches;
+  log() << "registering" << nBulkServices << "services in" << nBatches << "batches";
+
+  QString pid("my.bulk.service.%1");
+  QList<ctkServiceRegistration> bulkRegs;
+  for(int b = 0; b < nBatches; b++)
+  {
+    ctkHighPrecisionTimer t;
+    t.start();
+    for(int i = b * batchSize; i < (b + 1) * batchSize; i++)
+    {
+      ctkDictionary props;
+      props.insert("service.pid", pid.arg(i));
+      QObject* service = new PerfTestService();
+      services.push_back(service);
+      bulkRegs.push_back(pc->registerService<IPerfTestService>(service, props));
+    }
+    log() << "batch" << b << "with" << bulkRegs.size() - batchSize
+          << "services already registered took" << t.elapsedMilli() << "ms";
+  }
+
+  QCOMPARE(pc->getServiceReferences<IPerfTestService>().size(), nBatches * batchSize);
+  QCOMPARE(pc->getServiceReferences<IPerfTestService>(
+             QString("(service.pid=") + pid.arg(batchSize) + ")").size(), 1);
+
+  ctkHighPrecisionTimer t;
+  t.start();
+  for(int i = 0; i < bulkRegs.size(); i++)
+  {
+    bulkRegs[i].unregister();
+  }
+  log() << "unregister took" << t.elapsedMilli() << "ms";
+  QVERIFY(pc->getServiceReferences<IPerfTestService>().isEmpty());
+}
+
 
 //----------------------------------------------------------------------------
 ctkServiceListener::ctkServiceListener(ctkPluginFrameworkPerfRegistryTestSuite* ts)
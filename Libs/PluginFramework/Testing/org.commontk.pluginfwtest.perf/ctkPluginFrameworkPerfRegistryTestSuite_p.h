@@ -44,6 +44,8 @@ private:
 
   int nListeners;
   int nServices;
+  int nLookups;
+  int nBulkServices;
 
   int nRegistered;
   int nUnregistering;
@@ -78,9 +80,11 @@ private Q_SLOTS:
 
   void testAddListeners();
   void testRegisterServices();
+  void testConcurrentLookups();
 
   void testModifyServices();
   void testUnregisterServices();
+  void testBulkRegistration();
 };
 
 class ctkServiceListener : public QObject
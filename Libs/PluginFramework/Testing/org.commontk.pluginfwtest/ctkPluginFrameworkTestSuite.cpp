@@ -25,6 +25,7 @@
 #include <ctkPluginContext.h>
 #include <ctkPluginConstants.h>
 #include <ctkPluginException.h>
+#include <ctkLDAPSearchFilter.h>
 #include <ctkServiceException.h>
 
 #include <QDir>
@@ -455,6 +456,79 @@ void ctkPluginFrameworkTestSuite::frame045a()
   }
 }
 
+//----------------------------------------------------------------------------
+// Match LDAP filters with wildcards, approximate and negated comparisons
+void ctkPluginFrameworkTestSuite::frame046a()
+{
+  ctkDictionary props;
+  props.insert("name", "ctkTestService");
+  props.insert("ranking", 5);
+
+  QVERIFY(ctkLDAPSearchFilter("(name=ctk*Service)").match(props));
+  QVERIFY(ctkLDAPSearchFilter("(name=*Test*)").match(props));
+  QVERIFY(ctkLDAPSearchFilter("(name=*)").match(props));
+  QVERIFY(!ctkLDAPSearchFilter("(name=ctk*Foo)").match(props));
+  QVERIFY(!ctkLDAPSearchFilter("(name=ctk*Test*Test*)").match(props));
+  QVERIFY(!ctkLDAPSearchFilter("(name=ctkTest)").match(props));
+  QVERIFY(ctkLDAPSearchFilter("(name~=CTK testservice)").match(props));
+  QVERIFY(ctkLDAPSearchFilter("(&(name=ctk*)(!(ranking<=4)))").match(props));
+
+  // Attribute names are case sensitive only when matching case
+  QVERIFY(ctkLDAPSearchFilter("(NAME=ctkTestService)").match(props));
+  QVERIFY(!ctkLDAPSearchFilter("(NAME=ctkTestService)").matchCase(props));
+
+  // Filters are compiled once and reused
+  QString filter = "(|(name=other)(name=ctk*))";
+  QVERIFY(ctkLDAPSearchFilter(filter) == ctkLDAPSearchFilter(filter));
+  QVERIFY(ctkLDAPSearchFilter(filter).match(props));
+}
+
+//----------------------------------------------------------------------------
+// Look up services by indexed properties, check that the ranking order
+// is kept and that the indexes follow property changes
+void ctkPluginFrameworkTestSuite::frame047a()
+{
+  QObject service1;
+  QObject service2;
+  QObject service3;
+  ctkDictionary props;
+  props.insert(ctkPluginConstants::SERVICE_PID, "frame047a.pid");
+  props.insert(ctkPluginConstants::SERVICE_RANKING, 1);
+  ctkServiceRegistration sr1 = pc->registerService("QObject", &service1, props);
+  props.insert(ctkPluginConstants::SERVICE_RANKING, 2);
+  ctkServiceRegistration sr2 = pc->registerService("QObject", &service2, props);
+  props.insert(ctkPluginConstants::SERVICE_PID, "frame047a.other");
+  ctkServiceRegistration sr3 = pc->registerService("QObject", &service3, props);
+
+  QList<ctkServiceReference> srs = pc->getServiceReferences("QObject", "(service.pid=frame047a.pid)");
+  QCOMPARE(srs.size(), 2);
+  QVERIFY(srs[0] == sr2.getReference());
+  QVERIFY(srs[1] == sr1.getReference());
+
+  srs = pc->getServiceReferences("", "(&(service.pid=frame047a.pid)(service.ranking<=1))");
+  QCOMPARE(srs.size(), 1);
+  QVERIFY(srs[0] == sr1.getReference());
+
+  QString sidFilter = QString("(%1=%2)").arg(ctkPluginConstants::SERVICE_ID)
+      .arg(sr3.getReference().getProperty(ctkPluginConstants::SERVICE_ID).toLongLong());
+  srs = pc->getServiceReferences("", sidFilter);
+  QCOMPARE(srs.size(), 1);
+  QVERIFY(srs[0] == sr3.getReference());
+
+  props.insert(ctkPluginConstants::SERVICE_PID, "frame047a.pid");
+  props.insert(ctkPluginConstants::SERVICE_RANKING, 3);
+  sr3.setProperties(props);
+  srs = pc->getServiceReferences("QObject", "(service.pid=frame047a.pid)");
+  QCOMPARE(srs.size(), 3);
+  QVERIFY(srs[0] == sr3.getReference());
+  QVERIFY(pc->getServiceReferences("", "(service.pid=frame047a.other)").isEmpty());
+
+  sr1.unregister();
+  sr2.unregister();
+  sr3.unregister();
+  QVERIFY(pc->getServiceReferences("", "(service.pid=frame047a.pid)").isEmpty());
+}
+
 //----------------------------------------------------------------------------
 // Reinstalls and the updates testbundle_A.
 // The version is checked to see if an update has been made.
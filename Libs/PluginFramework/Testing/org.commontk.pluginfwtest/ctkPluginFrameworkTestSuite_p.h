@@ -66,6 +66,8 @@ private Q_SLOTS:
   void frame040a();
   void frame042a();
   void frame045a();
+  void frame046a();
+  void frame047a();
   void frame070a();
 
 private:
@@ -23,6 +23,9 @@ limitations under the License.
 
 #include <ctkException.h>
 
+#include <QCache>
+#include <QMutex>
+#include <QMutexLocker>
 #include <QSet>
 #include <QVariant>
 #include <QStringList>
@@ -99,19 +102,34 @@ class ctkLDAPExprData : public QSharedData
 public:
 
   ctkLDAPExprData( int op, QList<ctkLDAPExpr> args )
-    : m_operator(op), m_args(args)
+    : m_operator(op), m_args(args), m_matchAll(false), m_isTrue(false),
+    m_isFalse(false), m_intValue(0), m_floatValue(0), m_doubleValue(0),
+    m_longLongValue(0)
   {
   }
 
   ctkLDAPExprData( int op, QString attrName, QString attrValue )
-    : m_operator(op), m_attrName(attrName), m_attrValue(attrValue)
+    : m_operator(op), m_attrName(attrName), m_attrValue(attrValue),
+    m_attrNameLower(attrName.toLower()),
+    m_matchAll(op == ctkLDAPExpr::EQ && attrValue == QString(ctkLDAPExpr::WILDCARD)),
+    m_pattern(attrValue.split(ctkLDAPExpr::WILDCARD)),
+    m_approxValue(ctkLDAPExpr::fixupString(attrValue)),
+    m_isTrue(attrValue.compare("true", Qt::CaseInsensitive) == 0),
+    m_isFalse(attrValue.compare("false", Qt::CaseInsensitive) == 0),
+    m_intValue(attrValue.toInt()), m_floatValue(attrValue.toFloat()),
+    m_doubleValue(attrValue.toDouble()), m_longLongValue(attrValue.toLongLong())
   {
   }
 
   ctkLDAPExprData( const ctkLDAPExprData& other )
     : QSharedData(other), m_operator(other.m_operator),
     m_args(other.m_args), m_attrName(other.m_attrName),
-    m_attrValue(other.m_attrValue)
+    m_attrValue(other.m_attrValue), m_attrNameLower(other.m_attrNameLower),
+    m_matchAll(other.m_matchAll), m_pattern(other.m_pattern),
+    m_approxValue(other.m_approxValue), m_isTrue(other.m_isTrue),
+    m_isFalse(other.m_isFalse), m_intValue(other.m_intValue),
+    m_floatValue(other.m_floatValue), m_doubleValue(other.m_doubleValue),
+    m_longLongValue(other.m_longLongValue)
   {
   }
 
@@ -123,8 +141,44 @@ public:
   QString m_attrName;
   //!
   QString m_attrValue;
+
+  // The attribute value of simple expressions is converted once when the
+  // expression is parsed, instead of each time a property value is compared.
+
+  //! Attribute name for case insensitive property lookups
+  QString m_attrNameLower;
+  //! The expression is a presence test, (attr=*)
+  bool m_matchAll;
+  //! Attribute value split at the wildcards
+  QStringList m_pattern;
+  //! Attribute value for APPROX comparisons
+  QString m_approxValue;
+  bool m_isTrue;
+  bool m_isFalse;
+  int m_intValue;
+  float m_floatValue;
+  double m_doubleValue;
+  qlonglong m_longLongValue;
 };
 
+//----------------------------------------------------------------------------
+namespace {
+
+/// Cache of compiled expressions, shared by all framework instances
+struct ctkLDAPExprCache
+{
+  ctkLDAPExprCache()
+    : exprs(1024)
+  {}
+
+  QMutex mutex;
+  QCache<QString, ctkLDAPExpr> exprs;
+};
+
+}
+
+Q_GLOBAL_STATIC(ctkLDAPExprCache, ldapExprCache)
+
 //----------------------------------------------------------------------------
 ctkLDAPExpr::ctkLDAPExpr()
 {
@@ -154,6 +208,25 @@ ctkLDAPExpr::ctkLDAPExpr( const QString &filter )
   d = expr.d;
 }
 
+//----------------------------------------------------------------------------
+ctkLDAPExpr ctkLDAPExpr::cached( const QString &filter )
+{
+  ctkLDAPExprCache* cache = ldapExprCache();
+  {
+    QMutexLocker lock(&cache->mutex);
+    if (ctkLDAPExpr* expr = cache->exprs.object(filter))
+    {
+      return *expr;
+    }
+  }
+
+  // Parse without holding the lock, invalid filters throw here
+  ctkLDAPExpr expr(filter);
+  QMutexLocker lock(&cache->mutex);
+  cache->exprs.insert(filter, new ctkLDAPExpr(expr));
+  return expr;
+}
+
 //----------------------------------------------------------------------------
 ctkLDAPExpr::ctkLDAPExpr( int op, const QList<ctkLDAPExpr> &args )
   : d(new ctkLDAPExprData(op, args))
@@ -268,6 +341,38 @@ bool ctkLDAPExpr::isSimple(
   return false;
 }
 
+//----------------------------------------------------------------------------
+bool ctkLDAPExpr::getEquality(
+  const QStringList& keywords,
+  QString& keyword,
+  QString& value ) const
+{
+  if (d->m_operator == EQ) {
+    if (d->m_pattern.size() == 1 && !d->m_attrValue.isEmpty() &&
+      keywords.contains(d->m_attrNameLower)) {
+        keyword = d->m_attrNameLower;
+        value = d->m_attrValue;
+        return true;
+    }
+  } else if (d->m_operator == AND) {
+    int bestIndex = -1;
+    for (int i = 0; i < d->m_args.size( ); i++) {
+      QString k;
+      QString v;
+      if (d->m_args[i].getEquality(keywords, k, v)) {
+        int index = keywords.indexOf(k);
+        if (bestIndex < 0 || index < bestIndex) {
+          bestIndex = index;
+          keyword = k;
+          value = v;
+        }
+      }
+    }
+    return bestIndex >= 0;
+  }
+  return false;
+}
+
 //----------------------------------------------------------------------------
 bool ctkLDAPExpr::isNull() const
 {
@@ -277,7 +382,7 @@ bool ctkLDAPExpr::isNull() const
 //----------------------------------------------------------------------------
 bool ctkLDAPExpr::query( const QString &filter, const ctkDictionary &pd )
 {
-  return ctkLDAPExpr(filter).evaluate(pd, false);
+  return ctkLDAPExpr::cached(filter).evaluate(pd, false);
 }
 
 //----------------------------------------------------------------------------
@@ -286,8 +391,8 @@ bool ctkLDAPExpr::evaluate( const ctkServiceProperties &p, bool matchCase ) cons
   if ((d->m_operator & SIMPLE) != 0) {
     // try case sensitive match first
     int index = p.findCaseSensitive(d->m_attrName);
-    if (index < 0 && !matchCase) index = p.find(d->m_attrName);
-    return index < 0 ? false : compare(p.value(index), d->m_operator, d->m_attrValue);
+    if (index < 0 && !matchCase) index = p.findLowerCase(d->m_attrNameLower);
+    return index < 0 ? false : compare(p.value(index));
   } else { // (d->m_operator & COMPLEX) != 0
     switch (d->m_operator) {
     case AND:
@@ -311,69 +416,66 @@ bool ctkLDAPExpr::evaluate( const ctkServiceProperties &p, bool matchCase ) cons
 }
 
 //----------------------------------------------------------------------------
-bool ctkLDAPExpr::compare( const QVariant &obj, int op, const QString &s ) const
+bool ctkLDAPExpr::compare( const QVariant &obj ) const
 {
   if (obj.isNull())
     return false;
-  if (op == EQ && s == WILDCARD_QString )
+  if (d->m_matchAll)
     return true;
+  const int op = d->m_operator;
   try {
     if ( obj.canConvert<QString>( ) ) {
-      return compareString(obj.toString(), op, s);
+      return compareString(obj.toString());
     } else if (obj.canConvert<char>( ) ) {
-      return compareString(obj.toString(), op, s);
+      return compareString(obj.toString());
     } else if (obj.canConvert<bool>( ) ) {
       if (op==LE || op==GE)
         return false;
-      if ( obj.toBool() ) {
-        return s.compare("true", Qt::CaseInsensitive);
-      } else {
-        return s.compare("false", Qt::CaseInsensitive);
-      }
+      return obj.toBool() ? d->m_isTrue : d->m_isFalse;
     } 
     else if ( obj.canConvert<Byte>( ) || obj.canConvert<int>( ) ) 
     {
       switch(op) {
       case LE:
-        return obj.toInt() <= s.toInt();
+        return obj.toInt() <= d->m_intValue;
       case GE:
-        return obj.toInt() >= s.toInt();
+        return obj.toInt() >= d->m_intValue;
       default: /*APPROX and EQ*/
-        return s.toInt( ) == obj.toInt();
+        return d->m_intValue == obj.toInt();
       }
     } else if ( obj.canConvert<float>( ) ) {
       switch(op) {
       case LE:
-        return obj.toFloat() <= s.toFloat();
+        return obj.toFloat() <= d->m_floatValue;
       case GE:
-        return obj.toFloat() >= s.toFloat();
+        return obj.toFloat() >= d->m_floatValue;
       default: /*APPROX and EQ*/
-        return s.toFloat() == obj.toFloat();
+        return d->m_floatValue == obj.toFloat();
       }
     } else if (obj.canConvert<double>()) {
       switch(op) {
       case LE:
-        return obj.toDouble() <= s.toDouble();
+        return obj.toDouble() <= d->m_doubleValue;
       case GE:
-        return obj.toDouble() >= s.toDouble();
+        return obj.toDouble() >= d->m_doubleValue;
       default: /*APPROX and EQ*/
-        return s.toDouble( ) == obj.toDouble( );
+        return d->m_doubleValue == obj.toDouble( );
       }
     } else if (obj.canConvert<qlonglong>( )) {
       switch(op) {
       case LE:
-        return obj.toLongLong() <= s.toLongLong( );
+        return obj.toLongLong() <= d->m_longLongValue;
       case GE:
-        return obj.toLongLong() >= s.toLongLong( );
+        return obj.toLongLong() >= d->m_longLongValue;
       default: /*APPROX and EQ*/
-        return obj.toLongLong() == s.toLongLong( );
+        return obj.toLongLong() == d->m_longLongValue;
       }
     } 
     else if (obj.canConvert< QList<QVariant> >()) {
       QList<QVariant> list = obj.toList();
       QList<QVariant>::Iterator it;
       for (it=list.begin(); it != list.end( ); it++)
-         if (compare(*it, op, s))
+         if (compare(*it))
            return true;
     } 
   } catch (...) {
@@ -384,17 +486,17 @@ bool ctkLDAPExpr::compare( const QVariant &obj, int op, const QString &s ) const
 }
 
 //----------------------------------------------------------------------------
-bool ctkLDAPExpr::compareString( const QString &s1, int op, const QString &s2 )
+bool ctkLDAPExpr::compareString( const QString &s ) const
 {
-  switch(op) {
+  switch(d->m_operator) {
   case LE:
-    return s1.compare(s2) <= 0;
+    return s.compare(d->m_attrValue) <= 0;
   case GE:
-    return s1.compare(s2) >= 0;
+    return s.compare(d->m_attrValue) >= 0;
   case EQ:
-    return patSubstr(s1,s2);
+    return patSubstr(s, d->m_pattern);
   case APPROX:
-    return fixupString(s2) == fixupString(s1);
+    return d->m_approxValue == fixupString(s);
   default:
     return false;
   }
@@ -417,34 +519,33 @@ QString ctkLDAPExpr::fixupString( const QString &s )
 }
 
 //----------------------------------------------------------------------------
-bool ctkLDAPExpr::patSubstr( const QString &s, int si, const QString &pat, int pi )
-{
-  if (pat.size( )-pi == 0)
-    return s.size( )-si == 0;
-  if (QChar( pat[pi] ) == WILDCARD ) {
-    pi++;
-    for (;;) {
-      if (patSubstr( s, si, pat, pi))
-        return true;
-      if (s.size( )-si == 0)
-        return false;
-      si++;
-    }
-  } else {
-    if (s.size( )-si==0){
-      return false;
-    }
-    if(s[si]!=pat[pi]){
+bool ctkLDAPExpr::patSubstr( const QString &s, const QStringList &pat )
+{
+  if (s.isNull())
+    return false;
+  if (pat.size() == 1)
+    return s == pat.front();
+
+  // The first part must be a prefix and the last part a suffix of s.
+  // The parts in between are matched left to right, taking the first
+  // occurrence of each part leaves the most room for the following ones.
+  const QString& first = pat.front();
+  const QString& last = pat.back();
+  if (s.size() < first.size() + last.size() ||
+      !s.startsWith(first) || !s.endsWith(last))
+    return false;
+  int pos = first.size();
+  const int end = s.size() - last.size();
+  for (int i = 1; i < pat.size() - 1; ++i) {
+    const QString& part = pat[i];
+    if (part.isEmpty())
+      continue;
+    int index = s.indexOf(part, pos);
+    if (index < 0 || index + part.size() > end)
       return false;
-    }
-    return patSubstr( s, ++si, pat, ++pi);
+    pos = index + part.size();
   }
-}
-
-//----------------------------------------------------------------------------
-bool ctkLDAPExpr::patSubstr( const QString &s, const QString &pat )
-{
-  return s.isNull() ? false : patSubstr(s,0,pat,0);
+  return true;
 }
 
 //----------------------------------------------------------------------------
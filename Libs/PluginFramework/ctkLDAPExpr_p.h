@@ -64,9 +64,20 @@ public:
    */
   ctkLDAPExpr();
 
-  //!
+  //! Parse and compile the filter.
   ctkLDAPExpr(const QString &filter);
 
+  /**
+   * Returns the compiled expression of the filter. Compiled expressions
+   * are kept in a bounded cache which is shared by all framework instances,
+   * therefore filters that are used repeatedly (for example by service
+   * trackers and service listeners) are parsed only once.
+   *
+   * \throws ctkInvalidArgumentException if the filter is invalid.
+   *          Invalid filters are not cached.
+   */
+  static ctkLDAPExpr cached(const QString &filter);
+
   //!
   ctkLDAPExpr(const ctkLDAPExpr& other);
 
@@ -111,6 +122,20 @@ public:
     LocalCache& cache,
     bool matchCase) const;
 
+  /**
+   * Find an equality comparison which must be satisfied by all matches of
+   * this expression: either this expression is an equality comparison, or
+   * it is a conjunction with an equality comparison operand. Only comparisons
+   * of the given attributes without wildcards are considered, the attribute
+   * listed first is preferred.
+   *
+   * @param keywords Lower case attribute names to look for.
+   * @param keyword Set to the lower case attribute name of the comparison.
+   * @param value Set to the attribute value of the comparison.
+   * @return <code>true</code> if such a comparison was found.
+   */
+  bool getEquality(const QStringList& keywords, QString& keyword, QString& value) const;
+
   /**
    * Returns <code>true</code> if this instance is invalid, i.e. it was
    * constructed using ctkLDAPExpr().
@@ -133,6 +158,7 @@ public:
 private:
 
   class ParseState;
+  friend class ctkLDAPExprData;
 
   //!
   ctkLDAPExpr(int op, const QList<ctkLDAPExpr> &args);
@@ -146,20 +172,17 @@ private:
   //!
   static ctkLDAPExpr parseSimple(ParseState &ps);
 
-  //!
-  bool compare(const QVariant &obj, int op, const QString &s) const;
+  //! Compare a property value with the attribute value of this simple expression.
+  bool compare(const QVariant &obj) const;
 
   //!
-  static bool compareString(const QString &s1, int op, const QString &s2);
+  bool compareString(const QString &s) const;
 
   //!
   static QString fixupString(const QString &s);
 
-  //!
-  static bool patSubstr(const QString &s, const QString &pat);
-
-  //!
-  static bool patSubstr(const QString &s, int si, const QString &pat, int pi);
+  //! Match s against a pattern that was split at the wildcards.
+  static bool patSubstr(const QString &s, const QStringList &pat);
 
 
   const static QChar WILDCARD; // = 65535;
@@ -33,7 +33,7 @@ public:
   {}
 
   ctkLDAPSearchFilterData(const QString& filter)
-    : ldapExpr(filter)
+    : ldapExpr(ctkLDAPExpr::cached(filter))
   {}
 
   ctkLDAPSearchFilterData(const ctkLDAPSearchFilterData& other)
@@ -122,6 +122,18 @@ struct CTK_PLUGINFW_EXPORT ctkPluginConstants {
    */
   static const QString FRAMEWORK_PRELOAD_LIBRARIES; // = "org.commontk.pluginfw.preloadlibs"
 
+  /**
+   * Specifies service properties, in addition to SERVICE_ID and SERVICE_PID, for which
+   * the service registry maintains an index. The value of this property must be either
+   * of type QString or QStringList.
+   *
+   * Service lookups with a filter that requires an equality match of an indexed property,
+   * for example <code>(type=dicom.source)</code> or <code>(&(type=dicom.source)(name=*))</code>,
+   * only evaluate the filter for the services having the requested property value,
+   * instead of all services.
+   */
+  static const QString FRAMEWORK_SERVICE_INDEXED_PROPERTIES; // = "org.commontk.pluginfw.service.indexedproperties"
+
   /**
    * Manifest header identifying the plugin's symbolic name.
    *
@@ -21,16 +21,20 @@
 
 #include "ctkPluginFrameworkLauncher.h"
 #include "ctkPluginFrameworkFactory.h"
+#include "ctkPluginFrameworkContext_p.h"
 #include "ctkPluginFrameworkProperties_p.h"
 #include "ctkPluginFramework.h"
 #include "ctkPluginContext.h"
 #include "ctkPluginException.h"
 #include "ctkPlugin_p.h"
+#include "ctkPlugins_p.h"
+#include "ctkRequirePlugin_p.h"
 #include "ctkDefaultApplicationLauncher_p.h"
 #include "ctkLocationManager_p.h"
 #include "ctkBasicLocation_p.h"
 
 #include <ctkConfig.h>
+#include <ctkDependencyGraph.h>
 
 #include <QStringList>
 #include <QDirIterator>
@@ -39,6 +43,11 @@
 #include <QRunnable>
 #include <QSettings>
 #include <QProcessEnvironment>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QThread>
+#include <QThreadPool>
+#include <QVector>
 
 #ifdef _WIN32
 #include <windows.h>
@@ -52,6 +61,7 @@ const QString ctkPluginFrameworkLauncher::PROP_USER_DIR = "user.dir";
 // Framework properties
 const QString ctkPluginFrameworkLauncher::PROP_PLUGINS = "ctk.plugins";
 const QString ctkPluginFrameworkLauncher::PROP_PLUGINS_START_OPTIONS = "ctk.plugins.startOptions";
+const QString ctkPluginFrameworkLauncher::PROP_PLUGINS_PARALLEL_START = "ctk.plugins.parallelStart";
 const QString ctkPluginFrameworkLauncher::PROP_DEBUG = "ctk.debug";
 const QString ctkPluginFrameworkLauncher::PROP_DEV = "ctk.dev";
 const QString ctkPluginFrameworkLauncher::PROP_CONSOLE = "ctk.console";
@@ -84,6 +94,31 @@ const QString ctkPluginFrameworkLauncher::PROP_OSGI_RELAUNCH = "ctk.pluginfw.rel
 
 static const QString PROP_FORCED_RESTART = "ctk.forcedRestart";
 
+//----------------------------------------------------------------------------
+class ctkPluginLibraryLoader : public QRunnable
+{
+public:
+
+  ctkPluginLibraryLoader(ctkPluginPrivate* plugin, qint64* elapsed)
+    : plugin(plugin), elapsed(elapsed)
+  {}
+
+  void run()
+  {
+    QElapsedTimer timer;
+    timer.start();
+    // Errors are not handled here, they are reported by ctkPlugin::start(),
+    // which tries to load the library again.
+    plugin->pluginLoader.load();
+    *elapsed = timer.elapsed();
+  }
+
+private:
+
+  ctkPluginPrivate* const plugin;
+  qint64* const elapsed;
+};
+
 class ctkPluginFrameworkLauncherPrivate
 {
 public:
@@ -354,12 +389,151 @@ public:
       this->resolvePlugin(plugin);
     }
 
+    int threadCount = parallelStartThreadCount();
+    if (threadCount > 0)
+    {
+      startPluginsParallel(startEntries, startOptions, threadCount);
+      return;
+    }
+
     foreach(QSharedPointer<ctkPlugin> plugin, startEntries)
     {
       plugin->start(startOptions);
     }
   }
 
+  //----------------------------------------------------------------------------
+  int parallelStartThreadCount() const
+  {
+    QVariant parallelStartProp = ctkPluginFrameworkProperties::getProperty(ctkPluginFrameworkLauncher::PROP_PLUGINS_PARALLEL_START);
+    if (!parallelStartProp.isValid() || parallelStartProp.type() == QVariant::Bool)
+    {
+      return parallelStartProp.toBool() ? QThread::idealThreadCount() : 0;
+    }
+    bool okay = false;
+    int threadCount = parallelStartProp.toInt(&okay);
+    if (okay)
+    {
+      return qMax(threadCount, 0);
+    }
+    return parallelStartProp.toBool() ? QThread::idealThreadCount() : 0;
+  }
+
+  /*
+   * Start the plugins in the order given by their Require-Plugin dependencies. The libraries
+   * of all plugins which are going to be activated are loaded on a thread pool first.
+   * Activators are called sequentially on the calling thread, after the activators of
+   * all required plugins.
+   */
+  //----------------------------------------------------------------------------
+  void startPluginsParallel(const QList<QSharedPointer<ctkPlugin> >& startEntries,
+                            const ctkPlugin::StartOptions& startOptions, int threadCount)
+  {
+    // Plugins are numbered from 1, as required by ctkDependencyGraph
+    QList<ctkPlugin*> plugins;
+    QHash<ctkPlugin*, int> pluginIds;
+    QList<QPair<int, int> > dependencies;
+    QList<bool> activated;
+
+    foreach(QSharedPointer<ctkPlugin> plugin, startEntries)
+    {
+      if (!pluginIds.contains(plugin.data()))
+      {
+        plugins.push_back(plugin.data());
+        pluginIds.insert(plugin.data(), plugins.size());
+        activated.push_back(false);
+      }
+    }
+    const int basicPluginCount = plugins.size();
+
+    // Collect the plugins which are activated now, together with the plugins they require
+    QList<ctkPlugin*> pending;
+    foreach(QSharedPointer<ctkPlugin> plugin, startEntries)
+    {
+      ctkPluginPrivate* pd = plugin->d_func();
+      if (pd->state != ctkPlugin::INSTALLED && pd->state != ctkPlugin::UNINSTALLED &&
+          ((startOptions & ctkPlugin::START_ACTIVATION_POLICY) == 0 || pd->eagerActivation))
+      {
+        pending.push_back(plugin.data());
+      }
+    }
+    while (!pending.isEmpty())
+    {
+      ctkPlugin* plugin = pending.takeFirst();
+      int id = pluginIds.value(plugin);
+      if (activated[id - 1]) continue;
+      activated[id - 1] = true;
+
+      ctkPluginPrivate* pd = plugin->d_func();
+      foreach(ctkRequirePlugin* pr, pd->require)
+      {
+        QList<ctkPlugin*> pl = pd->fwCtx->plugins->getPlugins(pr->name, pr->pluginRange);
+        if (pl.isEmpty()) continue;
+
+        // Same choice as in ctkPluginPrivate::startDependencies()
+        ctkPlugin* required = pl.front();
+        if (!pluginIds.contains(required))
+        {
+          plugins.push_back(required);
+          pluginIds.insert(required, plugins.size());
+          activated.push_back(false);
+        }
+        dependencies.push_back(qMakePair(pluginIds.value(required), id));
+        pending.push_back(required);
+      }
+    }
+
+    ctkDependencyGraph graph(plugins.size());
+    for (int i = 0; i < dependencies.size(); ++i)
+    {
+      graph.insertEdge(dependencies[i].first, dependencies[i].second);
+    }
+    std::list<int> sorted;
+    if (!graph.topologicalSort(sorted))
+    {
+      qWarning() << "Cyclic Require-Plugin dependencies, starting plug-ins sequentially";
+      foreach(QSharedPointer<ctkPlugin> plugin, startEntries)
+      {
+        plugin->start(startOptions);
+      }
+      return;
+    }
+
+    QVector<qint64> loadTimes(plugins.size(), 0);
+    QThreadPool threadPool;
+    threadPool.setMaxThreadCount(threadCount);
+    for (int i = 0; i < plugins.size(); ++i)
+    {
+      if (activated[i])
+      {
+        threadPool.start(new ctkPluginLibraryLoader(plugins[i]->d_func(), &loadTimes[i]));
+      }
+    }
+    threadPool.waitForDone();
+
+    const bool debug = !plugins.isEmpty() && plugins.front()->d_func()->fwCtx->debug.startlevel;
+    QElapsedTimer timer;
+    for (std::list<int>::const_iterator it = sorted.begin(); it != sorted.end(); ++it)
+    {
+      ctkPlugin* plugin = plugins[*it - 1];
+      timer.start();
+      if (*it <= basicPluginCount)
+      {
+        plugin->start(startOptions);
+      }
+      else
+      {
+        // A required plugin which is not in the list of basic plugins
+        plugin->start(ctkPlugin::START_TRANSIENT);
+      }
+      if (debug)
+      {
+        qDebug() << "Started plug-in" << plugin->getSymbolicName() << "- library loaded in"
+                 << loadTimes[*it - 1] << "ms, activated in" << timer.elapsed() << "ms";
+      }
+    }
+  }
+
 
   QStringList pluginSearchPaths;
   QStringList pluginLibFilter;
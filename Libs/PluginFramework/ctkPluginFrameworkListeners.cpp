@@ -42,9 +42,29 @@ ctkPluginFrameworkListeners::ctkPluginFrameworkListeners(ctkPluginFrameworkConte
       << ctkPluginConstants::SERVICE_ID.toLower()
       << ctkPluginConstants::SERVICE_PID.toLower();
 
+  ServiceSlots* t = new ServiceSlots;
   for (int i = 0; i < hashedServiceKeys.size(); ++i)
   {
-    cache.push_back(QHash<QString, QList<ctkServiceSlotEntry> >());
+    t->cache.push_back(QHash<QString, QList<ctkServiceSlotEntry> >());
+  }
+  currentServiceSlots = QSharedPointer<const ServiceSlots>(t);
+}
+
+//----------------------------------------------------------------------------
+QSharedPointer<const ctkPluginFrameworkListeners::ServiceSlots> ctkPluginFrameworkListeners::serviceSlots()
+{
+  QMutexLocker lock(&serviceSlotsMutex);
+  return currentServiceSlots;
+}
+
+//----------------------------------------------------------------------------
+void ctkPluginFrameworkListeners::publishServiceSlots(const QSharedPointer<ServiceSlots>& t)
+{
+  QSharedPointer<const ServiceSlots> oldServiceSlots;
+  {
+    QMutexLocker lock(&serviceSlotsMutex);
+    oldServiceSlots = currentServiceSlots;
+    currentServiceSlots = t;
   }
 }
 
@@ -55,12 +75,14 @@ void ctkPluginFrameworkListeners::addServiceSlot(
 {
   QMutexLocker lock(&mutex); Q_UNUSED(lock)
   ctkServiceSlotEntry sse(plugin, receiver, slot, filter);
-  if (serviceSet.contains(sse))
+  QSharedPointer<ServiceSlots> t(new ServiceSlots(*serviceSlots()));
+  if (t->serviceSet.contains(sse))
   {
-    removeServiceSlot_unlocked(plugin, receiver, slot);
+    removeServiceSlot_unlocked(*t, plugin, receiver, slot);
   }
-  serviceSet.insert(sse);
-  checkSimple(sse);
+  t->serviceSet.insert(sse);
+  checkSimple(*t, sse);
+  publishServiceSlots(t);
 
   connect(receiver, SIGNAL(destroyed(QObject*)), this, SLOT(serviceListenerDestroyed(QObject*)), Qt::DirectConnection);
 }
@@ -71,16 +93,19 @@ void ctkPluginFrameworkListeners::removeServiceSlot(QSharedPointer<ctkPlugin> pl
                                                     const char* slot)
 {
   QMutexLocker lock(&mutex);
-  removeServiceSlot_unlocked(plugin, receiver, slot);
+  QSharedPointer<ServiceSlots> t(new ServiceSlots(*serviceSlots()));
+  removeServiceSlot_unlocked(*t, plugin, receiver, slot);
+  publishServiceSlots(t);
 }
 
 //----------------------------------------------------------------------------
-void ctkPluginFrameworkListeners::removeServiceSlot_unlocked(QSharedPointer<ctkPlugin> plugin,
+void ctkPluginFrameworkListeners::removeServiceSlot_unlocked(ServiceSlots& t,
+                                                             QSharedPointer<ctkPlugin> plugin,
                                                              QObject* receiver,
                                                              const char* slot)
 {
   ctkServiceSlotEntry entryToRemove(plugin, receiver, slot);
-  QMutableSetIterator<ctkServiceSlotEntry> it(serviceSet);
+  QMutableSetIterator<ctkServiceSlotEntry> it(t.serviceSet);
   while (it.hasNext())
   {
     ctkServiceSlotEntry currentEntry = it.next();
@@ -88,7 +113,7 @@ void ctkPluginFrameworkListeners::removeServiceSlot_unlocked(QSharedPointer<ctkP
     {
       currentEntry.setRemoved(true);
       //listeners.framework.hooks.handleServiceListenerUnreg(sle);
-      removeFromCache(currentEntry);
+      removeFromCache(t, currentEntry);
       it.remove();
       if (slot) break;
     }
@@ -110,14 +135,14 @@ void ctkPluginFrameworkListeners::serviceListenerDestroyed(QObject *listener)
 QSet<ctkServiceSlotEntry> ctkPluginFrameworkListeners::getMatchingServiceSlots(
     const ctkServiceReference& sr, bool lockProps)
 {
-  QMutexLocker lock(&mutex); Q_UNUSED(lock);
+  QSharedPointer<const ServiceSlots> t = serviceSlots();
 
   QSet<ctkServiceSlotEntry> set;
-  set.reserve(serviceSet.size());
+  set.reserve(t->serviceSet.size());
   // Check complicated or empty listener filters
   int n = 0;
   ctkLDAPExpr expr;
-  foreach (const ctkServiceSlotEntry& sse, complicatedListeners)
+  foreach (const ctkServiceSlotEntry& sse, t->complicatedListeners)
   {
     ++n;
     expr = sse.getLDAPExpr();
@@ -137,20 +162,20 @@ QSet<ctkServiceSlotEntry> ctkPluginFrameworkListeners::getMatchingServiceSlots(
   QStringList c = sr.d_func()->getProperty(ctkPluginConstants::OBJECTCLASS, lockProps).toStringList();
   foreach (QString objClass, c)
   {
-    addToSet(set, OBJECTCLASS_IX, objClass);
+    addToSet(*t, set, OBJECTCLASS_IX, objClass);
   }
 
   bool ok = false;
   qlonglong service_id = sr.d_func()->getProperty(ctkPluginConstants::SERVICE_ID, lockProps).toLongLong(&ok);
   if (ok)
   {
-    addToSet(set, SERVICE_ID_IX, QString::number(service_id));
+    addToSet(*t, set, SERVICE_ID_IX, QString::number(service_id));
   }
 
   QStringList service_pids = sr.d_func()->getProperty(ctkPluginConstants::SERVICE_PID, lockProps).toStringList();
   foreach (QString service_pid, service_pids)
   {
-    addToSet(set, SERVICE_PID_IX, service_pid);
+    addToSet(*t, set, SERVICE_PID_IX, service_pid);
   }
 
   return set;
@@ -202,8 +227,10 @@ void ctkPluginFrameworkListeners::serviceChanged(
 
   //framework.hooks.filterServiceEventReceivers(evt, receivers);
 
-  foreach (ctkServiceSlotEntry l, receivers)
+  for (QSet<ctkServiceSlotEntry>::const_iterator it = receivers.constBegin(),
+       end = receivers.constEnd(); it != end; ++it)
   {
+    const ctkServiceSlotEntry& l = *it;
     if (!matchBefore.isEmpty())
     {
       matchBefore.remove(l);
@@ -239,13 +266,13 @@ void ctkPluginFrameworkListeners::serviceChanged(
 }
 
 //----------------------------------------------------------------------------
-void ctkPluginFrameworkListeners::removeFromCache(const ctkServiceSlotEntry& sse)
+void ctkPluginFrameworkListeners::removeFromCache(ServiceSlots& t, const ctkServiceSlotEntry& sse)
 {
   if (!sse.getLocalCache().isEmpty())
   {
     for (int i = 0; i < hashedServiceKeys.size(); ++i)
     {
-      QHash<QString, QList<ctkServiceSlotEntry> >& keymap = cache[i];
+      QHash<QString, QList<ctkServiceSlotEntry> >& keymap = t.cache[i];
       QStringList& l = sse.getLocalCache()[i];
       QStringListIterator it(l);
       while (it.hasNext())
@@ -262,16 +289,16 @@ void ctkPluginFrameworkListeners::removeFromCache(const ctkServiceSlotEntry& sse
   }
   else
   {
-    complicatedListeners.removeAll(sse);
+    t.complicatedListeners.removeAll(sse);
   }
 }
 
 //----------------------------------------------------------------------------
-void ctkPluginFrameworkListeners::checkSimple(const ctkServiceSlotEntry& sse)
+void ctkPluginFrameworkListeners::checkSimple(ServiceSlots& t, const ctkServiceSlotEntry& sse)
 {
   if (sse.getLDAPExpr().isNull()) // || listeners.nocacheldap) {
   {
-    complicatedListeners.push_back(sse);
+    t.complicatedListeners.push_back(sse);
   }
   else
   {
@@ -285,7 +312,7 @@ void ctkPluginFrameworkListeners::checkSimple(const ctkServiceSlotEntry& sse)
         while (it.hasNext())
         {
           QString value = it.next();
-          QList<ctkServiceSlotEntry>& sses = cache[i][value];
+          QList<ctkServiceSlotEntry>& sses = t.cache[i][value];
           sses.push_back(sse);
         }
       }
@@ -296,16 +323,17 @@ void ctkPluginFrameworkListeners::checkSimple(const ctkServiceSlotEntry& sse)
       {
         qDebug() << "## DEBUG: Too complicated filter:" << sse.getFilter();
       }
-      complicatedListeners.push_back(sse);
+      t.complicatedListeners.push_back(sse);
     }
   }
 }
 
 //----------------------------------------------------------------------------
-void ctkPluginFrameworkListeners::addToSet(QSet<ctkServiceSlotEntry>& set,
+void ctkPluginFrameworkListeners::addToSet(const ServiceSlots& t, QSet<ctkServiceSlotEntry>& set,
                                            int cache_ix, const QString& val)
 {
-  QList<ctkServiceSlotEntry>& l = cache[cache_ix][val];
+  // Use value(), the published tables must not be modified
+  QList<ctkServiceSlotEntry> l = t.cache[cache_ix].value(val);
   if (!l.isEmpty())
   {
     if (pluginFw->debug.ldap)
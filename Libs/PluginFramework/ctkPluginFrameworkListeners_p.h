@@ -26,6 +26,7 @@
 #include <QHash>
 #include <QSet>
 #include <QMutex>
+#include <QSharedPointer>
 
 #include "ctkPluginEvent.h"
 #include "ctkPluginFrameworkEvent.h"
@@ -111,44 +112,64 @@ private Q_SLOTS:
 
 private:
 
+  /**
+   * Tables of the service slots. Published tables are never modified:
+   * getMatchingServiceSlots() works on the tables which are current when
+   * it is called, without locking. Adding and removing slots modifies a
+   * copy of the current tables and publishes it.
+   */
+  struct ServiceSlots
+  {
+    // Service listeners with complicated or empty filters
+    QList<ctkServiceSlotEntry> complicatedListeners;
+
+    // Service listeners with "simple" filters are cached
+    QList<QHash<QString, QList<ctkServiceSlotEntry> > > cache;
+
+    QSet<ctkServiceSlotEntry> serviceSet;
+  };
+
+  // Serializes modifications of the service slots
   QMutex mutex;
 
+  // Only guards currentServiceSlots
+  QMutex serviceSlotsMutex;
+  QSharedPointer<const ServiceSlots> currentServiceSlots;
+
   QList<QString> hashedServiceKeys;
   static const int OBJECTCLASS_IX; // = 0;
   static const int SERVICE_ID_IX; // = 1;
   static const int SERVICE_PID_IX; // = 2;
 
-  // Service listeners with complicated or empty filters
-  QList<ctkServiceSlotEntry> complicatedListeners;
-
-  // Service listeners with "simple" filters are cached
-  QList<QHash<QString, QList<ctkServiceSlotEntry> > > cache;
+  ctkPluginFrameworkContext* pluginFw;
 
-  QSet<ctkServiceSlotEntry> serviceSet;
+  QSharedPointer<const ServiceSlots> serviceSlots();
 
-  ctkPluginFrameworkContext* pluginFw;
+  void publishServiceSlots(const QSharedPointer<ServiceSlots>& t);
 
   /**
    * Remove all references to a service slot from the service listener
    * cache.
    */
-  void removeFromCache(const ctkServiceSlotEntry& sse);
+  void removeFromCache(ServiceSlots& t, const ctkServiceSlotEntry& sse);
 
   /**
    * Checks if the specified service slot's filter is simple enough
    * to cache.
    */
-  void checkSimple(const ctkServiceSlotEntry& sse);
+  void checkSimple(ServiceSlots& t, const ctkServiceSlotEntry& sse);
 
   /**
    * Add all members of the specified list to the specified set.
    */
-  void addToSet(QSet<ctkServiceSlotEntry>& set, int cache_ix, const QString& val);
+  void addToSet(const ServiceSlots& t, QSet<ctkServiceSlotEntry>& set,
+                int cache_ix, const QString& val);
 
   /**
    * The unsynchronized version of removeServiceSlot().
    */
-  void removeServiceSlot_unlocked(QSharedPointer<ctkPlugin> plugin, QObject* receiver,
+  void removeServiceSlot_unlocked(ServiceSlots& t,
+                                  QSharedPointer<ctkPlugin> plugin, QObject* receiver,
                                   const char* slot);
 };
 
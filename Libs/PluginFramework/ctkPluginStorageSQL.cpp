@@ -31,6 +31,7 @@
 #include "ctkServiceException.h"
 
 #include <QFileInfo>
+#include <QResource>
 #include <QUrl>
 #include <QThread>
 
@@ -427,18 +428,61 @@ void ctkPluginStorageSQL::insertArchive(QSharedPointer<ctkPluginArchiveSQL> pa,
   resourcePrefix.replace("_", ".");
   resourcePrefix = QString(":/") + resourcePrefix + "/";
 
-  // Load the plugin and cache the resources
+  // Read the resources from the binary resource file which is generated next
+  // to the plugin library at build time. This avoids loading the library and
+  // running its static initializers. The library is only loaded if the resource
+  // file is missing or older than the library.
 
   QPluginLoader pluginLoader;
-  pluginLoader.setLoadHints(getPluginLoadHints());
-  pluginLoader.setFileName(pa->getLibLocation());
-  if (!pluginLoader.load())
+  QString resourceFilePath = pa->getLibLocation() + ".rcc";
+  QString resourceMapRoot;
+  QFileInfo resourceFileInfo(resourceFilePath);
+  if (resourceFileInfo.exists() && resourceFileInfo.lastModified() >= fileInfo.lastModified())
   {
-    ctkPluginException exc(QString("The plugin \"%1\" could not be loaded: %2").arg(pa->getLibLocation())
-                           .arg(pluginLoader.errorString()));
-    throw exc;
+    // Map the resources to a unique root, they must not be confused with the
+    // resources of a loaded plugin library
+    resourceMapRoot = QString("/ctkPluginStorageSQL/%1/%2").arg(pa->getPluginId()).arg(pa->getPluginGeneration());
+    if (QResource::registerResource(resourceFilePath, resourceMapRoot))
+    {
+      resourcePrefix = QString(":") + resourceMapRoot + resourcePrefix.mid(1);
+    }
+    else
+    {
+      qWarning() << "Reading the resource file" << resourceFilePath << "failed, loading the plugin instead";
+      resourceMapRoot.clear();
+    }
+  }
+
+  if (resourceMapRoot.isEmpty())
+  {
+    // Load the plugin and cache the resources
+    pluginLoader.setLoadHints(getPluginLoadHints());
+    pluginLoader.setFileName(pa->getLibLocation());
+    if (!pluginLoader.load())
+    {
+      ctkPluginException exc(QString("The plugin \"%1\" could not be loaded: %2").arg(pa->getLibLocation())
+                             .arg(pluginLoader.errorString()));
+      throw exc;
+    }
+  }
+
+  try
+  {
+    insertArchiveRecords(pa, query, resourcePrefix, libTimestamp);
+  }
+  catch (...)
+  {
+    releaseArchiveResources(pluginLoader, resourceFilePath, resourceMapRoot);
+    throw;
   }
 
+  releaseArchiveResources(pluginLoader, resourceFilePath, resourceMapRoot);
+}
+
+//----------------------------------------------------------------------------
+void ctkPluginStorageSQL::insertArchiveRecords(QSharedPointer<ctkPluginArchiveSQL> pa, QSqlQuery* query,
+                                               const QString& resourcePrefix, const QString& libTimestamp)
+{
   QFile manifestResource(resourcePrefix + "META-INF/MANIFEST.MF");
   manifestResource.open(QIODevice::ReadOnly);
   QByteArray manifest = manifestResource.readAll();
@@ -491,8 +535,20 @@ void ctkPluginStorageSQL::insertArchive(QSharedPointer<ctkPluginArchiveSQL> pa,
 
     executeQuery(query, statement, bindValues);
   }
+}
 
-  pluginLoader.unload();
+//----------------------------------------------------------------------------
+void ctkPluginStorageSQL::releaseArchiveResources(QPluginLoader& pluginLoader, const QString& resourceFilePath,
+                                                  const QString& resourceMapRoot)
+{
+  if (resourceMapRoot.isEmpty())
+  {
+    pluginLoader.unload();
+  }
+  else
+  {
+    QResource::unregisterResource(resourceFilePath, resourceMapRoot);
+  }
 }
 
 //----------------------------------------------------------------------------
@@ -300,6 +300,20 @@ private:
 
   void insertArchive(QSharedPointer<ctkPluginArchiveSQL> pa, QSqlQuery* query);
 
+  /**
+   * Reads the manifest from the resources below <code>resourcePrefix</code> and
+   * writes the plugin record and its resources into the database.
+   */
+  void insertArchiveRecords(QSharedPointer<ctkPluginArchiveSQL> pa, QSqlQuery* query,
+                            const QString& resourcePrefix, const QString& libTimestamp);
+
+  /**
+   * Unloads the plugin library or unregisters the resource file which were
+   * used by insertArchiveRecords().
+   */
+  void releaseArchiveResources(QPluginLoader& pluginLoader, const QString& resourceFilePath,
+                               const QString& resourceMapRoot);
+
   void removeArchiveFromDB(ctkPluginArchiveSQL *pa, QSqlQuery *query);
 
   /**
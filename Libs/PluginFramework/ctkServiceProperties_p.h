@@ -33,6 +33,8 @@ class ctkServiceProperties
 private:
 
   QVarLengthArray<QString,10> ks;
+  // Lower case keys, for case insensitive lookups
+  QVarLengthArray<QString,10> lks;
   QVarLengthArray<QVariant,10> vs;
 
   QMap<QString, QVariant> map;
@@ -46,6 +48,8 @@ public:
 
   int find(const QString& key) const;
   int findCaseSensitive(const QString& key) const;
+  // Faster than find(), if the key is already in lower case
+  int findLowerCase(const QString& lowerCaseKey) const;
 
   QStringList keys() const;
 
@@ -78,9 +78,11 @@ ctkServiceSlotEntry::ctkServiceSlotEntry(
     QSharedPointer<ctkPlugin> p, QObject* receiver, const char* slot, const QString& filter)
   : d(new ctkServiceSlotEntryData(p, receiver, slot))
 {
+  // Computed here, entries are hashed concurrently by the framework listeners
+  d->hashValue = qHash(d->plugin) * 4 + qHash(d->receiver) * 2 + qHash(d->slot);
   if (!filter.isNull())
   {
-    d->ldap = ctkLDAPExpr(filter);
+    d->ldap = ctkLDAPExpr::cached(filter);
   }
 }
 
@@ -120,7 +122,7 @@ bool ctkServiceSlotEntry::operator==(const ctkServiceSlotEntry& other) const
 }
 
 //----------------------------------------------------------------------------
-void ctkServiceSlotEntry::invokeSlot(const ctkServiceEvent &event)
+void ctkServiceSlotEntry::invokeSlot(const ctkServiceEvent &event) const
 {
   if (!QMetaObject::invokeMethod(d->receiver, d->slot,
                                  Qt::DirectConnection,
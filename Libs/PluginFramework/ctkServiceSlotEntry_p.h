@@ -64,7 +64,7 @@ public:
 
   bool operator==(const ctkServiceSlotEntry& other) const;
 
-  void invokeSlot(const ctkServiceEvent& event);
+  void invokeSlot(const ctkServiceEvent& event) const;
 
   void setRemoved(bool removed);
 
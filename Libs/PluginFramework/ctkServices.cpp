@@ -33,6 +33,7 @@
 #include "ctkServiceException.h"
 #include "ctkServiceRegistration_p.h"
 #include "ctkLDAPExpr_p.h"
+#include "ctkServiceProperties_p.h"
 
 //----------------------------------------------------------------------------
 struct ServiceRegistrationComparator
@@ -63,9 +64,19 @@ ctkDictionary ctkServices::createServiceProperties(const ctkDictionary& in,
 
 //----------------------------------------------------------------------------
 ctkServices::ctkServices(ctkPluginFrameworkContext* fwCtx)
-  : mutex(), framework(fwCtx)
+  : mutex(), framework(fwCtx), currentTables(new ctkServicesTables)
 {
-
+  indexedProperties << ctkPluginConstants::SERVICE_ID.toLower()
+                    << ctkPluginConstants::SERVICE_PID.toLower();
+  QStringList configured = fwCtx->props.value(ctkPluginConstants::FRAMEWORK_SERVICE_INDEXED_PROPERTIES).toStringList();
+  foreach (QString key, configured)
+  {
+    key = key.trimmed().toLower();
+    if (!key.isEmpty() && !indexedProperties.contains(key))
+    {
+      indexedProperties << key;
+    }
+  }
 }
 
 //----------------------------------------------------------------------------
@@ -77,11 +88,37 @@ ctkServices::~ctkServices()
 //----------------------------------------------------------------------------
 void ctkServices::clear()
 {
-  services.clear();
-  classServices.clear();
+  QMutexLocker lock(&mutex);
+  publishTables(QSharedPointer<ctkServicesTables>(new ctkServicesTables));
   framework = 0;
 }
 
+//----------------------------------------------------------------------------
+QSharedPointer<const ctkServicesTables> ctkServices::tables() const
+{
+  QMutexLocker lock(&tablesMutex);
+  return currentTables;
+}
+
+//----------------------------------------------------------------------------
+QSharedPointer<ctkServicesTables> ctkServices::copyTables() const
+{
+  return QSharedPointer<ctkServicesTables>(new ctkServicesTables(*tables()));
+}
+
+//----------------------------------------------------------------------------
+void ctkServices::publishTables(const QSharedPointer<ctkServicesTables>& t)
+{
+  QSharedPointer<const ctkServicesTables> oldTables;
+  {
+    QMutexLocker lock(&tablesMutex);
+    oldTables = currentTables;
+    currentTables = t;
+  }
+  // The old tables are released here, outside of the lock,
+  // unless they are still used by a lookup.
+}
+
 //----------------------------------------------------------------------------
 ctkServiceRegistration ctkServices::registerService(ctkPluginPrivate* plugin,
                              const QStringList& classes,
@@ -115,20 +152,24 @@ ctkServiceRegistration ctkServices::registerService(ctkPluginPrivate* plugin,
 
   ctkServiceRegistration res(plugin, service,
                              createServiceProperties(properties, classes));
+  ctkServiceReference r = res.getReference();
   {
     QMutexLocker lock(&mutex);
-    services.insert(res, classes);
+    QSharedPointer<ctkServicesTables> t = copyTables();
+    t->services.insert(res, classes);
+    t->references.insert(res, r);
     for (QStringListIterator i(classes); i.hasNext(); )
     {
       QString currClass = i.next();
-      QList<ctkServiceRegistration>& s = classServices[currClass];
+      QList<ctkServiceRegistration>& s = t->classServices[currClass];
       QList<ctkServiceRegistration>::iterator ip =
           std::lower_bound(s.begin(), s.end(), res, ServiceRegistrationComparator());
       s.insert(ip, res);
     }
+    addToPropertyIndexes(*t, res, res.d_func()->properties);
+    publishTables(t);
   }
 
-  ctkServiceReference r = res.getReference();
   plugin->fwCtx->listeners.serviceChanged(
       plugin->fwCtx->listeners.getMatchingServiceSlots(r),
       ctkServiceEvent(ctkServiceEvent::REGISTERED, r));
@@ -140,12 +181,101 @@ void ctkServices::updateServiceRegistrationOrder(const ctkServiceRegistration& s
                                               const QStringList& classes)
 {
   QMutexLocker lock(&mutex);
+  QSharedPointer<ctkServicesTables> t = copyTables();
   for (QStringListIterator i(classes); i.hasNext(); )
   {
-    QList<ctkServiceRegistration>& s = classServices[i.next()];
+    QList<ctkServiceRegistration>& s = t->classServices[i.next()];
     s.removeAll(sr);
     s.insert(std::lower_bound(s.begin(), s.end(), sr, ServiceRegistrationComparator()), sr);
   }
+  publishTables(t);
+}
+
+//----------------------------------------------------------------------------
+void ctkServices::updateServiceRegistrationProperties(const ctkServiceRegistration& sr,
+                                                      const ctkServiceProperties& oldProperties)
+{
+  QMutexLocker lock(&mutex);
+  QSharedPointer<ctkServicesTables> t = copyTables();
+  removeFromPropertyIndexes(*t, sr, oldProperties);
+  addToPropertyIndexes(*t, sr, sr.d_func()->properties);
+  publishTables(t);
+}
+
+//----------------------------------------------------------------------------
+void ctkServices::addToPropertyIndexes(ctkServicesTables& t,
+                                       const ctkServiceRegistration& sr,
+                                       const ctkServiceProperties& props)
+{
+  foreach (const QString& key, indexedProperties)
+  {
+    QVariant value = props.value(props.findLowerCase(key));
+    if (value.isNull())
+    {
+      continue;
+    }
+    // Filters compare the string representation of the value, see ctkLDAPExpr::compare()
+    if (!value.canConvert<QString>())
+    {
+      ++t.unindexedPropertyCount[key];
+      continue;
+    }
+    QList<ctkServiceRegistration>& s = t.propertyServices[key][value.toString()];
+    s.insert(std::lower_bound(s.begin(), s.end(), sr, ServiceRegistrationComparator()), sr);
+  }
+}
+
+//----------------------------------------------------------------------------
+void ctkServices::removeFromPropertyIndexes(ctkServicesTables& t,
+                                            const ctkServiceRegistration& sr,
+                                            const ctkServiceProperties& props)
+{
+  foreach (const QString& key, indexedProperties)
+  {
+    QVariant value = props.value(props.findLowerCase(key));
+    if (value.isNull())
+    {
+      continue;
+    }
+    if (!value.canConvert<QString>())
+    {
+      if (--t.unindexedPropertyCount[key] <= 0)
+      {
+        t.unindexedPropertyCount.remove(key);
+      }
+      continue;
+    }
+    ctkServicesBucketHash<QString, QList<ctkServiceRegistration> >& values = t.propertyServices[key];
+    QString stringValue = value.toString();
+    if (values.contains(stringValue))
+    {
+      QList<ctkServiceRegistration>& s = values[stringValue];
+      s.removeAll(sr);
+      if (s.isEmpty())
+      {
+        values.remove(stringValue);
+      }
+    }
+  }
+}
+
+//----------------------------------------------------------------------------
+bool ctkServices::getIndexedCandidates(const ctkServicesTables& t, const ctkLDAPExpr& ldap,
+                                       QList<ctkServiceRegistration>& candidates) const
+{
+  QStringList keys = indexedProperties;
+  foreach (const QString& key, t.unindexedPropertyCount.keys())
+  {
+    keys.removeAll(key);
+  }
+  QString key;
+  QString value;
+  if (!ldap.getEquality(keys, key, value))
+  {
+    return false;
+  }
+  candidates = t.propertyServices.value(key).value(value);
+  return true;
 }
 
 //----------------------------------------------------------------------------
@@ -157,16 +287,15 @@ bool ctkServices::checkServiceClass(QObject* service, const QString& cls) const
 //----------------------------------------------------------------------------
 QList<ctkServiceRegistration> ctkServices::get(const QString& clazz) const
 {
-  QMutexLocker lock(&mutex);
-  return classServices.value(clazz);
+  return tables()->classServices.value(clazz);
 }
 
 //----------------------------------------------------------------------------
 ctkServiceReference ctkServices::get(ctkPluginPrivate* plugin, const QString& clazz) const
 {
-  QMutexLocker lock(&mutex);
+  QSharedPointer<const ctkServicesTables> t = tables();
   try {
-    QList<ctkServiceReference> srs = get_unlocked(clazz, QString(), plugin);
+    QList<ctkServiceReference> srs = get_unlocked(*t, clazz, QString(), plugin);
     if (framework->debug.service_reference)
     {
       qDebug() << "get service ref" << clazz << "for plugin"
@@ -186,12 +315,13 @@ ctkServiceReference ctkServices::get(ctkPluginPrivate* plugin, const QString& cl
 QList<ctkServiceReference> ctkServices::get(const QString& clazz, const QString& filter,
                                             ctkPluginPrivate* plugin) const
 {
-  QMutexLocker lock(&mutex);
-  return get_unlocked(clazz, filter, plugin);
+  QSharedPointer<const ctkServicesTables> t = tables();
+  return get_unlocked(*t, clazz, filter, plugin);
 }
 
 //----------------------------------------------------------------------------
-QList<ctkServiceReference> ctkServices::get_unlocked(const QString& clazz, const QString& filter,
+QList<ctkServiceReference> ctkServices::get_unlocked(const ctkServicesTables& t,
+                                                     const QString& clazz, const QString& filter,
                                                      ctkPluginPrivate* plugin) const
 {
   Q_UNUSED(plugin)
@@ -203,15 +333,24 @@ QList<ctkServiceReference> ctkServices::get_unlocked(const QString& clazz, const
   {
     if (!filter.isEmpty())
     {
-      ldap = ctkLDAPExpr(filter);
+      ldap = ctkLDAPExpr::cached(filter);
       QSet<QString> matched;
-      if (ldap.getMatchedObjectClasses(matched))
+      bool classesMatched = ldap.getMatchedObjectClasses(matched);
+      // Services of several classes are listed class by class, which is not the index order
+      if ((!classesMatched || matched.size() == 1) && getIndexedCandidates(t, ldap, v))
+      {
+        if (v.isEmpty())
+        {
+          return QList<ctkServiceReference>();
+        }
+        s = new QListIterator<ctkServiceRegistration>(v);
+      }
+      else if (classesMatched)
       {
         v.clear();
         foreach (QString className, matched)
         {
-          const QList<ctkServiceRegistration>& cl = classServices[className];
-          v += cl;
+          v += t.classServices.value(className);
         }
         if (!v.isEmpty())
         {
@@ -224,40 +363,53 @@ QList<ctkServiceReference> ctkServices::get_unlocked(const QString& clazz, const
       }
       else
       {
-        s = new QListIterator<ctkServiceRegistration>(services.keys());
+        s = new QListIterator<ctkServiceRegistration>(t.services.keys());
       }
     }
     else
     {
-      s = new QListIterator<ctkServiceRegistration>(services.keys());
+      s = new QListIterator<ctkServiceRegistration>(t.services.keys());
     }
   }
   else
   {
-    QList<ctkServiceRegistration> v = classServices.value(clazz);
-    if (!v.isEmpty())
-    {
-      s = new QListIterator<ctkServiceRegistration>(v);
-    }
-    else
+    v = t.classServices.value(clazz);
+    if (v.isEmpty())
     {
       return QList<ctkServiceReference>();
     }
     if (!filter.isEmpty())
     {
-      ldap = ctkLDAPExpr(filter);
+      ldap = ctkLDAPExpr::cached(filter);
+      QList<ctkServiceRegistration> candidates;
+      if (getIndexedCandidates(t, ldap, candidates) && candidates.size() < v.size())
+      {
+        // Candidates are in ranking order, like the services of the class
+        v.clear();
+        foreach (const ctkServiceRegistration& sr, candidates)
+        {
+          if (t.services.value(sr).contains(clazz))
+          {
+            v.push_back(sr);
+          }
+        }
+        if (v.isEmpty())
+        {
+          return QList<ctkServiceReference>();
+        }
+      }
     }
+    s = new QListIterator<ctkServiceRegistration>(v);
   }
 
   QList<ctkServiceReference> res;
   while (s->hasNext())
   {
     ctkServiceRegistration sr = s->next();
-    ctkServiceReference sri = sr.getReference();
 
     if (filter.isEmpty() || ldap.evaluate(sr.d_func()->properties, false))
     {
-      res.push_back(sri);
+      res.push_back(t.references.value(sr));
     }
   }
 
@@ -270,33 +422,36 @@ QList<ctkServiceReference> ctkServices::get_unlocked(const QString& clazz, const
 void ctkServices::removeServiceRegistration(const ctkServiceRegistration& sr)
 {
   QMutexLocker lock(&mutex);
+  QSharedPointer<ctkServicesTables> t = copyTables();
 
   QStringList classes = sr.d_func()->properties.value(ctkPluginConstants::OBJECTCLASS).toStringList();
-  services.remove(sr);
+  t->services.remove(sr);
+  t->references.remove(sr);
+  removeFromPropertyIndexes(*t, sr, sr.d_func()->properties);
   for (QStringListIterator i(classes); i.hasNext(); )
   {
     QString currClass = i.next();
-    QList<ctkServiceRegistration>& s = classServices[currClass];
+    QList<ctkServiceRegistration>& s = t->classServices[currClass];
     if (s.size() > 1)
     {
       s.removeAll(sr);
     }
     else
     {
-      classServices.remove(currClass);
+      t->classServices.remove(currClass);
     }
   }
+  publishTables(t);
 }
 
 //----------------------------------------------------------------------------
 QList<ctkServiceRegistration> ctkServices::getRegisteredByPlugin(ctkPluginPrivate* p) const
 {
-  QMutexLocker lock(&mutex);
+  QSharedPointer<const ctkServicesTables> t = tables();
 
   QList<ctkServiceRegistration> res;
-  for (QHashIterator<ctkServiceRegistration, QStringList> i(services); i.hasNext(); )
+  foreach (const ctkServiceRegistration& sr, t->services.keys())
   {
-    ctkServiceRegistration sr = i.next().key();
     if (sr.d_func()->plugin == p)
     {
       res.push_back(sr);
@@ -308,12 +463,11 @@ QList<ctkServiceRegistration> ctkServices::getRegisteredByPlugin(ctkPluginPrivat
 //----------------------------------------------------------------------------
 QList<ctkServiceRegistration> ctkServices::getUsedByPlugin(QSharedPointer<ctkPlugin> p) const
 {
-  QMutexLocker lock(&mutex);
+  QSharedPointer<const ctkServicesTables> t = tables();
 
   QList<ctkServiceRegistration> res;
-  for (QHashIterator<ctkServiceRegistration, QStringList> i(services); i.hasNext(); )
+  foreach (const ctkServiceRegistration& sr, t->services.keys())
   {
-    ctkServiceRegistration sr = i.next().key();
     if (sr.d_func()->isUsedByPlugin(p))
     {
       res.push_back(sr);
@@ -321,4 +475,3 @@ QList<ctkServiceRegistration> ctkServices::getUsedByPlugin(QSharedPointer<ctkPlu
   }
   return res;
 }
-
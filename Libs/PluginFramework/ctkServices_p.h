@@ -26,21 +26,180 @@
 #include <QHash>
 #include <QObject>
 #include <QMutex>
+#include <QSharedPointer>
 #include <QStringList>
+#include <QVector>
 
 #include "ctkPlugin_p.h"
+#include "ctkServiceReference.h"
 #include "ctkServiceRegistration.h"
 
+class ctkLDAPExpr;
+class ctkServiceProperties;
+
+
+/**
+ * \ingroup PluginFramework
+ *
+ * Hash with one entry per registered service, split into implicitly shared
+ * buckets. A copy shares all buckets and a modification only detaches the
+ * bucket of the modified key, so modifying a copy of the tables does not
+ * copy the entries of all the other services. The number of buckets grows
+ * with the square root of the number of entries.
+ */
+template<class Key, class T>
+class ctkServicesBucketHash
+{
+public:
+
+  ctkServicesBucketHash()
+    : buckets(MinimumBucketCount), count(0)
+  {}
+
+  int size() const
+  {
+    return count;
+  }
+
+  bool contains(const Key& key) const
+  {
+    return buckets.at(bucketIndex(key)).contains(key);
+  }
+
+  T value(const Key& key) const
+  {
+    return buckets.at(bucketIndex(key)).value(key);
+  }
+
+  T& operator[](const Key& key)
+  {
+    if (!contains(key))
+    {
+      ++count;
+      if (count > buckets.size() * buckets.size())
+      {
+        rehash(buckets.size() * 2);
+      }
+    }
+    return buckets[bucketIndex(key)][key];
+  }
+
+  void insert(const Key& key, const T& value)
+  {
+    (*this)[key] = value;
+  }
+
+  int remove(const Key& key)
+  {
+    int index = bucketIndex(key);
+    if (!buckets.at(index).contains(key))
+    {
+      return 0;
+    }
+    buckets[index].remove(key);
+    --count;
+    return 1;
+  }
+
+  QList<Key> keys() const
+  {
+    QList<Key> res;
+    for (int i = 0; i < buckets.size(); ++i)
+    {
+      res += buckets.at(i).keys();
+    }
+    return res;
+  }
+
+private:
+
+  enum { MinimumBucketCount = 16 };
+
+  int bucketIndex(const Key& key) const
+  {
+    return static_cast<int>(qHash(key) % static_cast<uint>(buckets.size()));
+  }
+
+  void rehash(int bucketCount)
+  {
+    QVector<QHash<Key, T> > oldBuckets = buckets;
+    buckets = QVector<QHash<Key, T> >(bucketCount);
+    for (int i = 0; i < oldBuckets.size(); ++i)
+    {
+      typename QHash<Key, T>::const_iterator it = oldBuckets.at(i).constBegin();
+      for (; it != oldBuckets.at(i).constEnd(); ++it)
+      {
+        buckets[bucketIndex(it.key())].insert(it.key(), it.value());
+      }
+    }
+  }
+
+  QVector<QHash<Key, T> > buckets;
+  int count;
+};
+
+/**
+ * \ingroup PluginFramework
+ *
+ * Tables of the registered services. Published tables are never modified,
+ * see ctkServices::tables().
+ */
+struct ctkServicesTables
+{
+  /**
+   * All registered services in the current framework.
+   * Mapping of registered service to class names under which
+   * the service is registerd.
+   */
+  ctkServicesBucketHash<ctkServiceRegistration, QStringList> services;
+
+  /**
+   * References of the registered services. Unlike
+   * ctkServiceRegistration::getReference(), they can be used by
+   * lookups while the service is being unregistered.
+   */
+  ctkServicesBucketHash<ctkServiceRegistration, ctkServiceReference> references;
+
+  /**
+   * Mapping of classname to registered service.
+   * The List of registered services are ordered with the highest
+   * ranked service first.
+   */
+  QHash<QString, QList<ctkServiceRegistration> > classServices;
+
+  /**
+   * Mapping of indexed property key to property value (as a string) to
+   * registered services. The lists of registered services are ordered with
+   * the highest ranked service first.
+   */
+  QHash<QString, ctkServicesBucketHash<QString, QList<ctkServiceRegistration> > > propertyServices;
+
+  /**
+   * Number of registered services with a value of the indexed property
+   * which cannot be converted to a string. The index of a property
+   * is not used for lookups while there are such services.
+   */
+  QHash<QString, int> unindexedPropertyCount;
+};
+
 
 /**
  * \ingroup PluginFramework
  *
  * Here we handle all the services that are registered in the framework.
+ *
+ * Lookups do not lock the registry: they work on the tables which are
+ * current when the lookup starts. Modifications are serialized by
+ * <code>mutex</code>, they modify a copy of the current tables (unchanged
+ * containers are shared with the current tables) and publish it.
  */
 class ctkServices {
 
 public:
 
+  /**
+   * Serializes modifications of the registry.
+   */
   mutable QMutex mutex;
 
   /**
@@ -57,18 +216,11 @@ public:
                                  long sid = -1);
 
   /**
-   * All registered services in the current framework.
-   * Mapping of registered service to class names under which
-   * the service is registerd.
+   * Lower case keys of the properties which are indexed in
+   * ctkServicesTables::propertyServices, in order of preference for lookups.
+   * Always contains SERVICE_ID and SERVICE_PID.
    */
-  QHash<ctkServiceRegistration, QStringList> services;
-
-  /**
-   * Mapping of classname to registered service.
-   * The List of registered services are ordered with the highest
-   * ranked service first.
-   */
-  QHash<QString, QList<ctkServiceRegistration> > classServices;
+  QStringList indexedProperties;
 
 
   ctkPluginFrameworkContext* framework;
@@ -79,6 +231,12 @@ public:
 
   void clear();
 
+  /**
+   * Get the current tables of registered services. The returned tables
+   * are not modified, later modifications of the registry publish new tables.
+   */
+  QSharedPointer<const ctkServicesTables> tables() const;
+
   /**
    * Register a service in the framework wide register.
    *
@@ -111,6 +269,16 @@ public:
                                       const QStringList& classes);
 
 
+  /**
+   * Service properties changed, update the property indexes.
+   *
+   * @param sr The ctkServiceRegistration object, having the new properties.
+   * @param oldProperties The properties before the change.
+   */
+  void updateServiceRegistrationProperties(const ctkServiceRegistration& sr,
+                                           const ctkServiceProperties& oldProperties);
+
+
   /**
    * Checks that a given service object is an instance of the given
    * class name.
@@ -181,9 +349,42 @@ public:
 
 private:
 
-  QList<ctkServiceReference> get_unlocked(const QString& clazz, const QString& filter,
+  /**
+   * Only guards currentTables, it is never locked while
+   * the tables are read or modified.
+   */
+  mutable QMutex tablesMutex;
+  QSharedPointer<const ctkServicesTables> currentTables;
+
+  /**
+   * Get a copy of the current tables, to be modified and published.
+   * <code>mutex</code> must be locked.
+   */
+  QSharedPointer<ctkServicesTables> copyTables() const;
+
+  void publishTables(const QSharedPointer<ctkServicesTables>& t);
+
+  QList<ctkServiceReference> get_unlocked(const ctkServicesTables& t,
+                                          const QString& clazz, const QString& filter,
                                           ctkPluginPrivate* plugin) const;
 
+  void addToPropertyIndexes(ctkServicesTables& t,
+                            const ctkServiceRegistration& sr,
+                            const ctkServiceProperties& props);
+
+  void removeFromPropertyIndexes(ctkServicesTables& t,
+                                 const ctkServiceRegistration& sr,
+                                 const ctkServiceProperties& props);
+
+  /**
+   * Get the services that may match the filter from the property indexes.
+   *
+   * @return <code>false</code> if the filter does not require an equality
+   *         match of an indexed property.
+   */
+  bool getIndexedCandidates(const ctkServicesTables& t, const ctkLDAPExpr& ldap,
+                            QList<ctkServiceRegistration>& candidates) const;
+
 };
 
 